@@ -20,11 +20,17 @@
 #endif
 
 #include <netdb.h>
+#include <errno.h>
+#include <signal.h>
 #include <unistd.h>
 #include <syslog.h>
 #include <string.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include <sys/stat.h>
+#if defined(HAVE_SYS_INOTIFY_H)
+#include <sys/inotify.h>
+#endif
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -41,11 +47,350 @@
 static conffile_t *conf = NULL;
 const char *confdir = CONFDIR;
 
+/* The rules of ypserv.conf are compiled into a table: domain and map
+   names are interned, the rules for a map name are kept in a bucket
+   of this name and the rules for map "*" in an extra list, both in
+   file order. Walking both lists in parallel finds the first rule of
+   the file which matches, as before.
+
+   The result is memoized per client prefix, domain and map. Two
+   addresses which are equal under the union of all netmasks of their
+   family match exactly the same rules, so the masked address is used
+   as key. */
+
+#define ACL_ANY     -1		/* "*" as domain */
+#define ACL_UNKNOWN -2		/* name not used in any rule */
+
+typedef struct acl_rule
+{
+  const conffile_t *conf;
+  int domain;
+} acl_rule_t;
+
+typedef struct acl_name
+{
+  char *name;
+  int *rules;			/* rules with this map name */
+  int nr_rules;
+} acl_name_t;
+
+static acl_rule_t *acl_rules = NULL;
+static int nr_acl_rules = 0;
+static int *acl_wild = NULL;	/* rules with map "*" */
+static int nr_acl_wild = 0;
+static acl_name_t *acl_names = NULL;
+static int nr_acl_names = 0;
+static int *acl_hash = NULL;	/* index into acl_names + 1 */
+static unsigned int acl_hash_size = 0;
+static unsigned char acl_mask4[4];
+static unsigned char acl_mask6[16];
+
+#define ACL_CACHE_SIZE 256
+
+typedef struct acl_cache_entry
+{
+  int family;
+  unsigned char addr[16];
+  char domain[YPMAXDOMAIN + 1];
+  char map[YPMAXMAP + 1];
+  const conffile_t *rule;
+} acl_cache_entry_t;
+
+static acl_cache_entry_t acl_cache[ACL_CACHE_SIZE];
+static pthread_mutex_t acl_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned int
+acl_hash_str (const char *str, unsigned int h)
+{
+  while (*str)
+    {
+      h ^= (unsigned char)*str++;
+      h *= 16777619u;
+    }
+  return h;
+}
+
+static int
+acl_find (const char *name)
+{
+  unsigned int i;
+
+  if (acl_hash_size == 0 || name == NULL)
+    return ACL_UNKNOWN;
+
+  for (i = acl_hash_str (name, 2166136261u) & (acl_hash_size - 1);
+       acl_hash[i] != 0; i = (i + 1) & (acl_hash_size - 1))
+    if (strcmp (acl_names[acl_hash[i] - 1].name, name) == 0)
+      return acl_hash[i] - 1;
+
+  return ACL_UNKNOWN;
+}
+
+/* acl_hash is large enough for all names of all rules. */
+static int
+acl_intern (char *name)
+{
+  unsigned int i;
+  int id = acl_find (name);
+
+  if (id >= 0)
+    return id;
+
+  for (i = acl_hash_str (name, 2166136261u) & (acl_hash_size - 1);
+       acl_hash[i] != 0; i = (i + 1) & (acl_hash_size - 1))
+    ;
+  acl_names[nr_acl_names].name = name;
+  acl_names[nr_acl_names].rules = NULL;
+  acl_names[nr_acl_names].nr_rules = 0;
+  acl_hash[i] = ++nr_acl_names;
+
+  return nr_acl_names - 1;
+}
+
+static int
+acl_append (int **list, int *nr, int rule)
+{
+  int *tmp = realloc (*list, (*nr + 1) * sizeof (int));
+
+  if (tmp == NULL)
+    return -1;
+  tmp[(*nr)++] = rule;
+  *list = tmp;
+  return 0;
+}
+
+static void
+acl_free (void)
+{
+  int i;
+
+  for (i = 0; i < nr_acl_names; i++)
+    free (acl_names[i].rules);
+  free (acl_names);
+  free (acl_hash);
+  free (acl_rules);
+  free (acl_wild);
+  acl_names = NULL;
+  acl_hash = NULL;
+  acl_rules = NULL;
+  acl_wild = NULL;
+  nr_acl_names = nr_acl_rules = nr_acl_wild = 0;
+  acl_hash_size = 0;
+  memset (acl_mask4, 0, sizeof (acl_mask4));
+  memset (acl_mask6, 0, sizeof (acl_mask6));
+
+  pthread_mutex_lock (&acl_cache_lock);
+  memset (acl_cache, 0, sizeof (acl_cache));
+  pthread_mutex_unlock (&acl_cache_lock);
+}
+
+static void
+acl_compile (void)
+{
+  conffile_t *work;
+  int i, nr = 0;
+
+  for (work = conf; work != NULL; work = work->next)
+    nr++;
+  if (nr == 0)
+    return;
+
+  for (acl_hash_size = 16; acl_hash_size < 4 * (unsigned int)nr;
+       acl_hash_size *= 2)
+    ;
+  acl_rules = calloc (nr, sizeof (acl_rule_t));
+  acl_names = calloc (2 * nr, sizeof (acl_name_t));
+  acl_hash = calloc (acl_hash_size, sizeof (int));
+  if (acl_rules == NULL || acl_names == NULL || acl_hash == NULL)
+    goto oom;
+
+  for (work = conf; work != NULL; work = work->next)
+    {
+      acl_rule_t *rule = &acl_rules[nr_acl_rules];
+
+      rule->conf = work;
+      if (strcmp (work->domain, "*") == 0)
+	rule->domain = ACL_ANY;
+      else
+	rule->domain = acl_intern (work->domain);
+
+      if (strcmp (work->map, "*") == 0)
+	{
+	  if (acl_append (&acl_wild, &nr_acl_wild, nr_acl_rules) < 0)
+	    goto oom;
+	}
+      else
+	{
+	  acl_name_t *name = &acl_names[acl_intern (work->map)];
+
+	  if (acl_append (&name->rules, &name->nr_rules, nr_acl_rules) < 0)
+	    goto oom;
+	}
+
+      switch (work->family)
+	{
+	case AF_INET:
+	  for (i = 0; i < 4; i++)
+	    acl_mask4[i] |= ((unsigned char *)&work->netmask)[i];
+	  break;
+	case AF_INET6:
+	  for (i = 0; i < 16; i++)
+	    acl_mask6[i] |= work->netmask6.s6_addr[i];
+	  break;
+	}
+      nr_acl_rules++;
+    }
+  return;
+
+ oom:
+  log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	   __FILE__, __LINE__);
+  exit (1);
+}
+
+static int
+acl_match_host (const conffile_t *rule, int family,
+		const unsigned char *addr)
+{
+  int i;
+
+  if (rule->family == AF_UNSPEC)
+    return 1;
+  if (rule->family != family)
+    return 0;
+
+  if (family == AF_INET)
+    {
+      struct in_addr in;
+
+      memcpy (&in, addr, sizeof (in));
+      return (in.s_addr & rule->netmask.s_addr) == rule->network.s_addr;
+    }
+
+  for (i = 0; i < 16; i++)
+    if ((addr[i] & rule->netmask6.s6_addr[i]) != rule->network6.s6_addr[i])
+      return 0;
+  return 1;
+}
+
+static const conffile_t *
+acl_lookup (int family, const unsigned char *addr,
+	    const char *domain, const char *map)
+{
+  int dom = acl_find (domain);
+  int id = acl_find (map);
+  const int *rules = id >= 0 ? acl_names[id].rules : NULL;
+  int nr_rules = id >= 0 ? acl_names[id].nr_rules : 0;
+  int i = 0, j = 0;
+
+  while (i < nr_rules || j < nr_acl_wild)
+    {
+      const acl_rule_t *rule;
+
+      if (j >= nr_acl_wild || (i < nr_rules && rules[i] < acl_wild[j]))
+	rule = &acl_rules[rules[i++]];
+      else
+	rule = &acl_rules[acl_wild[j++]];
+
+      if ((rule->domain == ACL_ANY || rule->domain == dom) &&
+	  acl_match_host (rule->conf, family, addr))
+	return rule->conf;
+    }
+  return NULL;
+}
+
+/* Search the first ypserv.conf rule for a client address, domain and
+   map. Returns the security of this rule or -1 if no rule matches. */
+int
+check_conf_rules (const struct sockaddr *sa, const char *domain,
+		  const char *map)
+{
+  acl_cache_entry_t *entry;
+  const conffile_t *rule;
+  unsigned char addr[16];
+  unsigned int h;
+  int i, family, len;
+
+  if (nr_acl_rules == 0 || map == NULL)
+    return -1;
+
+  memset (addr, 0, sizeof (addr));
+  switch (sa->sa_family)
+    {
+    case AF_INET:
+      family = AF_INET;
+      len = 4;
+      memcpy (addr, &((const struct sockaddr_in *)sa)->sin_addr, len);
+      break;
+    case AF_INET6:
+      {
+	const struct in6_addr *in6 = &((const struct sockaddr_in6 *)sa)->sin6_addr;
+
+	if (IN6_IS_ADDR_V4MAPPED (in6))
+	  {
+	    family = AF_INET;
+	    len = 4;
+	    memcpy (addr, &in6->s6_addr[12], len);
+	  }
+	else
+	  {
+	    family = AF_INET6;
+	    len = 16;
+	    memcpy (addr, in6->s6_addr, len);
+	  }
+      }
+      break;
+    default:
+      return -1;
+    }
+
+  if (domain == NULL || strlen (domain) > YPMAXDOMAIN ||
+      strlen (map) > YPMAXMAP)
+    {
+      rule = acl_lookup (family, addr, domain, map);
+      return rule ? rule->security : -1;
+    }
+
+  /* Only the bits used by any rule are relevant for the decision */
+  for (i = 0; i < len; i++)
+    addr[i] &= family == AF_INET ? acl_mask4[i] : acl_mask6[i];
+
+  h = 2166136261u ^ (unsigned int)family;
+  for (i = 0; i < len; i++)
+    {
+      h ^= addr[i];
+      h *= 16777619u;
+    }
+  h = acl_hash_str (map, acl_hash_str (domain, h));
+  entry = &acl_cache[h & (ACL_CACHE_SIZE - 1)];
+
+  pthread_mutex_lock (&acl_cache_lock);
+  if (entry->family == family &&
+      memcmp (entry->addr, addr, sizeof (addr)) == 0 &&
+      strcmp (entry->domain, domain) == 0 &&
+      strcmp (entry->map, map) == 0)
+    rule = entry->rule;
+  else
+    {
+      rule = acl_lookup (family, addr, domain, map);
+      entry->family = family;
+      memcpy (entry->addr, addr, sizeof (addr));
+      strcpy (entry->domain, domain);
+      strcpy (entry->map, map);
+      entry->rule = rule;
+    }
+  pthread_mutex_unlock (&acl_cache_lock);
+
+  return rule ? rule->security : -1;
+}
+
 void
 load_config (void)
 {
   conffile_t *tmp;
 
+  acl_free ();
+
   if (conf != NULL)
     {
       log_msg ("Reloading %s/ypserv.conf", confdir);
@@ -60,6 +405,7 @@ load_config (void)
     }
 
   conf = load_ypserv_conf (confdir);
+  acl_compile ();
 }
 
 /* Give a string with the DEFINE description back */
@@ -94,12 +440,219 @@ ypproc_name (int proc)
       return "ypproc_maplist";
     case YPPROC_NEWXFR:
       return "ypproc_newxfr";
+    case YPPROC_MATCH_MULTI:
+      return "ypproc_match_multi";
+    case YPPROC_NEXT_PAGE:
+      return "ypproc_next_page";
+    case YPPROC_CHANGES:
+      return "ypproc_changes";
     default:
       log_msg ("Unknown procedure '%i'", proc);
       return "unknown ?";
     }
 }
 
+/* getnetconfigent reads /etc/netconfig with every call. There are only
+   a few netids, the entries are looked up once and kept forever. An
+   entry is never changed after it was published by increasing
+   nr_netconfig, so readers need no lock. */
+
+#define NETCONFIG_CACHE_SIZE 16
+
+static struct
+{
+  char *netid;
+  struct netconfig *nconf;
+} netconfig_cache[NETCONFIG_CACHE_SIZE];
+static int nr_netconfig = 0;
+static pthread_mutex_t netconfig_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Like getnetconfigent, but the result is shared and must not be
+   given to freenetconfigent. */
+struct netconfig *
+get_netconfig (const char *netid)
+{
+  struct netconfig *nconf = NULL;
+  int i, n;
+
+  if (netid == NULL)
+    return NULL;
+
+  n = __atomic_load_n (&nr_netconfig, __ATOMIC_ACQUIRE);
+  for (i = 0; i < n; i++)
+    if (strcmp (netconfig_cache[i].netid, netid) == 0)
+      return netconfig_cache[i].nconf;
+
+  pthread_mutex_lock (&netconfig_lock);
+  for (i = 0; i < nr_netconfig; i++)
+    if (strcmp (netconfig_cache[i].netid, netid) == 0)
+      {
+	nconf = netconfig_cache[i].nconf;
+	goto out;
+      }
+
+  if (nr_netconfig >= NETCONFIG_CACHE_SIZE)
+    {
+      log_msg ("ERROR: too many netids, cannot cache \"%s\"", netid);
+      goto out;
+    }
+
+  if ((nconf = getnetconfigent (netid)) != NULL)
+    {
+      if ((netconfig_cache[nr_netconfig].netid = strdup (netid)) == NULL)
+	{
+	  freenetconfigent (nconf);
+	  nconf = NULL;
+	  goto out;
+	}
+      netconfig_cache[nr_netconfig].nconf = nconf;
+      __atomic_store_n (&nr_netconfig, nr_netconfig + 1, __ATOMIC_RELEASE);
+    }
+
+ out:
+  pthread_mutex_unlock (&netconfig_lock);
+  return nconf;
+}
+
+/* The result of is_valid_domain is cached per domain name. A thread
+   watches the map directory with inotify and increases
+   domain_generation whenever an entry in it is created, removed,
+   renamed or changed, which invalidates all cached results. Without
+   inotify, every check calls stat() as before. */
+
+#define DOMAIN_CACHE_SIZE 64
+
+typedef struct domain_cache_entry
+{
+  char name[YPMAXDOMAIN + 1];
+  unsigned int generation;	/* 0: unused */
+  int valid;
+} domain_cache_entry_t;
+
+static domain_cache_entry_t domain_cache[DOMAIN_CACHE_SIZE];
+static pthread_mutex_t domain_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t domain_once = PTHREAD_ONCE_INIT;
+static unsigned int domain_generation = 1;
+/* 0: not started yet, 1: watched, -1: not possible, use stat() */
+static int domain_watch = 0;
+static int domain_watch_fd = -1;
+
+#if defined(HAVE_SYS_INOTIFY_H)
+static void *
+domain_watch_run (void *arg)
+{
+  int fd = (int) (long) arg;
+  char buf[4096]
+    __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+  int ignored = 0;
+
+  while (!ignored)
+    {
+      ssize_t n = read (fd, buf, sizeof (buf));
+      char *p;
+
+      if (n < 0 && errno == EINTR)
+	continue;
+      if (n <= 0)
+	break;
+
+      for (p = buf; p < buf + n;
+	   p += sizeof (struct inotify_event) +
+	     ((struct inotify_event *) p)->len)
+	if (((struct inotify_event *) p)->mask & IN_IGNORED)
+	  ignored = 1;	/* the directory itself is gone */
+
+      __atomic_add_fetch (&domain_generation, 1, __ATOMIC_RELEASE);
+    }
+
+  pthread_mutex_lock (&domain_cache_lock);
+  if (domain_watch_fd == fd)
+    {
+      domain_watch = -1;
+      domain_watch_fd = -1;
+      close (fd);
+    }
+  pthread_mutex_unlock (&domain_cache_lock);
+
+  return NULL;
+}
+#endif
+
+/* Must be called with domain_cache_lock held */
+static void
+domain_watch_start (void)
+{
+#if defined(HAVE_SYS_INOTIFY_H)
+  sigset_t set, oldset;
+  pthread_t tid;
+  int fd;
+#endif
+
+  domain_watch = -1;
+#if defined(HAVE_SYS_INOTIFY_H)
+  if ((fd = inotify_init1 (IN_CLOEXEC)) < 0)
+    {
+      log_msg ("inotify_init1: %s", strerror (errno));
+      return;
+    }
+  /* The domains are relative to the current directory */
+  if (inotify_add_watch (fd, ".", IN_CREATE | IN_DELETE | IN_ATTRIB |
+			 IN_MOVED_FROM | IN_MOVED_TO |
+			 IN_DELETE_SELF | IN_MOVE_SELF) < 0)
+    {
+      log_msg ("inotify_add_watch: %s", strerror (errno));
+      close (fd);
+      return;
+    }
+
+  sigfillset (&set);
+  pthread_sigmask (SIG_BLOCK, &set, &oldset);
+  if (pthread_create (&tid, NULL, domain_watch_run, (void *) (long) fd) != 0)
+    {
+      log_msg ("Cannot create inotify thread: %s", strerror (errno));
+      close (fd);
+    }
+  else
+    {
+      pthread_detach (tid);
+      domain_watch_fd = fd;
+      domain_watch = 1;
+    }
+  pthread_sigmask (SIG_SETMASK, &oldset, NULL);
+#endif
+}
+
+static void
+domain_prepare (void)
+{
+  pthread_mutex_lock (&domain_cache_lock);
+}
+
+static void
+domain_parent (void)
+{
+  pthread_mutex_unlock (&domain_cache_lock);
+}
+
+/* The watch thread does not exist in a child process, start a new
+   one with the next check. */
+static void
+domain_child (void)
+{
+  if (domain_watch_fd >= 0)
+    close (domain_watch_fd);
+  domain_watch_fd = -1;
+  domain_watch = 0;
+  domain_generation++;
+  pthread_mutex_unlock (&domain_cache_lock);
+}
+
+static void
+domain_atfork (void)
+{
+  pthread_atfork (domain_prepare, domain_parent, domain_child);
+}
+
 /* The is_valid_domain function checks the domain specified bye the
    caller to make sure it's actually served by this server.
 
@@ -108,6 +661,9 @@ int
 is_valid_domain (const char *domain)
 {
   struct stat sbuf;
+  domain_cache_entry_t *entry = NULL;
+  unsigned int gen = 0;
+  int valid;
 
   if (domain == NULL || domain[0] == '\0' ||
       strcmp (domain, "binding") == 0 ||
@@ -116,51 +672,53 @@ is_valid_domain (const char *domain)
       strchr (domain, '/'))
     return 0;
 
-  if (stat (domain, &sbuf) < 0 || !S_ISDIR (sbuf.st_mode))
-    return 0;
-
-  return 1;
-}
-
-static struct netbuf *
-copy_netbuf (struct netbuf *src)
-{
-  struct netbuf *dst;
-
-  if (src == NULL)
-    return NULL;
+  if (strlen (domain) <= YPMAXDOMAIN)
+    {
+      pthread_once (&domain_once, domain_atfork);
+      pthread_mutex_lock (&domain_cache_lock);
+      if (domain_watch == 0)
+	domain_watch_start ();
+      if (domain_watch > 0)
+	{
+	  /* Read before stat(), a change meanwhile must not be lost */
+	  gen = __atomic_load_n (&domain_generation, __ATOMIC_ACQUIRE);
+	  entry = &domain_cache[acl_hash_str (domain, 2166136261u) &
+				(DOMAIN_CACHE_SIZE - 1)];
+	  if (entry->generation == gen && strcmp (entry->name, domain) == 0)
+	    {
+	      valid = entry->valid;
+	      pthread_mutex_unlock (&domain_cache_lock);
+	      return valid;
+	    }
+	}
+      pthread_mutex_unlock (&domain_cache_lock);
+    }
 
-  dst = calloc (1, sizeof (struct netbuf));
-  if (dst == NULL)
-    return NULL;
+  valid = stat (domain, &sbuf) == 0 && S_ISDIR (sbuf.st_mode);
 
-  dst->buf = malloc (src->len);
-  if (dst->buf == NULL)
+  if (entry != NULL)
     {
-      free (dst);
-      return NULL;
+      pthread_mutex_lock (&domain_cache_lock);
+      strcpy (entry->name, domain);
+      entry->generation = gen;
+      entry->valid = valid;
+      pthread_mutex_unlock (&domain_cache_lock);
     }
 
-  dst->len = src->len;
-  dst->maxlen = src->len;
-  memcpy (dst->buf, src->buf, src->len);
-
-  return dst;
+  return valid;
 }
 
 /* return values:
-   0: both IP addresses are identical
+   0: the IP address is the one in buf
    1: the IP addresses are not identical */
 static int
-cmp_netbuf (struct netbuf *nbuf1, struct netbuf *nbuf2)
+cmp_netbuf (const struct sockaddr_storage *buf, unsigned int len,
+	    struct netbuf *nbuf)
 {
-  if (nbuf1 == NULL || nbuf2 == NULL)
-    return 1;
-
-  if (nbuf1->len != nbuf2->len)
+  if (nbuf == NULL || nbuf->len != len)
     return 1;
 
-  if (memcmp (nbuf1->buf, nbuf2->buf, nbuf1->len) == 0)
+  if (memcmp (buf, nbuf->buf, len) == 0)
     return 0;
 
   return 1;
@@ -178,8 +736,12 @@ cmp_netbuf (struct netbuf *nbuf1, struct netbuf *nbuf2)
 int
 is_valid (struct svc_req *rqstp, const char *map, const char *domain)
 {
-  static struct netbuf *oldaddr = NULL;  /* so we dont log multiple times */
-  static int oldstatus = -1;
+  /* The last refused address of the thread, so we dont log multiple
+     times. An allowed request only resets oldstatus, so it takes no
+     lock and does not copy the address. */
+  static __thread struct sockaddr_storage oldaddr;
+  static __thread unsigned int oldaddrlen = 0;
+  static __thread int oldstatus = -1;
   struct netconfig *nconf;
   struct netbuf *rqhost;
   struct __rpc_sockinfo si;
@@ -192,31 +754,20 @@ is_valid (struct svc_req *rqstp, const char *map, const char *domain)
     return -2;
 
   rqhost = svc_getrpccaller (rqstp->rq_xprt);
-  nconf = getnetconfigent (rqstp->rq_xprt->xp_netid);
+  nconf = get_netconfig (rqstp->rq_xprt->xp_netid);
 
   status = securenet_host (nconf, rqhost);
 
   if (!__rpc_nconf2sockinfo(nconf, &si))
     return -1;
 
-  if ((map != NULL) && status && si.si_af == AF_INET)
+  if ((map != NULL) && status &&
+      (si.si_af == AF_INET || si.si_af == AF_INET6))
     {
-      struct sockaddr_in *sin = rqhost->buf;
-      conffile_t *work;
-
-      work = conf;
-      while (work)
-	{
-	  if ((sin->sin_addr.s_addr & work->netmask.s_addr) == work->network.s_addr)
-	    if (strcmp (work->domain, domain) == 0 ||
-		strcmp (work->domain, "*") == 0)
-	      if (strcmp (work->map, map) == 0 || strcmp (work->map, "*") == 0)
-		break;
-	  work = work->next;
-	}
+      int security = check_conf_rules (rqhost->buf, domain, map);
 
-      if (work != NULL)
-	switch (work->security)
+      if (security >= 0)
+	switch (security)
 	  {
 	  case SEC_NONE:
 	    break;
@@ -235,11 +786,7 @@ is_valid (struct svc_req *rqstp, const char *map, const char *domain)
 	  DB_FILE dbp = ypdb_open (domain, map);
 	  if (dbp != NULL)
 	    {
-	      datum key;
-
-	      key.dsize = sizeof ("YP_SECURE") - 1;
-	      key.dptr = "YP_SECURE";
-	      if (ypdb_exists (dbp, key))
+	      if (ypdb_secure (dbp))
 		if (taddr2port (nconf, rqhost) >= IPPORT_RESERVED)
 		  status = -1;
 	      ypdb_close (dbp);
@@ -259,10 +806,12 @@ is_valid (struct svc_req *rqstp, const char *map, const char *domain)
 	       taddr2port (nconf, rqhost), ypproc_name (rqstp->rq_proc),
 	       domain ? domain : "", map ? map : "", status);
     }
-  else
+
+  if (status < 1 && status != -4)
     {
-      if ((status < 1 && status != -4) &&
-	  (cmp_netbuf (oldaddr, rqhost) || (status != oldstatus)))
+      if (!debug_flag &&
+	  (cmp_netbuf (&oldaddr, oldaddrlen, rqhost) ||
+	   (status != oldstatus)))
 	{
 	  char host[INET6_ADDRSTRLEN];
 
@@ -272,20 +821,17 @@ is_valid (struct svc_req *rqstp, const char *map, const char *domain)
 		  taddr2port (nconf, rqhost), ypproc_name (rqstp->rq_proc),
 		  domain ? domain : "", map ? map : "", status);
 	}
-    }
 
-  /* Create a copy of the netbuf and free the old one */
-  if (oldaddr)
-    {
-      if (oldaddr->buf)
-	free (oldaddr->buf);
-      free (oldaddr);
+      if (rqhost != NULL && rqhost->len <= sizeof (oldaddr))
+	{
+	  memcpy (&oldaddr, rqhost->buf, rqhost->len);
+	  oldaddrlen = rqhost->len;
+	}
+      else
+	oldaddrlen = 0;
     }
-  oldaddr = copy_netbuf (rqhost);
   oldstatus = status;
 
-  freenetconfigent (nconf);
-
   return status;
 }
 
@@ -28,8 +28,11 @@
 /* access.c */
 extern void load_config (void);
 extern int is_valid_domain (const char *domain);
+extern struct netconfig *get_netconfig (const char *netid);
 extern int is_valid (struct svc_req *rqstp, const char *map,
 		     const char *domain);
+extern int check_conf_rules (const struct sockaddr *sa, const char *domain,
+			     const char *map);
 
 /* securenets.c */
 extern int load_securenets (void);
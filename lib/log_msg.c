@@ -27,9 +27,12 @@ log_msg (char *fmt,...)
   va_start (ap, fmt);
   if (debug_flag)
     {
+      /* Don't mix up lines written by different threads */
+      flockfile (debug_output);
       vfprintf (debug_output, fmt, ap);
       fputc ('\n', debug_output);
       fflush (debug_output);
+      funlockfile (debug_output);
     }
   else
     {
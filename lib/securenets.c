@@ -49,6 +49,32 @@ securenet_t;
 
 static securenet_t *securenets = NULL;
 
+/* For the lookup, the entries are compiled into a binary trie per
+   address family, indexed by the address bits in network byte order.
+   A node is terminal if an entry with this prefix exists, a client
+   has access if a terminal node is on the path of its address. All
+   nodes of a trie are kept in one array, child 0 means no child
+   (the root is never a child). Entries with a non-contiguous netmask
+   cannot be stored in the trie and are compared one by one. */
+typedef struct sn_node
+{
+  unsigned int child[2];
+  unsigned int terminal;
+}
+sn_node_t;
+
+typedef struct sn_trie
+{
+  sn_node_t *nodes;
+  unsigned int used;
+  unsigned int size;
+}
+sn_trie_t;
+
+static sn_trie_t trie4, trie6;
+static securenet_t **sn_other = NULL;
+static int nr_sn_other = 0;
+
 
 void
 dump_securenets (void)
@@ -104,6 +130,178 @@ dump_securenets (void)
   log_msg ("--- securenets end ---");
 }
 
+static unsigned int
+trie_node_new (sn_trie_t *t)
+{
+  if (t->used == t->size)
+    {
+      unsigned int size = t->size ? t->size * 2 : 64;
+      sn_node_t *tmp = realloc (t->nodes, size * sizeof (sn_node_t));
+
+      if (tmp == NULL)
+	{
+	  log_msg ("ERROR: could not allocate enough memory! [%s|%d]\n",
+		   __FILE__, __LINE__);
+	  exit (1);
+	}
+      t->nodes = tmp;
+      t->size = size;
+    }
+  memset (&t->nodes[t->used], 0, sizeof (sn_node_t));
+  return t->used++;
+}
+
+static inline int
+addr_bit (const unsigned char *addr, int i)
+{
+  return (addr[i >> 3] >> (7 - (i & 7))) & 1;
+}
+
+static void
+trie_insert (sn_trie_t *t, const unsigned char *addr, int prefixlen)
+{
+  unsigned int n;
+  int i;
+
+  if (t->used == 0)
+    trie_node_new (t);
+
+  n = 0;
+  for (i = 0; i < prefixlen; i++)
+    {
+      int bit = addr_bit (addr, i);
+
+      /* Already covered by a shorter prefix */
+      if (t->nodes[n].terminal)
+	return;
+      if (t->nodes[n].child[bit] == 0)
+	{
+	  unsigned int c = trie_node_new (t);
+	  t->nodes[n].child[bit] = c;
+	}
+      n = t->nodes[n].child[bit];
+    }
+  /* Everything below is covered by this prefix now */
+  t->nodes[n].terminal = 1;
+  t->nodes[n].child[0] = t->nodes[n].child[1] = 0;
+}
+
+static int
+trie_lookup (const sn_trie_t *t, const unsigned char *addr, int bits)
+{
+  unsigned int n = 0;
+  int i;
+
+  if (t->used == 0)
+    return 0;
+
+  for (i = 0; ; i++)
+    {
+      if (t->nodes[n].terminal)
+	return 1;
+      if (i == bits)
+	return 0;
+      if ((n = t->nodes[n].child[addr_bit (addr, i)]) == 0)
+	return 0;
+    }
+}
+
+static void
+trie_free (sn_trie_t *t)
+{
+  free (t->nodes);
+  memset (t, 0, sizeof (sn_trie_t));
+}
+
+/* Returns the prefix length of a contiguous netmask, else -1. */
+static int
+mask_prefixlen (const unsigned char *mask, int len)
+{
+  int i, prefixlen = 0;
+
+  for (i = 0; i < len && mask[i] == 0xff; i++)
+    prefixlen += 8;
+  if (i < len)
+    {
+      unsigned char m = mask[i];
+
+      while (m & 0x80)
+	{
+	  prefixlen++;
+	  m = (unsigned char)(m << 1);
+	}
+      if (m != 0)
+	return -1;
+      for (i++; i < len; i++)
+	if (mask[i] != 0)
+	  return -1;
+    }
+  return prefixlen;
+}
+
+static void
+compile_securenets (void)
+{
+  securenet_t *sn;
+
+  for (sn = securenets; sn != NULL; sn = sn->next)
+    {
+      const unsigned char *network, *netmask;
+      sn_trie_t *trie;
+      int i, len, prefixlen;
+
+      switch (sn->family)
+	{
+	case AF_INET:
+	  network = (const unsigned char *)
+	    &((struct sockaddr_in *)&(sn->network))->sin_addr;
+	  netmask = (const unsigned char *)
+	    &((struct sockaddr_in *)&(sn->netmask))->sin_addr;
+	  len = 4;
+	  trie = &trie4;
+	  break;
+	case AF_INET6:
+	  network = (const unsigned char *)
+	    &((struct sockaddr_in6 *)&(sn->network))->sin6_addr;
+	  netmask = (const unsigned char *)
+	    &((struct sockaddr_in6 *)&(sn->netmask))->sin6_addr;
+	  len = 16;
+	  trie = &trie6;
+	  break;
+	default:
+	  continue;
+	}
+
+      /* A network with bits outside of the netmask never matched
+	 any address. */
+      for (i = 0; i < len; i++)
+	if (network[i] & ~netmask[i])
+	  break;
+      if (i < len)
+	continue;
+
+      if ((prefixlen = mask_prefixlen (netmask, len)) >= 0)
+	trie_insert (trie, network, prefixlen);
+      else
+	{
+	  securenet_t **tmp = realloc (sn_other, (nr_sn_other + 1) *
+				       sizeof (securenet_t *));
+	  if (tmp == NULL)
+	    {
+	      log_msg ("ERROR: could not allocate enough memory! [%s|%d]\n",
+		       __FILE__, __LINE__);
+	      exit (1);
+	    }
+	  sn_other = tmp;
+	  sn_other[nr_sn_other++] = sn;
+	}
+    }
+
+  if (debug_flag)
+    log_msg ("securenets: %u IPv4 and %u IPv6 trie nodes, %d other entries",
+	     trie4.used, trie6.used, nr_sn_other);
+}
+
 int
 load_securenets (void)
 {
@@ -127,6 +325,11 @@ load_securenets (void)
 	}
     }
   securenets = NULL;
+  trie_free (&trie4);
+  trie_free (&trie6);
+  free (sn_other);
+  sn_other = NULL;
+  nr_sn_other = 0;
   work = NULL;
   tmp = NULL;
 
@@ -294,6 +497,8 @@ load_securenets (void)
     }
   fclose (in);
 
+  compile_securenets ();
+
   if (debug_flag)
     dump_securenets ();
 
@@ -303,8 +508,8 @@ load_securenets (void)
 int
 securenet_host (struct netconfig *nconf, struct netbuf *nbuf)
 {
-  securenet_t *ptr;
   struct __rpc_sockinfo si;
+  int i;
 
   if (nconf == NULL || nbuf == NULL || nbuf->len <= 0)
     return 0;
@@ -312,48 +517,67 @@ securenet_host (struct netconfig *nconf, struct netbuf *nbuf)
   if (!__rpc_nconf2sockinfo(nconf, &si))
     return 0;
 
-  ptr = securenets;
-
-  if (ptr == NULL) /* this means no securenets file, grant access */
+  if (securenets == NULL) /* this means no securenets file, grant access */
     return 1;
-  else
-    while (ptr != NULL)
+
+  switch (si.si_af)
+    {
+    case AF_INET:
+      {
+	struct sockaddr_in *sin1 = nbuf->buf;
+
+	if (trie_lookup (&trie4, (const unsigned char *)&sin1->sin_addr, 32))
+	  return 1;
+      }
+      break;
+    case AF_INET6:
       {
-	if (si.si_af == ptr->family)
-	  switch (ptr->family)
+	struct sockaddr_in6 *sin1 = nbuf->buf;
+
+	if (trie_lookup (&trie6, sin1->sin6_addr.s6_addr, 128))
+	  return 1;
+      }
+      break;
+    default:
+      return 0;
+    }
+
+  for (i = 0; i < nr_sn_other; i++)
+    {
+      securenet_t *ptr = sn_other[i];
+
+      if (si.si_af == ptr->family)
+	switch (ptr->family)
+	  {
+	  case AF_INET:
 	    {
-	    case AF_INET:
-	      {
-		struct sockaddr_in *sin1 = nbuf->buf;
-		struct sockaddr_in *sin2 = (struct sockaddr_in *)&(ptr->netmask);
-		struct sockaddr_in *sin3 = (struct sockaddr_in *)&(ptr->network);
+	      struct sockaddr_in *sin1 = nbuf->buf;
+	      struct sockaddr_in *sin2 = (struct sockaddr_in *)&(ptr->netmask);
+	      struct sockaddr_in *sin3 = (struct sockaddr_in *)&(ptr->network);
 
-		if ((sin1->sin_addr.s_addr & sin2->sin_addr.s_addr) ==
-		    sin3->sin_addr.s_addr)
-		  return 1;
-	      }
-	      break;
-	    case AF_INET6:
-	      {
-		int i;
-		struct sockaddr_in6 *sin1 = nbuf->buf;
-		struct sockaddr_in6 *sin2 =
-		  (struct sockaddr_in6 *)&(ptr->netmask);
-		struct sockaddr_in6 *sin3 =
-		  (struct sockaddr_in6 *)&(ptr->network);
-
-		for (i = 0; i < 16; i++)
-		  if ((sin1->sin6_addr.s6_addr[i] & sin2->sin6_addr.s6_addr[i])
-		      != sin3->sin6_addr.s6_addr[i])
-		    goto next;
+	      if ((sin1->sin_addr.s_addr & sin2->sin_addr.s_addr) ==
+		  sin3->sin_addr.s_addr)
 		return 1;
-	      }
-	      break;
-	    default:
-	      goto next; /* Something is wrong here, should not happen. */
 	    }
-      next:
-	ptr = ptr->next;
-      }
+	    break;
+	  case AF_INET6:
+	    {
+	      int j;
+	      struct sockaddr_in6 *sin1 = nbuf->buf;
+	      struct sockaddr_in6 *sin2 =
+		(struct sockaddr_in6 *)&(ptr->netmask);
+	      struct sockaddr_in6 *sin3 =
+		(struct sockaddr_in6 *)&(ptr->network);
+
+	      for (j = 0; j < 16; j++)
+		if ((sin1->sin6_addr.s6_addr[j] & sin2->sin6_addr.s6_addr[j])
+		    != sin3->sin6_addr.s6_addr[j])
+		  break;
+	      if (j == 16)
+		return 1;
+	    }
+	    break;
+	  }
+    }
   return 0;
 }
@@ -84,6 +84,27 @@ main (void)
   /* fail */
   if (check_entry (AF_INET6, "fe80::202:b3fe:ff:ff") != 1)
     return 1;
+  /* success */
+  if (check_entry (AF_INET, "172.17.0.200") != 0)
+    return 1;
+  /* fail */
+  if (check_entry (AF_INET, "172.17.1.1") != 1)
+    return 1;
+  /* success */
+  if (check_entry (AF_INET, "10.160.33.4") != 0)
+    return 1;
+  /* success */
+  if (check_entry (AF_INET6, "2620:113:80c0:8080:1::5") != 0)
+    return 1;
+  /* fail */
+  if (check_entry (AF_INET6, "2620:113:80c0:8081::5") != 1)
+    return 1;
+  /* success, non-contiguous netmask */
+  if (check_entry (AF_INET, "192.77.2.5") != 0)
+    return 1;
+  /* fail */
+  if (check_entry (AF_INET, "192.0.3.5") != 1)
+    return 1;
 
   return 0;
 }
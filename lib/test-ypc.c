@@ -0,0 +1,149 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "yp_db.h"
+#include "ypc.h"
+
+extern int debug_flag;
+
+static int
+check_fetch (DB_FILE dbp, const char *key, const char *expect)
+{
+  datum k, v;
+  char kbuf[32], buf[16];
+
+  strncpy (kbuf, key, sizeof (kbuf) - 1);
+  kbuf[sizeof (kbuf) - 1] = '\0';
+  k.dptr = kbuf;
+  k.dsize = strlen (kbuf);
+  v = ypdb_fetch_into (dbp, k, buf, sizeof (buf));
+
+  if (expect == NULL)
+    {
+      if (v.dptr != NULL || ypdb_exists (dbp, k))
+	{
+	  fprintf (stderr, "%s: found, but should not exist\n", key);
+	  return 1;
+	}
+      return 0;
+    }
+
+  if (v.dptr == NULL || (size_t) v.dsize != strlen (expect) ||
+      memcmp (v.dptr, expect, v.dsize) != 0)
+    {
+      fprintf (stderr, "%s: wrong value\n", key);
+      return 1;
+    }
+  if (v.dptr != buf)
+    ypdb_free (v.dptr);
+
+  return 0;
+}
+
+int
+main (void)
+{
+  ypc_writer_t *w;
+  DB_FILE dbp;
+  datum key;
+  char k[32], v[32];
+  FILE *fp;
+  int i, n;
+
+#if defined(HAVE_NDBM)
+  /* ypdb_open does not use ypc files with NDBM, skip */
+  return 77;
+#endif
+
+  debug_flag = 1;
+
+  if ((w = ypc_create ()) == NULL)
+    return 1;
+  /* More than the initial hash slots, so that they are resized */
+  for (i = 0; i < 5000; i++)
+    {
+      snprintf (k, sizeof (k), "key%d", i);
+      snprintf (v, sizeof (v), "value%d", i);
+      if (ypc_add (w, k, strlen (k), v, strlen (v)) != 0)
+	return 1;
+    }
+  /* Replace a value, the key must exist only once */
+  if (ypc_add (w, "key42", 5, "a longer replacement", 20) != 0)
+    return 1;
+  /* The ypc file is only used next to the database it was written
+     with, an empty file is enough for that. */
+  if ((fp = fopen ("test-ypc-map", "w")) == NULL || fclose (fp) != 0)
+    return 1;
+  if (ypc_write (w, "test-ypc-map.ypc", "test-ypc-map") != 0)
+    return 1;
+  ypc_free (w);
+
+  if ((dbp = ypdb_open (".", "test-ypc-map")) == NULL)
+    {
+      fprintf (stderr, "ypdb_open failed\n");
+      return 1;
+    }
+
+  if (check_fetch (dbp, "key0", "value0") != 0 ||
+      check_fetch (dbp, "key4999", "value4999") != 0 ||
+      check_fetch (dbp, "key42", "a longer replacement") != 0 ||
+      check_fetch (dbp, "key5000", NULL) != 0 ||
+      check_fetch (dbp, "", NULL) != 0)
+    return 1;
+
+  n = 0;
+  key = ypdb_firstkey (dbp);
+  while (key.dptr != NULL)
+    {
+      datum tkey = key;
+
+      ++n;
+      key = ypdb_nextkey (dbp, tkey);
+      ypdb_free (tkey.dptr);
+    }
+  if (n != 5000)
+    {
+      fprintf (stderr, "found %d keys instead of 5000\n", n);
+      return 1;
+    }
+
+  ypdb_close (dbp);
+  ypdb_close_all ();
+
+  /* A new database without new ypc file, the old one is stale */
+  if ((fp = fopen ("test-ypc-map~", "w")) == NULL ||
+      fputs ("new", fp) == EOF || fclose (fp) != 0 ||
+      rename ("test-ypc-map~", "test-ypc-map") != 0)
+    return 1;
+  if ((dbp = ypdb_open (".", "test-ypc-map")) != NULL)
+    {
+      if (check_fetch (dbp, "key0", NULL) != 0)
+	{
+	  fprintf (stderr, "stale ypc file used\n");
+	  return 1;
+	}
+      ypdb_close (dbp);
+    }
+  ypdb_close_all ();
+
+  unlink ("test-ypc-map");
+  unlink ("test-ypc-map.ypc");
+
+  return 0;
+}
@@ -0,0 +1,176 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "ypdb_cursor.h"
+
+#define NTHREADS 8
+#define NSTEPS 20000
+
+/* The cursors of the database library are counted only */
+static unsigned long nr_created = 0;
+static unsigned long nr_closed = 0;
+
+static void
+fake_close (void *cur)
+{
+  free (cur);
+  __atomic_add_fetch (&nr_closed, 1, __ATOMIC_RELAXED);
+}
+
+/* Continue the enumeration of owner behind key, like YPPROC_NEXT
+   does, and return the cursor with the next key. */
+static int
+next_key (const void *owner, int key, time_t now)
+{
+  char buf[16], next[16];
+  ypdb_cursor_t *c;
+
+  snprintf (buf, sizeof (buf), "key%d", key);
+  if ((c = ypdb_cursor_take (owner, buf, strlen (buf), now)) == NULL)
+    {
+      void *cur = malloc (1);
+
+      if (cur == NULL || (c = ypdb_cursor_new (owner, cur,
+					       fake_close)) == NULL)
+	return -1;
+      __atomic_add_fetch (&nr_created, 1, __ATOMIC_RELAXED);
+    }
+  snprintf (next, sizeof (next), "key%d", key + 1);
+  if (ypdb_cursor_set_key (c, next, strlen (next), now) != 0)
+    return -1;
+  ypdb_cursor_put (c);
+  return 0;
+}
+
+static int
+has_cursor (const void *owner, int key, time_t now)
+{
+  char buf[16];
+  ypdb_cursor_t *c;
+
+  snprintf (buf, sizeof (buf), "key%d", key);
+  if ((c = ypdb_cursor_take (owner, buf, strlen (buf), now)) == NULL)
+    return 0;
+  ypdb_cursor_put (c);
+  return 1;
+}
+
+/* Several enumerations per thread, some of them are given up */
+static void *
+run_thread (void *arg)
+{
+  int id = (int) (long) arg, i;
+  int pos[4] = { 0, 0, 0, 0 };
+  unsigned int seed = id;
+
+  for (i = 0; i < NSTEPS; i++)
+    {
+      int e = rand_r (&seed) % 4;
+
+      if (rand_r (&seed) % 100 == 0)
+	pos[e] = 0;		/* abandoned, start again */
+      if (next_key (&pos[e], pos[e], 1000) != 0)
+	return (void *) 1;
+      pos[e]++;
+    }
+  return NULL;
+}
+
+int
+main (void)
+{
+  pthread_t tid[NTHREADS];
+  int owner_a, owner_b, i;
+  time_t now = 1000;
+
+  /* Only YPDB_CURSORS are kept, the least recently used are closed */
+  for (i = 0; i < YPDB_CURSORS + 6; i++)
+    if (next_key (&owner_a, i * 2, now) != 0)
+      return 1;
+  if (ypdb_cursor_count () != YPDB_CURSORS || nr_closed != 6)
+    {
+      fprintf (stderr, "%d cursors, %lu closed\n", ypdb_cursor_count (),
+	       nr_closed);
+      return 1;
+    }
+  if (has_cursor (&owner_a, 1, now) || !has_cursor (&owner_a, 13, now) ||
+      has_cursor (&owner_b, 13, now))
+    {
+      fprintf (stderr, "wrong cursor found\n");
+      return 1;
+    }
+
+  /* A taken cursor is not found a second time */
+  {
+    ypdb_cursor_t *c = ypdb_cursor_take (&owner_a, "key13", 5, now);
+
+    if (c == NULL || ypdb_cursor_take (&owner_a, "key13", 5, now) != NULL)
+      return 1;
+    ypdb_cursor_free (c);
+  }
+
+  /* Closing a handle closes only its cursors */
+  if (next_key (&owner_b, 0, now) != 0)
+    return 1;
+  ypdb_cursor_close_all (&owner_a);
+  if (ypdb_cursor_count () != 1 || !has_cursor (&owner_b, 1, now))
+    {
+      fprintf (stderr, "%d cursors after close\n", ypdb_cursor_count ());
+      return 1;
+    }
+
+  /* Unused cursors expire */
+  if (next_key (&owner_a, 0, now + YPDB_CURSOR_TIMEOUT / 2) != 0 ||
+      has_cursor (&owner_a, 0, now + YPDB_CURSOR_TIMEOUT) ||
+      ypdb_cursor_count () != 1 ||
+      !has_cursor (&owner_a, 1, now + YPDB_CURSOR_TIMEOUT))
+    {
+      fprintf (stderr, "%d cursors after timeout\n", ypdb_cursor_count ());
+      return 1;
+    }
+  ypdb_cursor_close_all (&owner_a);
+
+  /* Concurrent enumerations */
+  for (i = 0; i < NTHREADS; i++)
+    if (pthread_create (&tid[i], NULL, run_thread, (void *) (long) i) != 0)
+      return 1;
+  for (i = 0; i < NTHREADS; i++)
+    {
+      void *ret;
+
+      pthread_join (tid[i], &ret);
+      if (ret != NULL)
+	return 1;
+    }
+  if (ypdb_cursor_count () > YPDB_CURSORS ||
+      nr_created != nr_closed + ypdb_cursor_count ())
+    {
+      fprintf (stderr, "%d cursors, %lu created, %lu closed\n",
+	       ypdb_cursor_count (), nr_created, nr_closed);
+      return 1;
+    }
+
+  return 0;
+}
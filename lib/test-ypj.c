@@ -0,0 +1,186 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ypc.h"
+#include "ypj.h"
+
+extern int debug_flag;
+
+#define NFILL 20
+
+/* Write a map as ypc file with the keys and values of kv, NULL
+   terminated, and NFILL other keys. The database file is empty, the
+   ypc file is only used if it exists. */
+static int
+write_map (const char *name, const char *order, int fill,
+	   const char **kv)
+{
+  char fname[64], k[32], v[32];
+  ypc_writer_t *w;
+  FILE *fp;
+  int i;
+
+  if ((fp = fopen (name, "w")) == NULL || fclose (fp) != 0)
+    return -1;
+
+  if ((w = ypc_create ()) == NULL)
+    return -1;
+  if (ypc_add (w, "YP_LAST_MODIFIED", 16, order, strlen (order)) != 0)
+    return -1;
+  for (i = 0; kv[i] != NULL; i += 2)
+    if (ypc_add (w, kv[i], strlen (kv[i]), kv[i + 1],
+		 strlen (kv[i + 1])) != 0)
+      return -1;
+  for (i = 0; i < NFILL; i++)
+    {
+      snprintf (k, sizeof (k), "fill%d", i);
+      snprintf (v, sizeof (v), "value%d-%d", i, fill);
+      if (ypc_add (w, k, strlen (k), v, strlen (v)) != 0)
+	return -1;
+    }
+  snprintf (fname, sizeof (fname), "%s%s", name, YPC_SUFFIX);
+  if (ypc_write (w, fname, name) != 0)
+    return -1;
+  ypc_free (w);
+
+  return 0;
+}
+
+/* Replace the old map with the new one */
+static void
+install_map (void)
+{
+  rename ("test-ypj-new", "test-ypj-old");
+  rename ("test-ypj-new.ypc", "test-ypj-old.ypc");
+}
+
+/* Count the changes since, and look for one of them */
+static int
+check_changes (uint32_t since, uint32_t current, int expect,
+	       uint32_t op, const char *key, const char *val)
+{
+  ypj_file_t *j;
+  char *k, *v;
+  size_t klen, vlen;
+  uint32_t o;
+  int n = 0, found = key == NULL, ret;
+
+  if ((j = ypj_open ("test-ypj.ypj")) == NULL)
+    {
+      fprintf (stderr, "ypj_open failed\n");
+      return 1;
+    }
+  if (ypj_since (j, since, current) != 0)
+    {
+      ypj_close (j);
+      if (expect < 0)
+	return 0;
+      fprintf (stderr, "no changes since %u\n", since);
+      return 1;
+    }
+
+  while ((ret = ypj_next (j, &o, &k, &klen, &v, &vlen)) > 0)
+    {
+      ++n;
+      if (key != NULL && o == op && klen == strlen (key) &&
+	  memcmp (k, key, klen) == 0 && vlen == strlen (val) &&
+	  memcmp (v, val, vlen) == 0)
+	found = 1;
+    }
+  ypj_close (j);
+
+  if (ret < 0 || n != expect || !found)
+    {
+      fprintf (stderr, "since %u: %d changes instead of %d%s\n",
+	       since, n, expect, found ? "" : ", missing change");
+      return 1;
+    }
+
+  return 0;
+}
+
+int
+main (void)
+{
+  const char *v1[] = { "a", "1", "b", "2", "c", "3",
+		       "YP_MASTER_NAME", "x", NULL };
+  const char *v2[] = { "a", "1", "b", "22", "d", "4", "YP_SECURE", "",
+		       "YP_MASTER_NAME", "y", NULL };
+  const char *v3[] = { "a", "1", "b", "22", "d", "44", NULL };
+
+#if defined(HAVE_NDBM)
+  /* ypdb_open does not use ypc files with NDBM, skip */
+  return 77;
+#endif
+
+  debug_flag = 0;
+
+  unlink ("test-ypj.ypj");
+  /* The first version, nothing to journal */
+  if (write_map ("test-ypj-new", "100", 0, v1) != 0 ||
+      ypj_update ("test-ypj.ypj", "test-ypj-old", "test-ypj-new") != 0 ||
+      access ("test-ypj.ypj", F_OK) == 0)
+    return 1;
+  install_map ();
+
+  /* b and YP_SECURE changed, d added, c deleted */
+  if (write_map ("test-ypj-new", "200", 0, v2) != 0 ||
+      ypj_update ("test-ypj.ypj", "test-ypj-old", "test-ypj-new") != 0)
+    return 1;
+  install_map ();
+  if (check_changes (100, 200, 4, YPJ_STORE, "b", "22") != 0 ||
+      check_changes (100, 200, 4, YPJ_DELETE, "c", "") != 0 ||
+      check_changes (100, 200, 4, YPJ_STORE, "YP_SECURE", "") != 0 ||
+      check_changes (200, 200, 0, 0, NULL, NULL) != 0 ||
+      check_changes (150, 200, -1, 0, NULL, NULL) != 0 ||
+      check_changes (100, 300, -1, 0, NULL, NULL) != 0)
+    return 1;
+
+  if (write_map ("test-ypj-new", "300", 0, v3) != 0 ||
+      ypj_update ("test-ypj.ypj", "test-ypj-old", "test-ypj-new") != 0)
+    return 1;
+  install_map ();
+  if (check_changes (100, 300, 6, YPJ_STORE, "d", "44") != 0 ||
+      check_changes (200, 300, 2, YPJ_DELETE, "YP_SECURE", "") != 0)
+    return 1;
+
+  /* Changes all fill keys, more than a copy of the map without the
+     first delta */
+  if (write_map ("test-ypj-new", "400", 1, v3) != 0 ||
+      ypj_update ("test-ypj.ypj", "test-ypj-old", "test-ypj-new") != 0)
+    return 1;
+  if (check_changes (100, 400, -1, 0, NULL, NULL) != 0 ||
+      check_changes (200, 400, NFILL + 2, YPJ_STORE, "fill7",
+		     "value7-1") != 0)
+    return 1;
+
+  unlink ("test-ypj-old");
+  unlink ("test-ypj-old.ypc");
+  unlink ("test-ypj-new");
+  unlink ("test-ypj-new.ypc");
+  unlink ("test-ypj.ypj");
+
+  return 0;
+}
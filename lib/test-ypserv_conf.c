@@ -13,21 +13,72 @@
    You should have received a copy of the GNU General Public License
    along with this program.  If not, see <http://www.gnu.org/licenses/>. */
 
+#include <string.h>
+#include <arpa/inet.h>
 #include <rpc/rpc.h>
 #include <rpc/rpc_com.h>
 
 #include "access.h"
+#include "ypserv_conf.h"
 
 extern int debug_flag;
 extern const char *confdir;
 
+static int
+check_rule (const char *ip, const char *domain, const char *map)
+{
+  struct sockaddr_storage ss;
+
+  memset (&ss, 0, sizeof (ss));
+  if (strchr (ip, ':'))
+    {
+      struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+
+      sin6->sin6_family = AF_INET6;
+      inet_pton (AF_INET6, ip, &sin6->sin6_addr);
+    }
+  else
+    {
+      struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+
+      sin->sin_family = AF_INET;
+      inet_pton (AF_INET, ip, &sin->sin_addr);
+    }
+
+  return check_conf_rules ((struct sockaddr *)&ss, domain, map);
+}
+
 int
 main (void)
 {
+  int i;
+
   debug_flag = 1;
   confdir = "test";
 
   load_config ();
 
+  /* Twice, the second round is answered from the cache */
+  for (i = 0; i < 2; i++)
+    {
+      if (check_rule ("10.1.2.3", "test", "shadow.byname") != SEC_PORT)
+	return 1;
+      if (check_rule ("2001:db9::1", "test", "shadow.byname") != SEC_PORT)
+	return 1;
+      if (check_rule ("10.161.7.8", "test", "passwd.byname") != SEC_DENY)
+	return 1;
+      if (check_rule ("::ffff:10.161.7.8", "test", "passwd.byname") != SEC_DENY)
+	return 1;
+      if (check_rule ("10.162.7.8", "test", "passwd.byname") != -1)
+	return 1;
+      if (check_rule ("2001:db8::1", "test", "passwd.byname") != SEC_DENY)
+	return 1;
+      if (check_rule ("2001:db8::1", "other", "passwd.byname") != -1)
+	return 1;
+      /* First rule wins */
+      if (check_rule ("2001:db8::1", "test", "shadow.byname") != SEC_PORT)
+	return 1;
+    }
+
   return 0;
 }
@@ -41,6 +41,109 @@ typedef struct
     void *data;
 } xdr_ypall_cb_t;
 
+/* Version 3 of YPPROG has all procedures of version 2, and
+   YPPROC_MATCH_MULTI, which looks up at most YPMAXMULTI keys of
+   several maps of one domain with one request. Every key has its
+   own status in the reply, like with YPPROC_MATCH. Values, which
+   do not fit into YPMAXPAGEBYTES anymore, are left out with the
+   status YP_NOMORE, the client has to ask for them again.
+   Additionally there are YPPROC_NEXT_PAGE and YPPROC_CHANGES, see
+   below. */
+#define YPVERS_MULTI 3
+#define YPMAXMULTI 64
+
+struct ypmatch_multi_key {
+	mapname map;
+	keydat_t keydat;
+};
+typedef struct ypmatch_multi_key ypmatch_multi_key;
+
+struct ypreq_match_multi {
+	domainname domain;
+	struct {
+		u_int keys_len;
+		ypmatch_multi_key *keys_val;
+	} keys;
+};
+typedef struct ypreq_match_multi ypreq_match_multi;
+
+struct ypresp_match_multi {
+	ypstat status;
+	struct {
+		u_int vals_len;
+		ypresp_val *vals_val;
+	} vals;
+};
+typedef struct ypresp_match_multi ypresp_match_multi;
+
+/* YPPROC_NEXT_PAGE of version 3 returns up to count entries of a
+   map, but not more than maxbytes, starting behind token. An empty
+   token starts with the first entry. The token of the reply
+   continues the enumeration, it is empty after the last entry. */
+#define YPMAXPAGE 1024
+#define YPMAXPAGEBYTES (UDPMSGSIZE - 512)
+
+struct ypmap_entry {
+	keydat_t keydat;
+	valdat_t valdat;
+};
+typedef struct ypmap_entry ypmap_entry;
+
+struct ypreq_page {
+	domainname domain;
+	mapname map;
+	keydat_t token;
+	u_int count;
+	u_int maxbytes;
+};
+typedef struct ypreq_page ypreq_page;
+
+struct ypresp_page {
+	ypstat status;
+	struct {
+		u_int entries_len;
+		ypmap_entry *entries_val;
+	} entries;
+	keydat_t token;
+};
+typedef struct ypresp_page ypresp_page;
+
+/* YPPROC_CHANGES of version 3 returns the changes of a map since
+   the version with the given order number, as far as the journal
+   of the map has them, else the status is YP_NOMORE. Like with
+   YPPROC_ALL, the changes follow the status one after the other,
+   each with a leading TRUE, and a FALSE after the last one. They
+   are not kept in memory, but taken from or given to the function
+   change. For encoding, change fills in the next change and returns
+   1, or 0 after the last one. A NULL change starts from the
+   beginning again. For decoding, change gets every change. If it
+   returns -1, encoding or decoding fails. */
+#define YPCHANGE_STORE 1
+#define YPCHANGE_DELETE 2
+
+struct ypreq_changes {
+	domainname domain;
+	mapname map;
+	u_int ordernum;
+};
+typedef struct ypreq_changes ypreq_changes;
+
+struct ypchange {
+	u_int op;
+	keydat_t keydat;
+	valdat_t valdat;
+};
+typedef struct ypchange ypchange;
+
+struct ypresp_changes {
+	ypstat status;
+	u_int ordernum;		/* of the map with all changes */
+	int (*change) (ypchange *, void *);
+	void (*release) (void *);
+	void *data;
+};
+typedef struct ypresp_changes ypresp_changes;
+
 #define YPBIND_ERR_ERR 1
 #define YPBIND_ERR_NOSERV 2
 #define YPBIND_ERR_RESC 3
@@ -85,6 +188,13 @@ extern  bool_t ypproc_maplist_2_svc(domainname *, ypresp_maplist *, struct svc_r
 #define YPPROC_NEWXFR 12
 extern  enum clnt_stat ypproc_newxfr_2(ypreq_newxfr *, ypresp_xfr *, CLIENT *);
 extern  bool_t ypproc_newxfr_2_svc(ypreq_newxfr *, ypresp_xfr *, struct svc_req *);
+#define YPPROC_MATCH_MULTI 13
+extern  bool_t ypproc_match_multi_3_svc(ypreq_match_multi *, ypresp_match_multi *, struct svc_req *);
+#define YPPROC_NEXT_PAGE 14
+extern  bool_t ypproc_next_page_3_svc(ypreq_page *, ypresp_page *, struct svc_req *);
+#define YPPROC_CHANGES 15
+extern  enum clnt_stat ypproc_changes_3(ypreq_changes *, ypresp_changes *, CLIENT *);
+extern  bool_t ypproc_changes_3_svc(ypreq_changes *, ypresp_changes *, struct svc_req *);
 
 extern int ypprog_2_freeresult (SVCXPRT *, xdrproc_t, caddr_t);
 
@@ -158,6 +268,15 @@ extern  bool_t xdr_ypresp_all (XDR *, ypresp_all*);
 extern  bool_t xdr_ypresp_xfr (XDR *, ypresp_xfr*);
 extern  bool_t xdr_ypmaplist (XDR *, ypmaplist*);
 extern  bool_t xdr_ypresp_maplist (XDR *, ypresp_maplist*);
+extern  bool_t xdr_ypmatch_multi_key (XDR *, ypmatch_multi_key*);
+extern  bool_t xdr_ypreq_match_multi (XDR *, ypreq_match_multi*);
+extern  bool_t xdr_ypresp_match_multi (XDR *, ypresp_match_multi*);
+extern  bool_t xdr_ypmap_entry (XDR *, ypmap_entry*);
+extern  bool_t xdr_ypreq_page (XDR *, ypreq_page*);
+extern  bool_t xdr_ypresp_page (XDR *, ypresp_page*);
+extern  bool_t xdr_ypchange (XDR *, ypchange*);
+extern  bool_t xdr_ypreq_changes (XDR *, ypreq_changes*);
+extern  bool_t xdr_ypresp_changes (XDR *, ypresp_changes*);
 extern  bool_t xdr_yppush_status (XDR *, yppush_status*);
 extern  bool_t xdr_yppushresp_xfr (XDR *, yppushresp_xfr*);
 
@@ -19,17 +19,32 @@
 #include "config.h"
 #endif
 
+#include <time.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <assert.h>
+#include <stdint.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 #include <sys/param.h>
+#if defined(HAVE_SYS_INOTIFY_H)
+#include <sys/inotify.h>
+#endif
 
 #include "ypserv_conf.h"
 #include "log_msg.h"
 #include "yp_db.h"
+#include "ypc.h"
+#include "ypj.h"
+#include "ypdb_cursor.h"
 #include "yp.h"
 
 #if defined(HAVE_LIBGDBM)
@@ -44,9 +59,14 @@
 
 #if defined(HAVE_COMPAT_LIBGDBM)
 
+#define _db_fetch(a,b) gdbm_fetch(a,b)
+#define _db_exists(a,b) gdbm_exists(a,b)
+#define _db_firstkey(a) gdbm_firstkey(a)
+#define _db_nextkey(a,b) gdbm_nextkey(a,b)
+
 /* Open a GDBM database */
 static GDBM_FILE
-_db_open (const char *domain, const char *map)
+_db_open_native (const char *domain, const char *map)
 {
   GDBM_FILE dbp;
   char *buf = NULL;
@@ -68,7 +88,7 @@ _db_open (const char *domain, const char *map)
 }
 
 static inline int
-_db_close (GDBM_FILE file)
+_db_close_native (GDBM_FILE file)
 {
   gdbm_close (file);
   return 0;
@@ -80,17 +100,19 @@ _db_close (GDBM_FILE file)
   The following stuff is for NDBM suport !
 ******************************************************/
 
+#define _db_fetch(a,b) dbm_fetch(a,b)
+#define _db_firstkey(a) dbm_firstkey(a)
+
 /* Open a NDBM database */
-static DB_FILE
-_db_open (const char *domain, const char *map)
+static DB_NATIVE
+_db_open_native (const char *domain, const char *map)
 {
-  DB_FILE dbp;
+  DB_NATIVE dbp;
   char buf[MAXPATHLEN + 2];
 
-  if (strlen (domain) + strlen (map) < MAXPATHLEN)
+  if ((size_t) snprintf (buf, sizeof (buf), "%s/%s", domain, map)
+      < sizeof (buf))
     {
-      sprintf (buf, "%s/%s", domain, map);
-
       dbp = dbm_open (buf, O_RDONLY, 0600);
 
       if (debug_flag && dbp == NULL)
@@ -108,14 +130,14 @@ _db_open (const char *domain, const char *map)
 }
 
 static inline int
-_db_close (DB_FILE file)
+_db_close_native (DB_NATIVE file)
 {
   dbm_close (file);
   return 0;
 }
 
-int
-ypdb_exists (DB_FILE dbp, datum key)
+static int
+_db_exists (DB_NATIVE dbp, datum key)
 {
   datum tmp = dbm_fetch (dbp, key);
 
@@ -125,8 +147,8 @@ ypdb_exists (DB_FILE dbp, datum key)
     return 0;
 }
 
-datum
-ypdb_nextkey (DB_FILE file, datum key)
+static datum
+_db_nextkey (DB_NATIVE file, datum key)
 {
   datum tkey;
 
@@ -143,6 +165,38 @@ ypdb_nextkey (DB_FILE file, datum key)
   return tkey;
 }
 
+/* The position of dbm_nextkey is part of the handle, so a cursor
+   needs a handle of its own. */
+#define YPDB_USE_CURSORS 1
+
+typedef DBM *DB_CURSOR;
+
+static DB_CURSOR
+_db_cursor_new (DB_FILE dbp, datum key, datum *next)
+{
+  DB_CURSOR cur = _db_open_native (dbp->domain, dbp->map);
+
+  if (cur == NULL)
+    {
+      *next = _db_nextkey (dbp->db, key);
+      return NULL;
+    }
+  *next = _db_nextkey (cur, key);
+  return cur;
+}
+
+static inline datum
+_db_cursor_next (DB_CURSOR cur)
+{
+  return dbm_nextkey (cur);
+}
+
+static inline void
+_db_cursor_close (DB_CURSOR cur)
+{
+  dbm_close (cur);
+}
+
 #elif defined(HAVE_LIBTC)
 
 /*****************************************************
@@ -150,17 +204,16 @@ ypdb_nextkey (DB_FILE file, datum key)
 ******************************************************/
 
 /* Open a Tokyo Cabinet B+ Tree database */
-static DB_FILE
-_db_open (const char *domain, const char *map)
+static DB_NATIVE
+_db_open_native (const char *domain, const char *map)
 {
-  DB_FILE dbp;
+  DB_NATIVE dbp;
   char buf[MAXPATHLEN + 2];
   int isok;
 
-  if (strlen (domain) + strlen (map) < MAXPATHLEN)
+  if ((size_t) snprintf (buf, sizeof (buf), "%s/%s", domain, map)
+      < sizeof (buf))
     {
-      sprintf (buf, "%s/%s", domain, map);
-
       dbp = tcbdbnew ();
       isok = tcbdbopen (dbp, buf, BDBOREADER | BDBONOLCK);
 
@@ -189,7 +242,7 @@ _db_open (const char *domain, const char *map)
 }
 
 static inline int
-_db_close (DB_FILE dbp)
+_db_close_native (DB_NATIVE dbp)
 {
   tcbdbclose (dbp);
   tcbdbdel (dbp);
@@ -197,8 +250,8 @@ _db_close (DB_FILE dbp)
   return 0;
 }
 
-datum
-ypdb_firstkey (DB_FILE dbp)
+static datum
+_db_firstkey (DB_NATIVE dbp)
 {
   datum tkey;
   BDBCUR *cur;
@@ -217,14 +270,14 @@ ypdb_firstkey (DB_FILE dbp)
   return tkey;
 }
 
-int
-ypdb_exists (DB_FILE dbp, datum key)
+static int
+_db_exists (DB_NATIVE dbp, datum key)
 {
   return tcbdbvnum (dbp, key.dptr, key.dsize) > 0;
 }
 
-datum
-ypdb_nextkey (DB_FILE dbp, datum key)
+static datum
+_db_nextkey (DB_NATIVE dbp, datum key)
 {
   datum tkey;
   BDBCUR *cur;
@@ -247,8 +300,54 @@ ypdb_nextkey (DB_FILE dbp, datum key)
   return tkey;
 }
 
-datum
-ypdb_fetch (DB_FILE bdb, datum key)
+#define YPDB_USE_CURSORS 1
+
+typedef BDBCUR *DB_CURSOR;
+
+/* Like _db_nextkey, but the cursor is returned to continue with */
+static DB_CURSOR
+_db_cursor_new (DB_FILE dbp, datum key, datum *next)
+{
+  BDBCUR *cur;
+
+  next->dptr = NULL;
+  next->dsize = 0;
+
+  if (!(cur = tcbdbcurnew (dbp->db)))
+    return NULL;
+
+  if (tcbdbcurjump (cur, key.dptr, key.dsize) && tcbdbcurnext (cur))
+    {
+      if ((next->dptr = tcbdbcurkey (cur, &next->dsize)) == NULL)
+	next->dsize = 0;
+    }
+
+  return cur;
+}
+
+static datum
+_db_cursor_next (DB_CURSOR cur)
+{
+  datum tkey;
+
+  tkey.dptr = NULL;
+  tkey.dsize = 0;
+
+  if (tcbdbcurnext (cur) &&
+      (tkey.dptr = tcbdbcurkey (cur, &tkey.dsize)) == NULL)
+    tkey.dsize = 0;
+
+  return tkey;
+}
+
+static inline void
+_db_cursor_close (DB_CURSOR cur)
+{
+  tcbdbcurdel (cur);
+}
+
+static datum
+_db_fetch (DB_NATIVE bdb, datum key)
 {
   datum res;
 
@@ -264,265 +363,1909 @@ ypdb_fetch (DB_FILE bdb, datum key)
 
 #endif
 
-typedef struct _fopen
+/* With "memory_maps: MAP..." in ypserv.conf, the selected maps are
+   read completely into memory when they are opened, if they are not
+   larger than memory_max bytes. All keys and values are stored one
+   after another in one arena, an open addressing hash table with
+   linear probing contains the index of the records. A fetch needs
+   no call of the database library and no system call, iteration
+   returns the keys in the order of the database file.
+
+   The records are only read, so no locking is necessary. The map
+   is freed if the handle is closed, like after YPPROC_CLEAR. */
+
+struct ypdb_mem
 {
-  char *domain;
-  char *map;
-  DB_FILE dbp;
-  int flag;
+  char *arena;
+  size_t arena_size;
+  ypc_rec_t *recs;
+  uint32_t nrecs;
+  uint32_t *slots;		/* index of record + 1, 0 if empty */
+  uint32_t mask;
+  void *file;			/* mapping of a ypc file, or NULL */
+  size_t file_size;
+};
+
+static void
+memmap_free (struct ypdb_mem *mem)
+{
+  if (mem->file != NULL)
+    munmap (mem->file, mem->file_size);
+  else
+    {
+      free (mem->arena);
+      free (mem->recs);
+      free (mem->slots);
+    }
+  free (mem);
 }
-Fopen, *FopenP;
 
-#define F_OPEN_FLAG 1
-#define F_MUST_CLOSE 2
+/* Bytes of memory used by a map loaded into memory. A mapped ypc
+   file is not counted, its pages are shared with the page cache. */
+static size_t
+memmap_size (const struct ypdb_mem *mem)
+{
+  if (mem == NULL || mem->file != NULL)
+    return 0;
 
-static int fast_open_init = -1;
-static Fopen fast_open_files[255];
+  return mem->arena_size + mem->nrecs * sizeof (ypc_rec_t) +
+    ((size_t) mem->mask + 1) * sizeof (uint32_t);
+}
 
-int
-ypdb_close_all (void)
+/* Returns the index of the record with key, or -1 */
+static long
+memmap_find (const struct ypdb_mem *mem, datum key)
 {
-  int i;
+  uint32_t h, i;
 
-  if (debug_flag)
-    log_msg ("ypdb_close_all() called");
+  if (key.dptr == NULL || key.dsize < 0)
+    return -1;
 
-  if (fast_open_init == -1)
-    return 0;
+  h = ypc_hash (key.dptr, key.dsize);
+  for (i = h & mem->mask; mem->slots[i] != 0; i = (i + 1) & mem->mask)
+    {
+      const ypc_rec_t *r = &mem->recs[mem->slots[i] - 1];
+
+      if (r->hash == h && r->klen == (uint32_t) key.dsize &&
+	  memcmp (mem->arena + r->off, key.dptr, key.dsize) == 0)
+	return mem->slots[i] - 1;
+    }
+
+  return -1;
+}
+
+/* Return a malloc'ed copy, like the database libraries do */
+static datum
+memmap_copy (const char *p, size_t len)
+{
+  datum res;
+
+  if ((res.dptr = malloc (len ? len : 1)) == NULL)
+    res.dsize = 0;
+  else
+    {
+      memcpy (res.dptr, p, len);
+      res.dsize = len;
+    }
+  return res;
+}
+
+#if defined(HAVE_NDBM)
+
+static struct ypdb_mem *
+memmap_load (DB_NATIVE db UNUSED, const char *domain UNUSED,
+	     const char *map UNUSED)
+{
+  /* Not supported, ypserv iterates NDBM maps with dbm_nextkey on
+     the handle of the library. */
+  return NULL;
+}
+
+#else
+
+static int
+memmap_append (struct ypdb_mem *mem, size_t *arena_alloc,
+	       uint32_t *recs_alloc, datum key, datum val)
+{
+  ypc_rec_t *r;
+  size_t need = (size_t) key.dsize + val.dsize;
+
+  if (mem->arena_size + need > memory_max)
+    return -1;
 
-  for (i = 0; i < cached_filehandles; i++)
+  if (mem->arena_size + need > *arena_alloc)
     {
-      if (fast_open_files[i].dbp != NULL)
-	{
-	  if (fast_open_files[i].flag & F_OPEN_FLAG)
-	    {
-	      if (debug_flag)
-		log_msg ("ypdb_close_all (%s/%s|%d) MARKED_TO_BE_CLOSE",
-			 fast_open_files[i].domain,
-			 fast_open_files[i].map, i);
-	      fast_open_files[i].flag |= F_MUST_CLOSE;
-	    }
-	  else
-	    {
-	      if (debug_flag)
-		log_msg ("ypdb_close_all (%s/%s|%d)",
-			 fast_open_files[i].domain,
-			 fast_open_files[i].map, i);
-	      free (fast_open_files[i].domain);
-	      fast_open_files[i].domain = NULL;
-	      free (fast_open_files[i].map);
-	      fast_open_files[i].map = NULL;
-	      _db_close (fast_open_files[i].dbp);
-	      fast_open_files[i].dbp = NULL;
-	      fast_open_files[i].flag = 0;
-	    }
-	}
+      size_t n = *arena_alloc ? *arena_alloc : 65536;
+      char *tmp;
+
+      while (n < mem->arena_size + need)
+	n *= 2;
+      if (n > memory_max)
+	n = memory_max;
+      if ((tmp = realloc (mem->arena, n)) == NULL)
+	return -1;
+      mem->arena = tmp;
+      *arena_alloc = n;
+    }
+  if (mem->nrecs == *recs_alloc)
+    {
+      uint32_t n = *recs_alloc ? *recs_alloc * 2 : 1024;
+      ypc_rec_t *tmp;
+
+      if ((tmp = realloc (mem->recs, n * sizeof (ypc_rec_t))) == NULL)
+	return -1;
+      mem->recs = tmp;
+      *recs_alloc = n;
     }
 
+  r = &mem->recs[mem->nrecs++];
+  r->hash = ypc_hash (key.dptr, key.dsize);
+  r->klen = key.dsize;
+  r->vlen = val.dsize;
+  r->unused = 0;
+  r->off = mem->arena_size;
+  memcpy (mem->arena + r->off, key.dptr, key.dsize);
+  memcpy (mem->arena + r->off + key.dsize, val.dptr, val.dsize);
+  mem->arena_size += need;
+
   return 0;
 }
 
-int
-ypdb_close (DB_FILE file)
+/* Read all records of the map into memory. Returns NULL if the map
+   is too large or there is not enough memory. */
+static struct ypdb_mem *
+memmap_load (DB_NATIVE db, const char *domain, const char *map)
 {
-  if (debug_flag)
-    log_msg ("ypdb_close() called");
+  struct ypdb_mem *mem;
+  size_t arena_alloc = 0;
+  uint32_t recs_alloc = 0, nslots, i;
+  datum key;
 
-  if (cached_filehandles > 0)
+  if ((mem = calloc (1, sizeof (struct ypdb_mem))) == NULL)
+    return NULL;
+
+  key = _db_firstkey (db);
+  while (key.dptr != NULL)
     {
-      if (fast_open_init != -1)
-	{
-	  int i;
+      datum tkey, val = _db_fetch (db, key);
 
-	  for (i = 0; i < cached_filehandles; ++i)
-	    {
-	      if (fast_open_files[i].dbp == file)
-		{
-		  if (fast_open_files[i].flag & F_MUST_CLOSE)
-		    {
-		      if (debug_flag)
-			log_msg ("ypdb_MUST_close (%s/%s|%d)",
-				 fast_open_files[i].domain,
-				 fast_open_files[i].map, i);
-		      free (fast_open_files[i].domain);
-		      fast_open_files[i].domain = NULL;
-		      free (fast_open_files[i].map);
-		      fast_open_files[i].map = NULL;
-		      _db_close (fast_open_files[i].dbp);
-		      fast_open_files[i].dbp = NULL;
-		      fast_open_files[i].flag = 0;
-		    }
-		  else
-		    {
-		      fast_open_files[i].flag &= ~F_OPEN_FLAG;
-		    }
-		  return 0;
-		}
-	    }
+      if (val.dptr != NULL &&
+	  memmap_append (mem, &arena_alloc, &recs_alloc, key, val) < 0)
+	{
+	  if (mem->arena_size + key.dsize + val.dsize > memory_max)
+	    log_msg ("%s/%s is larger than memory_max, not loaded",
+		     domain, map);
+	  else
+	    log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+		     __FILE__, __LINE__);
+	  ypdb_free (val.dptr);
+	  ypdb_free (key.dptr);
+	  memmap_free (mem);
+	  return NULL;
 	}
-      log_msg ("ERROR: Could not close file!");
-      return 1;
+      ypdb_free (val.dptr);
+
+      tkey = key;
+      key = _db_nextkey (db, tkey);
+      ypdb_free (tkey.dptr);
     }
-  else
+
+  /* Not more than half of the slots are used */
+  for (nslots = 16; nslots < mem->nrecs * 2; nslots <<= 1)
+    ;
+  if ((mem->slots = calloc (nslots, sizeof (uint32_t))) == NULL)
     {
-      _db_close (file);
-      return 0;
+      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	       __FILE__, __LINE__);
+      memmap_free (mem);
+      return NULL;
+    }
+  mem->mask = nslots - 1;
+
+  for (i = 0; i < mem->nrecs; i++)
+    {
+      uint32_t j = mem->recs[i].hash & mem->mask;
+
+      while (mem->slots[j] != 0)
+	j = (j + 1) & mem->mask;
+      mem->slots[j] = i + 1;
     }
+
+  if (debug_flag)
+    log_msg ("Loaded %s/%s into memory: %u records, %zu bytes",
+	     domain, map, mem->nrecs, mem->arena_size);
+
+  return mem;
 }
 
-DB_FILE
-ypdb_open (const char *domain, const char *map)
+#endif
+
+#if !defined(HAVE_NDBM)
+/* ypc files checked already, so that the records and hash slots of
+   a file are validated only once and not with every open. A file is
+   known by device, inode, modification time and size. */
+#define YPC_CHECKED 64
+
+typedef struct ypc_checked
 {
-  int i;
+  dev_t dev;
+  ino_t ino;
+  struct timespec mtime;
+  off_t size;
+  int valid;
+} ypc_checked_t;
+
+static ypc_checked_t ypc_checked[YPC_CHECKED];
+static unsigned int nr_ypc_checked = 0;
+static pthread_mutex_t ypc_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t ypc_once = PTHREAD_ONCE_INIT;
+
+static void
+ypc_prepare (void)
+{
+  pthread_mutex_lock (&ypc_lock);
+}
 
-  if (debug_flag)
-    log_msg ("\typdb_open(\"%s\", \"%s\")", domain, map);
+static void
+ypc_release (void)
+{
+  pthread_mutex_unlock (&ypc_lock);
+}
 
-  if (map[0] == '.' || strchr (map, '/'))
+/* ypproc_all and ypproc_xfr fork, the child opens maps, too */
+static void
+ypc_setup (void)
+{
+  pthread_atfork (ypc_prepare, ypc_release, ypc_release);
+}
+
+static int
+ypc_same_file (const ypc_checked_t *c, const struct stat *st)
+{
+  return c->dev == st->st_dev && c->ino == st->st_ino &&
+    c->mtime.tv_sec == st->st_mtim.tv_sec &&
+    c->mtime.tv_nsec == st->st_mtim.tv_nsec && c->size == st->st_size;
+}
+
+/* Returns 1 if the file was found valid, 0 if it is broken, or -1 if
+   it was not checked yet. */
+static int
+ypc_lookup_checked (const struct stat *st)
+{
+  unsigned int i;
+  int valid = -1;
+
+  pthread_once (&ypc_once, ypc_setup);
+  pthread_mutex_lock (&ypc_lock);
+  for (i = 0; i < nr_ypc_checked && i < YPC_CHECKED; i++)
+    if (ypc_same_file (&ypc_checked[i], st))
+      {
+	valid = ypc_checked[i].valid;
+	break;
+      }
+  pthread_mutex_unlock (&ypc_lock);
+
+  return valid;
+}
+
+/* Remember the result, the oldest one is replaced */
+static void
+ypc_add_checked (const struct stat *st, int valid)
+{
+  ypc_checked_t *c;
+
+  pthread_once (&ypc_once, ypc_setup);
+  pthread_mutex_lock (&ypc_lock);
+  c = &ypc_checked[nr_ypc_checked++ % YPC_CHECKED];
+  c->dev = st->st_dev;
+  c->ino = st->st_ino;
+  c->mtime = st->st_mtim;
+  c->size = st->st_size;
+  c->valid = valid;
+  pthread_mutex_unlock (&ypc_lock);
+}
+
+/* The records must be inside the data section and every hash slot
+   must point to a record, else a lookup could read outside of the
+   mapping. */
+static int
+ypc_check_records (const struct ypdb_mem *mem, const ypc_header_t *hdr)
+{
+  uint32_t i, used = 0;
+
+  for (i = 0; i < hdr->nrecs; i++)
+    if (mem->recs[i].off > mem->arena_size ||
+	(uint64_t) mem->recs[i].klen + mem->recs[i].vlen >
+	mem->arena_size - mem->recs[i].off)
+      return 0;
+  for (i = 0; i < hdr->nslots; i++)
+    if (mem->slots[i] > hdr->nrecs)
+      return 0;
+    else if (mem->slots[i] != 0)
+      ++used;
+  /* There must be an empty slot, else a lookup would not end */
+  return used < hdr->nslots;
+}
+
+/* With makedbm --mmap, there is a ypc file next to the map, which
+   is used instead of the database library. It is mapped read only,
+   so all ypserv processes share the pages with the page cache. A new
+   version is installed with rename, the old mapping stays valid
+   until the handle is closed. The ypc file is only used, if the
+   database is still the one it was written with. If ypxfr or
+   makedbm without --mmap replaced the map, it is out of date. */
+static struct ypdb_mem *
+ypc_open_map (const char *domain, const char *map)
+{
+  char path[MAXPATHLEN];
+  const ypc_header_t *hdr;
+  ypc_header_t h;
+  struct ypdb_mem *mem;
+  struct stat st, dbst;
+  void *p;
+  int fd, valid;
+
+  if ((size_t) snprintf (path, sizeof (path), "%s/%s%s", domain, map,
+			 YPC_SUFFIX) >= sizeof (path))
+    return NULL;
+
+  /* Look at the database, without the suffix */
+  path[strlen (path) - strlen (YPC_SUFFIX)] = '\0';
+  if (stat (path, &dbst) < 0)
+    return NULL;
+  strcat (path, YPC_SUFFIX);
+
+  if ((fd = open (path, O_RDONLY | O_CLOEXEC)) < 0)
+    return NULL;
+  if (fstat (fd, &st) < 0 || (size_t) st.st_size < sizeof (ypc_header_t) ||
+      pread (fd, &h, sizeof (h), 0) != (ssize_t) sizeof (h) ||
+      memcmp (h.magic, YPC_MAGIC, sizeof (h.magic)) != 0)
+    {
+      close (fd);
+      log_msg ("%s: invalid ypc file, ignored", path);
+      return NULL;
+    }
+  if (h.db_dev != (uint64_t) dbst.st_dev ||
+      h.db_ino != (uint64_t) dbst.st_ino ||
+      h.db_mtime != (int64_t) dbst.st_mtim.tv_sec ||
+      h.db_mtime_nsec != (uint32_t) dbst.st_mtim.tv_nsec)
     {
+      close (fd);
       if (debug_flag)
-	log_msg ("\t\t->Returning 0");
+	log_msg ("%s: not written with %s/%s, ignored", path, domain, map);
+      return NULL;
+    }
+  if ((valid = ypc_lookup_checked (&st)) == 0)
+    {
+      close (fd);
       return NULL;
     }
 
-  if (cached_filehandles > 0)
+  p = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (p == MAP_FAILED)
     {
-      /* First call, initialize the fast_open_init struct */
-      if (fast_open_init == -1)
-	{
-	  fast_open_init = 0;
-	  for (i = 0; i < cached_filehandles; i++)
-	    {
-	      fast_open_files[i].domain =
-		fast_open_files[i].map = NULL;
-	      fast_open_files[i].dbp = (DB_FILE) NULL;
-	      fast_open_files[i].flag = 0;
-	    }
-	}
+      log_msg ("Cannot map %s: %s", path, strerror (errno));
+      return NULL;
+    }
 
-      /* Search if we have already open the domain/map file */
-      for (i = 0; i < cached_filehandles; i++)
-	{
-	  if (fast_open_files[i].dbp != NULL)
-	    {
-	      if ((strcmp (domain, fast_open_files[i].domain) == 0) &&
-		  (strcmp (map, fast_open_files[i].map) == 0))
-		{
-		  /* The file is open and we know the file handle */
-		  if (debug_flag)
-		    log_msg ("Found: %s/%s (%d)", fast_open_files[i].domain,
-			     fast_open_files[i].map, i);
-
-		  if (fast_open_files[i].flag & F_OPEN_FLAG)
-		    {
-		      /* The file is already in use, don't open it twice.
-			 I think this could never happen. */
-		      log_msg ("\t%s/%s already open.", domain, map);
-		      return NULL;
-		    }
-		  else
-		    {
-		      /* Mark the file as open */
-		      fast_open_files[i].flag |= F_OPEN_FLAG;
-		      return fast_open_files[i].dbp;
-		    }
-		}
-	    }
-	}
+  if ((mem = calloc (1, sizeof (struct ypdb_mem))) == NULL)
+    {
+      munmap (p, st.st_size);
+      return NULL;
+    }
+  mem->file = p;
+  mem->file_size = st.st_size;
+
+  /* Don't trust the file, a broken one should not crash ypserv */
+  hdr = p;
+  if (memcmp (hdr->magic, YPC_MAGIC, sizeof (hdr->magic)) != 0 ||
+      hdr->byteorder != YPC_BYTEORDER || hdr->size != mem->file_size ||
+      hdr->nslots == 0 || (hdr->nslots & (hdr->nslots - 1)) != 0 ||
+      hdr->nrecs >= hdr->nslots ||
+      hdr->recs_off % 8 != 0 || hdr->slots_off % 4 != 0 ||
+      hdr->recs_off < sizeof (ypc_header_t) ||
+      hdr->recs_off + (uint64_t) hdr->nrecs * sizeof (ypc_rec_t)
+      > hdr->slots_off ||
+      hdr->slots_off + (uint64_t) hdr->nslots * sizeof (uint32_t)
+      > hdr->data_off || hdr->data_off > hdr->size)
+    goto invalid;
+
+  mem->arena = (char *) p + hdr->data_off;
+  mem->arena_size = hdr->size - hdr->data_off;
+  mem->recs = (void *) ((char *) p + hdr->recs_off);
+  mem->nrecs = hdr->nrecs;
+  mem->slots = (void *) ((char *) p + hdr->slots_off);
+  mem->mask = hdr->nslots - 1;
+
+  if (valid < 0)
+    {
+      if (!ypc_check_records (mem, hdr))
+	goto invalid;
+      ypc_add_checked (&st, 1);
+    }
 
-      /* Search for free entry. If we do not found one, close the LRU */
-      for (i = 0; i < cached_filehandles; i++)
-	{
-#if 0
-	  /* Bad Idea. If one of them is NULL, we will get a seg.fault
-	     I think it will only work with Linux libc 5.x */
-	  log_msg ("Opening: %s/%s (%d) %x",
-		   fast_open_files[i].domain,
-		   fast_open_files[i].map,
-		   i, fast_open_files[i].dbp);
+  if (debug_flag)
+    log_msg ("Using %s: %u records", path, mem->nrecs);
+
+  return mem;
+
+ invalid:
+  log_msg ("%s: invalid ypc file, ignored", path);
+  ypc_add_checked (&st, 0);
+  memmap_free (mem);
+  return NULL;
+}
 #endif
-	  if (fast_open_files[i].dbp == NULL)
-	    {
-	      /* Good, we have a free entry and don't need to close a map */
-	      int j;
-	      Fopen tmp;
-
-	      if ((fast_open_files[i].dbp = _db_open (domain, map)) == NULL)
-		return NULL;
-	      /* since .dbp is NULL, .domain must be NULL, too */
-	      assert (fast_open_files[i].domain == NULL);
-	      fast_open_files[i].domain = strdup (domain);
-	      /* since .dbp is NULL, .map must be NULL, too */
-	      assert (fast_open_files[i].map == NULL);
-	      fast_open_files[i].map = strdup (map);
-	      fast_open_files[i].flag |= F_OPEN_FLAG;
 
-	      if (debug_flag)
-		log_msg ("Opening: %s/%s (%d) %x", domain, map, i,
-			 fast_open_files[i].dbp);
+/* Does the map match one of the patterns in list, which are
+   separated by blanks or commas ? */
+int
+ypdb_map_in_list (const char *list, const char *map)
+{
+  const char *p = list;
 
-	      /* LRU: put this entry at the first position, move all the other
-		 one back */
-	      tmp = fast_open_files[i];
-	      for (j = i; j >= 1; --j)
-		fast_open_files[j] = fast_open_files[j-1];
+  if (p == NULL)
+    return 0;
 
-	      fast_open_files[0] = tmp;
-	      return fast_open_files[0].dbp;
-	    }
+  while (*p)
+    {
+      size_t len;
+
+      while (*p == ' ' || *p == '\t' || *p == ',')
+	p++;
+      len = strcspn (p, " \t,");
+      if (len > 0 && len < MAXPATHLEN)
+	{
+	  char pattern[MAXPATHLEN];
+
+	  memcpy (pattern, p, len);
+	  pattern[len] = '\0';
+	  if (fnmatch (pattern, map, 0) == 0)
+	    return 1;
 	}
+      p += len;
+    }
 
-      /* The badest thing, which could happen: no free cache entrys.
-	 Search the last entry, which isn't in use. */
-      for (i = (cached_filehandles - 1); i > 0; --i)
-	if ((fast_open_files[i].flag & F_OPEN_FLAG) != F_OPEN_FLAG)
-	  {
-	    int j;
-	    Fopen tmp;
-	    DB_FILE dbp;
-
-	    /* Check, if we can open the file. Else there is no reason
-	       to close a cached handle.  */
-	    if ((dbp = _db_open (domain, map)) == NULL)
-	      return NULL;
-
-	    if (debug_flag)
-	      {
-		log_msg ("Closing %s/%s (%d)",
-			 fast_open_files[i].domain,
-			 fast_open_files[i].map, i);
-		log_msg ("Opening: %s/%s (%d)", domain, map, i);
-	      }
-	    free (fast_open_files[i].domain);
-	    free (fast_open_files[i].map);
-	    _db_close (fast_open_files[i].dbp);
-
-	    fast_open_files[i].domain = strdup (domain);
-	    fast_open_files[i].map = strdup (map);
-	    fast_open_files[i].flag = F_OPEN_FLAG;
-	    fast_open_files[i].dbp = dbp;
-
-	    /* LRU: Move the new entry to the first positon */
-	    tmp = fast_open_files[i];
-	    for (j = i; j >= 1; --j)
-	      fast_open_files[j] = fast_open_files[j-1];
-
-	    fast_open_files[j] = tmp;
-	    return fast_open_files[j].dbp;
-	  }
+  return 0;
+}
 
-      log_msg ("ERROR: Couldn't find a free cache entry!");
+/* Should the map be loaded into memory ? */
+static int
+is_memory_map (const char *map)
+{
+  return ypdb_map_in_list (memory_maps, map);
+}
+
+#if defined(YPDB_USE_CURSORS)
+
+static void
+cursor_close (void *cur)
+{
+  _db_cursor_close (cur);
+}
+
+static datum
+cursor_nextkey (DB_FILE dbp, datum key)
+{
+  ypdb_cursor_t *c;
+  time_t now = time (NULL);
+  datum next;
 
-      for (i = 0; i < cached_filehandles; i++)
+  /* Only cached handles live long enough to be worth it */
+  if (cached_filehandles <= 0)
+    return _db_nextkey (dbp->db, key);
+
+  if ((c = ypdb_cursor_take (dbp, key.dptr, key.dsize, now)) != NULL)
+    next = _db_cursor_next (c->cur);
+  else
+    {
+      DB_CURSOR cur = _db_cursor_new (dbp, key, &next);
+
+      if (cur == NULL)
+	return next;
+      if ((c = ypdb_cursor_new (dbp, cur, cursor_close)) == NULL)
 	{
-	  log_msg ("Open files: %s/%s (%d) %x (%x)",
-		   fast_open_files[i].domain,
-		   fast_open_files[i].map,
-		   i, fast_open_files[i].dbp,
-		   fast_open_files[i].flag);
+	  _db_cursor_close (cur);
+	  return _db_nextkey (dbp->db, key);
 	}
+    }
+
+  if (next.dptr == NULL ||
+      ypdb_cursor_set_key (c, next.dptr, next.dsize, now) != 0)
+    {
+      /* End of the map, the cursor is not needed anymore */
+      ypdb_cursor_free (c);
+      return next;
+    }
+
+#if defined(HAVE_NDBM)
+  {
+    /* next points into the cursor handle, which another thread could
+       close after ypdb_cursor_put */
+    static __thread char keybuf[YPMAXRECORD];
+
+    if ((size_t) next.dsize <= sizeof (keybuf))
+      {
+	memcpy (keybuf, next.dptr, next.dsize);
+	next.dptr = keybuf;
+      }
+    else
+      {
+	ypdb_cursor_free (c);
+	return _db_nextkey (dbp->db, key);
+      }
+  }
+#endif
+
+  ypdb_cursor_put (c);
+  return next;
+}
+
+#endif
+
+static DB_FILE
+_db_open (const char *domain, const char *map)
+{
+  DB_FILE dbp;
+
+  if ((dbp = calloc (1, sizeof (struct ypdb_file))) == NULL)
+    {
+      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	       __FILE__, __LINE__);
       return NULL;
     }
-  else
-    return _db_open (domain, map);
+
+#if !defined(HAVE_NDBM)
+  if ((dbp->mem = ypc_open_map (domain, map)) != NULL)
+    return dbp;
+#endif
+
+  if ((dbp->db = _db_open_native (domain, map)) == NULL)
+    {
+      free (dbp);
+      return NULL;
+    }
+
+#if defined(HAVE_NDBM)
+  /* Needed to open the handle of a cursor */
+  if ((dbp->domain = strdup (domain)) == NULL ||
+      (dbp->map = strdup (map)) == NULL)
+    {
+      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	       __FILE__, __LINE__);
+      _db_close_native (dbp->db);
+      free (dbp->domain);
+      free (dbp);
+      return NULL;
+    }
+#endif
+
+  /* Only cached handles live long enough to be worth it */
+  if (cached_filehandles > 0 && is_memory_map (map) &&
+      (dbp->mem = memmap_load (dbp->db, domain, map)) != NULL)
+    {
+      _db_close_native (dbp->db);
+      dbp->db = NULL;
+    }
+
+  return dbp;
+}
+
+static int
+_db_close (DB_FILE dbp)
+{
+#if defined(YPDB_USE_CURSORS)
+  ypdb_cursor_close_all (dbp);
+#endif
+  if (dbp->mem != NULL)
+    memmap_free (dbp->mem);
+  else
+    _db_close_native (dbp->db);
+#if defined(HAVE_NDBM)
+  free (dbp->domain);
+  free (dbp->map);
+#endif
+  free (dbp->meta.master);
+  free (dbp->meta.first.dptr);
+  free (dbp);
+  return 0;
+}
+
+datum
+ypdb_fetch (DB_FILE dbp, datum key)
+{
+  if (dbp->mem != NULL)
+    {
+      long i = memmap_find (dbp->mem, key);
+      datum res = { NULL, 0 };
+
+      if (i >= 0)
+	{
+	  const ypc_rec_t *r = &dbp->mem->recs[i];
+
+	  res = memmap_copy (dbp->mem->arena + r->off + r->klen, r->vlen);
+	}
+      return res;
+    }
+
+  return _db_fetch (dbp->db, key);
+}
+
+/* Like ypdb_fetch, but a value of a map in memory is copied into buf,
+   if it fits. The caller must not free the value, if dptr is buf. */
+datum
+ypdb_fetch_into (DB_FILE dbp, datum key, char *buf, size_t size)
+{
+  if (dbp->mem != NULL)
+    {
+      long i = memmap_find (dbp->mem, key);
+      datum res = { NULL, 0 };
+
+      if (i >= 0)
+	{
+	  const ypc_rec_t *r = &dbp->mem->recs[i];
+
+	  if (r->vlen <= size)
+	    {
+	      memcpy (buf, dbp->mem->arena + r->off + r->klen, r->vlen);
+	      res.dptr = buf;
+	      res.dsize = r->vlen;
+	    }
+	  else
+	    res = memmap_copy (dbp->mem->arena + r->off + r->klen, r->vlen);
+	}
+      return res;
+    }
+
+  return _db_fetch (dbp->db, key);
+}
+
+int
+ypdb_exists (DB_FILE dbp, datum key)
+{
+  if (dbp->mem != NULL)
+    return memmap_find (dbp->mem, key) >= 0;
+
+  return _db_exists (dbp->db, key);
+}
+
+datum
+ypdb_firstkey (DB_FILE dbp)
+{
+  if (dbp->mem != NULL)
+    {
+      datum res = { NULL, 0 };
+
+      if (dbp->mem->nrecs > 0)
+	res = memmap_copy (dbp->mem->arena, dbp->mem->recs[0].klen);
+      return res;
+    }
+
+  return _db_firstkey (dbp->db);
+}
+
+datum
+ypdb_nextkey (DB_FILE dbp, datum key)
+{
+  if (dbp->mem != NULL)
+    {
+      long i = memmap_find (dbp->mem, key);
+      datum res = { NULL, 0 };
+
+      if (i >= 0 && (uint32_t) i + 1 < dbp->mem->nrecs)
+	{
+	  const ypc_rec_t *r = &dbp->mem->recs[i + 1];
+
+	  res = memmap_copy (dbp->mem->arena + r->off, r->klen);
+	}
+      return res;
+    }
+
+#if defined(YPDB_USE_CURSORS)
+  return cursor_nextkey (dbp, key);
+#else
+  return _db_nextkey (dbp->db, key);
+#endif
+}
+
+/* The cached handles are found with a hash table over domain and map.
+   All entries are also on a LRU list, the most recently used one
+   first, so the handle to close if the cache is full is found
+   without searching and without moving other entries. An entry
+   which is replaced while still in use is retired: it is removed
+   from the table and the list, and closed by the last user.
+
+   A map in memory is only read, so one handle is used by all threads
+   at the same time. A handle of the database library is used by one
+   thread at a time. If all handles of such a map are in use, another
+   one is opened, up to one per thread answering requests. So lookups
+   in a frequently used map don't wait for each other. */
+typedef struct _fopen
+{
+  char *domain;
+  char *map;
+  DB_FILE dbp;
+  int flag;
+  int users;			/* threads using the handle */
+  int pins;			/* see ypdb_pin */
+  pthread_t owner;		/* of a handle of the database library */
+  unsigned int hash;
+  size_t memsize;		/* bytes of a map loaded into memory */
+  struct _fopen *hnext;		/* hash chain */
+  struct _fopen *prev;		/* LRU list */
+  struct _fopen *next;
+}
+Fopen, *FopenP;
+
+#define F_MUST_CLOSE 2
+#define F_RETIRED 4
+
+/* At most so many handles of the database library per map */
+#define YPDB_MAX_HANDLES 16
+
+static Fopen **fast_open_hash = NULL;
+static unsigned int fast_open_hash_size = 0;
+static Fopen *lru_head = NULL;
+static Fopen *lru_tail = NULL;
+static int nr_open = 0;
+static size_t mem_open = 0;
+
+static unsigned long stat_hits = 0;
+static unsigned long stat_misses = 0;
+static unsigned long stat_evictions = 0;
+static unsigned long stat_waits = 0;
+static unsigned long stat_reloads = 0;
+
+/* ypserv may answer requests from several threads. The cache is
+   protected by fast_open_lock. If all handles of a map are in use
+   and no other one may be opened, threads wait on fast_open_cond
+   until a handle is given back by ypdb_close. */
+static pthread_mutex_t fast_open_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fast_open_cond = PTHREAD_COND_INITIALIZER;
+static pthread_once_t fast_open_once = PTHREAD_ONCE_INIT;
+/* Protects reading the metadata of a handle, see meta_load. It is
+   never taken with fast_open_lock held. */
+static pthread_mutex_t meta_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+fast_open_prepare (void)
+{
+  pthread_mutex_lock (&meta_lock);
+  pthread_mutex_lock (&fast_open_lock);
+}
+
+static void
+fast_open_release (void)
+{
+  pthread_mutex_unlock (&fast_open_lock);
+  pthread_mutex_unlock (&meta_lock);
+}
+
+static void fast_open_child (void);
+
+/* ypproc_all and ypproc_xfr fork, make sure the child does not
+   inherit a locked cache from another thread. Every cached handle
+   needs a file descriptor, leave at least half of them for the
+   connections. */
+static void
+fast_open_setup (void)
+{
+  struct rlimit rl;
+
+  pthread_atfork (fast_open_prepare, fast_open_release, fast_open_child);
+
+  if (getrlimit (RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY &&
+      (rlim_t) cached_filehandles > rl.rlim_cur / 2)
+    {
+      log_msg ("files: %d handles exceed the limit of open files, using %d",
+	       cached_filehandles, (int) (rl.rlim_cur / 2));
+      cached_filehandles = rl.rlim_cur / 2;
+    }
+}
+
+void
+ypdb_cache_stats (void)
+{
+  unsigned long hits, misses;
+
+  hits = __atomic_load_n (&stat_hits, __ATOMIC_RELAXED);
+  misses = __atomic_load_n (&stat_misses, __ATOMIC_RELAXED);
+  log_msg ("  files: %lu hits, %lu misses (%.1f%% hit ratio), "
+	   "%lu waits", hits, misses,
+	   hits + misses ? 100.0 * hits / (hits + misses) : 0.0,
+	   __atomic_load_n (&stat_waits, __ATOMIC_RELAXED));
+  log_msg ("  files: %d of %d handles open, %lu bytes in memory, "
+	   "%lu evictions, %lu reloads",
+	   __atomic_load_n (&nr_open, __ATOMIC_RELAXED), cached_filehandles,
+	   (unsigned long) __atomic_load_n (&mem_open, __ATOMIC_RELAXED),
+	   __atomic_load_n (&stat_evictions, __ATOMIC_RELAXED),
+	   __atomic_load_n (&stat_reloads, __ATOMIC_RELAXED));
+}
+
+static unsigned int
+fopen_hash (const char *domain, const char *map)
+{
+  unsigned int h = 2166136261u;
+
+  while (*domain)
+    {
+      h ^= (unsigned char) *domain++;
+      h *= 16777619u;
+    }
+  h ^= '/';
+  h *= 16777619u;
+  while (*map)
+    {
+      h ^= (unsigned char) *map++;
+      h *= 16777619u;
+    }
+  return h;
+}
+
+static Fopen *
+hash_find (const char *domain, const char *map, unsigned int h)
+{
+  Fopen *e;
+
+  if (fast_open_hash_size == 0)
+    return NULL;
+
+  for (e = fast_open_hash[h & (fast_open_hash_size - 1)]; e != NULL;
+       e = e->hnext)
+    if (e->hash == h && strcmp (e->domain, domain) == 0 &&
+	strcmp (e->map, map) == 0)
+      return e;
+  return NULL;
+}
+
+/* Can another thread use the handle now ? */
+static int
+entry_busy (const Fopen *e)
+{
+  return e->users > 0 && e->dbp->mem == NULL;
+}
+
+static int
+entry_in_use (const Fopen *e)
+{
+  return e->users > 0 || e->pins > 0;
+}
+
+/* Find a handle of domain/map, which is not busy. count is set to the
+   number of handles of the map, mine to 1 if the calling thread uses
+   one of them already. */
+static Fopen *
+hash_find_free (const char *domain, const char *map, unsigned int h,
+		int *count, int *mine)
+{
+  Fopen *e, *found = NULL;
+
+  *count = *mine = 0;
+  if (fast_open_hash_size == 0)
+    return NULL;
+
+  for (e = fast_open_hash[h & (fast_open_hash_size - 1)]; e != NULL;
+       e = e->hnext)
+    if (e->hash == h && strcmp (e->domain, domain) == 0 &&
+	strcmp (e->map, map) == 0)
+      {
+	++*count;
+	if (!entry_busy (e))
+	  {
+	    if (found == NULL)
+	      found = e;
+	  }
+	else if (pthread_equal (e->owner, pthread_self ()))
+	  *mine = 1;
+      }
+  return found;
+}
+
+/* Handles of the database library per map, one for every thread
+   answering requests */
+static int
+max_handles (void)
+{
+  int n = worker_threads + 1;
+
+  return n > YPDB_MAX_HANDLES ? YPDB_MAX_HANDLES : n;
+}
+
+/* Rebuild the table with twice the size, all entries are on the
+   LRU list. */
+static int
+hash_grow (void)
+{
+  unsigned int size = fast_open_hash_size ? fast_open_hash_size * 2 : 64;
+  Fopen **tab, *e;
+
+  if ((tab = calloc (size, sizeof (Fopen *))) == NULL)
+    return -1;
+
+  for (e = lru_head; e != NULL; e = e->next)
+    {
+      unsigned int i = e->hash & (size - 1);
+
+      e->hnext = tab[i];
+      tab[i] = e;
+    }
+  free (fast_open_hash);
+  fast_open_hash = tab;
+  fast_open_hash_size = size;
+  return 0;
+}
+
+static void
+lru_unlink (Fopen *e)
+{
+  if (e->prev)
+    e->prev->next = e->next;
+  else
+    lru_head = e->next;
+  if (e->next)
+    e->next->prev = e->prev;
+  else
+    lru_tail = e->prev;
+  e->prev = e->next = NULL;
+}
+
+static void
+lru_push_front (Fopen *e)
+{
+  e->prev = NULL;
+  e->next = lru_head;
+  if (lru_head)
+    lru_head->prev = e;
+  else
+    lru_tail = e;
+  lru_head = e;
+}
+
+/* Add a handle, which is not in use yet, to the cache. Must be called
+   with fast_open_lock held. */
+static Fopen *
+insert_entry (const char *domain, const char *map, unsigned int h,
+	      DB_FILE dbp)
+{
+  Fopen *e;
+
+  if ((unsigned int) nr_open >= fast_open_hash_size && hash_grow () < 0)
+    return NULL;
+  if ((e = calloc (1, sizeof (Fopen))) == NULL)
+    return NULL;
+  if ((e->domain = strdup (domain)) == NULL ||
+      (e->map = strdup (map)) == NULL)
+    {
+      free (e->domain);
+      free (e);
+      return NULL;
+    }
+
+  e->dbp = dbp;
+  e->hash = h;
+  e->memsize = memmap_size (dbp->mem);
+  e->hnext = fast_open_hash[h & (fast_open_hash_size - 1)];
+  fast_open_hash[h & (fast_open_hash_size - 1)] = e;
+  lru_push_front (e);
+  dbp->cache = e;
+  __atomic_store_n (&nr_open, nr_open + 1, __ATOMIC_RELAXED);
+  __atomic_store_n (&mem_open, mem_open + e->memsize, __ATOMIC_RELAXED);
+
+  return e;
+}
+
+/* Remove an entry from the table and the LRU list. Users and pins
+   keep it, but new requests get another handle. */
+static void
+retire_entry (Fopen *e)
+{
+  Fopen **pp = &fast_open_hash[e->hash & (fast_open_hash_size - 1)];
+
+  while (*pp != e)
+    pp = &(*pp)->hnext;
+  *pp = e->hnext;
+  lru_unlink (e);
+  e->flag |= F_RETIRED | F_MUST_CLOSE;
+
+  __atomic_store_n (&nr_open, nr_open - 1, __ATOMIC_RELAXED);
+  __atomic_store_n (&mem_open, mem_open - e->memsize, __ATOMIC_RELAXED);
+}
+
+static void
+close_entry (Fopen *e)
+{
+  if (!(e->flag & F_RETIRED))
+    retire_entry (e);
+
+  e->dbp->cache = NULL;
+  _db_close (e->dbp);
+  free (e->domain);
+  free (e->map);
+  free (e);
+}
+
+/* Close the least recently used handles not in use, until the
+   number of handles and the memory of the maps fit into the limits
+   again. Must be called with fast_open_lock held. */
+static void
+evict_locked (void)
+{
+  Fopen *e = lru_tail;
+
+  while (e != NULL &&
+	 (nr_open > cached_filehandles ||
+	  (cached_filememory > 0 && mem_open > cached_filememory)))
+    {
+      Fopen *prev = e->prev;
+
+      if (!entry_in_use (e))
+	{
+	  if (debug_flag)
+	    log_msg ("Closing %s/%s", e->domain, e->map);
+	  close_entry (e);
+	  __atomic_add_fetch (&stat_evictions, 1, __ATOMIC_RELAXED);
+	}
+      e = prev;
+    }
+}
+
+/* Close all cached handles, the ones in use or pinned are retired.
+   Must be called with fast_open_lock held. */
+static void
+close_all_locked (void)
+{
+  Fopen *e = lru_head;
+
+  while (e != NULL)
+    {
+      Fopen *next = e->next;
+
+      if (entry_in_use (e))
+	{
+	  if (debug_flag)
+	    log_msg ("ypdb_close_all (%s/%s) MARKED_TO_BE_CLOSE",
+		     e->domain, e->map);
+	  retire_entry (e);
+	}
+      else
+	{
+	  if (debug_flag)
+	    log_msg ("ypdb_close_all (%s/%s)", e->domain, e->map);
+	  close_entry (e);
+	}
+      e = next;
+    }
+}
+
+int
+ypdb_close_all (void)
+{
+  if (debug_flag)
+    log_msg ("ypdb_close_all() called");
+
+  pthread_mutex_lock (&fast_open_lock);
+  close_all_locked ();
+  pthread_mutex_unlock (&fast_open_lock);
+
+  return 0;
+}
+
+/* With "processes: N" in ypserv.conf, a YPPROC_CLEAR request is only
+   received by one of the ypserv processes. The map files are mapped
+   by the database library, so all processes share the pages, but
+   every process has its own handles, and its own copy of maps read
+   into memory with memory_maps. The process receiving the
+   request increases a counter in shared memory, all others compare
+   it in ypdb_open with the value they have seen last and close their
+   cached handles, if it has changed. */
+static unsigned int *clear_generation = NULL;
+static unsigned int seen_generation = 0;
+/* Without worker processes, only count the requests of this one */
+static unsigned int local_generation = 0;
+
+int
+ypdb_share_clear (void)
+{
+  void *p;
+
+  p = mmap (NULL, sizeof (unsigned int), PROT_READ | PROT_WRITE,
+	    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    {
+      log_msg ("Cannot create shared memory: %s", strerror (errno));
+      return -1;
+    }
+  clear_generation = p;
+  *clear_generation = seen_generation;
+  return 0;
+}
+
+void (*ypdb_changed_hook) (const char *domain, const char *map) = NULL;
+
+/* YPPROC_CLEAR: close all cached handles of all ypserv processes */
+int
+ypdb_clear_all (void)
+{
+  if (clear_generation != NULL)
+    __atomic_add_fetch (clear_generation, 1, __ATOMIC_SEQ_CST);
+  else
+    __atomic_add_fetch (&local_generation, 1, __ATOMIC_SEQ_CST);
+  if (ypdb_changed_hook != NULL)
+    ypdb_changed_hook (NULL, NULL);
+
+  return ypdb_close_all ();
+}
+
+/* Maps replaced by a new version, see reload_map. Counted per map
+   in a table indexed by the hash of domain/map, two maps sharing a
+   slot only drop the cached contents of the other one, too. */
+#define RELOAD_SLOTS 1024
+static unsigned int reload_generation[RELOAD_SLOTS];
+
+/* Number of YPPROC_CLEAR requests received so far by all ypserv
+   processes. Caches of map contents compare it with the value they
+   have seen last. */
+unsigned int
+ypdb_clear_generation (void)
+{
+  if (clear_generation != NULL)
+    return __atomic_load_n (clear_generation, __ATOMIC_SEQ_CST);
+  else
+    return __atomic_load_n (&local_generation, __ATOMIC_SEQ_CST);
+}
+
+/* Like ypdb_clear_generation, plus the number of times domain/map
+   was replaced in this process. */
+unsigned int
+ypdb_map_generation (const char *domain, const char *map)
+{
+  unsigned int slot = fopen_hash (domain, map) % RELOAD_SLOTS;
+
+  return ypdb_clear_generation () +
+    __atomic_load_n (&reload_generation[slot], __ATOMIC_SEQ_CST);
+}
+
+/* With "reload: yes", a thread watches the directories of the domains
+   with cached handles. makedbm and ypxfr write a new map into a
+   temporary file and rename it. If the map has a cached handle, the
+   thread opens the new file, which includes loading it into memory,
+   and replaces the entry in the cache. Requests still reading the
+   old handle, and YPPROC_ALL streams which pinned it, finish with
+   the old version of the map, the last of them closes it. */
+
+/* Wait so many ms for more events before the maps are opened,
+   makedbm renames the ypc file and the database one after the
+   other. */
+#define RELOAD_SETTLE 100
+
+typedef struct reload_watch
+{
+  int wd;
+  char *domain;
+} reload_watch_t;
+
+typedef struct reload_pending
+{
+  char *domain;
+  char *map;
+  struct reload_pending *next;
+} reload_pending_t;
+
+/* Protected by fast_open_lock */
+static reload_watch_t *reload_watches = NULL;
+static int nr_reload_watches = 0;
+static int reload_fd = -1;
+
+/* Must be called with fast_open_lock held */
+static void
+reload_watch_domain (const char *domain)
+{
+#if defined(HAVE_SYS_INOTIFY_H)
+  reload_watch_t *tmp;
+  char *name;
+  int i, wd;
+
+  if (reload_fd < 0)
+    return;
+
+  for (i = 0; i < nr_reload_watches; i++)
+    if (strcmp (reload_watches[i].domain, domain) == 0)
+      return;
+
+  if ((wd = inotify_add_watch (reload_fd, domain,
+			       IN_MOVED_TO | IN_CLOSE_WRITE)) < 0)
+    {
+      log_msg ("inotify_add_watch (%s): %s", domain, strerror (errno));
+      return;
+    }
+
+  if ((name = strdup (domain)) == NULL ||
+      (tmp = realloc (reload_watches,
+		      (nr_reload_watches + 1) * sizeof (reload_watch_t)))
+      == NULL)
+    {
+      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	       __FILE__, __LINE__);
+      free (name);
+      inotify_rm_watch (reload_fd, wd);
+      return;
+    }
+  reload_watches = tmp;
+  tmp[nr_reload_watches].domain = name;
+  tmp[nr_reload_watches].wd = wd;
+  nr_reload_watches++;
+#else
+  (void) domain;
+#endif
+}
+
+/* Returns a copy of the domain watched with wd, or NULL */
+static char *
+reload_domain (int wd)
+{
+  char *domain = NULL;
+  int i;
+
+  pthread_mutex_lock (&fast_open_lock);
+  for (i = 0; i < nr_reload_watches; i++)
+    if (reload_watches[i].wd == wd)
+      {
+	domain = strdup (reload_watches[i].domain);
+	break;
+      }
+  pthread_mutex_unlock (&fast_open_lock);
+
+  return domain;
+}
+
+/* The domain directory was removed */
+static void
+reload_unwatch (int wd)
+{
+  int i;
+
+  pthread_mutex_lock (&fast_open_lock);
+  for (i = 0; i < nr_reload_watches; i++)
+    if (reload_watches[i].wd == wd)
+      {
+	free (reload_watches[i].domain);
+	reload_watches[i] = reload_watches[--nr_reload_watches];
+	break;
+      }
+  pthread_mutex_unlock (&fast_open_lock);
+}
+
+/* The name of the map stored in the file name, or NULL for temporary
+   files. */
+static char *
+reload_map_name (const char *name)
+{
+  static const char *const suffixes[] = {
+    YPC_SUFFIX, YPJ_SUFFIX,
+#if defined(HAVE_NDBM)
+    ".db", ".pag", ".dir",
+#endif
+  };
+  size_t i, len = strlen (name);
+
+  if (len == 0 || name[0] == '.' || name[len - 1] == '~')
+    return NULL;
+
+  for (i = 0; i < sizeof (suffixes) / sizeof (suffixes[0]); i++)
+    {
+      size_t slen = strlen (suffixes[i]);
+
+      if (len > slen && strcmp (name + len - slen, suffixes[i]) == 0)
+	{
+	  len -= slen;
+	  break;
+	}
+    }
+
+  return strndup (name, len);
+}
+
+static void
+reload_queue (reload_pending_t **pending, int wd, const char *name)
+{
+  reload_pending_t *r;
+  char *domain, *map;
+
+  if ((map = reload_map_name (name)) == NULL)
+    return;
+  if ((domain = reload_domain (wd)) == NULL)
+    {
+      free (map);
+      return;
+    }
+
+  for (r = *pending; r != NULL; r = r->next)
+    if (strcmp (r->map, map) == 0 && strcmp (r->domain, domain) == 0)
+      break;
+
+  if (r != NULL || (r = malloc (sizeof (reload_pending_t))) == NULL)
+    {
+      free (domain);
+      free (map);
+      return;
+    }
+  r->domain = domain;
+  r->map = map;
+  r->next = *pending;
+  *pending = r;
+}
+
+/* Open the new version of domain/map and replace the cached handles
+   with it. The caches of the contents of this map are dropped in any
+   case, there could be entries for it without cached handle. */
+static void
+reload_map (const char *domain, const char *map)
+{
+  unsigned int h = fopen_hash (domain, map);
+  DB_FILE dbp = NULL;
+  Fopen *e;
+
+  pthread_mutex_lock (&fast_open_lock);
+  e = hash_find (domain, map, h);
+  pthread_mutex_unlock (&fast_open_lock);
+
+  if (e != NULL && (dbp = _db_open (domain, map)) == NULL && debug_flag)
+    log_msg ("Cannot reopen %s/%s, keeping old version", domain, map);
+
+  if (dbp != NULL)
+    {
+      pthread_mutex_lock (&fast_open_lock);
+      if ((e = hash_find (domain, map, h)) != NULL)
+	{
+	  do
+	    {
+	      if (entry_in_use (e))
+		retire_entry (e);
+	      else
+		close_entry (e);
+	    }
+	  while ((e = hash_find (domain, map, h)) != NULL);
+	  e = insert_entry (domain, map, h, dbp);
+	}
+      if (e != NULL)
+	{
+	  if (debug_flag)
+	    log_msg ("Reloaded %s/%s", domain, map);
+	  __atomic_add_fetch (&stat_reloads, 1, __ATOMIC_RELAXED);
+	  evict_locked ();
+	}
+      else
+	_db_close (dbp);	/* closed meanwhile or out of memory */
+      pthread_mutex_unlock (&fast_open_lock);
+    }
+
+  __atomic_add_fetch (&reload_generation[h % RELOAD_SLOTS], 1,
+		     __ATOMIC_SEQ_CST);
+  if (ypdb_changed_hook != NULL)
+    ypdb_changed_hook (domain, map);
+}
+
+#if defined(HAVE_SYS_INOTIFY_H)
+static void *
+reload_run (void *arg)
+{
+  int fd = (int) (long) arg;
+  char buf[4096]
+    __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+  reload_pending_t *pending = NULL;
+  time_t since = 0;
+
+  for (;;)
+    {
+      struct pollfd pfd;
+      ssize_t n;
+      char *p;
+      int ret;
+
+      pfd.fd = fd;
+      pfd.events = POLLIN;
+      ret = poll (&pfd, 1, pending != NULL ? RELOAD_SETTLE : -1);
+      if (ret < 0 && errno == EINTR)
+	continue;
+      if (ret < 0)
+	break;
+
+      /* Don't wait forever, if maps are installed all the time */
+      if (ret == 0 || (pending != NULL && time (NULL) - since > 1))
+	{
+	  while (pending != NULL)
+	    {
+	      reload_pending_t *r = pending;
+
+	      pending = r->next;
+	      reload_map (r->domain, r->map);
+	      free (r->domain);
+	      free (r->map);
+	      free (r);
+	    }
+	  continue;
+	}
+
+      n = read (fd, buf, sizeof (buf));
+      if (n < 0 && errno == EINTR)
+	continue;
+      if (n <= 0)
+	break;
+
+      if (pending == NULL)
+	since = time (NULL);
+
+      for (p = buf; p < buf + n;
+	   p += sizeof (struct inotify_event) +
+	     ((struct inotify_event *) p)->len)
+	{
+	  struct inotify_event *ev = (struct inotify_event *) p;
+
+	  if (ev->mask & IN_IGNORED)
+	    reload_unwatch (ev->wd);
+	  else if (ev->len > 0)
+	    reload_queue (&pending, ev->wd, ev->name);
+	}
+    }
+
+  log_msg ("reload: reading inotify events failed: %s", strerror (errno));
+  pthread_mutex_lock (&fast_open_lock);
+  if (reload_fd == fd)
+    {
+      reload_fd = -1;
+      close (fd);
+    }
+  pthread_mutex_unlock (&fast_open_lock);
+
+  return NULL;
+}
+#endif
+
+/* Start the thread reopening replaced maps. Every ypserv process
+   calls this after the worker processes were forked. */
+void
+ypdb_reload_init (void)
+{
+#if defined(HAVE_SYS_INOTIFY_H)
+  sigset_t set, oldset;
+  pthread_t tid;
+  int fd;
+#endif
+
+  if (!map_reload || cached_filehandles <= 0)
+    return;
+
+#if defined(HAVE_SYS_INOTIFY_H)
+  pthread_once (&fast_open_once, fast_open_setup);
+
+  if ((fd = inotify_init1 (IN_CLOEXEC)) < 0)
+    {
+      log_msg ("inotify_init1: %s", strerror (errno));
+      return;
+    }
+
+  pthread_mutex_lock (&fast_open_lock);
+  sigfillset (&set);
+  pthread_sigmask (SIG_BLOCK, &set, &oldset);
+  if (pthread_create (&tid, NULL, reload_run, (void *) (long) fd) != 0)
+    {
+      log_msg ("Cannot create inotify thread: %s", strerror (errno));
+      close (fd);
+    }
+  else
+    {
+      pthread_detach (tid);
+      reload_fd = fd;
+    }
+  pthread_sigmask (SIG_SETMASK, &oldset, NULL);
+  pthread_mutex_unlock (&fast_open_lock);
+#else
+  log_msg ("reload: not supported on this system, ignoring option");
+#endif
+}
+
+/* The reload thread does not exist in a child process */
+static void
+fast_open_child (void)
+{
+  int i;
+
+  if (reload_fd >= 0)
+    close (reload_fd);
+  reload_fd = -1;
+  for (i = 0; i < nr_reload_watches; i++)
+    free (reload_watches[i].domain);
+  nr_reload_watches = 0;
+  pthread_mutex_unlock (&fast_open_lock);
+  pthread_mutex_unlock (&meta_lock);
+}
+
+int
+ypdb_close (DB_FILE file)
+{
+  if (debug_flag)
+    log_msg ("ypdb_close() called");
+
+  if (cached_filehandles > 0)
+    {
+      Fopen *e;
+
+      pthread_mutex_lock (&fast_open_lock);
+      if ((e = file->cache) != NULL)
+	{
+	  if (--e->users == 0 && (e->flag & F_MUST_CLOSE) && e->pins == 0)
+	    {
+	      if (debug_flag)
+		log_msg ("ypdb_MUST_close (%s/%s)", e->domain, e->map);
+	      close_entry (e);
+	    }
+	  pthread_cond_broadcast (&fast_open_cond);
+	  pthread_mutex_unlock (&fast_open_lock);
+	  return 0;
+	}
+      pthread_mutex_unlock (&fast_open_lock);
+      log_msg ("ERROR: Could not close file!");
+      return 1;
+    }
+  else
+    {
+      _db_close (file);
+      return 0;
+    }
+}
+
+/* A YPPROC_ALL stream reads the map in several parts and gives the
+   handle back in between. It pins the handle, so it stays open even
+   if the map is replaced or YPPROC_CLEAR is called meanwhile, and
+   the stream sees one version of the map. Returns NULL, if the
+   handle is not cached. */
+struct _fopen *
+ypdb_pin (DB_FILE dbp)
+{
+  Fopen *e;
+
+  pthread_mutex_lock (&fast_open_lock);
+  if ((e = dbp->cache) != NULL)
+    e->pins++;
+  pthread_mutex_unlock (&fast_open_lock);
+
+  return e;
+}
+
+/* Use a pinned handle again, it has to be given back with ypdb_close */
+DB_FILE
+ypdb_open_pinned (struct _fopen *pin)
+{
+  Fopen *e = pin;
+
+  pthread_mutex_lock (&fast_open_lock);
+  while (entry_busy (e))
+    {
+      __atomic_add_fetch (&stat_waits, 1, __ATOMIC_RELAXED);
+      pthread_cond_wait (&fast_open_cond, &fast_open_lock);
+    }
+  e->users++;
+  e->owner = pthread_self ();
+  if (!(e->flag & F_RETIRED))
+    {
+      lru_unlink (e);
+      lru_push_front (e);
+    }
+  pthread_mutex_unlock (&fast_open_lock);
+
+  return e->dbp;
+}
+
+void
+ypdb_unpin (struct _fopen *pin)
+{
+  Fopen *e = pin;
+
+  pthread_mutex_lock (&fast_open_lock);
+  if (--e->pins == 0 && (e->flag & F_MUST_CLOSE) && e->users == 0)
+    {
+      if (debug_flag)
+	log_msg ("ypdb_MUST_close (%s/%s)", e->domain, e->map);
+      close_entry (e);
+    }
+  pthread_mutex_unlock (&fast_open_lock);
+}
+
+static DB_FILE
+cached_db_open (const char *domain, const char *map)
+{
+  unsigned int h = fopen_hash (domain, map);
+  DB_FILE dbp;
+  Fopen *e;
+  int count, mine;
+
+ again:
+  /* Search if we have already open the domain/map file */
+  if ((e = hash_find_free (domain, map, h, &count, &mine)) != NULL)
+    {
+      /* The file is open and we know the file handle */
+      if (debug_flag)
+	log_msg ("Found: %s/%s", e->domain, e->map);
+
+      e->users++;
+      e->owner = pthread_self ();
+      lru_unlink (e);
+      lru_push_front (e);
+      __atomic_add_fetch (&stat_hits, 1, __ATOMIC_RELAXED);
+      return e->dbp;
+    }
+
+  if (count >= max_handles ())
+    {
+      if (mine)
+	{
+	  /* The file is already in use by us, don't wait for
+	     ourself. I think this could never happen. */
+	  log_msg ("\t%s/%s already open.", domain, map);
+	  return NULL;
+	}
+      /* Other threads are using all handles, wait until one is
+	 given back. The cache could have changed meanwhile, so
+	 start again. */
+      __atomic_add_fetch (&stat_waits, 1, __ATOMIC_RELAXED);
+      pthread_cond_wait (&fast_open_cond, &fast_open_lock);
+      goto again;
+    }
+
+  __atomic_add_fetch (&stat_misses, 1, __ATOMIC_RELAXED);
+
+  /* Check, if we can open the file. Else there is no reason
+     to close a cached handle.  */
+  if ((dbp = _db_open (domain, map)) == NULL)
+    return NULL;
+
+  if ((e = insert_entry (domain, map, h, dbp)) == NULL)
+    {
+      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	       __FILE__, __LINE__);
+      _db_close (dbp);
+      return NULL;
+    }
+
+  if (debug_flag)
+    log_msg ("Opening: %s/%s", domain, map);
+
+  e->users = 1;
+  e->owner = pthread_self ();
+  reload_watch_domain (domain);
+
+  evict_locked ();
+  /* All other handles are in use, this one is closed again by
+     ypdb_close. */
+  if (nr_open > cached_filehandles)
+    e->flag |= F_MUST_CLOSE;
+
+  return dbp;
+}
+
+DB_FILE
+ypdb_open (const char *domain, const char *map)
+{
+  if (debug_flag)
+    log_msg ("\typdb_open(\"%s\", \"%s\")", domain, map);
+
+  if (map[0] == '.' || strchr (map, '/'))
+    {
+      if (debug_flag)
+	log_msg ("\t\t->Returning 0");
+      return NULL;
+    }
+
+  if (cached_filehandles > 0)
+    {
+      DB_FILE dbp;
+
+      pthread_once (&fast_open_once, fast_open_setup);
+      pthread_mutex_lock (&fast_open_lock);
+
+      if (clear_generation != NULL)
+	{
+	  unsigned int gen = __atomic_load_n (clear_generation,
+					      __ATOMIC_SEQ_CST);
+
+	  if (gen != seen_generation)
+	    {
+	      if (debug_flag)
+		log_msg ("Maps cleared by other ypserv process");
+	      close_all_locked ();
+	      seen_generation = gen;
+	      if (ypdb_changed_hook != NULL)
+		ypdb_changed_hook (NULL, NULL);
+	    }
+	}
+
+      dbp = cached_db_open (domain, map);
+      pthread_mutex_unlock (&fast_open_lock);
+
+      return dbp;
+    }
+  else
+    return _db_open (domain, map);
+}
+
+#define META_ORDER  0x01
+#define META_MASTER 0x02
+#define META_SECURE 0x04
+#define META_FIRST  0x08
+
+/* The metadata is read from the map once per handle. A handle of a
+   map in memory is used by several threads at the same time, so it
+   is read with meta_lock held, see fast_open_prepare. */
+
+static int
+meta_loaded (DB_FILE dbp, unsigned int what)
+{
+  return (__atomic_load_n (&dbp->meta.loaded, __ATOMIC_ACQUIRE) & what) != 0;
+}
+
+static void
+meta_load_locked (DB_FILE dbp, unsigned int what)
+{
+  struct ypdb_meta *meta = &dbp->meta;
+  datum key, val;
+
+  if (what == META_ORDER)
+    {
+      key.dsize = sizeof ("YP_LAST_MODIFIED") - 1;
+      key.dptr = "YP_LAST_MODIFIED";
+
+      val = ypdb_fetch (dbp, key);
+      if (val.dptr != NULL)
+	{
+	  char buf[32];
+	  size_t len = val.dsize;
+
+	  if (len >= sizeof (buf))
+	    len = sizeof (buf) - 1;
+	  memcpy (buf, val.dptr, len);
+	  buf[len] = '\0';
+	  meta->order = strtoul (buf, NULL, 10);
+	  meta->has_order = 1;
+	  ypdb_free (val.dptr);
+	}
+    }
+  else if (what == META_MASTER)
+    {
+      key.dsize = sizeof ("YP_MASTER_NAME") - 1;
+      key.dptr = "YP_MASTER_NAME";
+
+      val = ypdb_fetch (dbp, key);
+      if (val.dptr != NULL)
+	{
+	  meta->master = strndup (val.dptr, val.dsize);
+	  ypdb_free (val.dptr);
+	  if (meta->master == NULL)
+	    return;		/* try again next time */
+	}
+    }
+  else if (what == META_SECURE)
+    {
+      key.dsize = sizeof ("YP_SECURE") - 1;
+      key.dptr = "YP_SECURE";
+
+      meta->secure = ypdb_exists (dbp, key);
+    }
+  else if (what == META_FIRST)
+    {
+      datum dkey = ypdb_firstkey (dbp);
+
+      while (dkey.dptr != NULL && dkey.dsize >= 3 &&
+	     strncmp (dkey.dptr, "YP_", 3) == 0)
+	{
+	  datum tkey;
+
+#if defined(HAVE_NDBM)
+	  if (dbp->mem == NULL)
+	    {
+	      /* This is much more faster then ypdb_nextkey, but
+		 it is terrible to port to other databases */
+	      dkey = dbm_nextkey (dbp->db);
+	      continue;
+	    }
+#endif
+	  tkey = dkey;
+	  dkey = ypdb_nextkey (dbp, tkey);
+	  ypdb_free (tkey.dptr);
+	}
+
+      if (dkey.dptr != NULL)
+	{
+	  /* Keep our own copy, the handle may own dkey */
+	  if ((meta->first.dptr = malloc (dkey.dsize)) == NULL)
+	    {
+	      ypdb_free (dkey.dptr);
+	      return;
+	    }
+	  memcpy (meta->first.dptr, dkey.dptr, dkey.dsize);
+	  meta->first.dsize = dkey.dsize;
+	  ypdb_free (dkey.dptr);
+	}
+    }
+
+  __atomic_or_fetch (&meta->loaded, what, __ATOMIC_RELEASE);
+}
+
+/* Without cached handles, a handle is used by one thread only, and
+   the fork handlers for meta_lock are not registered. */
+static void
+meta_load (DB_FILE dbp, unsigned int what)
+{
+  if (cached_filehandles <= 0)
+    {
+      meta_load_locked (dbp, what);
+      return;
+    }
+
+  pthread_mutex_lock (&meta_lock);
+  if (!meta_loaded (dbp, what))
+    meta_load_locked (dbp, what);
+  pthread_mutex_unlock (&meta_lock);
+}
+
+/* Return the YP_LAST_MODIFIED entry of the map, or 0 if there is none */
+unsigned int
+ypdb_last_modified (DB_FILE dbp)
+{
+  unsigned int ordernum = 0;
+
+  ypdb_order (dbp, &ordernum);
+  return ordernum;
+}
+
+/* Return 1 and the YP_LAST_MODIFIED entry in ordernum, or 0 if the
+   map has none. */
+int
+ypdb_order (DB_FILE dbp, unsigned int *ordernum)
+{
+  if (!meta_loaded (dbp, META_ORDER))
+    meta_load (dbp, META_ORDER);
+
+  if (dbp->meta.has_order)
+    *ordernum = dbp->meta.order;
+  return dbp->meta.has_order;
+}
+
+/* Return the YP_MASTER_NAME entry, valid until ypdb_close, or NULL */
+const char *
+ypdb_master_name (DB_FILE dbp)
+{
+  if (!meta_loaded (dbp, META_MASTER))
+    meta_load (dbp, META_MASTER);
+
+  return dbp->meta.master;
+}
+
+/* Return 1 if the map has a YP_SECURE key */
+int
+ypdb_secure (DB_FILE dbp)
+{
+  if (!meta_loaded (dbp, META_SECURE))
+    meta_load (dbp, META_SECURE);
+
+  return dbp->meta.secure;
+}
+
+/* Like ypdb_firstkey, but skips the YP_ keys. The key is a copy,
+   which has to be freed with free(). */
+datum
+ypdb_first_datakey (DB_FILE dbp)
+{
+  datum res = { NULL, 0 };
+
+  if (!meta_loaded (dbp, META_FIRST))
+    meta_load (dbp, META_FIRST);
+
+  if (dbp->meta.first.dptr != NULL &&
+      (res.dptr = malloc (dbp->meta.first.dsize)) != NULL)
+    {
+      memcpy (res.dptr, dbp->meta.first.dptr, dbp->meta.first.dsize);
+      res.dsize = dbp->meta.first.dsize;
+    }
+  return res;
 }
@@ -17,48 +17,89 @@
 #include <hovel.h>
 #endif
 
-#define DB_FILE GDBM_FILE
-#define ypdb_fetch(a,b)  gdbm_fetch(a,b)
-#define ypdb_exists(a,b)  gdbm_exists(a,b)
+#define DB_NATIVE GDBM_FILE
 #define ypdb_free(a) free(a)
-#define ypdb_firstkey(a) gdbm_firstkey(a)
-#define ypdb_nextkey(a,b) gdbm_nextkey(a,b)
 
 #elif defined(HAVE_NDBM)
 
 #include <ndbm.h>
 
-#define DB_FILE DBM*
-#define ypdb_fetch(a,b)  dbm_fetch(a,b)
-#define ypdb_free(a)
-
-extern int ypdb_exists (DB_FILE file, datum key);
-/* extern datum ypdb_firstkey (DB_FILE file); */
-#define ypdb_firstkey(a) dbm_firstkey(a)
-extern datum ypdb_nextkey (DB_FILE file, datum key);
-extern datum ypdb_fetch (DB_FILE file, datum key);
+#define DB_NATIVE DBM*
+#define ypdb_free(a) ((void) (a))
 
 #elif defined(HAVE_LIBTC)
 
 #include <tcbdb.h>
 
-#define DB_FILE TCBDB *
-
+#define DB_NATIVE TCBDB *
 #define ypdb_free(a) free(a)
 
-extern int ypdb_exists (DB_FILE file, datum key);
-extern datum ypdb_firstkey (DB_FILE file);
-extern datum ypdb_nextkey (DB_FILE file, datum key);
-extern datum ypdb_fetch (DB_FILE bdb, datum key);
-
 #else
 
 #error "No database found or selected !"
 
 #endif
 
+/* A map is either accessed with the database library (db), or it
+   was loaded completely into memory (mem). */
+struct ypdb_mem;
+
+/* The YP_ keys of a map, read on first use and kept as long as the
+   handle is open. "loaded" says which of the fields are valid. */
+struct ypdb_meta
+{
+  unsigned int loaded;
+  int secure;			/* map has a YP_SECURE key */
+  int has_order;		/* map has a YP_LAST_MODIFIED key */
+  unsigned int order;
+  char *master;			/* YP_MASTER_NAME, NULL if none */
+  datum first;			/* first key not starting with "YP_" */
+};
+
+struct _fopen;
+
+struct ypdb_file
+{
+  DB_NATIVE db;
+  struct ypdb_mem *mem;
+  struct ypdb_meta meta;
+  struct _fopen *cache;		/* entry in the handle cache or NULL */
+#if defined(HAVE_NDBM)
+  char *domain;
+  char *map;
+#endif
+};
+
+#define DB_FILE struct ypdb_file *
+
+extern int ypdb_exists (DB_FILE file, datum key);
+extern datum ypdb_firstkey (DB_FILE file);
+extern datum ypdb_nextkey (DB_FILE file, datum key);
+extern datum ypdb_fetch (DB_FILE file, datum key);
+extern datum ypdb_fetch_into (DB_FILE file, datum key, char *buf,
+			      size_t size);
+
 extern DB_FILE ypdb_open (const char *domain, const char *map);
+extern int ypdb_map_in_list (const char *list, const char *map);
 extern int ypdb_close_all (void);
+extern int ypdb_clear_all (void);
+extern int ypdb_share_clear (void);
+extern unsigned int ypdb_clear_generation (void);
+extern unsigned int ypdb_map_generation (const char *domain,
+					const char *map);
+/* Called after domain/map was replaced, and with NULL for both after
+   YPPROC_CLEAR. It must not block, the cache may be locked. */
+extern void (*ypdb_changed_hook) (const char *domain, const char *map);
+extern unsigned int ypdb_last_modified (DB_FILE dbp);
+extern int ypdb_order (DB_FILE dbp, unsigned int *ordernum);
+extern const char *ypdb_master_name (DB_FILE dbp);
+extern int ypdb_secure (DB_FILE dbp);
+extern datum ypdb_first_datakey (DB_FILE dbp);
 extern int ypdb_close (DB_FILE file);
+extern struct _fopen *ypdb_pin (DB_FILE dbp);
+extern DB_FILE ypdb_open_pinned (struct _fopen *pin);
+extern void ypdb_unpin (struct _fopen *pin);
+extern void ypdb_reload_init (void);
+extern void ypdb_cache_stats (void);
 
 #endif
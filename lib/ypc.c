@@ -0,0 +1,259 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "ypc.h"
+
+struct ypc_writer
+{
+  char *data;
+  uint64_t data_size;
+  uint64_t data_alloc;
+  ypc_rec_t *recs;
+  uint32_t nrecs;
+  uint32_t recs_alloc;
+  uint32_t *slots;
+  uint32_t nslots;
+};
+
+/* FNV-1a */
+uint32_t
+ypc_hash (const char *key, size_t len)
+{
+  uint32_t h = 2166136261U;
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    {
+      h ^= (unsigned char) key[i];
+      h *= 16777619U;
+    }
+
+  return h;
+}
+
+ypc_writer_t *
+ypc_create (void)
+{
+  ypc_writer_t *w;
+
+  if ((w = calloc (1, sizeof (ypc_writer_t))) == NULL)
+    return NULL;
+
+  w->nslots = 1024;
+  if ((w->slots = calloc (w->nslots, sizeof (uint32_t))) == NULL)
+    {
+      free (w);
+      return NULL;
+    }
+
+  return w;
+}
+
+void
+ypc_free (ypc_writer_t *w)
+{
+  if (w == NULL)
+    return;
+  free (w->data);
+  free (w->recs);
+  free (w->slots);
+  free (w);
+}
+
+/* Returns the slot of key, or the empty slot where it belongs */
+static uint32_t
+find_slot (const ypc_writer_t *w, uint32_t hash, const char *key,
+	   size_t klen)
+{
+  uint32_t i;
+
+  for (i = hash & (w->nslots - 1); w->slots[i] != 0;
+       i = (i + 1) & (w->nslots - 1))
+    {
+      const ypc_rec_t *r = &w->recs[w->slots[i] - 1];
+
+      if (r->hash == hash && r->klen == klen &&
+	  memcmp (w->data + r->off, key, klen) == 0)
+	break;
+    }
+
+  return i;
+}
+
+/* Not more than half of the slots are used */
+static int
+grow_slots (ypc_writer_t *w)
+{
+  uint32_t *old = w->slots, nold = w->nslots, i;
+
+  if ((w->slots = calloc (nold * 2, sizeof (uint32_t))) == NULL)
+    {
+      w->slots = old;
+      return -1;
+    }
+  w->nslots = nold * 2;
+
+  for (i = 0; i < nold; i++)
+    if (old[i] != 0)
+      {
+	const ypc_rec_t *r = &w->recs[old[i] - 1];
+	uint32_t j;
+
+	for (j = r->hash & (w->nslots - 1); w->slots[j] != 0;
+	     j = (j + 1) & (w->nslots - 1))
+	  ;
+	w->slots[j] = old[i];
+      }
+  free (old);
+
+  return 0;
+}
+
+/* Add a record. If the key exists already, the value is replaced,
+   like gdbm_store with GDBM_REPLACE does. */
+int
+ypc_add (ypc_writer_t *w, const char *key, size_t klen,
+	 const char *val, size_t vlen)
+{
+  uint32_t hash = ypc_hash (key, klen), slot;
+  ypc_rec_t *r;
+
+  if (klen > UINT32_MAX || vlen > UINT32_MAX)
+    return -1;
+
+  if (w->data_size + klen + vlen > w->data_alloc)
+    {
+      uint64_t n = w->data_alloc ? w->data_alloc : 65536;
+      char *tmp;
+
+      while (n < w->data_size + klen + vlen)
+	n *= 2;
+      if ((tmp = realloc (w->data, n)) == NULL)
+	return -1;
+      w->data = tmp;
+      w->data_alloc = n;
+    }
+
+  slot = find_slot (w, hash, key, klen);
+  if (w->slots[slot] != 0)
+    r = &w->recs[w->slots[slot] - 1];
+  else
+    {
+      if ((w->nrecs + 1) * 2 > w->nslots)
+	{
+	  if (grow_slots (w) < 0)
+	    return -1;
+	  slot = find_slot (w, hash, key, klen);
+	}
+      if (w->nrecs == w->recs_alloc)
+	{
+	  uint32_t n = w->recs_alloc ? w->recs_alloc * 2 : 1024;
+	  ypc_rec_t *tmp;
+
+	  if ((tmp = realloc (w->recs, n * sizeof (ypc_rec_t))) == NULL)
+	    return -1;
+	  w->recs = tmp;
+	  w->recs_alloc = n;
+	}
+      r = &w->recs[w->nrecs++];
+      w->slots[slot] = w->nrecs;
+    }
+
+  /* A replaced value stays unused in the data section */
+  r->hash = hash;
+  r->klen = klen;
+  r->vlen = vlen;
+  r->unused = 0;
+  r->off = w->data_size;
+  memcpy (w->data + w->data_size, key, klen);
+  memcpy (w->data + w->data_size + klen, val, vlen);
+  w->data_size += klen + vlen;
+
+  return 0;
+}
+
+/* Write the map to filename, the caller renames it afterwards.
+   dbfile is the database with the same records, which has to be
+   written completely already, or NULL if there is none ypserv could
+   compare. */
+int
+ypc_write (ypc_writer_t *w, const char *filename, const char *dbfile)
+{
+  ypc_header_t hdr;
+  struct stat st;
+  FILE *fp;
+  int fd;
+
+  memset (&st, 0, sizeof (st));
+  if (dbfile != NULL && stat (dbfile, &st) != 0)
+    return -1;
+
+  memset (&hdr, 0, sizeof (hdr));
+  memcpy (hdr.magic, YPC_MAGIC, sizeof (hdr.magic));
+  hdr.byteorder = YPC_BYTEORDER;
+  hdr.nrecs = w->nrecs;
+  hdr.nslots = w->nslots;
+  hdr.recs_off = sizeof (hdr);
+  hdr.slots_off = hdr.recs_off + (uint64_t) w->nrecs * sizeof (ypc_rec_t);
+  hdr.data_off = hdr.slots_off + (uint64_t) w->nslots * sizeof (uint32_t);
+  hdr.size = hdr.data_off + w->data_size;
+  hdr.db_dev = st.st_dev;
+  hdr.db_ino = st.st_ino;
+  hdr.db_mtime = st.st_mtim.tv_sec;
+  hdr.db_mtime_nsec = st.st_mtim.tv_nsec;
+
+  /* Same permissions as the database */
+  if ((fd = open (filename, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0)
+    return -1;
+  if ((fp = fdopen (fd, "w")) == NULL)
+    {
+      close (fd);
+      unlink (filename);
+      return -1;
+    }
+
+  if (fwrite (&hdr, sizeof (hdr), 1, fp) != 1 ||
+      (w->nrecs > 0 &&
+       fwrite (w->recs, sizeof (ypc_rec_t), w->nrecs, fp) != w->nrecs) ||
+      fwrite (w->slots, sizeof (uint32_t), w->nslots, fp) != w->nslots ||
+      (w->data_size > 0 &&
+       fwrite (w->data, w->data_size, 1, fp) != 1) ||
+      fflush (fp) != 0 || fsync (fileno (fp)) != 0)
+    {
+      fclose (fp);
+      unlink (filename);
+      return -1;
+    }
+
+  if (fclose (fp) != 0)
+    {
+      unlink (filename);
+      return -1;
+    }
+
+  return 0;
+}
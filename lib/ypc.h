@@ -0,0 +1,83 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifndef __YPC_H__
+#define __YPC_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* A ypc file is an immutable map, written by makedbm --mmap next to
+   the map of the database library, and mapped into memory by
+   ypserv. All numbers are in the byte order of the host, which
+   created the file.
+
+   header | records | hash slots | keys and values
+
+   The records are in the order of makedbm's input. A hash slot
+   contains the index of a record + 1, or 0 if it is empty. There
+   are always empty slots, a lookup starts at hash & (nslots - 1)
+   and continues with the next slot until the key or an empty slot
+   is found. A record points to the key in the data section, the
+   value follows the key directly.
+
+   The header records the device, inode and modification time of the
+   database file written together with the ypc file. If the database
+   was replaced later without a new ypc file, ypserv ignores it. */
+
+#define YPC_SUFFIX ".ypc"
+#define YPC_MAGIC "YPCMAP02"
+#define YPC_BYTEORDER 0x01020304
+
+typedef struct ypc_header
+{
+  char magic[8];
+  uint32_t byteorder;
+  uint32_t nrecs;
+  uint32_t nslots;
+  uint32_t unused;
+  uint64_t recs_off;
+  uint64_t slots_off;
+  uint64_t data_off;
+  uint64_t size;		/* of the whole file */
+  uint64_t db_dev;
+  uint64_t db_ino;
+  int64_t db_mtime;
+  uint32_t db_mtime_nsec;
+  uint32_t unused2;
+} ypc_header_t;
+
+typedef struct ypc_rec
+{
+  uint32_t hash;
+  uint32_t klen;
+  uint32_t vlen;
+  uint32_t unused;
+  uint64_t off;			/* of the key in the data section */
+} ypc_rec_t;
+
+typedef struct ypc_writer ypc_writer_t;
+
+extern uint32_t ypc_hash (const char *key, size_t len);
+
+extern ypc_writer_t *ypc_create (void);
+extern int ypc_add (ypc_writer_t *w, const char *key, size_t klen,
+		    const char *val, size_t vlen);
+extern int ypc_write (ypc_writer_t *w, const char *filename,
+		      const char *dbfile);
+extern void ypc_free (ypc_writer_t *w);
+
+#endif
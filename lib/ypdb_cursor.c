@@ -0,0 +1,198 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "ypdb_cursor.h"
+
+/* Most recently used first */
+static ypdb_cursor_t *cursors = NULL;
+static int nr_cursors = 0;
+static pthread_mutex_t cursor_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t cursor_once = PTHREAD_ONCE_INIT;
+
+static void
+cursor_prepare (void)
+{
+  pthread_mutex_lock (&cursor_lock);
+}
+
+static void
+cursor_release (void)
+{
+  pthread_mutex_unlock (&cursor_lock);
+}
+
+/* ypproc_all and ypproc_xfr fork, the child enumerates a map with
+   cursors, too. */
+static void
+cursor_setup (void)
+{
+  pthread_atfork (cursor_prepare, cursor_release, cursor_release);
+}
+
+static void
+cursor_lock_acquire (void)
+{
+  pthread_once (&cursor_once, cursor_setup);
+  pthread_mutex_lock (&cursor_lock);
+}
+
+ypdb_cursor_t *
+ypdb_cursor_new (const void *owner, void *cur, ypdb_cursor_close_t close)
+{
+  ypdb_cursor_t *c;
+
+  if ((c = calloc (1, sizeof (ypdb_cursor_t))) == NULL)
+    return NULL;
+  c->owner = owner;
+  c->cur = cur;
+  c->close = close;
+  return c;
+}
+
+int
+ypdb_cursor_set_key (ypdb_cursor_t *c, const char *key, int keylen,
+		     time_t now)
+{
+  char *tmp;
+
+  if ((tmp = malloc (keylen + 1)) == NULL)
+    return -1;
+  memcpy (tmp, key, keylen);
+  free (c->key);
+  c->key = tmp;
+  c->keylen = keylen;
+  c->used = now;
+  return 0;
+}
+
+void
+ypdb_cursor_free (ypdb_cursor_t *c)
+{
+  c->close (c->cur);
+  free (c->key);
+  free (c);
+}
+
+ypdb_cursor_t *
+ypdb_cursor_take (const void *owner, const char *key, int keylen,
+		  time_t now)
+{
+  ypdb_cursor_t **pp, *c, *found = NULL, *expired = NULL;
+
+  cursor_lock_acquire ();
+  pp = &cursors;
+  while ((c = *pp) != NULL)
+    {
+      if (found == NULL && c->owner == owner && c->keylen == keylen &&
+	  memcmp (c->key, key, keylen) == 0)
+	{
+	  *pp = c->next;
+	  found = c;
+	  --nr_cursors;
+	}
+      else if (now - c->used >= YPDB_CURSOR_TIMEOUT)
+	{
+	  *pp = c->next;
+	  c->next = expired;
+	  expired = c;
+	  --nr_cursors;
+	}
+      else
+	pp = &c->next;
+    }
+  pthread_mutex_unlock (&cursor_lock);
+
+  while (expired != NULL)
+    {
+      c = expired;
+      expired = c->next;
+      ypdb_cursor_free (c);
+    }
+
+  return found;
+}
+
+/* If there are too many cursors, the least recently used is closed */
+void
+ypdb_cursor_put (ypdb_cursor_t *c)
+{
+  ypdb_cursor_t **pp, *old = NULL;
+
+  cursor_lock_acquire ();
+  c->next = cursors;
+  cursors = c;
+  if (++nr_cursors > YPDB_CURSORS)
+    {
+      for (pp = &cursors; (*pp)->next != NULL; pp = &(*pp)->next)
+	;
+      old = *pp;
+      *pp = NULL;
+      --nr_cursors;
+    }
+  pthread_mutex_unlock (&cursor_lock);
+
+  if (old != NULL)
+    ypdb_cursor_free (old);
+}
+
+void
+ypdb_cursor_close_all (const void *owner)
+{
+  ypdb_cursor_t **pp, *c, *list = NULL;
+
+  cursor_lock_acquire ();
+  pp = &cursors;
+  while ((c = *pp) != NULL)
+    {
+      if (c->owner == owner)
+	{
+	  *pp = c->next;
+	  c->next = list;
+	  list = c;
+	  --nr_cursors;
+	}
+      else
+	pp = &c->next;
+    }
+  pthread_mutex_unlock (&cursor_lock);
+
+  while (list != NULL)
+    {
+      c = list;
+      list = c->next;
+      ypdb_cursor_free (c);
+    }
+}
+
+int
+ypdb_cursor_count (void)
+{
+  int n;
+
+  cursor_lock_acquire ();
+  n = nr_cursors;
+  pthread_mutex_unlock (&cursor_lock);
+
+  return n;
+}
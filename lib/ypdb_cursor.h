@@ -0,0 +1,65 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifndef __YPDB_CURSOR_H__
+#define __YPDB_CURSOR_H__
+
+#include <time.h>
+
+/* YPPROC_NEXT gets the key returned last and has to find it again.
+   With NDBM this is a linear search through the map, with Tokyo
+   Cabinet a new cursor is created and positioned for every request.
+   So the position behind the key returned last is kept in a cursor,
+   and the next request for this key continues from there. Cursors
+   belong to a cached handle and are closed with it, so they never
+   see a changed map. There are at most YPDB_CURSORS of them, and
+   they are closed if they were not used for YPDB_CURSOR_TIMEOUT
+   seconds. GDBM and maps in memory find the next key directly. */
+
+#define YPDB_CURSORS 64
+#define YPDB_CURSOR_TIMEOUT 60
+
+typedef void (*ypdb_cursor_close_t) (void *cur);
+
+typedef struct ypdb_cursor
+{
+  struct ypdb_cursor *next;
+  const void *owner;		/* handle the cursor belongs to */
+  void *cur;			/* cursor of the database library */
+  ypdb_cursor_close_t close;
+  char *key;			/* key returned last */
+  int keylen;
+  time_t used;
+} ypdb_cursor_t;
+
+/* A new cursor, which is not in the list yet */
+extern ypdb_cursor_t *ypdb_cursor_new (const void *owner, void *cur,
+				       ypdb_cursor_close_t close);
+/* Remember the key returned last, returns -1 if out of memory */
+extern int ypdb_cursor_set_key (ypdb_cursor_t *c, const char *key,
+				int keylen, time_t now);
+/* Remove the cursor of owner behind key from the list, so that nobody
+   else closes it while it is used. Expired cursors are closed. */
+extern ypdb_cursor_t *ypdb_cursor_take (const void *owner, const char *key,
+					int keylen, time_t now);
+/* Put the cursor back into the list as most recently used one */
+extern void ypdb_cursor_put (ypdb_cursor_t *c);
+extern void ypdb_cursor_free (ypdb_cursor_t *c);
+/* Close all cursors of owner, before the handle is closed */
+extern void ypdb_cursor_close_all (const void *owner);
+extern int ypdb_cursor_count (void);
+
+#endif
@@ -0,0 +1,483 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "yp_db.h"
+#include "ypj.h"
+
+/* The records of the new delta */
+typedef struct ypj_buf
+{
+  char *data;
+  uint64_t size;
+  uint64_t alloc;
+  uint32_t nrecs;
+} ypj_buf_t;
+
+struct ypj_file
+{
+  char *map;
+  size_t size;
+  size_t start;			/* first delta to send */
+  size_t pos;
+  uint32_t left;		/* records of the current delta */
+};
+
+static int
+buf_add (ypj_buf_t *b, uint32_t op, datum key, datum val)
+{
+  uint64_t need = sizeof (ypj_rec_t) + key.dsize + val.dsize;
+  ypj_rec_t rec;
+
+  if (b->size + need > b->alloc)
+    {
+      uint64_t n = b->alloc ? b->alloc : 65536;
+      char *tmp;
+
+      while (n < b->size + need)
+	n *= 2;
+      if ((tmp = realloc (b->data, n)) == NULL)
+	return -1;
+      b->data = tmp;
+      b->alloc = n;
+    }
+
+  memset (&rec, 0, sizeof (rec));
+  rec.op = op;
+  rec.klen = key.dsize;
+  rec.vlen = val.dsize;
+  memcpy (b->data + b->size, &rec, sizeof (rec));
+  memcpy (b->data + b->size + sizeof (rec), key.dptr, key.dsize);
+  if (val.dsize > 0)
+    memcpy (b->data + b->size + sizeof (rec) + key.dsize, val.dptr,
+	    val.dsize);
+  b->size += need;
+  b->nrecs++;
+
+  return 0;
+}
+
+/* The same keys, which a transfer with YPPROC_ALL copies */
+static int
+journaled_key (datum key)
+{
+  if (key.dsize < 3 || strncmp (key.dptr, "YP_", 3) != 0)
+    return 1;
+  return (key.dsize == 9 && memcmp (key.dptr, "YP_SECURE", 9) == 0) ||
+    (key.dsize == 14 && memcmp (key.dptr, "YP_INTERDOMAIN", 14) == 0);
+}
+
+/* Record every key of newdb, which is not in olddb or has another
+   value there, and every key of olddb, which is not in newdb. nkeys
+   is the number of keys of newdb. */
+static int
+diff_maps (DB_FILE olddb, DB_FILE newdb, ypj_buf_t *b, uint32_t *nkeys)
+{
+  datum key, next;
+  int ret = 0;
+
+  *nkeys = 0;
+  key = ypdb_firstkey (newdb);
+  while (key.dptr != NULL && ret == 0)
+    {
+      if (journaled_key (key))
+	{
+	  datum nval = ypdb_fetch (newdb, key);
+	  datum oval = ypdb_fetch (olddb, key);
+
+	  ++*nkeys;
+	  if (nval.dptr == NULL)
+	    ret = -1;
+	  else if (oval.dptr == NULL || oval.dsize != nval.dsize ||
+		   memcmp (oval.dptr, nval.dptr, nval.dsize) != 0)
+	    ret = buf_add (b, YPJ_STORE, key, nval);
+	  ypdb_free (nval.dptr);
+	  ypdb_free (oval.dptr);
+	}
+      next = ypdb_nextkey (newdb, key);
+      ypdb_free (key.dptr);
+      key = next;
+    }
+  ypdb_free (key.dptr);
+
+  key = ypdb_firstkey (olddb);
+  while (key.dptr != NULL && ret == 0)
+    {
+      if (journaled_key (key) && !ypdb_exists (newdb, key))
+	{
+	  datum empty = { NULL, 0 };
+
+	  ret = buf_add (b, YPJ_DELETE, key, empty);
+	}
+      next = ypdb_nextkey (olddb, key);
+      ypdb_free (key.dptr);
+      key = next;
+    }
+  ypdb_free (key.dptr);
+
+  return ret;
+}
+
+/* Read the whole journal, NULL if there is none or it is not valid */
+static char *
+read_journal (const char *filename, size_t *size)
+{
+  ypj_header_t hdr;
+  struct stat st;
+  char *data;
+  int fd;
+
+  if ((fd = open (filename, O_RDONLY)) < 0)
+    return NULL;
+  if (fstat (fd, &st) < 0 || (size_t) st.st_size < sizeof (hdr) ||
+      (data = malloc (st.st_size)) == NULL)
+    {
+      close (fd);
+      return NULL;
+    }
+  if (read (fd, data, st.st_size) != st.st_size)
+    {
+      free (data);
+      close (fd);
+      return NULL;
+    }
+  close (fd);
+
+  memcpy (&hdr, data, sizeof (hdr));
+  if (memcmp (hdr.magic, YPJ_MAGIC, sizeof (hdr.magic)) != 0 ||
+      hdr.byteorder != YPJ_BYTEORDER)
+    {
+      free (data);
+      return NULL;
+    }
+
+  *size = st.st_size;
+  return data;
+}
+
+/* Write the deltas of the old journal, which continue with "from"
+   and are still worth it, and the new delta to filename. The
+   changes of all deltas together should be less than a new copy of
+   the map. */
+static int
+write_journal (const char *filename, uint32_t from, uint32_t to,
+	       const ypj_buf_t *b, uint32_t nkeys)
+{
+  size_t offs[YPJ_MAXDELTAS + 1], size = 0, keep;
+  uint32_t nrecs[YPJ_MAXDELTAS + 1], total;
+  uint32_t i, n = 0, first;
+  ypj_header_t hdr;
+  ypj_delta_t delta;
+  char *old, *tmpname;
+  FILE *fp;
+  int fd, ret = -1;
+
+  if ((old = read_journal (filename, &size)) != NULL)
+    {
+      size_t pos = sizeof (hdr);
+      uint32_t last = 0;
+
+      memcpy (&hdr, old, sizeof (hdr));
+      for (i = 0; i < hdr.ndeltas; i++)
+	{
+	  if (pos + sizeof (delta) > size)
+	    break;
+	  memcpy (&delta, old + pos, sizeof (delta));
+	  if (delta.size > size - pos - sizeof (delta) ||
+	      (i > 0 && delta.from != last))
+	    break;
+	  /* Only the last YPJ_MAXDELTAS are of interest */
+	  if (n == YPJ_MAXDELTAS)
+	    {
+	      memmove (offs, offs + 1, (n - 1) * sizeof (offs[0]));
+	      memmove (nrecs, nrecs + 1, (n - 1) * sizeof (nrecs[0]));
+	      --n;
+	    }
+	  offs[n] = pos;
+	  nrecs[n] = delta.nrecs;
+	  ++n;
+	  last = delta.to;
+	  pos += sizeof (delta) + delta.size;
+	}
+      /* The old journal does not end with the old map */
+      if (i < hdr.ndeltas || pos != size || last != from)
+	n = 0;
+    }
+
+  /* Keep the newest deltas, which fit */
+  total = b->nrecs;
+  for (first = n; first > 0; first--)
+    {
+      if (n - first + 2 > YPJ_MAXDELTAS ||
+	  total + nrecs[first - 1] > nkeys)
+	break;
+      total += nrecs[first - 1];
+    }
+  keep = first < n ? size - offs[first] : 0;
+
+  if (asprintf (&tmpname, "%s~", filename) < 0)
+    {
+      free (old);
+      return -1;
+    }
+
+  memset (&hdr, 0, sizeof (hdr));
+  memcpy (hdr.magic, YPJ_MAGIC, sizeof (hdr.magic));
+  hdr.byteorder = YPJ_BYTEORDER;
+  hdr.ndeltas = n - first + 1;
+
+  memset (&delta, 0, sizeof (delta));
+  delta.from = from;
+  delta.to = to;
+  delta.nrecs = b->nrecs;
+  delta.size = b->size;
+
+  /* Same permissions as the database */
+  if ((fd = open (tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0)
+    goto out;
+  if ((fp = fdopen (fd, "w")) == NULL)
+    {
+      close (fd);
+      unlink (tmpname);
+      goto out;
+    }
+
+  if (fwrite (&hdr, sizeof (hdr), 1, fp) != 1 ||
+      (keep > 0 && fwrite (old + offs[first], keep, 1, fp) != 1) ||
+      fwrite (&delta, sizeof (delta), 1, fp) != 1 ||
+      (b->size > 0 && fwrite (b->data, b->size, 1, fp) != 1) ||
+      fflush (fp) != 0 || fsync (fileno (fp)) != 0)
+    {
+      fclose (fp);
+      unlink (tmpname);
+      goto out;
+    }
+  if (fclose (fp) != 0 || rename (tmpname, filename) != 0)
+    {
+      unlink (tmpname);
+      goto out;
+    }
+  ret = 0;
+
+ out:
+  free (tmpname);
+  free (old);
+  return ret;
+}
+
+static void
+split_path (const char *path, char **dir, const char **base)
+{
+  const char *p = strrchr (path, '/');
+
+  if (p == NULL)
+    {
+      *dir = strdup (".");
+      *base = path;
+    }
+  else
+    {
+      *dir = p == path ? strdup ("/") : strndup (path, p - path);
+      *base = p + 1;
+    }
+}
+
+/* Add the changes from the map oldmap to newmap to the journal
+   filename, before newmap replaces oldmap. Without an old version
+   of the map with an order number, there is nothing to journal and
+   an old journal is removed. */
+int
+ypj_update (const char *filename, const char *oldmap, const char *newmap)
+{
+  char *olddir, *newdir;
+  const char *oldbase, *newbase;
+  DB_FILE olddb = NULL;
+  DB_FILE newdb = NULL;
+  unsigned int from = 0, to = 0;
+  ypj_buf_t b;
+  uint32_t nkeys;
+  int ret = -1;
+
+  memset (&b, 0, sizeof (b));
+  split_path (oldmap, &olddir, &oldbase);
+  split_path (newmap, &newdir, &newbase);
+  if (olddir == NULL || newdir == NULL)
+    goto out;
+
+  if ((olddb = ypdb_open (olddir, oldbase)) == NULL ||
+      !ypdb_order (olddb, &from))
+    {
+      unlink (filename);
+      ret = 0;
+      goto out;
+    }
+  if ((newdb = ypdb_open (newdir, newbase)) == NULL ||
+      !ypdb_order (newdb, &to))
+    goto out;
+
+  if (diff_maps (olddb, newdb, &b, &nkeys) == 0)
+    ret = write_journal (filename, from, to, &b, nkeys);
+
+ out:
+  if (olddb != NULL)
+    ypdb_close (olddb);
+  if (newdb != NULL)
+    ypdb_close (newdb);
+  ypdb_close_all ();
+  free (olddir);
+  free (newdir);
+  free (b.data);
+
+  return ret;
+}
+
+ypj_file_t *
+ypj_open (const char *filename)
+{
+  ypj_header_t hdr;
+  ypj_file_t *j;
+  struct stat st;
+  void *map;
+  int fd;
+
+  if ((fd = open (filename, O_RDONLY)) < 0)
+    return NULL;
+  if (fstat (fd, &st) < 0 || (size_t) st.st_size < sizeof (hdr))
+    {
+      close (fd);
+      return NULL;
+    }
+  map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (map == MAP_FAILED)
+    return NULL;
+
+  memcpy (&hdr, map, sizeof (hdr));
+  if (memcmp (hdr.magic, YPJ_MAGIC, sizeof (hdr.magic)) != 0 ||
+      hdr.byteorder != YPJ_BYTEORDER ||
+      (j = calloc (1, sizeof (ypj_file_t))) == NULL)
+    {
+      munmap (map, st.st_size);
+      return NULL;
+    }
+  j->map = map;
+  j->size = st.st_size;
+  j->start = j->pos = j->size;
+
+  return j;
+}
+
+void
+ypj_close (ypj_file_t *j)
+{
+  if (j == NULL)
+    return;
+  munmap (j->map, j->size);
+  free (j);
+}
+
+/* Prepare ypj_next to return the changes from the map version since
+   to current. Returns -1 if the journal does not have them. */
+int
+ypj_since (ypj_file_t *j, uint32_t since, uint32_t current)
+{
+  ypj_header_t hdr;
+  ypj_delta_t delta;
+  size_t pos = sizeof (hdr), start = 0;
+  uint32_t i, last = 0;
+
+  memcpy (&hdr, j->map, sizeof (hdr));
+  for (i = 0; i < hdr.ndeltas; i++)
+    {
+      if (pos + sizeof (delta) > j->size)
+	return -1;
+      memcpy (&delta, j->map + pos, sizeof (delta));
+      if (delta.size > j->size - pos - sizeof (delta) ||
+	  (i > 0 && delta.from != last))
+	return -1;
+      if (start == 0 && delta.from == since)
+	start = pos;
+      last = delta.to;
+      pos += sizeof (delta) + delta.size;
+    }
+
+  if (hdr.ndeltas == 0 || last != current)
+    return -1;
+  if (since == current)
+    start = j->size;
+  else if (start == 0)
+    return -1;
+
+  j->start = start;
+  ypj_rewind (j);
+  return 0;
+}
+
+void
+ypj_rewind (ypj_file_t *j)
+{
+  j->pos = j->start;
+  j->left = 0;
+}
+
+/* Returns 1 and the next change, 0 after the last one, or -1 if the
+   journal is corrupt. */
+int
+ypj_next (ypj_file_t *j, uint32_t *op, char **key, size_t *klen,
+	  char **val, size_t *vlen)
+{
+  ypj_rec_t rec;
+
+  while (j->left == 0)
+    {
+      ypj_delta_t delta;
+
+      if (j->pos >= j->size)
+	return 0;
+      if (j->pos + sizeof (delta) > j->size)
+	return -1;
+      memcpy (&delta, j->map + j->pos, sizeof (delta));
+      j->pos += sizeof (delta);
+      j->left = delta.nrecs;
+    }
+
+  if (j->pos + sizeof (rec) > j->size)
+    return -1;
+  memcpy (&rec, j->map + j->pos, sizeof (rec));
+  if ((uint64_t) rec.klen + rec.vlen > j->size - j->pos - sizeof (rec))
+    return -1;
+
+  *op = rec.op;
+  *key = j->map + j->pos + sizeof (rec);
+  *klen = rec.klen;
+  *val = *key + rec.klen;
+  *vlen = rec.vlen;
+  j->pos += sizeof (rec) + rec.klen + rec.vlen;
+  j->left--;
+
+  return 1;
+}
@@ -0,0 +1,83 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifndef __YPJ_H__
+#define __YPJ_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* A ypj file is the change journal of a map, written by makedbm
+   --journal next to the map. It contains the differences between
+   the last versions of the map, the oldest first, so a slave with
+   one of these versions needs only the changes since then. All
+   numbers are in the byte order of the host, which created the
+   file.
+
+   header | delta | records | delta | records | ...
+
+   A delta contains the changes from the map with the order number
+   "from" to the one with "to", the "to" of a delta is the "from" of
+   the next one. A record is followed by its key and value, the
+   value of a deleted key is empty. The YP_ keys are not journaled,
+   except YP_SECURE and YP_INTERDOMAIN, which ypxfr copies, too. */
+
+#define YPJ_SUFFIX ".ypj"
+#define YPJ_MAGIC "YPJMAP01"
+#define YPJ_BYTEORDER 0x01020304
+/* Changes to older versions are dropped */
+#define YPJ_MAXDELTAS 32
+
+#define YPJ_STORE 1		/* key was added or changed */
+#define YPJ_DELETE 2
+
+typedef struct ypj_header
+{
+  char magic[8];
+  uint32_t byteorder;
+  uint32_t ndeltas;
+} ypj_header_t;
+
+typedef struct ypj_delta
+{
+  uint32_t from;
+  uint32_t to;
+  uint32_t nrecs;
+  uint32_t unused;
+  uint64_t size;		/* of the records of this delta */
+} ypj_delta_t;
+
+typedef struct ypj_rec
+{
+  uint32_t op;
+  uint32_t klen;
+  uint32_t vlen;
+  uint32_t unused;
+} ypj_rec_t;
+
+typedef struct ypj_file ypj_file_t;
+
+extern int ypj_update (const char *filename, const char *oldmap,
+		       const char *newmap);
+
+extern ypj_file_t *ypj_open (const char *filename);
+extern int ypj_since (ypj_file_t *j, uint32_t since, uint32_t current);
+extern void ypj_rewind (ypj_file_t *j);
+extern int ypj_next (ypj_file_t *j, uint32_t *op, char **key,
+		     size_t *klen, char **val, size_t *vlen);
+extern void ypj_close (ypj_file_t *j);
+
+#endif
@@ -0,0 +1,120 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "yp.h"
+
+bool_t
+xdr_ypchange (XDR *xdrs, ypchange *objp)
+{
+  if (!xdr_u_int (xdrs, &objp->op) ||
+      !xdr_bytes (xdrs, (char **) &objp->keydat.keydat_val,
+		  &objp->keydat.keydat_len, YPMAXRECORD))
+    return FALSE;
+  return xdr_bytes (xdrs, (char **) &objp->valdat.valdat_val,
+		    &objp->valdat.valdat_len, YPMAXRECORD);
+}
+
+bool_t
+xdr_ypreq_changes (XDR *xdrs, ypreq_changes *objp)
+{
+  if (!xdr_string (xdrs, &objp->domain, YPMAXDOMAIN) ||
+      !xdr_string (xdrs, &objp->map, YPMAXMAP))
+    return FALSE;
+  return xdr_u_int (xdrs, &objp->ordernum);
+}
+
+bool_t
+xdr_ypresp_changes (XDR *xdrs, ypresp_changes *objp)
+{
+  ypchange change;
+  bool_t more;
+
+  if (xdrs->x_op == XDR_FREE)
+    {
+      if (objp->release != NULL)
+	(*objp->release) (objp->data);
+      objp->release = NULL;
+      objp->data = NULL;
+      return TRUE;
+    }
+
+  if (!xdr_ypstat (xdrs, &objp->status) ||
+      !xdr_u_int (xdrs, &objp->ordernum))
+    return FALSE;
+  if (objp->status != YP_TRUE)
+    return TRUE;
+
+  if (xdrs->x_op == XDR_ENCODE)
+    {
+      /* The reply could be encoded a second time into a larger
+	 buffer */
+      (*objp->change) (NULL, objp->data);
+      for (;;)
+	{
+	  int ret;
+
+	  memset (&change, 0, sizeof (change));
+	  if ((ret = (*objp->change) (&change, objp->data)) < 0)
+	    return FALSE;
+	  more = ret > 0;
+	  if (!xdr_bool (xdrs, &more))
+	    return FALSE;
+	  if (!more)
+	    return TRUE;
+	  if (!xdr_ypchange (xdrs, &change))
+	    return FALSE;
+	}
+    }
+
+  for (;;)
+    {
+      int ret;
+
+      if (!xdr_bool (xdrs, &more))
+	return FALSE;
+      if (!more)
+	return TRUE;
+      memset (&change, 0, sizeof (change));
+      if (!xdr_ypchange (xdrs, &change))
+	{
+	  xdr_free ((xdrproc_t) xdr_ypchange, (char *) &change);
+	  return FALSE;
+	}
+      ret = (*objp->change) (&change, objp->data);
+      xdr_free ((xdrproc_t) xdr_ypchange, (char *) &change);
+      if (ret < 0)
+	return FALSE;
+    }
+}
+
+/* Default timeout can be changed using clnt_control() */
+static struct timeval TIMEOUT = { 25, 0 };
+
+enum clnt_stat
+ypproc_changes_3 (ypreq_changes *argp, ypresp_changes *clnt_res,
+		  CLIENT *clnt)
+{
+  return (clnt_call(clnt, YPPROC_CHANGES,
+		    (xdrproc_t) xdr_ypreq_changes, (caddr_t) argp,
+		    (xdrproc_t) xdr_ypresp_changes, (caddr_t) clnt_res,
+		    TIMEOUT));
+}
@@ -22,6 +22,7 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <string.h>
 #include <sys/types.h>
 #include <netinet/in.h>
@@ -33,18 +34,58 @@
 #include "ypserv_conf.h"
 
 int dns_flag = 0;
+/* dns_server (address and port of the name server used for the dns
+   option): NULL means, the first nameserver of /etc/resolv.conf. */
+char *dns_server = NULL;
 int slp_flag = 0;
 unsigned long int slp_timeout = 3600;
 int xfr_check_port = 0;
 char *trusted_master = NULL;
 /* cached_filehandles (how many databases will be cached):
-   big -> slow list searching, we go 3 times through the list.
-   little -> have to close/open very often.
-   We now uses 30, because searching 3 times in the list is faster
-   then reopening the database.
-   You can open max. 255 file handles.
-*/
+   the handles are found with a hash table, so a large number costs
+   only memory and file descriptors. little -> have to close/open
+   very often. */
 int cached_filehandles = 30;
+/* cached_filememory (how many bytes the maps loaded into memory by
+   cached handles may use together): 0 means, there is no limit. */
+unsigned long cached_filememory = 0;
+/* worker_threads (how many additional threads answer UDP requests):
+   0 means, everything is done by the main thread. */
+int worker_threads = 0;
+/* epoll_flag: serve TCP connections from our own epoll loop,
+   tcp_timeout: close TCP connections idle for so many seconds. */
+int epoll_flag = 0;
+int tcp_timeout = 300;
+/* worker_processes (how many ypserv processes share the ports):
+   0 or 1 means, there is only one process. */
+int worker_processes = 0;
+/* udp_batch (how many datagrams are read with one recvmmsg call):
+   0 means, the UDP transports of the RPC library are used. */
+int udp_batch = 0;
+/* match_cache_size (how many bytes the cache of MATCH results may use):
+   0 means, there is no cache. */
+unsigned long match_cache_size = 0;
+/* memory_maps (which maps are loaded completely into memory) and
+   memory_max (how large such a map may be in bytes). */
+char *memory_maps = NULL;
+unsigned long memory_max = 16 * 1024 * 1024;
+/* bloom_bits (how many bits of a Bloom filter are used for every key):
+   0 means, there are no filters. */
+int bloom_bits = 0;
+/* all_streams (how many YPPROC_ALL replies the event loop streams at
+   the same time): 0 means, a child process is forked for every
+   request. */
+int all_streams = 16;
+/* all_cache_size (how many bytes the encoded YPPROC_ALL replies of
+   all maps may use): 0 means, there is no cache. */
+unsigned long all_cache_size = 0;
+/* map_reload: replace the cached handle of a map, if a new version
+   of the map file is renamed into place. */
+int map_reload = 1;
+/* preload_maps (which maps are opened before ypserv is ready) and
+   preload_lock (lock the files of these maps into memory). */
+char *preload_maps = NULL;
+int preload_lock = 0;
 
 
 static int
@@ -187,11 +228,12 @@ load_ypserv_conf (const char *path)
       line++;
       switch (tolower (c))
 	{
-	case 'F':
-	case 'f':
-	  {
+	case 'A':
+	case 'a':
+	  {			/* all_streams / all_cache */
 	    size_t i, j;
-	    unsigned long files = 30;
+	    unsigned long size = 0;
+	    char unit = '\0';
 
 	    if (fgets (buf1, sizeof (buf1) - 1, in) == NULL)
 	      {
@@ -200,7 +242,6 @@ load_ypserv_conf (const char *path)
 	      }
 
 	    i = 0;
-	    buf1[sizeof (buf1) - 1] = '\0';
 	    while (c != ':' && i <= strlen (buf1))
 	      {
 		if ((c == ' ') || (c == '\t'))
@@ -208,39 +249,228 @@ load_ypserv_conf (const char *path)
 		buf2[i] = c;
 		buf2[i + 1] = '\0';
 		c = buf1[i];
-		++i;
+		i++;
 	      }
 
 	    while ((buf1[i - 1] != ':') && (i <= strlen (buf1)))
-	      ++i;
+	      i++;
+
+	    if ((buf1[i - 1] != ':') ||
+		((strcasecmp (buf2, "all_streams") != 0) &&
+		 (strcasecmp (buf2, "all_cache") != 0)))
+	      {
+		log_msg ("Parse error in line %d: => Ignore line", line);
+		break;
+	      }
+
+	    while (((buf1[i] == ' ') || (buf1[i] == '\t')) &&
+		   (i <= strlen (buf1)))
+	      i++;
+	    j = 0;
+	    while ((buf1[i] != '\0') && (buf1[i] != '\n'))
+	      buf3[j++] = buf1[i++];
+	    buf3[j] = 0;
+
+	    sscanf (buf3, "%lu%c", &size, &unit);
+
+	    if (strcasecmp (buf2, "all_streams") == 0)
+	      {
+		all_streams = size;
+
+		if (all_streams > 1024)
+		  all_streams = 1024;
+
+		if (debug_flag)
+		  log_msg ("ypserv.conf: all_streams: %d", all_streams);
+	      }
+	    else
+	      {
+		if (unit == 'k' || unit == 'K')
+		  size *= 1024;
+		else if (unit == 'm' || unit == 'M')
+		  size *= 1024 * 1024;
+
+		all_cache_size = size;
 
-	    if ((buf1[i - 1] == ':') && (strcasecmp (buf2, "files") == 0))
+		if (debug_flag)
+		  log_msg ("ypserv.conf: all_cache: %lu", all_cache_size);
+	      }
+	    break;
+	  }
+	case 'B':
+	case 'b':
+	  {			/* bloom_bits */
+	    size_t i, j;
+	    unsigned long bits = 0;
+
+	    if (fgets (buf1, sizeof (buf1) - 1, in) == NULL)
+	      {
+		log_msg ("Read error in line %d => Ignore line", line);
+		break;
+	      }
+
+	    i = 0;
+	    while (c != ':' && i <= strlen (buf1))
+	      {
+		if ((c == ' ') || (c == '\t'))
+		  break;
+		buf2[i] = c;
+		buf2[i + 1] = '\0';
+		c = buf1[i];
+		i++;
+	      }
+
+	    while ((buf1[i - 1] != ':') && (i <= strlen (buf1)))
+	      i++;
+
+	    if ((buf1[i - 1] == ':') && (strcasecmp (buf2, "bloom_bits") == 0))
 	      {
 		while (((buf1[i] == ' ') || (buf1[i] == '\t')) &&
 		       (i <= strlen (buf1)))
-		  ++i;
+		  i++;
 		j = 0;
 		while ((buf1[i] != '\0') && (buf1[i] != '\n'))
 		  buf3[j++] = buf1[i++];
 		buf3[j] = 0;
 
-		sscanf (buf3, "%lu", &files);
+		sscanf (buf3, "%lu", &bits);
+
+		bloom_bits = bits;
+
+		if (bloom_bits > 32)
+		  bloom_bits = 32;
+
+		if (debug_flag)
+		  log_msg ("ypserv.conf: bloom_bits: %d", bloom_bits);
 	      }
 	    else
 	      log_msg ("Parse error in line %d: => Ignore line", line);
+	    break;
+	  }
+	case 'E':
+	case 'e':
+	  {			/* epoll */
+	    size_t i, j;
 
-	    cached_filehandles = files;
+	    if (fgets (buf1, sizeof (buf1) - 1, in) == NULL)
+	      {
+		log_msg ("Read error in line %d => Ignore line", line);
+		break;
+	      }
 
-	    if (cached_filehandles > 255)
-              cached_filehandles = 255;
+	    i = 0;
+	    while (c != ':' && i <= strlen (buf1))
+	      {
+		if ((c == ' ') || (c == '\t'))
+		  break;
+		buf2[i] = c;
+		buf2[i + 1] = '\0';
+		c = buf1[i];
+		i++;
+	      }
+
+	    while ((buf1[i - 1] != ':') && (i <= strlen (buf1)))
+	      i++;
+
+	    if ((buf1[i - 1] == ':') && (strcasecmp (buf2, "epoll") == 0))
+	      {
+		while (((buf1[i] == ' ') || (buf1[i] == '\t')) &&
+		       (i <= strlen (buf1)))
+		  i++;
+		j = 0;
+		while ((buf1[i] != '\0') && (buf1[i] != '\n'))
+		  buf3[j++] = buf1[i++];
+		buf3[j] = 0;
+
+		sscanf (buf3, "%s", buf2);
+		if (strcasecmp (buf2, "yes") == 0)
+		  epoll_flag = 1;
+		else if (strcasecmp (buf2, "no") == 0)
+		  epoll_flag = 0;
+		else
+		  log_msg ("Unknown epoll option in line %d: => Ignore line",
+			   line);
+	      }
+	    else
+	      log_msg ("Parse error in line %d: => Ignore line", line);
 
 	    if (debug_flag)
-	      log_msg ("ypserv.conf: files: %lu", files);
+	      log_msg ("ypserv.conf: epoll: %d", epoll_flag);
+	    break;
+	  }
+	case 'F':
+	case 'f':
+	  {			/* files / files_memory */
+	    size_t i, j;
+	    unsigned long files = 30;
+	    char unit = '\0';
+
+	    if (fgets (buf1, sizeof (buf1) - 1, in) == NULL)
+	      {
+		log_msg ("Read error in line %d => Ignore line", line);
+		break;
+	      }
+
+	    i = 0;
+	    buf1[sizeof (buf1) - 1] = '\0';
+	    while (c != ':' && i <= strlen (buf1))
+	      {
+		if ((c == ' ') || (c == '\t'))
+		  break;
+		buf2[i] = c;
+		buf2[i + 1] = '\0';
+		c = buf1[i];
+		++i;
+	      }
+
+	    while ((buf1[i - 1] != ':') && (i <= strlen (buf1)))
+	      ++i;
+
+	    if ((buf1[i - 1] != ':') ||
+		((strcasecmp (buf2, "files") != 0) &&
+		 (strcasecmp (buf2, "files_memory") != 0)))
+	      {
+		log_msg ("Parse error in line %d: => Ignore line", line);
+		break;
+	      }
+
+	    while (((buf1[i] == ' ') || (buf1[i] == '\t')) &&
+		   (i <= strlen (buf1)))
+	      ++i;
+	    j = 0;
+	    while ((buf1[i] != '\0') && (buf1[i] != '\n'))
+	      buf3[j++] = buf1[i++];
+	    buf3[j] = 0;
+
+	    sscanf (buf3, "%lu%c", &files, &unit);
+
+	    if (strcasecmp (buf2, "files") == 0)
+	      {
+		if (files > INT_MAX)
+		  files = INT_MAX;
+		cached_filehandles = files;
+
+		if (debug_flag)
+		  log_msg ("ypserv.conf: files: %lu", files);
+	      }
+	    else
+	      {
+		if (unit == 'k' || unit == 'K')
+		  files *= 1024;
+		else if (unit == 'm' || unit == 'M')
+		  files *= 1024 * 1024;
+
+		cached_filememory = files;
+
+		if (debug_flag)
+		  log_msg ("ypserv.conf: files_memory: %lu",
+			   cached_filememory);
+	      }
 	    break;
 	  }
 	case 'D':
 	case 'd':
-	  {
+	  {			/* dns / dns_server */
 	    size_t i, j;
 
 	    if (fgets (buf1, sizeof (buf1) - 1, in) == NULL)
@@ -263,7 +493,31 @@ load_ypserv_conf (const char *path)
 	    while ((buf1[i - 1] != ':') && (i <= strlen (buf1)))
 	      i++;
 
-	    if ((buf1[i - 1] == ':') && (strcasecmp (buf2, "dns") == 0))
+	    if ((buf1[i - 1] == ':') && (strcasecmp (buf2, "dns_server") == 0))
+	      {
+		while (((buf1[i] == ' ') || (buf1[i] == '\t')) &&
+		       (i <= strlen (buf1)))
+		  i++;
+		j = 0;
+		while ((buf1[i] != '\0') && (buf1[i] != '\n'))
+		  buf3[j++] = buf1[i++];
+		buf3[j] = 0;
+
+		if (sscanf (buf3, "%s", buf2) != 1)
+		  {
+		    log_msg ("Parse error in line %d: => Ignore line", line);
+		    break;
+		  }
+		free (dns_server);
+		if ((dns_server = strdup (buf2)) == NULL)
+		  log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+			   __FILE__, __LINE__);
+
+		if (debug_flag)
+		  log_msg ("ypserv.conf: dns_server: %s", buf2);
+		break;
+	      }
+	    else if ((buf1[i - 1] == ':') && (strcasecmp (buf2, "dns") == 0))
 	      {
 		if (!dns_flag)	/* Do not overwrite parameter */
 		  {
@@ -292,6 +546,238 @@ load_ypserv_conf (const char *path)
 	      log_msg ("ypserv.conf: dns: %d", dns_flag);
 	    break;
 	  }
+	case 'M':
+	case 'm':
+	  {			/* match_cache / memory_maps / memory_max */
+	    size_t i, j;
+	    unsigned long size = 0;
+	    char unit = '\0';
+
+	    if (fgets (buf1, sizeof (buf1) - 1, in) == NULL)
+	      {
+		log_msg ("Read error in line %d => Ignore line", line);
+		break;
+	      }
+
+	    i = 0;
+	    while (c != ':' && i <= strlen (buf1))
+	      {
+		if ((c == ' ') || (c == '\t'))
+		  break;
+		buf2[i] = c;
+		buf2[i + 1] = '\0';
+		c = buf1[i];
+		i++;
+	      }
+
+	    while ((buf1[i - 1] != ':') && (i <= strlen (buf1)))
+	      i++;
+
+	    if ((buf1[i - 1] != ':') ||
+		((strcasecmp (buf2, "match_cache") != 0) &&
+		 (strcasecmp (buf2, "memory_maps") != 0) &&
+		 (strcasecmp (buf2, "memory_max") != 0)))
+	      {
+		log_msg ("Parse error in line %d: => Ignore line", line);
+		break;
+	      }
+
+	    while (((buf1[i] == ' ') || (buf1[i] == '\t')) &&
+		   (i <= strlen (buf1)))
+	      i++;
+	    j = 0;
+	    while ((buf1[i] != '\0') && (buf1[i] != '\n'))
+	      buf3[j++] = buf1[i++];
+	    buf3[j] = 0;
+
+	    if (strcasecmp (buf2, "memory_maps") == 0)
+	      {
+		char *tmp;
+
+		/* The maps of several lines are added */
+		if (memory_maps == NULL)
+		  tmp = strdup (buf3);
+		else if (asprintf (&tmp, "%s %s", memory_maps, buf3) < 0)
+		  tmp = NULL;
+		if (tmp == NULL)
+		  {
+		    log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+			     __FILE__, __LINE__);
+		    break;
+		  }
+		free (memory_maps);
+		memory_maps = tmp;
+
+		if (debug_flag)
+		  log_msg ("ypserv.conf: memory_maps: %s", memory_maps);
+		break;
+	      }
+
+	    sscanf (buf3, "%lu%c", &size, &unit);
+	    if (unit == 'k' || unit == 'K')
+	      size *= 1024;
+	    else if (unit == 'm' || unit == 'M')
+	      size *= 1024 * 1024;
+
+	    if (strcasecmp (buf2, "match_cache") == 0)
+	      {
+		match_cache_size = size;
+
+		if (debug_flag)
+		  log_msg ("ypserv.conf: match_cache: %lu", match_cache_size);
+	      }
+	    else
+	      {
+		memory_max = size;
+
+		if (debug_flag)
+		  log_msg ("ypserv.conf: memory_max: %lu", memory_max);
+	      }
+	    break;
+	  }
+	case 'P':
+	case 'p':
+	  {			/* processes / preload / preload_lock */
+	    size_t i, j;
+	    unsigned long processes = 0;
+
+	    if (fgets (buf1, sizeof (buf1) - 1, in) == NULL)
+	      {
+		log_msg ("Read error in line %d => Ignore line", line);
+		break;
+	      }
+
+	    i = 0;
+	    while (c != ':' && i <= strlen (buf1))
+	      {
+		if ((c == ' ') || (c == '\t'))
+		  break;
+		buf2[i] = c;
+		buf2[i + 1] = '\0';
+		c = buf1[i];
+		i++;
+	      }
+
+	    while ((buf1[i - 1] != ':') && (i <= strlen (buf1)))
+	      i++;
+
+	    if ((buf1[i - 1] != ':') ||
+		((strcasecmp (buf2, "processes") != 0) &&
+		 (strcasecmp (buf2, "preload") != 0) &&
+		 (strcasecmp (buf2, "preload_lock") != 0)))
+	      {
+		log_msg ("Parse error in line %d: => Ignore line", line);
+		break;
+	      }
+
+	    while (((buf1[i] == ' ') || (buf1[i] == '\t')) &&
+		   (i <= strlen (buf1)))
+	      i++;
+	    j = 0;
+	    while ((buf1[i] != '\0') && (buf1[i] != '\n'))
+	      buf3[j++] = buf1[i++];
+	    buf3[j] = 0;
+
+	    if (strcasecmp (buf2, "preload") == 0)
+	      {
+		char *tmp;
+
+		/* The maps of several lines are added */
+		if (preload_maps == NULL)
+		  tmp = strdup (buf3);
+		else if (asprintf (&tmp, "%s %s", preload_maps, buf3) < 0)
+		  tmp = NULL;
+		if (tmp == NULL)
+		  {
+		    log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+			     __FILE__, __LINE__);
+		    break;
+		  }
+		free (preload_maps);
+		preload_maps = tmp;
+
+		if (debug_flag)
+		  log_msg ("ypserv.conf: preload: %s", preload_maps);
+	      }
+	    else if (strcasecmp (buf2, "preload_lock") == 0)
+	      {
+		sscanf (buf3, "%s", buf2);
+		if (strcasecmp (buf2, "yes") == 0)
+		  preload_lock = 1;
+		else if (strcasecmp (buf2, "no") == 0)
+		  preload_lock = 0;
+		else
+		  log_msg ("Unknown preload_lock option in line %d: => Ignore line",
+			   line);
+
+		if (debug_flag)
+		  log_msg ("ypserv.conf: preload_lock: %d", preload_lock);
+	      }
+	    else
+	      {
+		sscanf (buf3, "%lu", &processes);
+
+		worker_processes = processes;
+
+		if (worker_processes > 64)
+		  worker_processes = 64;
+
+		if (debug_flag)
+		  log_msg ("ypserv.conf: processes: %d", worker_processes);
+	      }
+	    break;
+	  }
+	case 'R':
+	case 'r':
+	  {			/* reload */
+	    size_t i, j;
+
+	    if (fgets (buf1, sizeof (buf1) - 1, in) == NULL)
+	      {
+		log_msg ("Read error in line %d => Ignore line", line);
+		break;
+	      }
+
+	    i = 0;
+	    while (c != ':' && i <= strlen (buf1))
+	      {
+		if ((c == ' ') || (c == '\t'))
+		  break;
+		buf2[i] = c;
+		buf2[i + 1] = '\0';
+		c = buf1[i];
+		i++;
+	      }
+
+	    while ((buf1[i - 1] != ':') && (i <= strlen (buf1)))
+	      i++;
+
+	    if ((buf1[i - 1] == ':') && (strcasecmp (buf2, "reload") == 0))
+	      {
+		while (((buf1[i] == ' ') || (buf1[i] == '\t')) &&
+		       (i <= strlen (buf1)))
+		  i++;
+		j = 0;
+		while ((buf1[i] != '\0') && (buf1[i] != '\n'))
+		  buf3[j++] = buf1[i++];
+		buf3[j] = 0;
+
+		sscanf (buf3, "%s", buf2);
+		if (strcasecmp (buf2, "yes") == 0)
+		  map_reload = 1;
+		else if (strcasecmp (buf2, "no") == 0)
+		  map_reload = 0;
+		else
+		  log_msg ("Unknown reload option in line %d: => Ignore line",
+			   line);
+	      }
+	    else
+	      log_msg ("Parse error in line %d: => Ignore line", line);
+
+	    if (debug_flag)
+	      log_msg ("ypserv.conf: reload: %d", map_reload);
+	    break;
+	  }
 	case 'S':
 	case 's':
 	  {			/* sunos_kludge / slp */
@@ -379,7 +865,7 @@ load_ypserv_conf (const char *path)
 	  }
 	case 'T':
 	case 't':
-	  {			/* tryresolve / trusted_master */
+	  {			/* tryresolve / trusted_master / threads / tcp_timeout */
 	    size_t i, j;
 
 	    if (fgets (buf1, sizeof (buf1) - 1, in) == NULL)
@@ -421,12 +907,103 @@ load_ypserv_conf (const char *path)
 
 		sscanf (buf3, "%s", buf2);
 		trusted_master = strdup (buf2);
+
+		if (debug_flag)
+		  log_msg ("ypserv.conf: trusted_master: %s", trusted_master);
+	      }
+	    else if ((buf1[i - 1] == ':') && (strcasecmp (buf2, "threads") == 0))
+	      {
+		unsigned long threads = 0;
+
+		while (((buf1[i] == ' ') || (buf1[i] == '\t')) &&
+		       (i <= strlen (buf1)))
+		  i++;
+		j = 0;
+		while ((buf1[i] != '\0') && (buf1[i] != '\n'))
+		  buf3[j++] = buf1[i++];
+		buf3[j] = 0;
+
+		sscanf (buf3, "%lu", &threads);
+
+		worker_threads = threads;
+
+		if (worker_threads > 64)
+		  worker_threads = 64;
+
+		if (debug_flag)
+		  log_msg ("ypserv.conf: threads: %d", worker_threads);
+	      }
+	    else if ((buf1[i - 1] == ':') && (strcasecmp (buf2, "tcp_timeout") == 0))
+	      {
+		unsigned long timeout = 0;
+
+		while (((buf1[i] == ' ') || (buf1[i] == '\t')) &&
+		       (i <= strlen (buf1)))
+		  i++;
+		j = 0;
+		while ((buf1[i] != '\0') && (buf1[i] != '\n'))
+		  buf3[j++] = buf1[i++];
+		buf3[j] = 0;
+
+		sscanf (buf3, "%lu", &timeout);
+
+		tcp_timeout = timeout;
+
+		if (debug_flag)
+		  log_msg ("ypserv.conf: tcp_timeout: %d", tcp_timeout);
 	      }
 	    else
 	      log_msg ("Parse error in line %d: => Ignore line", line);
+	    break;
+	  }
+	case 'U':
+	case 'u':
+	  {			/* udp_batch */
+	    size_t i, j;
+	    unsigned long batch = 0;
 
-	    if (debug_flag)
-	      log_msg ("ypserv.conf: trusted_master: %s", trusted_master);
+	    if (fgets (buf1, sizeof (buf1) - 1, in) == NULL)
+	      {
+		log_msg ("Read error in line %d => Ignore line", line);
+		break;
+	      }
+
+	    i = 0;
+	    while (c != ':' && i <= strlen (buf1))
+	      {
+		if ((c == ' ') || (c == '\t'))
+		  break;
+		buf2[i] = c;
+		buf2[i + 1] = '\0';
+		c = buf1[i];
+		i++;
+	      }
+
+	    while ((buf1[i - 1] != ':') && (i <= strlen (buf1)))
+	      i++;
+
+	    if ((buf1[i - 1] == ':') && (strcasecmp (buf2, "udp_batch") == 0))
+	      {
+		while (((buf1[i] == ' ') || (buf1[i] == '\t')) &&
+		       (i <= strlen (buf1)))
+		  i++;
+		j = 0;
+		while ((buf1[i] != '\0') && (buf1[i] != '\n'))
+		  buf3[j++] = buf1[i++];
+		buf3[j] = 0;
+
+		sscanf (buf3, "%lu", &batch);
+
+		udp_batch = batch;
+
+		if (udp_batch > 1024)
+		  udp_batch = 1024;
+
+		if (debug_flag)
+		  log_msg ("ypserv.conf: udp_batch: %d", udp_batch);
+	      }
+	    else
+	      log_msg ("Parse error in line %d: => Ignore line", line);
 	    break;
 	  }
 	case 'X':
@@ -483,9 +1060,11 @@ load_ypserv_conf (const char *path)
 	case '1': case '2': case '3':
 	case '4': case '5': case '6':
 	case '7': case '8': case '9':
-	case '*':
+	case '*': case '[':
 	  {
 	    char *n, *d, *m, *s, *p, *f;
+	    struct in6_addr network6;
+	    long prefixlen = 128;
 	    conffile_t *tmp;
 
 	    buf1[0] = c;
@@ -495,13 +1074,40 @@ load_ypserv_conf (const char *path)
 		break;
 	      }
 
-	    n = strtok (buf1, ":");
-	    if (n == NULL)
+	    if (c == '[')
 	      {
-		log_msg ("Parse error in line %d => Ignore line", line);
-		break;
+		/* [2001:db8::]/32, the address itself contains ':' */
+		n = strchr (buf1, ']');
+		if (n != NULL)
+		  {
+		    *n++ = '\0';
+		    n += strspn (n, " \t");
+		    if (*n == '/')
+		      {
+			prefixlen = strtol (n + 1, &n, 10);
+			n += strspn (n, " \t");
+		      }
+		    if (*n != ':' || prefixlen < 0 || prefixlen > 128 ||
+			inet_pton (AF_INET6, &buf1[1], &network6) != 1)
+		      n = NULL;
+		  }
+		if (n == NULL)
+		  {
+		    log_msg ("Malformed network/netmask entry in line %d", line);
+		    break;
+		  }
+		d = strtok (n + 1, ":");
+	      }
+	    else
+	      {
+		n = strtok (buf1, ":");
+		if (n == NULL)
+		  {
+		    log_msg ("Parse error in line %d => Ignore line", line);
+		    break;
+		  }
+		d = strtok (NULL, ":");
 	      }
-	    d = strtok (NULL, ":");
 	    if (d == NULL)
 	      {
 		log_msg ("No domain given in line %d => Ignore line", line);
@@ -531,10 +1137,28 @@ load_ypserv_conf (const char *path)
 		log_msg ("ERROR: could not allocate enough memory! [%s|%d]", __FILE__, __LINE__);
 		exit (1);
 	      }
-	    tmp->next = NULL;
+	    memset (tmp, 0, sizeof (conffile_t));
+
+	    if (c == '[')
+	      {
+		int i;
 
-	    if (c == '*')
+		tmp->family = AF_INET6;
+		for (i = 0; i < 16; i++)
+		  {
+		    if (prefixlen >= 8)
+		      tmp->netmask6.s6_addr[i] = 0xff;
+		    else if (prefixlen > 0)
+		      tmp->netmask6.s6_addr[i] =
+			(unsigned char)(0xff << (8 - prefixlen));
+		    prefixlen -= 8;
+		    tmp->network6.s6_addr[i] =
+		      network6.s6_addr[i] & tmp->netmask6.s6_addr[i];
+		  }
+	      }
+	    else if (c == '*')
 	      {
+		tmp->family = AF_UNSPEC;
 #if defined(HAVE_INET_ATON)
 		inet_aton ("0.0.0.0", &tmp->network);
 		inet_aton ("0.0.0.0", &tmp->netmask);
@@ -545,6 +1169,7 @@ load_ypserv_conf (const char *path)
 	      }
 	    else
 	      {
+		tmp->family = AF_INET;
 		if (getipnr (n, buf2, buf3) != 0)
 		  {
 		    log_msg ("Malformed network/netmask entry in line %d", line);
@@ -588,12 +1213,27 @@ load_ypserv_conf (const char *path)
 			 line);
 		free (tmp->map);
 		free (tmp);
+		break;
 	      }
 	    if (debug_flag)
 	      {
-		log_msg ("ypserv.conf: %s/%s:%s:%s:%d",
-			 inet_ntoa (tmp->network), inet_ntoa (tmp->netmask),
-			 tmp->domain, tmp->map, tmp->security);
+		char host[INET6_ADDRSTRLEN];
+		char mask[INET6_ADDRSTRLEN];
+
+		if (tmp->family == AF_INET6)
+		  log_msg ("ypserv.conf: %s/%s:%s:%s:%d",
+			   inet_ntop (AF_INET6, &tmp->network6,
+				      host, sizeof (host)),
+			   inet_ntop (AF_INET6, &tmp->netmask6,
+				      mask, sizeof (mask)),
+			   tmp->domain, tmp->map, tmp->security);
+		else
+		  log_msg ("ypserv.conf: %s/%s:%s:%s:%d",
+			   inet_ntop (AF_INET, &tmp->network,
+				      host, sizeof (host)),
+			   inet_ntop (AF_INET, &tmp->netmask,
+				      mask, sizeof (mask)),
+			   tmp->domain, tmp->map, tmp->security);
 	      }
 
 	    if (work == NULL)
@@ -24,8 +24,11 @@
 /* Struct for ypserv.conf options */
 typedef struct conffile
 {
+  int family;			/* AF_UNSPEC for "*" */
   struct in_addr netmask;
   struct in_addr network;
+  struct in6_addr netmask6;
+  struct in6_addr network6;
   char *domain;
   char *map;
   int security;
@@ -33,11 +36,27 @@ typedef struct conffile
 } conffile_t;
 
 extern int dns_flag;
+extern char *dns_server;
 extern int slp_flag;
 extern unsigned long int slp_timeout;
 extern int cached_filehandles;
+extern unsigned long cached_filememory;
 extern int xfr_check_port;
 extern char *trusted_master;
+extern int worker_threads;
+extern int epoll_flag;
+extern int tcp_timeout;
+extern int worker_processes;
+extern int udp_batch;
+extern unsigned long match_cache_size;
+extern char *memory_maps;
+extern unsigned long memory_max;
+extern int bloom_bits;
+extern int all_streams;
+extern unsigned long all_cache_size;
+extern int map_reload;
+extern char *preload_maps;
+extern int preload_lock;
 
 extern void load_config(void);
 extern conffile_t *load_ypserv_conf(const char *);
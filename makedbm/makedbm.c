@@ -40,6 +40,9 @@ int callrpc (char *host, u_long prognum, u_long versnum, u_long procnum,
 #include <sys/time.h>
 #include <sys/stat.h>
 
+#include "ypc.h"
+#include "ypj.h"
+
 #if defined(HAVE_COMPAT_LIBGDBM)
 
 #if defined(HAVE_LIBGDBM)
@@ -66,6 +69,12 @@ static DBM *dbm;
 
 #include <tcbdb.h>
 
+/* Tokyo Cabinet has no datum, the same as in lib/yp.h */
+typedef struct {
+  char *dptr;
+  int dsize;
+} datum;
+
 #define YPDB_REPLACE 1
 
 static TCBDB *dbm;
@@ -93,6 +102,8 @@ ypdb_close (TCBDB *dbm)
 #endif
 
 static int lower = 0;
+/* With --mmap, all records are written to a ypc file, too */
+static ypc_writer_t *ypc = NULL;
 
 static inline void
 write_data (datum key, datum data)
@@ -103,6 +114,13 @@ write_data (datum key, datum data)
       ypdb_close (dbm);
       exit (1);
     }
+  if (ypc != NULL && ypc_add (ypc, key.dptr, key.dsize,
+			      data.dptr, data.dsize) != 0)
+    {
+      fprintf (stderr, "makedbm: Out of memory\n");
+      ypdb_close (dbm);
+      exit (1);
+    }
 }
 
 #ifdef HAVE_NDBM
@@ -123,12 +141,14 @@ create_file (char *fileName, char *dbmName, char *masterName,
 	     char *domainName, char *inputName,
 	     char *outputName, int aliases, int shortlines,
 	     int b_flag, int s_flag, int remove_comments,
-	     int check_limit)
+	     int check_limit, int mmap_flag, int journal_flag)
 {
   datum kdat, vdat;
   char *key = NULL;
   size_t keylen = 0;
   char *filename = NULL;
+  char *ypcname = NULL;
+  char *ypjname = NULL;
   FILE *input;
   char orderNum[12];
   struct timeval tv;
@@ -161,6 +181,12 @@ create_file (char *fileName, char *dbmName, char *masterName,
       exit (1);
     }
 
+  if (mmap_flag && (ypc = ypc_create ()) == NULL)
+    {
+      fprintf (stderr, "makedbm: Out of memory\n");
+      exit (1);
+    }
+
   if (masterName && *masterName)
     {
       kdat.dptr = "YP_MASTER_NAME";
@@ -418,6 +444,69 @@ create_file (char *fileName, char *dbmName, char *masterName,
     }
 
   ypdb_close (dbm);
+
+  /* With --journal, the changes to the old map, which is still
+     there, are added to the journal. Else an old journal does not
+     fit the new map anymore. */
+  ypjname = calloc (1, strlen (dbmName) + sizeof (YPJ_SUFFIX) + 1);
+  if (ypjname == NULL)
+    {
+      fprintf (stderr, "makedbm: Out of memory\n");
+      exit (1);
+    }
+  sprintf (ypjname, "%s%s", dbmName, YPJ_SUFFIX);
+  if (journal_flag)
+    {
+      if (ypj_update (ypjname, dbmName, filename) != 0)
+	{
+	  fprintf (stderr, "makedbm: Cannot write %s\n", ypjname);
+	  unlink (ypjname);
+	}
+    }
+  else
+    unlink (ypjname);
+  free (ypjname);
+
+  /* ypserv uses the ypc file instead of the database. Without --mmap,
+     an old one has to be removed. */
+  ypcname = calloc (1, strlen (dbmName) + sizeof (YPC_SUFFIX) + 1);
+  if (ypcname == NULL)
+    {
+      fprintf (stderr, "makedbm: Out of memory\n");
+      exit (1);
+    }
+  sprintf (ypcname, "%s%s", dbmName, YPC_SUFFIX);
+  if (ypc != NULL)
+    {
+      char *ypctmp = calloc (1, strlen (ypcname) + 2);
+
+      if (ypctmp == NULL)
+	{
+	  fprintf (stderr, "makedbm: Out of memory\n");
+	  exit (1);
+	}
+      sprintf (ypctmp, "%s~", ypcname);
+#if defined(HAVE_NDBM)
+      /* ypserv does not use ypc files with NDBM */
+      if (ypc_write (ypc, ypctmp, NULL) != 0)
+#else
+      /* The database is renamed afterwards, which keeps the inode */
+      if (ypc_write (ypc, ypctmp, filename) != 0)
+#endif
+	{
+	  fprintf (stderr, "makedbm: Cannot write %s\n", ypctmp);
+	  unlink (ypcname);
+	}
+      else
+	rename (ypctmp, ypcname);
+      free (ypctmp);
+      ypc_free (ypc);
+      ypc = NULL;
+    }
+  else
+    unlink (ypcname);
+  free (ypcname);
+
 #if defined(HAVE_NDBM)
 #if defined(__GLIBC__) && __GLIBC__ >= 2
   {
@@ -619,7 +708,9 @@ Usage (int exit_code)
 {
   fprintf (stderr, "usage: makedbm -u dbname\n");
   fprintf (stderr, "       makedbm [-a|-r] [-b] [-c] [-s] [-l] [-i YP_INPUT_NAME]\n");
-  fprintf (stderr, "               [-o YP_OUTPUT_NAME] [-m YP_MASTER_NAME] inputfile dbname\n");
+  fprintf (stderr, "               [-o YP_OUTPUT_NAME] [-m YP_MASTER_NAME] [--mmap]\n");
+  fprintf (stderr, "               [--journal]\n");
+  fprintf (stderr, "               inputfile dbname\n");
   fprintf (stderr, "       makedbm -c\n");
   fprintf (stderr, "       makedbm --version\n");
   exit (exit_code);
@@ -640,6 +731,8 @@ main (int argc, char *argv[])
   int s_flag = 0;
   int remove_comments = 0;
   int check_limit = 1;
+  int mmap_flag = 0;
+  int journal_flag = 0;
 
   while (1)
     {
@@ -657,6 +750,8 @@ main (int argc, char *argv[])
 	{"remove-spaces", no_argument, NULL, '\254'},
 	{"remove-comments", no_argument, NULL, 'r'},
 	{"no-limit-check", no_argument, NULL, '\253'},
+	{"mmap", no_argument, NULL, '\252'},
+	{"journal", no_argument, NULL, '\251'},
 	{NULL, 0, NULL, '\0'}
       };
 
@@ -708,6 +803,12 @@ main (int argc, char *argv[])
 	case '\253':
 	  check_limit = 0;
 	  break;
+	case '\252':
+	  mmap_flag++;
+	  break;
+	case '\251':
+	  journal_flag++;
+	  break;
 	case '\255':
 	  fprintf  (stdout, "makedbm (%s) %s", PACKAGE, VERSION);
 	  return 0;
@@ -755,7 +856,8 @@ main (int argc, char *argv[])
 
 	  create_file (argv[0], argv[1], masterName, domainName,
 		       inputName, outputName, aliases, shortline,
-		       b_flag, s_flag, remove_comments, check_limit);
+		       b_flag, s_flag, remove_comments, check_limit,
+		       mmap_flag, journal_flag);
 
 	  if (clear)
 	    send_clear ();
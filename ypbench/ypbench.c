@@ -0,0 +1,887 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+/* ypbench sends a mix of requests from many concurrent clients to
+   one ypserv and reports the throughput and the latency distribution
+   of every procedure. The server is contacted directly on the given
+   port, rpcbind is not asked. The keys for MATCH and NEXT are taken
+   from the map itself and chosen with a Zipf distribution, so that
+   a few keys are requested very often and most keys seldom. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <rpc/rpc.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "yp.h"
+#include <rpcsvc/ypclnt.h>
+#include "log_msg.h"
+
+enum {
+  OP_MATCH,
+  OP_FIRST,
+  OP_NEXT,
+  OP_ORDER,
+  OP_MAPLIST,
+  OP_ALL,
+  NR_OPS
+};
+
+static const char *op_names[NR_OPS] = {
+  "match", "first", "next", "order", "maplist", "all"
+};
+
+/* The latency histogram has HIST_SUB buckets for every power of two
+   nanoseconds, which gives a resolution of about 6%. */
+#define HIST_SHIFT 4
+#define HIST_SUB (1 << HIST_SHIFT)
+#define HIST_BUCKETS (40 * HIST_SUB)
+
+typedef struct bench_stats {
+  unsigned long requests[NR_OPS];
+  unsigned long errors[NR_OPS];
+  unsigned long entries;	/* received with ALL */
+  uint64_t max[NR_OPS];
+  unsigned long hist[NR_OPS][HIST_BUCKETS];
+} bench_stats_t;
+
+typedef struct bench_client {
+  pthread_t tid;
+  int tcp;
+  CLIENT *clnt;
+  CLIENT *clnt_tcp;		/* for ALL, if clnt is UDP */
+  unsigned long todo;		/* if a number of requests is given */
+  uint64_t rng;
+  bench_stats_t stats;
+} bench_client_t;
+
+/* Keys of the map, keys[0] is requested most often */
+typedef struct bench_keys {
+  unsigned long count;
+  unsigned long size;
+  keydat_t *keys;
+  double *cdf;
+} bench_keys_t;
+
+static struct timeval TIMEOUT = { 5, 0 };
+static struct timeval RETRY = { 1, 0 };
+
+static struct sockaddr_storage server_addr;
+static socklen_t server_addrlen;
+static char *domain;
+static char *map;
+static bench_keys_t keys;
+static unsigned int mix[NR_OPS] = { 100, 0, 0, 0, 0, 0 };
+static unsigned int mix_total = 100;
+static unsigned long requests;
+
+static pthread_barrier_t start_barrier;
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static unsigned int done_clients;
+static volatile int stop_flag;
+
+static uint64_t
+now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static unsigned int
+hist_bucket (uint64_t ns)
+{
+  unsigned int e, idx;
+
+  if (ns < HIST_SUB)
+    return ns;
+  e = 63 - __builtin_clzll (ns);
+  idx = (e - HIST_SHIFT + 1) * HIST_SUB
+    + ((ns >> (e - HIST_SHIFT)) & (HIST_SUB - 1));
+  return idx < HIST_BUCKETS ? idx : HIST_BUCKETS - 1;
+}
+
+/* Smallest latency of a bucket */
+static uint64_t
+hist_value (unsigned int idx)
+{
+  unsigned int e;
+
+  if (idx < HIST_SUB)
+    return idx;
+  e = idx / HIST_SUB + HIST_SHIFT - 1;
+  return (uint64_t) (HIST_SUB + idx % HIST_SUB) << (e - HIST_SHIFT);
+}
+
+/* Latency in microseconds, below which are p of the requests. The
+   upper end of the bucket is used, but not more than the maximum. */
+static double
+hist_percentile (const unsigned long *hist, unsigned long count,
+		 uint64_t max, double p)
+{
+  unsigned long sum = 0, rank;
+  double r = p * count;
+  unsigned int i;
+
+  if (count == 0)
+    return 0;
+  rank = r;
+  if (rank < r || rank == 0)
+    rank++;
+  for (i = 0; i < HIST_BUCKETS; i++)
+    {
+      sum += hist[i];
+      if (sum >= rank)
+	break;
+    }
+  if (i < HIST_BUCKETS && hist_value (i + 1) < max)
+    max = hist_value (i + 1);
+  return max / 1000.0;
+}
+
+/* xorshift64* */
+static uint64_t
+rng_next (uint64_t *state)
+{
+  uint64_t x = *state;
+
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  return x * 0x2545F4914F6CDD1DULL;
+}
+
+static double
+rng_double (uint64_t *state)
+{
+  return (rng_next (state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static void
+zipf_init (double exponent)
+{
+  unsigned long i;
+  double sum = 0;
+
+  keys.cdf = malloc (keys.count * sizeof (double));
+  if (keys.cdf == NULL)
+    {
+      log_msg ("malloc() failed: %s", strerror (errno));
+      exit (1);
+    }
+  for (i = 0; i < keys.count; i++)
+    {
+      sum += pow (i + 1, -exponent);
+      keys.cdf[i] = sum;
+    }
+  for (i = 0; i < keys.count; i++)
+    keys.cdf[i] /= sum;
+}
+
+static keydat_t *
+zipf_key (uint64_t *rng)
+{
+  double u = rng_double (rng);
+  unsigned long lo = 0, hi = keys.count - 1;
+
+  while (lo < hi)
+    {
+      unsigned long mid = lo + (hi - lo) / 2;
+
+      if (keys.cdf[mid] < u)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return &keys.keys[lo];
+}
+
+/* Decodes the reply of YPPROC_ALL. libnsl uses a global callback for
+   this, which cannot be shared by several threads, so the entries
+   are decoded here. They are only counted, or, if a bench_keys_t is
+   given, their keys are collected. */
+typedef struct all_result {
+  ypstat status;
+  unsigned long entries;
+  bench_keys_t *keys;
+} all_result_t;
+
+static bool_t
+xdr_bench_all (XDR *xdrs, all_result_t *res)
+{
+  while (1)
+    {
+      ypresp_key_val kv;
+      bool_t more;
+
+      if (!xdr_bool (xdrs, &more))
+	return FALSE;
+      if (!more)
+	return TRUE;
+      memset (&kv, 0, sizeof (kv));
+      if (!xdr_ypresp_key_val (xdrs, &kv))
+	return FALSE;
+      if (kv.status != YP_TRUE)
+	{
+	  if (kv.status != YP_NOMORE)
+	    res->status = kv.status;
+	}
+      else
+	{
+	  res->entries++;
+	  if (res->keys != NULL)
+	    {
+	      bench_keys_t *k = res->keys;
+
+	      if (k->count == k->size)
+		{
+		  keydat_t *tmp;
+
+		  k->size = k->size ? k->size * 2 : 1024;
+		  tmp = realloc (k->keys, k->size * sizeof (keydat_t));
+		  if (tmp == NULL)
+		    {
+		      xdr_free ((xdrproc_t) xdr_ypresp_key_val, (char *) &kv);
+		      return FALSE;
+		    }
+		  k->keys = tmp;
+		}
+	      /* Take over the key, free only the value */
+	      k->keys[k->count++] = kv.keydat;
+	      kv.keydat.keydat_len = 0;
+	      kv.keydat.keydat_val = NULL;
+	    }
+	}
+      xdr_free ((xdrproc_t) xdr_ypresp_key_val, (char *) &kv);
+    }
+}
+
+static CLIENT *
+bench_clnt_create (int tcp)
+{
+  struct netconfig *nconf;
+  struct netbuf nbuf;
+  const char *netid;
+  CLIENT *clnt;
+
+  if (server_addr.ss_family == AF_INET6)
+    netid = tcp ? "tcp6" : "udp6";
+  else
+    netid = tcp ? "tcp" : "udp";
+
+  if ((nconf = getnetconfigent (netid)) == NULL)
+    {
+      log_msg ("ypbench: unknown netid %s", netid);
+      return NULL;
+    }
+  nbuf.buf = &server_addr;
+  nbuf.len = nbuf.maxlen = server_addrlen;
+  clnt = clnt_tli_create (RPC_ANYFD, nconf, &nbuf, YPPROG, YPVERS, 0, 0);
+  freenetconfigent (nconf);
+  if (clnt == NULL)
+    {
+      log_msg ("ypbench: %s", clnt_spcreateerror (netid));
+      return NULL;
+    }
+  if (!tcp)
+    clnt_control (clnt, CLSET_RETRY_TIMEOUT, (char *) &RETRY);
+  return clnt;
+}
+
+static void
+load_keys (double exponent)
+{
+  ypreq_nokey req;
+  all_result_t res;
+  enum clnt_stat stat;
+  CLIENT *clnt;
+
+  if ((clnt = bench_clnt_create (1)) == NULL)
+    exit (1);
+
+  req.domain = domain;
+  req.map = map;
+  memset (&res, 0, sizeof (res));
+  res.status = YP_TRUE;
+  res.keys = &keys;
+  stat = clnt_call (clnt, YPPROC_ALL, (xdrproc_t) xdr_ypreq_nokey,
+		    (caddr_t) &req, (xdrproc_t) xdr_bench_all,
+		    (caddr_t) &res, TIMEOUT);
+  clnt_destroy (clnt);
+  if (stat != RPC_SUCCESS)
+    {
+      log_msg ("ypbench: cannot read %s: %s", map, clnt_sperrno (stat));
+      exit (1);
+    }
+  if (res.status != YP_TRUE)
+    {
+      log_msg ("ypbench: cannot read %s: %s", map,
+	       yperr_string (ypprot_err (res.status)));
+      exit (1);
+    }
+  if (keys.count == 0)
+    {
+      log_msg ("ypbench: %s is empty", map);
+      exit (1);
+    }
+
+  zipf_init (exponent);
+}
+
+static int
+pick_op (uint64_t *rng)
+{
+  unsigned int r = rng_next (rng) % mix_total;
+  int op;
+
+  for (op = 0; op < NR_OPS - 1; op++)
+    {
+      if (r < mix[op])
+	break;
+      r -= mix[op];
+    }
+  return op;
+}
+
+/* Sends one request, returns 0 on success. */
+static int
+do_request (bench_client_t *bc, int op)
+{
+  enum clnt_stat stat;
+  CLIENT *clnt = bc->clnt;
+  ypreq_nokey req_nokey;
+  ypreq_key req_key;
+  int ok = 0;
+
+  req_nokey.domain = req_key.domain = domain;
+  req_nokey.map = req_key.map = map;
+
+  switch (op)
+    {
+    case OP_MATCH:
+      {
+	ypresp_val resp;
+
+	req_key.keydat = *zipf_key (&bc->rng);
+	memset (&resp, 0, sizeof (resp));
+	stat = clnt_call (clnt, YPPROC_MATCH, (xdrproc_t) xdr_ypreq_key,
+			  (caddr_t) &req_key, (xdrproc_t) xdr_ypresp_val,
+			  (caddr_t) &resp, TIMEOUT);
+	if (stat == RPC_SUCCESS)
+	  {
+	    ok = resp.status == YP_TRUE;
+	    clnt_freeres (clnt, (xdrproc_t) xdr_ypresp_val, (caddr_t) &resp);
+	  }
+      }
+      break;
+    case OP_FIRST:
+    case OP_NEXT:
+      {
+	ypresp_key_val resp;
+
+	memset (&resp, 0, sizeof (resp));
+	if (op == OP_FIRST)
+	  stat = clnt_call (clnt, YPPROC_FIRST, (xdrproc_t) xdr_ypreq_nokey,
+			    (caddr_t) &req_nokey,
+			    (xdrproc_t) xdr_ypresp_key_val,
+			    (caddr_t) &resp, TIMEOUT);
+	else
+	  {
+	    req_key.keydat = *zipf_key (&bc->rng);
+	    stat = clnt_call (clnt, YPPROC_NEXT, (xdrproc_t) xdr_ypreq_key,
+			      (caddr_t) &req_key,
+			      (xdrproc_t) xdr_ypresp_key_val,
+			      (caddr_t) &resp, TIMEOUT);
+	  }
+	if (stat == RPC_SUCCESS)
+	  {
+	    ok = resp.status == YP_TRUE || resp.status == YP_NOMORE;
+	    clnt_freeres (clnt, (xdrproc_t) xdr_ypresp_key_val,
+			  (caddr_t) &resp);
+	  }
+      }
+      break;
+    case OP_ORDER:
+      {
+	ypresp_order resp;
+
+	memset (&resp, 0, sizeof (resp));
+	stat = clnt_call (clnt, YPPROC_ORDER, (xdrproc_t) xdr_ypreq_nokey,
+			  (caddr_t) &req_nokey, (xdrproc_t) xdr_ypresp_order,
+			  (caddr_t) &resp, TIMEOUT);
+	if (stat == RPC_SUCCESS)
+	  ok = resp.status == YP_TRUE;
+      }
+      break;
+    case OP_MAPLIST:
+      {
+	ypresp_maplist resp;
+
+	memset (&resp, 0, sizeof (resp));
+	stat = clnt_call (clnt, YPPROC_MAPLIST, (xdrproc_t) xdr_domainname,
+			  (caddr_t) &domain, (xdrproc_t) xdr_ypresp_maplist,
+			  (caddr_t) &resp, TIMEOUT);
+	if (stat == RPC_SUCCESS)
+	  {
+	    ok = resp.status == YP_TRUE;
+	    clnt_freeres (clnt, (xdrproc_t) xdr_ypresp_maplist,
+			  (caddr_t) &resp);
+	  }
+      }
+      break;
+    case OP_ALL:
+      {
+	all_result_t res;
+
+	/* YPPROC_ALL is only answered over TCP */
+	if (!bc->tcp)
+	  {
+	    if (bc->clnt_tcp == NULL
+		&& (bc->clnt_tcp = bench_clnt_create (1)) == NULL)
+	      return -1;
+	    clnt = bc->clnt_tcp;
+	  }
+	memset (&res, 0, sizeof (res));
+	res.status = YP_TRUE;
+	stat = clnt_call (clnt, YPPROC_ALL, (xdrproc_t) xdr_ypreq_nokey,
+			  (caddr_t) &req_nokey, (xdrproc_t) xdr_bench_all,
+			  (caddr_t) &res, TIMEOUT);
+	if (stat == RPC_SUCCESS)
+	  {
+	    ok = res.status == YP_TRUE;
+	    bc->stats.entries += res.entries;
+	  }
+      }
+      break;
+    default:
+      abort ();
+    }
+
+  if (stat != RPC_SUCCESS && stat != RPC_TIMEDOUT && clnt != bc->clnt)
+    {
+      /* A broken TCP connection for ALL is opened again next time */
+      clnt_destroy (bc->clnt_tcp);
+      bc->clnt_tcp = NULL;
+    }
+  else if (stat != RPC_SUCCESS && stat != RPC_TIMEDOUT && bc->tcp)
+    {
+      CLIENT *tmp = bench_clnt_create (1);
+
+      if (tmp != NULL)
+	{
+	  clnt_destroy (bc->clnt);
+	  bc->clnt = tmp;
+	}
+    }
+
+  return ok ? 0 : -1;
+}
+
+static void *
+client_run (void *arg)
+{
+  bench_client_t *bc = arg;
+  unsigned long n = 0;
+
+  pthread_barrier_wait (&start_barrier);
+
+  while (!stop_flag && (requests == 0 || n < bc->todo))
+    {
+      int op = pick_op (&bc->rng);
+      uint64_t start, lat;
+
+      start = now_ns ();
+      if (do_request (bc, op) != 0)
+	bc->stats.errors[op]++;
+      lat = now_ns () - start;
+
+      bc->stats.requests[op]++;
+      bc->stats.hist[op][hist_bucket (lat)]++;
+      if (lat > bc->stats.max[op])
+	bc->stats.max[op] = lat;
+      n++;
+    }
+
+  pthread_mutex_lock (&done_lock);
+  done_clients++;
+  pthread_cond_signal (&done_cond);
+  pthread_mutex_unlock (&done_lock);
+
+  return NULL;
+}
+
+/* Parses "match=80,next=10,all=1" */
+static int
+parse_mix (const char *str)
+{
+  char *copy, *tok, *saveptr;
+  unsigned int new_mix[NR_OPS];
+  unsigned int total = 0;
+  int op;
+
+  memset (new_mix, 0, sizeof (new_mix));
+  if ((copy = strdup (str)) == NULL)
+    return -1;
+
+  for (tok = strtok_r (copy, ",", &saveptr); tok != NULL;
+       tok = strtok_r (NULL, ",", &saveptr))
+    {
+      char *val = strchr (tok, '=');
+      char *ep;
+      unsigned long weight = 1;
+
+      if (val != NULL)
+	{
+	  *val++ = '\0';
+	  weight = strtoul (val, &ep, 10);
+	  if (*val == '\0' || *ep != '\0' || weight > 1000000)
+	    {
+	      free (copy);
+	      return -1;
+	    }
+	}
+      for (op = 0; op < NR_OPS; op++)
+	if (strcasecmp (tok, op_names[op]) == 0)
+	  break;
+      if (op == NR_OPS)
+	{
+	  free (copy);
+	  return -1;
+	}
+      new_mix[op] = weight;
+      total += weight;
+    }
+  free (copy);
+
+  if (total == 0)
+    return -1;
+  memcpy (mix, new_mix, sizeof (mix));
+  mix_total = total;
+  return 0;
+}
+
+static int
+resolve_server (const char *host, int port)
+{
+  struct addrinfo hints, *res;
+  int ret;
+
+  memset (&hints, 0, sizeof (hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  if ((ret = getaddrinfo (host, NULL, &hints, &res)) != 0)
+    {
+      log_msg ("ypbench: %s: %s", host, gai_strerror (ret));
+      return -1;
+    }
+  memcpy (&server_addr, res->ai_addr, res->ai_addrlen);
+  server_addrlen = res->ai_addrlen;
+  freeaddrinfo (res);
+
+  if (server_addr.ss_family == AF_INET6)
+    ((struct sockaddr_in6 *) &server_addr)->sin6_port = htons (port);
+  else
+    ((struct sockaddr_in *) &server_addr)->sin_port = htons (port);
+  return 0;
+}
+
+static void
+print_row (const char *name, unsigned long requests, unsigned long errors,
+	   const unsigned long *hist, uint64_t max, double seconds)
+{
+  printf ("%-8s %10lu %8lu %10.0f %9.1f %9.1f %9.1f %9.1f\n", name,
+	  requests, errors, requests / seconds,
+	  hist_percentile (hist, requests, max, 0.5),
+	  hist_percentile (hist, requests, max, 0.99),
+	  hist_percentile (hist, requests, max, 0.999), max / 1000.0);
+}
+
+static void
+print_report (bench_stats_t *st, double seconds, int print_hist)
+{
+  static unsigned long total_hist[HIST_BUCKETS];
+  unsigned long total = 0, errors = 0;
+  uint64_t max = 0;
+  unsigned int i;
+  int op;
+
+  printf ("%-8s %10s %8s %10s %9s %9s %9s %9s\n", "op", "requests",
+	  "errors", "qps", "p50 us", "p99 us", "p999 us", "max us");
+  for (op = 0; op < NR_OPS; op++)
+    {
+      if (st->requests[op] == 0)
+	continue;
+      print_row (op_names[op], st->requests[op], st->errors[op],
+		 st->hist[op], st->max[op], seconds);
+      total += st->requests[op];
+      errors += st->errors[op];
+      if (st->max[op] > max)
+	max = st->max[op];
+      for (i = 0; i < HIST_BUCKETS; i++)
+	total_hist[i] += st->hist[op][i];
+    }
+  print_row ("total", total, errors, total_hist, max, seconds);
+  if (st->requests[OP_ALL] > 0)
+    printf ("all: %lu entries per request\n",
+	    st->entries / st->requests[OP_ALL]);
+
+  if (print_hist && total > 0)
+    {
+      unsigned long sum = 0;
+
+      printf ("\n%12s %10s %8s\n", "< us", "requests", "cum %");
+      for (i = 0; i < HIST_BUCKETS; i++)
+	{
+	  if (total_hist[i] == 0)
+	    continue;
+	  sum += total_hist[i];
+	  printf ("%12.1f %10lu %8.3f\n", hist_value (i + 1) / 1000.0,
+		  total_hist[i], 100.0 * sum / total);
+	}
+    }
+}
+
+static void
+Usage (int exit_code)
+{
+  fprintf (stderr, "Usage: ypbench -p port [-h host] [-c clients] [-t seconds] [-n requests]\n");
+  fprintf (stderr, "               [-P udp|tcp|mixed] [-z exponent] [-m mix] [-H] domain map\n");
+  fprintf (stderr, "       ypbench --version\n");
+  fprintf (stderr, "\nmix is a list of procedures with weights, for example\n");
+  fprintf (stderr, "match=90,first=1,next=5,order=2,maplist=1,all=1\n");
+  exit (exit_code);
+}
+
+int
+main (int argc, char **argv)
+{
+  const char *host = "localhost";
+  const char *proto = "udp";
+  unsigned int clients = 1, i;
+  double exponent = 0.99, seconds;
+  int duration = -1, port = -1, print_hist = 0;
+  bench_client_t *bc;
+  bench_stats_t *total;
+  struct timespec deadline;
+  uint64_t start, end;
+
+  debug_flag = 1;
+
+  while (1)
+    {
+      int c;
+      int option_index = 0;
+      static struct option long_options[] =
+      {
+	{"version", no_argument, NULL, '\255'},
+	{"host", required_argument, NULL, 'h'},
+	{"port", required_argument, NULL, 'p'},
+	{"clients", required_argument, NULL, 'c'},
+	{"time", required_argument, NULL, 't'},
+	{"requests", required_argument, NULL, 'n'},
+	{"proto", required_argument, NULL, 'P'},
+	{"zipf", required_argument, NULL, 'z'},
+	{"mix", required_argument, NULL, 'm'},
+	{"histogram", no_argument, NULL, 'H'},
+	{"help", no_argument, NULL, '\254'},
+	{"usage", no_argument, NULL, '\254'},
+	{NULL, 0, NULL, '\0'}
+      };
+
+      c = getopt_long (argc, argv, "h:p:c:t:n:P:z:m:H", long_options,
+		       &option_index);
+      if (c == EOF)
+	break;
+      switch (c)
+	{
+	case 'h':
+	  host = optarg;
+	  break;
+	case 'p':
+	  port = atoi (optarg);
+	  if (port <= 0 || port > 0xffff)
+	    {
+	      log_msg ("ypbench: invalid port %s", optarg);
+	      return 1;
+	    }
+	  break;
+	case 'c':
+	  clients = atoi (optarg);
+	  if (clients < 1 || clients > 4096)
+	    {
+	      log_msg ("ypbench: invalid number of clients %s", optarg);
+	      return 1;
+	    }
+	  break;
+	case 't':
+	  duration = atoi (optarg);
+	  break;
+	case 'n':
+	  requests = strtoul (optarg, NULL, 10);
+	  break;
+	case 'P':
+	  if (strcmp (optarg, "udp") != 0 && strcmp (optarg, "tcp") != 0
+	      && strcmp (optarg, "mixed") != 0)
+	    Usage (1);
+	  proto = optarg;
+	  break;
+	case 'z':
+	  exponent = strtod (optarg, NULL);
+	  if (exponent < 0)
+	    Usage (1);
+	  break;
+	case 'm':
+	  if (parse_mix (optarg) != 0)
+	    {
+	      log_msg ("ypbench: invalid mix %s", optarg);
+	      return 1;
+	    }
+	  break;
+	case 'H':
+	  print_hist = 1;
+	  break;
+	case '\255':
+	  log_msg ("ypbench (%s) %s", PACKAGE, VERSION);
+	  return 0;
+	case '\254':
+	  Usage (0);
+	  break;
+	default:
+	  Usage (1);
+	}
+    }
+
+  argc -= optind;
+  argv += optind;
+
+  if (argc != 2 || port < 0)
+    Usage (1);
+  domain = argv[0];
+  map = argv[1];
+
+  /* Without a number of requests, run for 10 seconds */
+  if (duration < 0)
+    duration = requests > 0 ? 0 : 10;
+
+  if (resolve_server (host, port) != 0)
+    return 1;
+
+  load_keys (exponent);
+
+  bc = calloc (clients, sizeof (bench_client_t));
+  if (bc == NULL)
+    {
+      log_msg ("malloc() failed: %s", strerror (errno));
+      return 1;
+    }
+
+  for (i = 0; i < clients; i++)
+    {
+      if (strcmp (proto, "mixed") == 0)
+	bc[i].tcp = i % 2;
+      else
+	bc[i].tcp = strcmp (proto, "tcp") == 0;
+      if ((bc[i].clnt = bench_clnt_create (bc[i].tcp)) == NULL)
+	return 1;
+      if (requests > 0)
+	bc[i].todo = requests / clients + (i < requests % clients);
+      bc[i].rng = 0x9E3779B97F4A7C15ULL * (i + 1);
+    }
+
+  printf ("ypbench: %u %s clients, %lu keys of %s, zipf %.2f\n",
+	  clients, proto, keys.count, map, exponent);
+
+  pthread_barrier_init (&start_barrier, NULL, clients + 1);
+  for (i = 0; i < clients; i++)
+    if ((errno = pthread_create (&bc[i].tid, NULL, client_run, &bc[i])) != 0)
+      {
+	log_msg ("pthread_create() failed: %s", strerror (errno));
+	return 1;
+      }
+
+  pthread_barrier_wait (&start_barrier);
+  start = now_ns ();
+
+  clock_gettime (CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += duration;
+  pthread_mutex_lock (&done_lock);
+  while (done_clients < clients)
+    {
+      if (duration > 0)
+	{
+	  if (pthread_cond_timedwait (&done_cond, &done_lock,
+				      &deadline) == ETIMEDOUT)
+	    break;
+	}
+      else
+	pthread_cond_wait (&done_cond, &done_lock);
+    }
+  pthread_mutex_unlock (&done_lock);
+  /* Joining waits for the requests still on the wire, which must not
+     count as run time */
+  end = now_ns ();
+  stop_flag = 1;
+
+  total = calloc (1, sizeof (bench_stats_t));
+  if (total == NULL)
+    {
+      log_msg ("malloc() failed: %s", strerror (errno));
+      return 1;
+    }
+  for (i = 0; i < clients; i++)
+    {
+      int op;
+      unsigned int j;
+
+      pthread_join (bc[i].tid, NULL);
+      for (op = 0; op < NR_OPS; op++)
+	{
+	  total->requests[op] += bc[i].stats.requests[op];
+	  total->errors[op] += bc[i].stats.errors[op];
+	  if (bc[i].stats.max[op] > total->max[op])
+	    total->max[op] = bc[i].stats.max[op];
+	  for (j = 0; j < HIST_BUCKETS; j++)
+	    total->hist[op][j] += bc[i].stats.hist[op][j];
+	}
+      total->entries += bc[i].stats.entries;
+      clnt_destroy (bc[i].clnt);
+      if (bc[i].clnt_tcp != NULL)
+	clnt_destroy (bc[i].clnt_tcp);
+    }
+  seconds = (end - start) / 1e9;
+
+  printf ("%.2f seconds\n\n", seconds);
+  print_report (total, seconds, print_hist);
+
+  return 0;
+}
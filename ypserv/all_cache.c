@@ -0,0 +1,432 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <time.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "log_msg.h"
+#include "ypserv_conf.h"
+#include "stats.h"
+#include "all_cache.h"
+
+/* With "all_cache: SIZE" in ypserv.conf, the reply to the first
+   YPPROC_ALL request for a map is written into an anonymous file
+   while it is streamed: all records encoded with XDR, split into
+   record marking fragments. Later requests for the map get only the
+   reply header from the event loop, the rest of the reply is sent
+   with sendfile from this file, without reading the map or encoding
+   anything.
+
+   A snapshot is dropped after a YPPROC_CLEAR request, after the map
+   was reloaded, and if the YP_LAST_MODIFIED entry of the map has changed, which is checked at
+   most every ALL_RECHECK seconds. Streams sending a dropped snapshot
+   keep a reference to it, the last one closes the file.
+
+   Snapshots are only used by the event loop in the main thread, so
+   there is no locking. */
+
+#define ALL_RECHECK 1
+/* Size of the record marking fragments in the file */
+#define ALL_FRAGMENT (64 * 1024)
+
+struct all_snap
+{
+  struct all_snap *prev, *next;	/* LRU list, or list of builders */
+  char *domain;
+  char *map;
+  int fd;
+  off_t size;
+  unsigned int ordernum;
+  unsigned int generation;
+  time_t checked;
+  int refs;
+  int cached;
+  int building;
+  int failed;
+  XDR xdrs;			/* encodes into fd while building */
+};
+
+static all_snap_t *lru_head = NULL;
+static all_snap_t *lru_tail = NULL;
+static all_snap_t *builders = NULL;
+static unsigned long cache_bytes = 0;
+static unsigned long cache_entries = 0;
+static unsigned int cache_generation = 0;
+
+/* Counters */
+static unsigned long stat_hits = 0;
+static unsigned long stat_misses = 0;
+static unsigned long stat_builds = 0;
+static unsigned long stat_evictions = 0;
+static unsigned long stat_invalidations = 0;
+
+static void
+all_cache_stats (void)
+{
+  unsigned long hits, misses;
+
+  hits = __atomic_load_n (&stat_hits, __ATOMIC_RELAXED);
+  misses = __atomic_load_n (&stat_misses, __ATOMIC_RELAXED);
+  log_msg ("  all_cache: %lu hits, %lu misses (%.1f%% hit ratio), "
+	   "%lu replies encoded", hits, misses,
+	   hits + misses ? 100.0 * hits / (hits + misses) : 0.0,
+	   __atomic_load_n (&stat_builds, __ATOMIC_RELAXED));
+  log_msg ("  all_cache: %lu maps, %lu of %lu bytes, %lu evictions, "
+	   "%lu invalidations", __atomic_load_n (&cache_entries,
+						 __ATOMIC_RELAXED),
+	   __atomic_load_n (&cache_bytes, __ATOMIC_RELAXED),
+	   all_cache_size,
+	   __atomic_load_n (&stat_evictions, __ATOMIC_RELAXED),
+	   __atomic_load_n (&stat_invalidations, __ATOMIC_RELAXED));
+}
+
+static void
+snap_free (all_snap_t *a)
+{
+  if (a->building)
+    XDR_DESTROY (&a->xdrs);
+  if (a->fd >= 0)
+    close (a->fd);
+  free (a->domain);
+  free (a->map);
+  free (a);
+}
+
+static void
+list_unlink (all_snap_t **head, all_snap_t **tail, all_snap_t *a)
+{
+  if (a->prev)
+    a->prev->next = a->next;
+  else
+    *head = a->next;
+  if (a->next)
+    a->next->prev = a->prev;
+  else if (tail != NULL)
+    *tail = a->prev;
+  a->prev = a->next = NULL;
+}
+
+static void
+lru_prepend (all_snap_t *a)
+{
+  a->prev = NULL;
+  a->next = lru_head;
+  if (lru_head)
+    lru_head->prev = a;
+  else
+    lru_tail = a;
+  lru_head = a;
+}
+
+/* Remove a snapshot from the cache, it is freed by the last stream
+   using it. */
+static void
+snap_uncache (all_snap_t *a)
+{
+  list_unlink (&lru_head, &lru_tail, a);
+  a->cached = 0;
+  __atomic_sub_fetch (&cache_bytes, (unsigned long) a->size,
+		      __ATOMIC_RELAXED);
+  __atomic_sub_fetch (&cache_entries, 1, __ATOMIC_RELAXED);
+  if (a->refs == 0)
+    snap_free (a);
+}
+
+/* Drop all snapshots after YPPROC_CLEAR */
+static void
+check_generation (void)
+{
+  unsigned int gen = ypdb_clear_generation ();
+
+  if (gen == cache_generation)
+    return;
+
+  while (lru_head != NULL)
+    {
+      snap_uncache (lru_head);
+      __atomic_add_fetch (&stat_invalidations, 1, __ATOMIC_RELAXED);
+    }
+  cache_generation = gen;
+}
+
+void
+all_cache_init (void)
+{
+  if (all_cache_size == 0)
+    return;
+
+#ifndef HAVE_MEMFD_CREATE
+  log_msg ("all_cache: not supported on this system, ignoring option");
+  all_cache_size = 0;
+#else
+  cache_generation = ypdb_clear_generation ();
+  stats_register (all_cache_stats);
+#endif
+}
+
+/* Look for the snapshot of domain/map. If there is a valid one, a
+   reference to it is returned, which the caller has to give back
+   with all_cache_release. */
+all_snap_t *
+all_cache_lookup (const char *domain, const char *map, int *fd, off_t *size)
+{
+  all_snap_t *a;
+  time_t now;
+
+  if (all_cache_size == 0)
+    return NULL;
+
+  check_generation ();
+
+  for (a = lru_head; a != NULL; a = a->next)
+    if (strcmp (a->map, map) == 0 && strcmp (a->domain, domain) == 0)
+      break;
+
+  if (a == NULL)
+    {
+      __atomic_add_fetch (&stat_misses, 1, __ATOMIC_RELAXED);
+      return NULL;
+    }
+
+  if (a->generation != ypdb_map_generation (domain, map))
+    {
+      if (debug_flag)
+	log_msg ("all_cache: %s/%s was reloaded", domain, map);
+      snap_uncache (a);
+      __atomic_add_fetch (&stat_invalidations, 1, __ATOMIC_RELAXED);
+      __atomic_add_fetch (&stat_misses, 1, __ATOMIC_RELAXED);
+      return NULL;
+    }
+
+  now = time (NULL);
+  if (now - a->checked >= ALL_RECHECK)
+    {
+      DB_FILE dbp = ypdb_open (domain, map);
+      unsigned int ordernum = 0;
+
+      if (dbp != NULL)
+	{
+	  ordernum = ypdb_last_modified (dbp);
+	  ypdb_close (dbp);
+	}
+      if (dbp == NULL || ordernum != a->ordernum)
+	{
+	  if (debug_flag)
+	    log_msg ("all_cache: %s/%s has changed", domain, map);
+	  snap_uncache (a);
+	  __atomic_add_fetch (&stat_invalidations, 1, __ATOMIC_RELAXED);
+	  __atomic_add_fetch (&stat_misses, 1, __ATOMIC_RELAXED);
+	  return NULL;
+	}
+      a->checked = now;
+    }
+
+  list_unlink (&lru_head, &lru_tail, a);
+  lru_prepend (a);
+  ++a->refs;
+  __atomic_add_fetch (&stat_hits, 1, __ATOMIC_RELAXED);
+
+  *fd = a->fd;
+  *size = a->size;
+  return a;
+}
+
+static int
+snap_write (void *handle, void *buf, int len)
+{
+  all_snap_t *a = handle;
+  const char *p = buf;
+  int left = len;
+
+  /* Larger than the whole cache, or the stream is already broken */
+  if (a->failed ||
+      (unsigned long) a->size + len > all_cache_size)
+    {
+      a->failed = 1;
+      return -1;
+    }
+
+  while (left > 0)
+    {
+      ssize_t n = write (a->fd, p, left);
+
+      if (n < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  log_msg ("all_cache: cannot write %s/%s: %s", a->domain, a->map,
+		   strerror (errno));
+	  a->failed = 1;
+	  return -1;
+	}
+      p += n;
+      left -= n;
+    }
+  a->size += len;
+
+  return len;
+}
+
+/* Start a new snapshot of domain/map, while the reply is streamed
+   from the map dbp. Returns NULL, if there is no cache or another
+   stream builds a snapshot of this map already. */
+all_snap_t *
+all_cache_build (DB_FILE dbp, const char *domain, const char *map,
+		 unsigned int generation)
+{
+#ifdef HAVE_MEMFD_CREATE
+  all_snap_t *a;
+
+  if (all_cache_size == 0)
+    return NULL;
+
+  for (a = builders; a != NULL; a = a->next)
+    if (strcmp (a->map, map) == 0 && strcmp (a->domain, domain) == 0)
+      return NULL;
+
+  if ((a = calloc (1, sizeof (all_snap_t))) == NULL ||
+      (a->domain = strdup (domain)) == NULL ||
+      (a->map = strdup (map)) == NULL)
+    {
+      if (a)
+	free (a->domain);
+      free (a);
+      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	       __FILE__, __LINE__);
+      return NULL;
+    }
+
+  if ((a->fd = memfd_create ("ypserv-all", MFD_CLOEXEC)) < 0)
+    {
+      log_msg ("all_cache: memfd_create failed: %s", strerror (errno));
+      a->fd = -1;
+      snap_free (a);
+      return NULL;
+    }
+
+  xdrrec_create (&a->xdrs, ALL_FRAGMENT, 0, a, NULL, snap_write);
+  a->xdrs.x_op = XDR_ENCODE;
+  a->building = 1;
+  a->refs = 1;
+  a->ordernum = ypdb_last_modified (dbp);
+  a->generation = generation;
+
+  a->prev = NULL;
+  a->next = builders;
+  if (builders)
+    builders->prev = a;
+  builders = a;
+
+  return a;
+#else
+  (void) dbp;
+  (void) domain;
+  (void) map;
+  (void) generation;
+  return NULL;
+#endif
+}
+
+/* Add the next record of the reply to the snapshot */
+void
+all_cache_add (all_snap_t *a, ypresp_key_val *val)
+{
+  bool_t more = TRUE;
+
+  if (a->failed)
+    return;
+
+  if (!xdr_bool (&a->xdrs, &more) || !xdr_ypresp_key_val (&a->xdrs, val))
+    a->failed = 1;
+}
+
+/* The reply was streamed completely, ending with status, so the
+   snapshot can be used for the next requests. */
+void
+all_cache_finish (all_snap_t *a, ypstat status)
+{
+  bool_t more = FALSE;
+
+  if (status != YP_TRUE)
+    {
+      ypresp_key_val val;
+
+      memset (&val, 0, sizeof (val));
+      val.status = status;
+      all_cache_add (a, &val);
+    }
+
+  if (!a->failed &&
+      (!xdr_bool (&a->xdrs, &more) || !xdrrec_endofrecord (&a->xdrs, TRUE)))
+    a->failed = 1;
+
+  list_unlink (&builders, NULL, a);
+  XDR_DESTROY (&a->xdrs);
+  a->building = 0;
+
+  check_generation ();
+  if (a->failed ||
+      a->generation != ypdb_map_generation (a->domain, a->map))
+    return;
+
+  while (lru_tail != NULL &&
+	 cache_bytes + (unsigned long) a->size > all_cache_size)
+    {
+      if (debug_flag)
+	log_msg ("all_cache: evicting %s/%s", lru_tail->domain,
+		 lru_tail->map);
+      snap_uncache (lru_tail);
+      __atomic_add_fetch (&stat_evictions, 1, __ATOMIC_RELAXED);
+    }
+
+  lru_prepend (a);
+  a->cached = 1;
+  a->checked = time (NULL);
+  __atomic_add_fetch (&cache_bytes, (unsigned long) a->size,
+		      __ATOMIC_RELAXED);
+  __atomic_add_fetch (&cache_entries, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch (&stat_builds, 1, __ATOMIC_RELAXED);
+
+  if (debug_flag)
+    log_msg ("all_cache: %s/%s encoded with %lu bytes", a->domain, a->map,
+	     (unsigned long) a->size);
+}
+
+/* Give back a snapshot returned by all_cache_lookup or
+   all_cache_build. */
+void
+all_cache_release (all_snap_t *a)
+{
+  if (--a->refs > 0)
+    return;
+
+  if (a->building)
+    {
+      /* The stream was aborted */
+      list_unlink (&builders, NULL, a);
+      snap_free (a);
+    }
+  else if (!a->cached)
+    snap_free (a);
+}
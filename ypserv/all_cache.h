@@ -0,0 +1,37 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifndef __ALL_CACHE_H__
+#define __ALL_CACHE_H__
+
+#include <sys/types.h>
+#include <rpc/rpc.h>
+
+#include "yp.h"
+#include "yp_db.h"
+
+typedef struct all_snap all_snap_t;
+
+extern void all_cache_init (void);
+extern all_snap_t *all_cache_lookup (const char *domain, const char *map,
+				     int *fd, off_t *size);
+extern all_snap_t *all_cache_build (DB_FILE dbp, const char *domain,
+				    const char *map, unsigned int generation);
+extern void all_cache_add (all_snap_t *a, ypresp_key_val *val);
+extern void all_cache_finish (all_snap_t *a, ypstat status);
+extern void all_cache_release (all_snap_t *a);
+
+#endif
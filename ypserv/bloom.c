@@ -0,0 +1,556 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "yp.h"
+#include "yp_db.h"
+#include "log_msg.h"
+#include "ypserv_conf.h"
+#include "stats.h"
+#include "bloom.h"
+
+/* With "bloom_bits: N" in ypserv.conf, a Bloom filter with N bits
+   for every key is built for a map, after the first MATCH request for
+   it arrived. A key, which is not in the filter, is not in the map,
+   so the request is answered with YP_NOKEY without searching the
+   database. Only if the filter has the key, the map is searched.
+
+   The filters are built by a thread, requests never wait for it.
+   Until the filter of a map is there, its keys are searched in the
+   database as without filter.
+
+   The filter has to be rebuild after the map was changed, else new
+   keys would not be found. It is dropped after a YPPROC_CLEAR
+   request and after the map was reloaded. The thread compares the
+   YP_LAST_MODIFIED entry at most every BLOOM_RECHECK seconds and
+   builds a new filter, if it has changed.
+
+   The maps are found with a hash table, with not more than
+   BLOOM_MAX_MAPS entries. If a filter could not be built, this is
+   kept until the next YPPROC_CLEAR or reload of the map, and a map
+   which could not be opened is remembered, so that requests for such
+   maps don't try it again and again. */
+
+#define BLOOM_RECHECK 1
+#define BLOOM_HASH_SIZE 256	/* a power of 2 */
+#define BLOOM_MAX_MAPS 1024
+#define BLOOM_MISSING 64
+
+typedef struct bloom_filter
+{
+  uint64_t *bits;		/* NULL if there is no filter */
+  uint64_t mask;		/* number of bits - 1 */
+  unsigned int nhash;
+  unsigned long nkeys;
+  unsigned int ordernum;
+} bloom_filter_t;
+
+typedef struct bloom_map
+{
+  struct bloom_map *next;	/* hash chain */
+  struct bloom_map *qnext;	/* queue of the build thread */
+  char *domain;
+  char *map;
+  unsigned int hash;
+  bloom_filter_t f;
+  unsigned int generation;	/* of ypdb_map_generation */
+  time_t checked;
+  int queued;
+  int building;
+  int failed;
+} bloom_map_t;
+
+/* Maps, which could not be opened */
+typedef struct bloom_missing
+{
+  unsigned int hash;
+  unsigned int generation;
+  int valid;
+} bloom_missing_t;
+
+static pthread_mutex_t bloom_lock = PTHREAD_MUTEX_INITIALIZER;
+static bloom_map_t *bloom_maps[BLOOM_HASH_SIZE];
+static unsigned int nr_bloom_maps = 0;
+static bloom_missing_t bloom_missing[BLOOM_MISSING];
+static pthread_cond_t bloom_cond = PTHREAD_COND_INITIALIZER;
+static bloom_map_t *bloom_queue = NULL;
+static bloom_map_t **bloom_queue_tail = &bloom_queue;
+
+/* Counters */
+static unsigned long stat_checks = 0;
+static unsigned long stat_negatives = 0;
+static unsigned long stat_false_pos = 0;
+static unsigned long stat_builds = 0;
+
+/* Set if the last bloom_lookup of this thread found the key in a
+   filter */
+static __thread int bloom_passed = 0;
+
+static void
+bloom_stats (void)
+{
+  unsigned long negatives, false_pos;
+  bloom_map_t *m;
+  unsigned int b;
+
+  negatives = __atomic_load_n (&stat_negatives, __ATOMIC_RELAXED);
+  false_pos = __atomic_load_n (&stat_false_pos, __ATOMIC_RELAXED);
+
+  log_msg ("  bloom: %lu checks, %lu answered with YP_NOKEY, "
+	   "%lu false positives (%.2f%%), %lu filters built",
+	   __atomic_load_n (&stat_checks, __ATOMIC_RELAXED), negatives,
+	   false_pos, negatives + false_pos ?
+	   100.0 * false_pos / (negatives + false_pos) : 0.0,
+	   __atomic_load_n (&stat_builds, __ATOMIC_RELAXED));
+
+  pthread_mutex_lock (&bloom_lock);
+  for (b = 0; b < BLOOM_HASH_SIZE; b++)
+    for (m = bloom_maps[b]; m != NULL; m = m->next)
+      if (m->f.bits != NULL)
+	{
+	  uint64_t i, set = 0;
+	  double fill, rate = 1.0;
+	  unsigned int k;
+
+	  for (i = 0; i <= m->f.mask / 64; i++)
+	    set += __builtin_popcountll (m->f.bits[i]);
+
+	  /* The chance that all nhash bits of a new key are set */
+	  fill = (double) set / (m->f.mask + 1);
+	  for (k = 0; k < m->f.nhash; k++)
+	    rate *= fill;
+
+	  log_msg ("  bloom: %s/%s: %lu keys, %lu bytes, %u hashes, "
+		   "expected false positive rate %.2f%%", m->domain, m->map,
+		   m->f.nkeys, (unsigned long) ((m->f.mask + 1) / 8),
+		   m->f.nhash, 100.0 * rate);
+	}
+  pthread_mutex_unlock (&bloom_lock);
+}
+
+/* FNV-1a, 64bit */
+static uint64_t
+bloom_hash (const char *key, u_int keylen)
+{
+  uint64_t h = 14695981039346656037ULL;
+  u_int i;
+
+  for (i = 0; i < keylen; i++)
+    {
+      h ^= (unsigned char) key[i];
+      h *= 1099511628211ULL;
+    }
+
+  return h;
+}
+
+/* Bit number i of the key with hash h, computed with double hashing */
+static inline uint64_t
+bloom_bit (uint64_t h, unsigned int i, uint64_t mask)
+{
+  uint64_t h2 = ((h >> 32) | (h << 32)) * 0x9e3779b97f4a7c15ULL;
+
+  return (h + i * (h2 | 1)) & mask;
+}
+
+static unsigned int
+bloom_map_hash (const char *domain, const char *map)
+{
+  uint64_t h = bloom_hash (domain, strlen (domain));
+
+  h ^= bloom_hash (map, strlen (map)) * 0x9e3779b97f4a7c15ULL;
+  return h ^ (h >> 32);
+}
+
+static bloom_map_t *
+bloom_find_map (const char *domain, const char *map, unsigned int h)
+{
+  bloom_map_t *m;
+
+  for (m = bloom_maps[h & (BLOOM_HASH_SIZE - 1)]; m != NULL; m = m->next)
+    if (m->hash == h && strcmp (m->map, map) == 0 &&
+	strcmp (m->domain, domain) == 0)
+      return m;
+
+  return NULL;
+}
+
+static bloom_map_t *
+bloom_add_map (const char *domain, const char *map, unsigned int h)
+{
+  bloom_map_t *m;
+
+  if (nr_bloom_maps >= BLOOM_MAX_MAPS)
+    return NULL;
+
+  if ((m = calloc (1, sizeof (bloom_map_t))) == NULL ||
+      (m->domain = strdup (domain)) == NULL ||
+      (m->map = strdup (map)) == NULL)
+    {
+      if (m)
+	free (m->domain);
+      free (m);
+      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	       __FILE__, __LINE__);
+      return NULL;
+    }
+  m->hash = h;
+  m->next = bloom_maps[h & (BLOOM_HASH_SIZE - 1)];
+  bloom_maps[h & (BLOOM_HASH_SIZE - 1)] = m;
+  nr_bloom_maps++;
+
+  return m;
+}
+
+static int
+bloom_is_missing (unsigned int h, unsigned int gen)
+{
+  bloom_missing_t *b = &bloom_missing[h % BLOOM_MISSING];
+
+  return b->valid && b->hash == h && b->generation == gen;
+}
+
+static void
+bloom_set_missing (unsigned int h, unsigned int gen)
+{
+  bloom_missing_t *b = &bloom_missing[h % BLOOM_MISSING];
+
+  b->hash = h;
+  b->generation = gen;
+  b->valid = 1;
+}
+
+/* Read all keys of the map and create the filter. Is called by the
+   thread without bloom_lock. */
+static int
+bloom_build (DB_FILE dbp, const char *domain, const char *map,
+	     bloom_filter_t *f)
+{
+  uint64_t *hashes = NULL, *bits, nbits, i;
+  unsigned long nkeys = 0, size = 0;
+  unsigned int k;
+  datum dkey;
+
+  for (dkey = ypdb_firstkey (dbp); dkey.dptr != NULL; )
+    {
+      if (nkeys == size)
+	{
+	  uint64_t *tmp;
+
+	  size = size ? size * 2 : 1024;
+	  if ((tmp = realloc (hashes, size * sizeof (uint64_t))) == NULL)
+	    {
+	      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+		       __FILE__, __LINE__);
+	      ypdb_free (dkey.dptr);
+	      free (hashes);
+	      return -1;
+	    }
+	  hashes = tmp;
+	}
+      hashes[nkeys++] = bloom_hash (dkey.dptr, dkey.dsize);
+
+#if defined(HAVE_NDBM)
+      dkey = dbm_nextkey (dbp->db);
+#else
+      {
+	datum tkey = dkey;
+	dkey = ypdb_nextkey (dbp, tkey);
+	ypdb_free (tkey.dptr);
+      }
+#endif
+    }
+  f->ordernum = ypdb_last_modified (dbp);
+
+  /* Round up to a power of 2, so that a mask can be used */
+  for (nbits = 64; nbits < (uint64_t) nkeys * bloom_bits; nbits <<= 1)
+    ;
+  if ((bits = calloc (nbits / 64, sizeof (uint64_t))) == NULL)
+    {
+      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	       __FILE__, __LINE__);
+      free (hashes);
+      return -1;
+    }
+
+  /* ln(2) * bits per key is the optimal number of hash functions */
+  f->nhash = (bloom_bits * 69 + 50) / 100;
+  if (f->nhash < 1)
+    f->nhash = 1;
+  else if (f->nhash > 16)
+    f->nhash = 16;
+
+  for (i = 0; i < nkeys; i++)
+    for (k = 0; k < f->nhash; k++)
+      {
+	uint64_t bit = bloom_bit (hashes[i], k, nbits - 1);
+
+	bits[bit / 64] |= 1ULL << (bit % 64);
+      }
+  free (hashes);
+
+  f->bits = bits;
+  f->mask = nbits - 1;
+  f->nkeys = nkeys;
+  __atomic_add_fetch (&stat_builds, 1, __ATOMIC_RELAXED);
+
+  if (debug_flag)
+    log_msg ("bloom: filter for %s/%s with %lu keys built",
+	     domain, map, nkeys);
+
+  return 0;
+}
+
+static void
+bloom_drop (bloom_map_t *m)
+{
+  free (m->f.bits);
+  m->f.bits = NULL;
+}
+
+/* Must be called with bloom_lock held */
+static void
+bloom_remove_map (bloom_map_t *m)
+{
+  bloom_map_t **pp = &bloom_maps[m->hash & (BLOOM_HASH_SIZE - 1)];
+
+  while (*pp != m)
+    pp = &(*pp)->next;
+  *pp = m->next;
+  nr_bloom_maps--;
+
+  bloom_drop (m);
+  free (m->domain);
+  free (m->map);
+  free (m);
+}
+
+/* Let the thread build or check the filter of m. Must be called with
+   bloom_lock held. */
+static void
+bloom_queue_map (bloom_map_t *m)
+{
+  if (m->queued)
+    return;
+
+  m->queued = 1;
+  m->qnext = NULL;
+  *bloom_queue_tail = m;
+  bloom_queue_tail = &m->qnext;
+  pthread_cond_signal (&bloom_cond);
+}
+
+/* Build the filter of m, if there is none or the map has changed.
+   Is called with bloom_lock held, which is released meanwhile. Only
+   this thread frees entries, so m stays valid. */
+static void
+bloom_update (bloom_map_t *m)
+{
+  unsigned int gen = m->generation, ordernum = m->f.ordernum;
+  int have = m->f.bits != NULL, changed = 1;
+  bloom_filter_t f;
+  DB_FILE dbp;
+
+  m->building = 1;
+  pthread_mutex_unlock (&bloom_lock);
+
+  f.bits = NULL;
+  if ((dbp = ypdb_open (m->domain, m->map)) != NULL)
+    {
+      if (have && ypdb_last_modified (dbp) == ordernum)
+	changed = 0;
+      else if (bloom_build (dbp, m->domain, m->map, &f) < 0)
+	f.bits = NULL;
+      ypdb_close (dbp);
+    }
+
+  pthread_mutex_lock (&bloom_lock);
+  m->building = 0;
+
+  /* Don't use the filter, if the map was cleared or reloaded
+     meanwhile, the next request queues the map again. */
+  if (gen != m->generation ||
+      gen != ypdb_map_generation (m->domain, m->map))
+    {
+      free (f.bits);
+      return;
+    }
+
+  if (dbp == NULL)
+    {
+      if (debug_flag)
+	log_msg ("bloom: cannot open %s/%s", m->domain, m->map);
+      bloom_set_missing (m->hash, gen);
+      if (!m->queued)
+	bloom_remove_map (m);
+      return;
+    }
+
+  if (!changed)
+    return;
+
+  if (have && debug_flag)
+    log_msg ("bloom: %s/%s changed, dropping filter", m->domain, m->map);
+  bloom_drop (m);
+  m->checked = time (NULL);
+  if (f.bits == NULL)
+    {
+      if (debug_flag)
+	log_msg ("bloom: no filter for %s/%s", m->domain, m->map);
+      m->failed = 1;
+    }
+  else
+    m->f = f;
+}
+
+static void *
+bloom_run (void *arg)
+{
+  (void) arg;
+
+  pthread_mutex_lock (&bloom_lock);
+  for (;;)
+    {
+      bloom_map_t *m;
+
+      while (bloom_queue == NULL)
+	pthread_cond_wait (&bloom_cond, &bloom_lock);
+
+      m = bloom_queue;
+      if ((bloom_queue = m->qnext) == NULL)
+	bloom_queue_tail = &bloom_queue;
+      m->queued = 0;
+
+      bloom_update (m);
+    }
+
+  return NULL;
+}
+
+void
+bloom_init (void)
+{
+  sigset_t set, oldset;
+  pthread_t tid;
+
+  if (bloom_bits == 0)
+    return;
+
+  sigfillset (&set);
+  pthread_sigmask (SIG_BLOCK, &set, &oldset);
+  if (pthread_create (&tid, NULL, bloom_run, NULL) != 0)
+    {
+      log_msg ("Cannot create bloom filter thread: %s", strerror (errno));
+      bloom_bits = 0;
+    }
+  else
+    {
+      pthread_detach (tid);
+      stats_register (bloom_stats);
+    }
+  pthread_sigmask (SIG_SETMASK, &oldset, NULL);
+}
+
+/* Returns 0 if key is for sure not in domain/map, else 1 */
+int
+bloom_lookup (const char *domain, const char *map,
+	      const char *key, u_int keylen)
+{
+  unsigned int gen, h, k;
+  bloom_map_t *m;
+  uint64_t kh;
+  time_t now;
+
+  bloom_passed = 0;
+  if (bloom_bits == 0)
+    return 1;
+
+  h = bloom_map_hash (domain, map);
+  gen = ypdb_map_generation (domain, map);
+  now = time (NULL);
+
+  pthread_mutex_lock (&bloom_lock);
+
+  if ((m = bloom_find_map (domain, map, h)) == NULL)
+    {
+      if (bloom_is_missing (h, gen) ||
+	  (m = bloom_add_map (domain, map, h)) == NULL)
+	goto maybe;
+      m->generation = gen;
+      bloom_queue_map (m);
+      goto maybe;
+    }
+  else if (m->generation != gen)
+    {
+      bloom_drop (m);
+      m->failed = 0;
+      m->generation = gen;
+      bloom_queue_map (m);
+      goto maybe;
+    }
+  else if (m->failed || m->f.bits == NULL)
+    goto maybe;
+  else if (now - m->checked >= BLOOM_RECHECK)
+    {
+      /* Until the thread has compared it, the filter is used */
+      m->checked = now;
+      bloom_queue_map (m);
+    }
+
+  __atomic_add_fetch (&stat_checks, 1, __ATOMIC_RELAXED);
+
+  kh = bloom_hash (key, keylen);
+  for (k = 0; k < m->f.nhash; k++)
+    {
+      uint64_t bit = bloom_bit (kh, k, m->f.mask);
+
+      if (!(m->f.bits[bit / 64] & (1ULL << (bit % 64))))
+	{
+	  pthread_mutex_unlock (&bloom_lock);
+	  __atomic_add_fetch (&stat_negatives, 1, __ATOMIC_RELAXED);
+	  if (debug_flag)
+	    log_msg ("\t-> Not in bloom filter");
+	  return 0;
+	}
+    }
+
+  pthread_mutex_unlock (&bloom_lock);
+  bloom_passed = 1;
+  return 1;
+
+ maybe:
+  pthread_mutex_unlock (&bloom_lock);
+  return 1;
+}
+
+/* bloom_lookup found the key, but the map did not have it */
+void
+bloom_false_positive (void)
+{
+  if (bloom_passed)
+    __atomic_add_fetch (&stat_false_pos, 1, __ATOMIC_RELAXED);
+}
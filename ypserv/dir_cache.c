@@ -0,0 +1,576 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <time.h>
+#include <errno.h>
+#include <dirent.h>
+#include <alloca.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#if defined(HAVE_SYS_INOTIFY_H)
+#include <sys/inotify.h>
+#endif
+
+#include "yp.h"
+#include "yp_db.h"
+#include "ypc.h"
+#include "ypj.h"
+#include "log_msg.h"
+#include "ypserv_conf.h"
+#include "stats.h"
+#include "dir_cache.h"
+
+/* ORDER and MAPLIST answers are cached per domain. A thread watches
+   the directories of the domains with inotify, and every change of
+   an entry increases the generation of the domain, which invalidates
+   all of its answers. ORDER answers are also dropped after
+   YPPROC_CLEAR and after the map was reloaded. The MAPLIST reply is kept XDR encoded and sent as
+   it is. Without inotify, every request reads the map or the
+   directory as before. */
+
+#define DC_ORDER_BUCKETS 64
+
+typedef struct dc_order
+{
+  struct dc_order *next;
+  char *map;
+  unsigned int ordernum;
+  unsigned int generation;
+  unsigned int clear_generation;
+} dc_order_t;
+
+struct dir_maplist
+{
+  int refs;
+  u_int len;
+  char data[];			/* encoded ypresp_maplist */
+};
+
+/* Entries of the domain list and the ORDER entries are never freed,
+   there are not more of them than maps served. */
+typedef struct dc_domain
+{
+  struct dc_domain *next;
+  char *domain;
+  int wd;			/* -1: not watched, nothing is cached */
+  unsigned int generation;
+  dc_order_t *order[DC_ORDER_BUCKETS];
+  dir_maplist_t *maplist;
+  unsigned int maplist_generation;
+} dc_domain_t;
+
+static pthread_mutex_t dc_lock = PTHREAD_MUTEX_INITIALIZER;
+static dc_domain_t *dc_domains = NULL;
+static int dc_fd = -1;
+
+/* Counters */
+static unsigned long stat_order_hits = 0;
+static unsigned long stat_order_misses = 0;
+static unsigned long stat_maplist_hits = 0;
+static unsigned long stat_maplist_misses = 0;
+
+static void
+dir_cache_stats (void)
+{
+  log_msg ("  dir_cache: ORDER %lu hits, %lu misses, "
+	   "MAPLIST %lu hits, %lu misses",
+	   __atomic_load_n (&stat_order_hits, __ATOMIC_RELAXED),
+	   __atomic_load_n (&stat_order_misses, __ATOMIC_RELAXED),
+	   __atomic_load_n (&stat_maplist_hits, __ATOMIC_RELAXED),
+	   __atomic_load_n (&stat_maplist_misses, __ATOMIC_RELAXED));
+}
+
+static unsigned int
+dc_hash (const char *map)
+{
+  unsigned int h = 2166136261U;
+
+  while (*map)
+    {
+      h ^= (unsigned char) *map++;
+      h *= 16777619U;
+    }
+  return h;
+}
+
+/* Find the entry of a domain, create it and start watching the
+   directory, if needed. Must be called with dc_lock held. */
+static dc_domain_t *
+dc_find_domain (const char *domain)
+{
+  dc_domain_t *d;
+
+  for (d = dc_domains; d != NULL; d = d->next)
+    if (strcmp (d->domain, domain) == 0)
+      break;
+
+  if (d == NULL)
+    {
+      if ((d = calloc (1, sizeof (dc_domain_t))) == NULL)
+	return NULL;
+      if ((d->domain = strdup (domain)) == NULL)
+	{
+	  free (d);
+	  return NULL;
+	}
+      d->wd = -1;
+      d->generation = 1;
+      d->next = dc_domains;
+      dc_domains = d;
+    }
+
+#if defined(HAVE_SYS_INOTIFY_H)
+  /* The directory could have been removed and created again */
+  if (d->wd < 0 && dc_fd >= 0)
+    {
+      d->wd = inotify_add_watch (dc_fd, domain,
+				 IN_CREATE | IN_DELETE | IN_ATTRIB |
+				 IN_CLOSE_WRITE | IN_MOVED_FROM |
+				 IN_MOVED_TO | IN_DELETE_SELF |
+				 IN_MOVE_SELF);
+      if (d->wd < 0 && debug_flag)
+	log_msg ("inotify_add_watch (%s): %s", domain, strerror (errno));
+      __atomic_add_fetch (&d->generation, 1, __ATOMIC_RELEASE);
+    }
+#endif
+
+  return d;
+}
+
+#if defined(HAVE_SYS_INOTIFY_H)
+static void *
+dc_watch_run (void *arg)
+{
+  int fd = (int) (long) arg;
+  char buf[4096]
+    __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+
+  for (;;)
+    {
+      ssize_t n = read (fd, buf, sizeof (buf));
+      char *p;
+
+      if (n < 0 && errno == EINTR)
+	continue;
+      if (n <= 0)
+	break;
+
+      pthread_mutex_lock (&dc_lock);
+      for (p = buf; p < buf + n;
+	   p += sizeof (struct inotify_event) +
+	     ((struct inotify_event *) p)->len)
+	{
+	  struct inotify_event *ev = (struct inotify_event *) p;
+	  dc_domain_t *d;
+
+	  for (d = dc_domains; d != NULL; d = d->next)
+	    if (d->wd == ev->wd)
+	      {
+		__atomic_add_fetch (&d->generation, 1, __ATOMIC_RELEASE);
+		if (ev->mask & IN_IGNORED)
+		  d->wd = -1;	/* the directory is gone */
+		break;
+	      }
+	}
+      pthread_mutex_unlock (&dc_lock);
+    }
+
+  /* Without the thread, nothing may be cached anymore */
+  log_msg ("dir_cache: reading inotify events failed, cache disabled");
+  pthread_mutex_lock (&dc_lock);
+  if (dc_fd == fd)
+    {
+      dc_domain_t *d;
+
+      for (d = dc_domains; d != NULL; d = d->next)
+	d->wd = -1;
+      dc_fd = -1;
+      close (fd);
+    }
+  pthread_mutex_unlock (&dc_lock);
+
+  return NULL;
+}
+#endif
+
+static void
+dc_prepare (void)
+{
+  pthread_mutex_lock (&dc_lock);
+}
+
+static void
+dc_parent (void)
+{
+  pthread_mutex_unlock (&dc_lock);
+}
+
+/* The watch thread does not exist in a child process */
+static void
+dc_child (void)
+{
+  dc_domain_t *d;
+
+  for (d = dc_domains; d != NULL; d = d->next)
+    d->wd = -1;
+  if (dc_fd >= 0)
+    close (dc_fd);
+  dc_fd = -1;
+  pthread_mutex_unlock (&dc_lock);
+}
+
+/* Called by every ypserv process after the worker processes were
+   forked. */
+void
+dir_cache_init (void)
+{
+#if defined(HAVE_SYS_INOTIFY_H)
+  sigset_t set, oldset;
+  pthread_t tid;
+  int fd;
+
+  if ((fd = inotify_init1 (IN_CLOEXEC)) < 0)
+    {
+      log_msg ("dir_cache: inotify_init1: %s", strerror (errno));
+      return;
+    }
+
+  sigfillset (&set);
+  pthread_sigmask (SIG_BLOCK, &set, &oldset);
+  if (pthread_create (&tid, NULL, dc_watch_run, (void *) (long) fd) != 0)
+    {
+      log_msg ("Cannot create inotify thread: %s", strerror (errno));
+      close (fd);
+    }
+  else
+    {
+      pthread_detach (tid);
+      dc_fd = fd;
+      pthread_atfork (dc_prepare, dc_parent, dc_child);
+      stats_register (dir_cache_stats);
+    }
+  pthread_sigmask (SIG_SETMASK, &oldset, NULL);
+#endif
+}
+
+/* Get the DateTimeModified value for a certain map database */
+static unsigned long
+get_dtm (const char *domain, const char *map)
+{
+  struct stat sbuf;
+  char *buf = alloca (strlen (domain) + strlen (map) + 3);
+  char *cp;
+
+  cp = stpcpy (buf, domain);
+  *cp++ = '/';
+  strcpy (cp, map);
+
+  if (stat (buf, &sbuf) < 0)
+    return time (NULL); /* We set it to the current time. */
+  else
+    return (unsigned long) sbuf.st_mtime;
+}
+
+/* The order number of domain/map: the YP_LAST_MODIFIED entry, or the
+   modification time of the map file. */
+ypstat
+dir_cache_order (const char *domain, const char *map, unsigned int *ordernum)
+{
+  unsigned int h = dc_hash (map) & (DC_ORDER_BUCKETS - 1);
+  unsigned int gen = 0, clear_gen;
+  dc_domain_t *d;
+  dc_order_t *o = NULL;
+  DB_FILE dbp;
+
+  clear_gen = ypdb_map_generation (domain, map);
+
+  pthread_mutex_lock (&dc_lock);
+  if ((d = dc_find_domain (domain)) != NULL && d->wd >= 0)
+    {
+      /* Read before the map, a change meanwhile must not be lost */
+      gen = __atomic_load_n (&d->generation, __ATOMIC_ACQUIRE);
+      for (o = d->order[h]; o != NULL; o = o->next)
+	if (strcmp (o->map, map) == 0)
+	  break;
+      if (o != NULL && o->generation == gen &&
+	  o->clear_generation == clear_gen)
+	{
+	  *ordernum = o->ordernum;
+	  pthread_mutex_unlock (&dc_lock);
+	  __atomic_add_fetch (&stat_order_hits, 1, __ATOMIC_RELAXED);
+	  return YP_TRUE;
+	}
+    }
+  pthread_mutex_unlock (&dc_lock);
+  __atomic_add_fetch (&stat_order_misses, 1, __ATOMIC_RELAXED);
+
+  if ((dbp = ypdb_open (domain, map)) == NULL)
+    return YP_NOMAP;
+
+  if (!ypdb_order (dbp, ordernum))
+    {
+      /* No YP_LAST_MODIFIED record in map? Use DTM timestamp.. */
+      *ordernum = get_dtm (domain, map);
+    }
+  ypdb_close (dbp);
+
+  if (gen == 0)
+    return YP_TRUE;
+
+  pthread_mutex_lock (&dc_lock);
+  if (o == NULL)
+    {
+      for (o = d->order[h]; o != NULL; o = o->next)
+	if (strcmp (o->map, map) == 0)
+	  break;
+      if (o == NULL && (o = calloc (1, sizeof (dc_order_t))) != NULL)
+	{
+	  if ((o->map = strdup (map)) == NULL)
+	    {
+	      free (o);
+	      o = NULL;
+	    }
+	  else
+	    {
+	      o->next = d->order[h];
+	      d->order[h] = o;
+	    }
+	}
+    }
+  if (o != NULL)
+    {
+      o->ordernum = *ordernum;
+      o->generation = gen;
+      o->clear_generation = clear_gen;
+    }
+  pthread_mutex_unlock (&dc_lock);
+
+  return YP_TRUE;
+}
+
+static int
+add_maplist (ypmaplist **mlhp, char *map)
+{
+  ypmaplist *mlp;
+#if defined(HAVE_NDBM)
+#if defined(sun) || defined(__sun__)
+  int len = strlen (map);
+
+  /* We have all maps twice: with .dir and with .pag. Ignore .pag */
+  if (len > 3 && map[len - 4] == '.' && map[len - 3] == 'p' &&
+      map[len - 2] == 'a' && map[len - 1] == 'g')
+    return 0;
+
+  if (len > 3 && map[len - 4] == '.' && map[len - 3] == 'd' &&
+      map[len - 2] == 'i' && map[len - 1] == 'r')
+    map[len - 4] = '\0';
+#else
+  int len = strlen (map);
+
+  if (len > 2 && map[len - 3] == '.' && map[len - 2] == 'd' &&
+      map[len - 1] == 'b')
+    map[len - 3] = '\0';
+#endif
+#endif
+
+  if ((mlp = malloc (sizeof (*mlp))) == NULL)
+    return -1;
+
+  if ((mlp->map = strdup (map)) == NULL)
+    {
+      free (mlp);
+      return -1;
+    }
+
+  mlp->next = *mlhp;
+  *mlhp = mlp;
+
+  return 0;
+}
+
+/* Read the domain directory and encode the reply */
+static dir_maplist_t *
+build_maplist (const char *domain)
+{
+  ypresp_maplist result;
+  dir_maplist_t *reply;
+  ypmaplist *p;
+  u_int len = 2 * BYTES_PER_XDR_UNIT;
+  DIR *dp;
+  XDR xdrs;
+
+  memset (&result, 0, sizeof (result));
+
+  /* open domain directory */
+  dp = opendir (domain);
+  if (dp == NULL)
+    {
+      if (debug_flag)
+	log_msg ("opendir: %s", strerror (errno));
+
+      result.status = YP_BADDB;
+    }
+  else
+    {
+      struct dirent *dep;
+
+      result.status = YP_TRUE;
+      while ((dep = readdir (dp)) != NULL)
+	{
+	  /* ignore files starting with . */
+	  if (dep->d_name[0] == '.')
+	    continue;
+	  /* ignore temporary files ending with ~, created
+	     by makedbm and ypxfr if updating maps */
+	  if (dep->d_name[strlen(dep->d_name) - 1] == '~')
+	    continue;
+	  /* ignore the ypc files of makedbm --mmap */
+	  if (strlen (dep->d_name) > strlen (YPC_SUFFIX) &&
+	      strcmp (dep->d_name + strlen (dep->d_name) - strlen (YPC_SUFFIX),
+		      YPC_SUFFIX) == 0)
+	    continue;
+	  /* and the journals of makedbm --journal */
+	  if (strlen (dep->d_name) > strlen (YPJ_SUFFIX) &&
+	      strcmp (dep->d_name + strlen (dep->d_name) - strlen (YPJ_SUFFIX),
+		      YPJ_SUFFIX) == 0)
+	    continue;
+	  if (add_maplist (&result.list, dep->d_name) < 0)
+	    {
+	      result.status = YP_YPERR;
+	      break;
+	    }
+	}
+      closedir (dp);
+    }
+
+  if (debug_flag)
+    {
+      if (result.status == YP_TRUE)
+        {
+          p = result.list;
+          log_msg ("-> ");
+          while (p)
+            {
+              if (p->next)
+		log_msg ("   %s,", p->map);
+	      else
+		log_msg ("   %s", p->map);
+              p = p->next;
+            }
+        }
+      else
+        log_msg ("\t-> Error #%d", result.status);
+    }
+
+  /* status, and for every map a "more" flag and the name */
+  if (result.status == YP_TRUE)
+    for (p = result.list; p != NULL; p = p->next)
+      len += 2 * BYTES_PER_XDR_UNIT + RNDUP (strlen (p->map));
+  else
+    xdr_free ((xdrproc_t) xdr_ypresp_maplist, (char *) &result);
+
+  if ((reply = malloc (sizeof (dir_maplist_t) + len)) != NULL)
+    {
+      reply->refs = 1;
+      xdrmem_create (&xdrs, reply->data, len, XDR_ENCODE);
+      if (!xdr_ypresp_maplist (&xdrs, &result))
+	{
+	  free (reply);
+	  reply = NULL;
+	}
+      else
+	reply->len = xdr_getpos (&xdrs);
+      xdr_destroy (&xdrs);
+    }
+  xdr_free ((xdrproc_t) xdr_ypresp_maplist, (char *) &result);
+
+  if (reply == NULL)
+    log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	     __FILE__, __LINE__);
+  return reply;
+}
+
+/* The encoded MAPLIST reply for domain, which has to be given back
+   with dir_cache_release. NULL if there is not enough memory. */
+dir_maplist_t *
+dir_cache_maplist (const char *domain)
+{
+  dir_maplist_t *reply;
+  unsigned int gen = 0;
+  dc_domain_t *d;
+
+  pthread_mutex_lock (&dc_lock);
+  if ((d = dc_find_domain (domain)) != NULL && d->wd >= 0)
+    {
+      gen = __atomic_load_n (&d->generation, __ATOMIC_ACQUIRE);
+      if (d->maplist != NULL && d->maplist_generation == gen)
+	{
+	  reply = d->maplist;
+	  reply->refs++;
+	  pthread_mutex_unlock (&dc_lock);
+	  __atomic_add_fetch (&stat_maplist_hits, 1, __ATOMIC_RELAXED);
+	  if (debug_flag)
+	    log_msg ("\t-> cached reply");
+	  return reply;
+	}
+    }
+  pthread_mutex_unlock (&dc_lock);
+  __atomic_add_fetch (&stat_maplist_misses, 1, __ATOMIC_RELAXED);
+
+  if ((reply = build_maplist (domain)) == NULL || gen == 0)
+    return reply;
+
+  /* Replace the old reply, if it was not built meanwhile by another
+     thread */
+  pthread_mutex_lock (&dc_lock);
+  if (d->maplist == NULL || d->maplist_generation != gen)
+    {
+      if (d->maplist != NULL && --d->maplist->refs == 0)
+	free (d->maplist);
+      d->maplist = reply;
+      d->maplist_generation = gen;
+      reply->refs++;
+    }
+  pthread_mutex_unlock (&dc_lock);
+
+  return reply;
+}
+
+bool_t
+xdr_dir_maplist (XDR *xdrs, dir_maplist_t *reply)
+{
+  return xdr_opaque (xdrs, reply->data, reply->len);
+}
+
+void
+dir_cache_release (dir_maplist_t *reply)
+{
+  int refs;
+
+  pthread_mutex_lock (&dc_lock);
+  refs = --reply->refs;
+  pthread_mutex_unlock (&dc_lock);
+  if (refs == 0)
+    free (reply);
+}
@@ -0,0 +1,33 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifndef __DIR_CACHE_H__
+#define __DIR_CACHE_H__
+
+#include <rpc/rpc.h>
+
+#include "yp.h"
+
+typedef struct dir_maplist dir_maplist_t;
+
+extern void dir_cache_init (void);
+extern ypstat dir_cache_order (const char *domain, const char *map,
+			       unsigned int *ordernum);
+extern dir_maplist_t *dir_cache_maplist (const char *domain);
+extern bool_t xdr_dir_maplist (XDR *xdrs, dir_maplist_t *reply);
+extern void dir_cache_release (dir_maplist_t *reply);
+
+#endif
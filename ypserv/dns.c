@@ -0,0 +1,1308 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <time.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <rpc/rpc.h>
+#include <rpc/svc_dg.h>
+#include <rpc/svc_mt.h>
+
+#include "yp.h"
+#include "log_msg.h"
+#include "ypserv_conf.h"
+#include "stats.h"
+#include "evloop.h"
+#include "svc_mmsg.h"
+#include "dns.h"
+
+/* With "dns: yes" in ypserv.conf, a MATCH request for hosts.byname
+   or hosts.byaddr, whose key is not in the map, is answered with the
+   A or PTR record of the key. The queries are sent to dns_server or
+   the first nameserver of /etc/resolv.conf. Every query has an own
+   UDP socket, bound to a random port, and a random id from
+   getrandom(), so an answer cannot be spoofed without guessing both.
+   The sockets are in an epoll set, which is registered like a RPC
+   transport together with a timer for retransmissions, so the
+   answers are read by the main loop and a miss never blocks it.
+
+   The request waits for the answer without blocking the transport:
+   for UDP, the transaction id and the address of the client are
+   kept and the reply is sent with sendto() later, connections of the
+   event loop are deferred with evloop_defer(). Requests, which
+   cannot wait (TCP without "epoll: yes", YPPROC_MATCH_MULTI), get
+   YP_YPERR while the query is sent, not YP_NOKEY for a name which
+   may exist, and the answer from the cache with the next request.
+
+   Answers are cached as long as their TTL allows, at most
+   DNS_MAX_TTL seconds. Names, which do not exist, are cached as long
+   as the SOA record in the answer says (RFC 2308), or DNS_NEG_TTL
+   seconds. The least recently used entries are removed if there are
+   more than DNS_CACHE_MAX. */
+
+#define DNS_PORT 53
+#define DNS_CACHE_MAX 4096	/* entries, also the hash table size */
+#define DNS_MAX_TTL 86400
+#define DNS_NEG_TTL 60
+#define DNS_RETRY_MS 1000	/* retransmit after so many milliseconds */
+#define DNS_TRIES 3
+#define DNS_TICK_MS 250
+#define DNS_MAX_WAITERS 64	/* requests waiting for the same query */
+#define DNS_MAX_QUERIES 256	/* pending queries, each has a socket */
+#define DNS_BIND_TRIES 8	/* random ports tried for a socket */
+#define DNS_MSGSIZE 512
+#define DNS_NAMESIZE 256
+#define DNS_VALSIZE 1024
+
+#define DNS_T_A 1
+#define DNS_T_CNAME 5
+#define DNS_T_SOA 6
+#define DNS_T_PTR 12
+#define DNS_C_IN 1
+
+typedef enum { DE_PENDING, DE_FOUND, DE_NOTFOUND } de_state_t;
+
+struct dns_entry;
+
+typedef struct dns_waiter
+{
+  struct dns_waiter *next;
+  struct dns_entry *entry;	/* NULL if the answer is being sent */
+  void *conn;			/* handle of evloop_defer, or */
+  int fd;			/* the UDP socket of the request */
+  u_int32_t xid;
+  socklen_t addrlen;
+  struct sockaddr_storage addr;
+} dns_waiter_t;
+
+typedef struct dns_entry
+{
+  struct dns_entry *hnext;	/* hash chain */
+  struct dns_entry *prev;	/* LRU list, most recently used first */
+  struct dns_entry *next;
+  struct dns_entry *pnext;	/* list of pending queries */
+  unsigned int hash;
+  int type;			/* DNS_T_A or DNS_T_PTR */
+  de_state_t state;
+  time_t expires;
+  unsigned long sent;		/* ms of the last query */
+  int tries;
+  int fd;			/* socket of the query, or -1 */
+  u_int16_t id;
+  int nr_waiters;
+  dns_waiter_t *waiters;
+  char *val;
+  u_int vallen;
+  char key[];
+} dns_entry_t;
+
+typedef struct dns_xprt
+{
+  SVCXPRT xprt;
+  SVCXPRT_EXT ext;
+} dns_xprt_t;
+
+static pthread_mutex_t dns_lock = PTHREAD_MUTEX_INITIALIZER;
+static dns_entry_t **dns_table = NULL;
+static dns_entry_t *dns_head = NULL;
+static dns_entry_t *dns_tail = NULL;
+static dns_entry_t *dns_pending = NULL;
+static unsigned long dns_entries = 0;
+static unsigned long dns_queries = 0;	/* with an open socket */
+static int dns_epfd = -1;
+static struct sockaddr_storage dns_addr;
+static socklen_t dns_addrlen;
+static int dns_timer_fd = -1;
+static int dns_timer_armed = 0;
+/* Appended to names without a dot, from "domain" or "search" */
+static char dns_domain[DNS_NAMESIZE];
+
+/* Counters, protected by dns_lock */
+static unsigned long stat_hits = 0;
+static unsigned long stat_neg_hits = 0;
+static unsigned long stat_misses = 0;
+static unsigned long stat_queries = 0;
+static unsigned long stat_found = 0;
+static unsigned long stat_notfound = 0;
+static unsigned long stat_failed = 0;
+static unsigned long stat_timeouts = 0;
+
+static void
+dns_stats (void)
+{
+  pthread_mutex_lock (&dns_lock);
+  log_msg ("  dns: %lu hits, %lu negative hits, %lu misses, %lu entries",
+	   stat_hits, stat_neg_hits, stat_misses, dns_entries);
+  log_msg ("  dns: %lu queries, %lu found, %lu not found, %lu failed, "
+	   "%lu timed out", stat_queries, stat_found, stat_notfound,
+	   stat_failed, stat_timeouts);
+  pthread_mutex_unlock (&dns_lock);
+}
+
+static unsigned long
+dns_now_ms (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+}
+
+/* A host name, which can be sent as query. The same characters are
+   accepted in names of answers, which become part of a value. */
+static int
+dns_valid_name (const char *name)
+{
+  size_t len = strlen (name), label = 0, i;
+
+  if (len == 0 || len >= DNS_NAMESIZE - 1 || name[0] == '.')
+    return 0;
+
+  for (i = 0; i < len; i++)
+    {
+      unsigned char c = name[i];
+
+      if (c == '.')
+	{
+	  if (label == 0)
+	    return 0;
+	  label = 0;
+	}
+      else if (isalnum (c) || c == '-' || c == '_')
+	{
+	  if (++label > 63)
+	    return 0;
+	}
+      else
+	return 0;
+    }
+
+  return 1;
+}
+
+/* FNV-1a of the key, mixed with the type */
+static unsigned int
+dns_hash (int type, const char *key)
+{
+  unsigned int h = 2166136261U;
+
+  for (; *key; key++)
+    {
+      h ^= (unsigned char) *key;
+      h *= 16777619U;
+    }
+
+  return h ^ (unsigned int) type;
+}
+
+static dns_entry_t *
+de_find (int type, const char *key, unsigned int hash)
+{
+  dns_entry_t *e;
+
+  for (e = dns_table[hash & (DNS_CACHE_MAX - 1)]; e != NULL; e = e->hnext)
+    if (e->hash == hash && e->type == type && strcmp (e->key, key) == 0)
+      return e;
+
+  return NULL;
+}
+
+static void
+de_unlink_lru (dns_entry_t *e)
+{
+  if (e->prev)
+    e->prev->next = e->next;
+  else
+    dns_head = e->next;
+  if (e->next)
+    e->next->prev = e->prev;
+  else
+    dns_tail = e->prev;
+}
+
+static void
+de_touch (dns_entry_t *e)
+{
+  if (dns_head == e)
+    return;
+
+  de_unlink_lru (e);
+  e->prev = NULL;
+  e->next = dns_head;
+  dns_head->prev = e;
+  dns_head = e;
+}
+
+/* Closing the socket removes it from the epoll set, too */
+static void
+de_close (dns_entry_t *e)
+{
+  if (e->fd >= 0)
+    {
+      close (e->fd);
+      e->fd = -1;
+      --dns_queries;
+    }
+}
+
+static void
+de_remove (dns_entry_t *e)
+{
+  dns_entry_t **pp = &dns_table[e->hash & (DNS_CACHE_MAX - 1)];
+
+  de_close (e);
+
+  while (*pp != e)
+    pp = &(*pp)->hnext;
+  *pp = e->hnext;
+
+  de_unlink_lru (e);
+  --dns_entries;
+  free (e->val);
+  free (e);
+}
+
+/* Remove e from the list of pending queries */
+static void
+de_unpend (dns_entry_t *e)
+{
+  dns_entry_t **pp;
+
+  for (pp = &dns_pending; *pp != NULL; pp = &(*pp)->pnext)
+    if (*pp == e)
+      {
+	*pp = e->pnext;
+	break;
+      }
+  e->pnext = NULL;
+}
+
+static dns_entry_t *
+de_new (int type, const char *key, unsigned int hash)
+{
+  size_t len = strlen (key);
+  dns_entry_t *e;
+
+  /* Pending queries are never removed */
+  if (dns_entries >= DNS_CACHE_MAX)
+    {
+      for (e = dns_tail; e != NULL && e->state == DE_PENDING; e = e->prev)
+	;
+      if (e == NULL)
+	return NULL;
+      de_remove (e);
+    }
+
+  if ((e = calloc (1, sizeof (dns_entry_t) + len + 1)) == NULL)
+    {
+      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	       __FILE__, __LINE__);
+      return NULL;
+    }
+  e->hash = hash;
+  e->type = type;
+  e->state = DE_PENDING;
+  e->fd = -1;
+  memcpy (e->key, key, len + 1);
+
+  e->hnext = dns_table[hash & (DNS_CACHE_MAX - 1)];
+  dns_table[hash & (DNS_CACHE_MAX - 1)] = e;
+  e->next = dns_head;
+  if (dns_head)
+    dns_head->prev = e;
+  else
+    dns_tail = e;
+  dns_head = e;
+  ++dns_entries;
+
+  return e;
+}
+
+static void
+dns_timer_arm (int on)
+{
+  struct itimerspec its;
+
+  if (dns_timer_armed == on)
+    return;
+
+  memset (&its, 0, sizeof (its));
+  if (on)
+    {
+      its.it_value.tv_nsec = DNS_TICK_MS * 1000000L;
+      its.it_interval.tv_nsec = DNS_TICK_MS * 1000000L;
+    }
+  if (timerfd_settime (dns_timer_fd, 0, &its, NULL) < 0)
+    log_msg ("dns: timerfd_settime failed: %s", strerror (errno));
+  else
+    dns_timer_armed = on;
+}
+
+/* The name, for which e is looked up */
+static int
+dns_qname (const dns_entry_t *e, char *buf, size_t size)
+{
+  int n;
+
+  if (e->type == DNS_T_PTR)
+    {
+      unsigned char a[4];
+
+      if (inet_pton (AF_INET, e->key, a) != 1)
+	return -1;
+      n = snprintf (buf, size, "%u.%u.%u.%u.in-addr.arpa",
+		    a[3], a[2], a[1], a[0]);
+    }
+  else if (strchr (e->key, '.') == NULL && dns_domain[0] != '\0')
+    n = snprintf (buf, size, "%s.%s", e->key, dns_domain);
+  else
+    n = snprintf (buf, size, "%s", e->key);
+
+  if (n < 0 || (size_t) n >= size)
+    return -1;
+  return 0;
+}
+
+/* A socket for one query, bound to a random port and connected to
+   the name server, so only its answers are received. */
+static int
+dns_socket (void)
+{
+  struct epoll_event ev;
+  int fd, i;
+
+  fd = socket (dns_addr.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+	       0);
+  if (fd < 0)
+    {
+      log_msg ("dns: cannot create socket: %s", strerror (errno));
+      return -1;
+    }
+
+  for (i = 0; i < DNS_BIND_TRIES; i++)
+    {
+      struct sockaddr_storage ss;
+      u_int16_t port;
+
+      if (getrandom (&port, sizeof (port), GRND_NONBLOCK) != sizeof (port))
+	break;
+      port = 1024 + port % (65536 - 1024);
+
+      memset (&ss, 0, sizeof (ss));
+      ss.ss_family = dns_addr.ss_family;
+      if (ss.ss_family == AF_INET)
+	((struct sockaddr_in *) &ss)->sin_port = htons (port);
+      else
+	((struct sockaddr_in6 *) &ss)->sin6_port = htons (port);
+      if (bind (fd, (struct sockaddr *) &ss, dns_addrlen) == 0)
+	break;
+      if (errno != EADDRINUSE)
+	break;
+    }
+  /* Else connect binds the socket to a port chosen by the kernel */
+  if (i == DNS_BIND_TRIES && debug_flag)
+    log_msg ("dns: no free random port found");
+
+  if (connect (fd, (struct sockaddr *) &dns_addr, dns_addrlen) < 0)
+    {
+      log_msg ("dns: cannot connect to name server: %s", strerror (errno));
+      close (fd);
+      return -1;
+    }
+
+  memset (&ev, 0, sizeof (ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  if (epoll_ctl (dns_epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+      log_msg ("dns: epoll_ctl failed: %s", strerror (errno));
+      close (fd);
+      return -1;
+    }
+
+  return fd;
+}
+
+static int
+dns_send (dns_entry_t *e)
+{
+  unsigned char msg[DNS_MSGSIZE];
+  char name[DNS_NAMESIZE];
+  size_t len = 12;
+  const char *p;
+
+  if (dns_qname (e, name, sizeof (name)) < 0)
+    return -1;
+
+  /* A retransmission keeps the socket and the id, so a late answer
+     to the first one is accepted, too. */
+  if (e->fd < 0)
+    {
+      if (dns_queries >= DNS_MAX_QUERIES)
+	{
+	  if (debug_flag)
+	    log_msg ("dns: too many queries, %s not sent", name);
+	  return -1;
+	}
+      if (getrandom (&e->id, sizeof (e->id), GRND_NONBLOCK)
+	  != sizeof (e->id))
+	{
+	  log_msg ("dns: getrandom failed: %s", strerror (errno));
+	  return -1;
+	}
+      if ((e->fd = dns_socket ()) < 0)
+	return -1;
+      ++dns_queries;
+    }
+
+  memset (msg, 0, len);
+  msg[0] = e->id >> 8;
+  msg[1] = e->id & 0xff;
+  msg[2] = 0x01;		/* recursion desired */
+  msg[5] = 1;			/* one question */
+
+  for (p = name; *p != '\0';)
+    {
+      const char *dot = strchr (p, '.');
+      size_t l = dot ? (size_t) (dot - p) : strlen (p);
+
+      if (l == 0 || l > 63 || len + l + 1 + 5 > sizeof (msg))
+	return -1;
+      msg[len++] = l;
+      memcpy (msg + len, p, l);
+      len += l;
+      p += l;
+      if (*p == '.')
+	++p;
+    }
+  msg[len++] = 0;
+  msg[len++] = 0;
+  msg[len++] = e->type;
+  msg[len++] = 0;
+  msg[len++] = DNS_C_IN;
+
+  e->sent = dns_now_ms ();
+  ++e->tries;
+  ++stat_queries;
+
+  if (send (e->fd, msg, len, 0) < 0)
+    {
+      if (debug_flag)
+	log_msg ("dns: cannot send query for %s: %s", name, strerror (errno));
+      return -1;
+    }
+  if (debug_flag)
+    log_msg ("dns: query %u for %s (%d. try)", e->id, name, e->tries);
+
+  return 0;
+}
+
+static unsigned int
+get16 (const unsigned char *p)
+{
+  return (p[0] << 8) | p[1];
+}
+
+static u_int32_t
+get32 (const unsigned char *p)
+{
+  return ((u_int32_t) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/* Read the name at off of the message into name, if it is not
+   NULL. Returns the offset behind the name or -1 if it is broken. */
+static int
+dns_read_name (const unsigned char *msg, int len, int off, char *name,
+	       size_t size)
+{
+  int end = -1, jumps = 0;
+  size_t n = 0;
+
+  for (;;)
+    {
+      unsigned int l;
+
+      if (off >= len)
+	return -1;
+      l = msg[off];
+      if ((l & 0xc0) == 0xc0)
+	{
+	  if (off + 1 >= len || ++jumps > 16)
+	    return -1;
+	  if (end < 0)
+	    end = off + 2;
+	  off = ((l & 0x3f) << 8) | msg[off + 1];
+	  continue;
+	}
+      if (l & 0xc0)
+	return -1;
+      ++off;
+      if (l == 0)
+	break;
+      if (off + (int) l > len)
+	return -1;
+      if (name != NULL)
+	{
+	  if (n + l + 2 > size)
+	    return -1;
+	  if (n > 0)
+	    name[n++] = '.';
+	  memcpy (name + n, msg + off, l);
+	  n += l;
+	}
+      off += l;
+    }
+
+  if (name != NULL)
+    name[n] = '\0';
+  return end < 0 ? off : end;
+}
+
+/* Returns DE_FOUND and the value in val, or DE_NOTFOUND, and the
+   time the answer may be cached in ttl. -1 means the query failed,
+   -2 that msg is not the answer to the query. */
+static int
+dns_parse (const dns_entry_t *e, const char *qname,
+	   const unsigned char *msg, int len, char *val, size_t size,
+	   u_int32_t *ttl)
+{
+  char name[DNS_NAMESIZE], canon[DNS_NAMESIZE];
+  u_int32_t minttl = DNS_MAX_TTL;
+  unsigned int flags, qd, an, ns, i;
+  int off, rcode, n;
+
+  if (len < 12)
+    return -2;
+  flags = get16 (msg + 2);
+  qd = get16 (msg + 4);
+  an = get16 (msg + 6);
+  ns = get16 (msg + 8);
+  if (!(flags & 0x8000) || qd != 1)
+    return -2;
+
+  off = dns_read_name (msg, len, 12, name, sizeof (name));
+  if (off < 0 || off + 4 > len || strcasecmp (name, qname) != 0 ||
+      get16 (msg + off) != (unsigned int) e->type)
+    return -2;
+  off += 4;
+
+  rcode = flags & 0x0f;
+  if ((flags & 0x0200) || (rcode != 0 && rcode != 3))
+    return -1;			/* truncated, SERVFAIL, REFUSED, ... */
+
+  /* Follow a CNAME chain to the record we asked for */
+  strcpy (canon, qname);
+  for (i = 0; i < an; i++)
+    {
+      unsigned int type, class, rdlen;
+      u_int32_t rrttl;
+
+      off = dns_read_name (msg, len, off, name, sizeof (name));
+      if (off < 0 || off + 10 > len)
+	return -1;
+      type = get16 (msg + off);
+      class = get16 (msg + off + 2);
+      rrttl = get32 (msg + off + 4);
+      rdlen = get16 (msg + off + 8);
+      off += 10;
+      if (off + (int) rdlen > len)
+	return -1;
+
+      if (class == DNS_C_IN && strcasecmp (name, canon) == 0)
+	{
+	  if (rrttl < minttl)
+	    minttl = rrttl;
+
+	  if (type == DNS_T_CNAME)
+	    {
+	      if (dns_read_name (msg, len, off, canon, sizeof (canon)) < 0)
+		return -1;
+	    }
+	  else if (type == DNS_T_A && e->type == DNS_T_A && rdlen == 4)
+	    {
+	      char addr[INET_ADDRSTRLEN];
+
+	      inet_ntop (AF_INET, msg + off, addr, sizeof (addr));
+	      if (!dns_valid_name (canon))
+		return -1;
+	      /* Like a line of /etc/hosts, the key is an alias if
+		 the canonical name is a different one */
+	      if (strcasecmp (canon, e->key) == 0)
+		n = snprintf (val, size, "%s\t%s", addr, canon);
+	      else
+		n = snprintf (val, size, "%s\t%s %s", addr, canon, e->key);
+	      if (n < 0 || (size_t) n >= size)
+		return -1;
+	      *ttl = minttl;
+	      return DE_FOUND;
+	    }
+	  else if (type == DNS_T_PTR && e->type == DNS_T_PTR)
+	    {
+	      if (dns_read_name (msg, len, off, name, sizeof (name)) < 0 ||
+		  !dns_valid_name (name))
+		return -1;
+	      n = snprintf (val, size, "%s\t%s", e->key, name);
+	      if (n < 0 || (size_t) n >= size)
+		return -1;
+	      *ttl = minttl;
+	      return DE_FOUND;
+	    }
+	}
+      off += rdlen;
+    }
+
+  /* Not found, the SOA record in the authority section says how
+     long this may be cached. */
+  *ttl = DNS_NEG_TTL;
+  for (i = 0; i < ns; i++)
+    {
+      unsigned int type, rdlen;
+      u_int32_t rrttl;
+      int p;
+
+      off = dns_read_name (msg, len, off, NULL, 0);
+      if (off < 0 || off + 10 > len)
+	break;
+      type = get16 (msg + off);
+      rrttl = get32 (msg + off + 4);
+      rdlen = get16 (msg + off + 8);
+      off += 10;
+      if (off + (int) rdlen > len)
+	break;
+      if (type == DNS_T_SOA)
+	{
+	  /* mname and rname, followed by serial, refresh, retry,
+	     expire and minimum */
+	  if ((p = dns_read_name (msg, len, off, NULL, 0)) < 0 ||
+	      (p = dns_read_name (msg, len, p, NULL, 0)) < 0 ||
+	      p + 20 > len)
+	    break;
+	  *ttl = get32 (msg + p + 16);
+	  if (rrttl < *ttl)
+	    *ttl = rrttl;
+	  if (*ttl > DNS_MAX_TTL)
+	    *ttl = DNS_MAX_TTL;
+	  break;
+	}
+      off += rdlen;
+    }
+
+  return DE_NOTFOUND;
+}
+
+/* The query of e is finished, detach the waiting requests and keep
+   the answer, or remove e if state is -1. The returned requests are
+   answered by the caller after dns_lock is released. */
+static dns_waiter_t *
+de_complete (dns_entry_t *e, int state, u_int32_t ttl, const char *val)
+{
+  dns_waiter_t *w = e->waiters, *p;
+
+  de_unpend (e);
+  de_close (e);
+  e->waiters = NULL;
+  e->nr_waiters = 0;
+  for (p = w; p != NULL; p = p->next)
+    p->entry = NULL;
+
+  if (state == DE_FOUND)
+    {
+      e->vallen = strlen (val);
+      if ((e->val = strdup (val)) == NULL)
+	state = -1;
+    }
+  if (state < 0)
+    {
+      de_remove (e);
+      return w;
+    }
+
+  e->state = state;
+  e->expires = time (NULL) + ttl;
+  return w;
+}
+
+/* The connection of a deferred request was closed */
+static void
+dns_cancel (void *data)
+{
+  dns_waiter_t *w = data, **pp;
+
+  pthread_mutex_lock (&dns_lock);
+  if (w->entry == NULL)
+    {
+      /* Freed by waiters_reply */
+      w->conn = NULL;
+      w->fd = -1;
+      pthread_mutex_unlock (&dns_lock);
+      return;
+    }
+
+  for (pp = &w->entry->waiters; *pp != NULL; pp = &(*pp)->next)
+    if (*pp == w)
+      {
+	*pp = w->next;
+	--w->entry->nr_waiters;
+	break;
+      }
+  pthread_mutex_unlock (&dns_lock);
+  free (w);
+}
+
+/* Remember, where the reply to the current request has to be sent.
+   Returns -1 if the transport cannot wait for it. */
+static int
+waiter_init (dns_waiter_t *w, SVCXPRT *xprt)
+{
+  socklen_t len;
+  int type;
+
+  w->fd = -1;
+  if (!svc_mmsg_xid (xprt, &w->xid))
+    {
+      len = sizeof (type);
+      if (getsockopt (xprt->xp_fd, SOL_SOCKET, SO_TYPE, &type, &len) < 0)
+	return -1;
+      if (type != SOCK_DGRAM)
+	{
+	  w->conn = evloop_defer (xprt, dns_cancel, w);
+	  return w->conn != NULL ? 0 : -1;
+	}
+      w->xid = *__rpcb_get_dg_xidp (xprt);
+    }
+
+  if (xprt->xp_rtaddr.buf == NULL || xprt->xp_rtaddr.len > sizeof (w->addr))
+    return -1;
+  memcpy (&w->addr, xprt->xp_rtaddr.buf, xprt->xp_rtaddr.len);
+  w->addrlen = xprt->xp_rtaddr.len;
+  w->fd = xprt->xp_fd;
+
+  return 0;
+}
+
+static void
+waiter_sendto (dns_waiter_t *w, ypresp_val *res)
+{
+  char buf[UDPMSGSIZE];
+  struct rpc_msg msg;
+  XDR xdrs;
+
+  memset (&msg, 0, sizeof (msg));
+  msg.rm_xid = w->xid;
+  msg.rm_direction = REPLY;
+  msg.rm_reply.rp_stat = MSG_ACCEPTED;
+  msg.acpted_rply.ar_verf = _null_auth;
+  msg.acpted_rply.ar_stat = SUCCESS;
+  msg.acpted_rply.ar_results.where = (caddr_t) res;
+  msg.acpted_rply.ar_results.proc = (xdrproc_t) xdr_ypresp_val;
+
+  xdrmem_create (&xdrs, buf, sizeof (buf), XDR_ENCODE);
+  if (!xdr_replymsg (&xdrs, &msg))
+    log_msg ("dns: cannot encode reply");
+  else if (sendto (w->fd, buf, xdr_getpos (&xdrs), 0,
+		   (struct sockaddr *) &w->addr, w->addrlen) < 0 && debug_flag)
+    log_msg ("dns: cannot send reply: %s", strerror (errno));
+  XDR_DESTROY (&xdrs);
+}
+
+/* Answer the requests, which waited for a query, with val or
+   YP_NOKEY, and free them. */
+static void
+waiters_reply (dns_waiter_t *w, char *val)
+{
+  ypresp_val res;
+
+  memset (&res, 0, sizeof (res));
+  if (val != NULL)
+    {
+      res.status = YP_TRUE;
+      res.valdat.valdat_val = val;
+      res.valdat.valdat_len = strlen (val);
+    }
+  else
+    res.status = YP_NOKEY;
+
+  while (w != NULL)
+    {
+      dns_waiter_t *next = w->next;
+
+      if (w->conn != NULL)
+	evloop_reply (w->conn, (xdrproc_t) xdr_ypresp_val, &res);
+      else if (w->fd >= 0)
+	waiter_sendto (w, &res);
+      free (w);
+      w = next;
+    }
+}
+
+/* Look up key in the cache, or send a query for it. Returns 1 if
+   result is set, which is YP_YPERR if there is no answer yet, or
+   0 if the reply is sent when the answer arrives. */
+int
+dns_match (struct svc_req *rqstp, const char *map, const char *key,
+	   u_int keylen, ypresp_val *result, char *buf, size_t size)
+{
+  char name[DNS_NAMESIZE];
+  unsigned int hash;
+  dns_entry_t *e;
+  dns_waiter_t *w;
+  int type, ret = 1;
+
+  if (dns_epfd < 0)
+    return 1;
+  if (strcmp (map, "hosts.byname") == 0)
+    type = DNS_T_A;
+  else if (strcmp (map, "hosts.byaddr") == 0)
+    type = DNS_T_PTR;
+  else
+    return 1;
+
+  if (keylen >= sizeof (name))
+    return 1;
+  memcpy (name, key, keylen);
+  name[keylen] = '\0';
+  if (type == DNS_T_PTR)
+    {
+      struct in_addr a;
+
+      if (inet_pton (AF_INET, name, &a) != 1)
+	return 1;
+    }
+  else if (!dns_valid_name (name))
+    return 1;
+
+  hash = dns_hash (type, name);
+
+  pthread_mutex_lock (&dns_lock);
+  e = de_find (type, name, hash);
+  if (e != NULL && e->state != DE_PENDING && e->expires <= time (NULL))
+    {
+      de_remove (e);
+      e = NULL;
+    }
+
+  if (e != NULL && e->state == DE_FOUND)
+    {
+      if (e->vallen <= size)
+	{
+	  memcpy (buf, e->val, e->vallen);
+	  result->status = YP_TRUE;
+	  result->valdat.valdat_val = buf;
+	  result->valdat.valdat_len = e->vallen;
+	}
+      de_touch (e);
+      ++stat_hits;
+    }
+  else if (e != NULL && e->state == DE_NOTFOUND)
+    {
+      de_touch (e);
+      ++stat_neg_hits;
+    }
+  else
+    {
+      /* Unless the request waits for the answer */
+      result->status = YP_YPERR;
+
+      if (e == NULL)
+	{
+	  ++stat_misses;
+	  if ((e = de_new (type, name, hash)) == NULL)
+	    goto out;
+	  if (dns_send (e) < 0)
+	    {
+	      de_remove (e);
+	      goto out;
+	    }
+	  e->pnext = dns_pending;
+	  dns_pending = e;
+	  dns_timer_arm (1);
+	}
+
+      if (rqstp->rq_proc != YPPROC_MATCH ||
+	  e->nr_waiters >= DNS_MAX_WAITERS)
+	goto out;
+      if ((w = calloc (1, sizeof (dns_waiter_t))) == NULL)
+	{
+	  log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+		   __FILE__, __LINE__);
+	  goto out;
+	}
+      if (waiter_init (w, rqstp->rq_xprt) < 0)
+	{
+	  free (w);
+	  goto out;
+	}
+      w->entry = e;
+      w->next = e->waiters;
+      e->waiters = w;
+      ++e->nr_waiters;
+      ret = 0;
+    }
+
+ out:
+  pthread_mutex_unlock (&dns_lock);
+  return ret;
+}
+
+/* Read the answer of the name server from the socket fd. It is
+   only read while the query is pending, a closed socket may have
+   been reused for something else already. */
+static void
+dns_sock_read (int fd)
+{
+  unsigned char buf[DNS_MSGSIZE * 2];
+  char qname[DNS_NAMESIZE], val[DNS_VALSIZE];
+  dns_waiter_t *w;
+  dns_entry_t *e;
+  u_int32_t ttl = 0;
+  ssize_t n;
+  int state;
+
+  pthread_mutex_lock (&dns_lock);
+  for (e = dns_pending; e != NULL && e->fd != fd; e = e->pnext)
+    ;
+  if (e == NULL || dns_qname (e, qname, sizeof (qname)) < 0)
+    {
+      pthread_mutex_unlock (&dns_lock);
+      return;
+    }
+
+  for (;;)
+    {
+      n = recv (fd, buf, sizeof (buf), 0);
+      if (n < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  if (errno != EAGAIN && errno != EWOULDBLOCK && debug_flag)
+	    log_msg ("dns: recv failed: %s", strerror (errno));
+	  pthread_mutex_unlock (&dns_lock);
+	  return;
+	}
+      /* Not the answer to the query of this socket */
+      if (n < 12 || get16 (buf) != e->id)
+	continue;
+      state = dns_parse (e, qname, buf, n, val, sizeof (val), &ttl);
+      if (state != -2)
+	break;
+    }
+
+  if (debug_flag)
+    {
+      if (state == DE_FOUND)
+	log_msg ("dns: %s -> \"%s\" (ttl %u)", qname, val, ttl);
+      else if (state == DE_NOTFOUND)
+	log_msg ("dns: %s not found (ttl %u)", qname, ttl);
+      else
+	log_msg ("dns: query for %s failed", qname);
+    }
+
+  if (state == DE_FOUND)
+    ++stat_found;
+  else if (state == DE_NOTFOUND)
+    ++stat_notfound;
+  else
+    ++stat_failed;
+
+  w = de_complete (e, state, ttl, val);
+  if (dns_pending == NULL)
+    dns_timer_arm (0);
+  pthread_mutex_unlock (&dns_lock);
+
+  waiters_reply (w, state == DE_FOUND ? val : NULL);
+}
+
+/* Read the sockets of the queries, which have an answer */
+static bool_t
+dns_sock_recv (SVCXPRT *xprt, struct rpc_msg *msg __attribute__ ((unused)))
+{
+  struct epoll_event ev[16];
+  int n, i;
+
+  do
+    {
+      n = epoll_wait (xprt->xp_fd, ev, sizeof (ev) / sizeof (ev[0]), 0);
+      for (i = 0; i < n; i++)
+	dns_sock_read (ev[i].data.fd);
+    }
+  while (n == sizeof (ev) / sizeof (ev[0]));
+
+  return FALSE;
+}
+
+/* Retransmit queries without answer, give up after DNS_TRIES */
+static bool_t
+dns_timer_recv (SVCXPRT *xprt, struct rpc_msg *msg __attribute__ ((unused)))
+{
+  dns_waiter_t *expired = NULL, **tail = &expired;
+  unsigned long now = dns_now_ms ();
+  uint64_t ticks;
+  dns_entry_t *e, *next;
+
+  if (read (xprt->xp_fd, &ticks, sizeof (ticks)) < 0 && errno != EAGAIN)
+    log_msg ("dns: cannot read timer: %s", strerror (errno));
+
+  pthread_mutex_lock (&dns_lock);
+  for (e = dns_pending; e != NULL; e = next)
+    {
+      next = e->pnext;
+      if (now - e->sent < DNS_RETRY_MS)
+	continue;
+      if (e->tries < DNS_TRIES && dns_send (e) == 0)
+	continue;
+
+      if (debug_flag)
+	log_msg ("dns: no answer for \"%s\"", e->key);
+      ++stat_timeouts;
+      *tail = de_complete (e, -1, 0, NULL);
+      while (*tail != NULL)
+	tail = &(*tail)->next;
+    }
+  if (dns_pending == NULL)
+    dns_timer_arm (0);
+  pthread_mutex_unlock (&dns_lock);
+
+  waiters_reply (expired, NULL);
+  return FALSE;
+}
+
+static enum xprt_stat
+dns_stat (SVCXPRT *xprt __attribute__ ((unused)))
+{
+  return XPRT_IDLE;
+}
+
+static bool_t
+dns_args (SVCXPRT *xprt __attribute__ ((unused)),
+	  xdrproc_t xdr_args __attribute__ ((unused)),
+	  void *args_ptr __attribute__ ((unused)))
+{
+  return FALSE;
+}
+
+static bool_t
+dns_reply (SVCXPRT *xprt __attribute__ ((unused)),
+	   struct rpc_msg *msg __attribute__ ((unused)))
+{
+  return FALSE;
+}
+
+static void
+dns_destroy (SVCXPRT *xprt __attribute__ ((unused)))
+{
+}
+
+static bool_t
+dns_control (SVCXPRT *xprt __attribute__ ((unused)),
+	     const u_int rq __attribute__ ((unused)),
+	     void *in __attribute__ ((unused)))
+{
+  return FALSE;
+}
+
+static const struct xp_ops dns_sock_ops = {
+  dns_sock_recv, dns_stat, dns_args, dns_reply, dns_args, dns_destroy
+};
+
+static const struct xp_ops dns_timer_ops = {
+  dns_timer_recv, dns_stat, dns_args, dns_reply, dns_args, dns_destroy
+};
+
+static const struct xp_ops2 dns_ops2 = {
+  dns_control
+};
+
+/* The file descriptor is polled by svc_run, workers_run and
+   evloop_run like the one of a RPC transport, xp_recv is called if
+   there is something to read. */
+static int
+dns_xprt_create (int fd, const struct xp_ops *ops)
+{
+  dns_xprt_t *x;
+
+  if ((x = calloc (1, sizeof (dns_xprt_t))) == NULL)
+    {
+      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	       __FILE__, __LINE__);
+      return -1;
+    }
+  x->xprt.xp_fd = fd;
+  x->xprt.xp_ops = ops;
+  x->xprt.xp_ops2 = &dns_ops2;
+  x->xprt.xp_p3 = &x->ext;
+  xprt_register (&x->xprt);
+
+  return 0;
+}
+
+/* "address", "address:port" or "[IPv6 address]:port" */
+static int
+dns_parse_server (const char *str, struct sockaddr_storage *ss,
+		  socklen_t *len)
+{
+  struct sockaddr_in *sin = (struct sockaddr_in *) ss;
+  struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *) ss;
+  char addr[INET6_ADDRSTRLEN + 2];
+  const char *port = NULL, *p;
+  unsigned long portnr = DNS_PORT;
+
+  if (str[0] == '[')
+    {
+      if ((p = strchr (str, ']')) == NULL ||
+	  (size_t) (p - str - 1) >= sizeof (addr))
+	return -1;
+      memcpy (addr, str + 1, p - str - 1);
+      addr[p - str - 1] = '\0';
+      if (p[1] == ':')
+	port = p + 2;
+      else if (p[1] != '\0')
+	return -1;
+    }
+  else
+    {
+      if (strlen (str) >= sizeof (addr))
+	return -1;
+      strcpy (addr, str);
+      /* A single colon separates the port of an IPv4 address */
+      if ((p = strchr (addr, ':')) != NULL && strchr (p + 1, ':') == NULL)
+	{
+	  addr[p - addr] = '\0';
+	  port = str + (p - addr) + 1;
+	}
+    }
+
+  if (port != NULL)
+    {
+      char *ep;
+
+      portnr = strtoul (port, &ep, 10);
+      if (*port == '\0' || *ep != '\0' || portnr == 0 || portnr > 65535)
+	return -1;
+    }
+
+  memset (ss, 0, sizeof (*ss));
+  if (inet_pton (AF_INET, addr, &sin->sin_addr) == 1)
+    {
+      sin->sin_family = AF_INET;
+      sin->sin_port = htons (portnr);
+      *len = sizeof (*sin);
+    }
+  else if (inet_pton (AF_INET6, addr, &sin6->sin6_addr) == 1)
+    {
+      sin6->sin6_family = AF_INET6;
+      sin6->sin6_port = htons (portnr);
+      *len = sizeof (*sin6);
+    }
+  else
+    return -1;
+
+  return 0;
+}
+
+/* The first nameserver, and the domain for names without a dot */
+static void
+dns_read_resolv_conf (char *server, size_t size)
+{
+  char line[1024], keyword[32], arg[DNS_NAMESIZE];
+  FILE *fp;
+
+  if ((fp = fopen ("/etc/resolv.conf", "r")) == NULL)
+    return;
+
+  while (fgets (line, sizeof (line), fp) != NULL)
+    {
+      if (sscanf (line, "%31s %255s", keyword, arg) != 2)
+	continue;
+      if (strcmp (keyword, "nameserver") == 0 && server[0] == '\0' &&
+	  strlen (arg) < size)
+	strcpy (server, arg);
+      else if ((strcmp (keyword, "domain") == 0 ||
+		strcmp (keyword, "search") == 0) && dns_domain[0] == '\0' &&
+	       dns_valid_name (arg))
+	strcpy (dns_domain, arg);
+    }
+  fclose (fp);
+}
+
+void
+dns_init (void)
+{
+  char server[DNS_NAMESIZE] = "";
+  int fd, tfd;
+
+  if (!dns_flag)
+    return;
+
+  dns_read_resolv_conf (server, sizeof (server));
+  if (dns_server != NULL)
+    snprintf (server, sizeof (server), "%s", dns_server);
+  else if (server[0] == '\0')
+    strcpy (server, "127.0.0.1");
+
+  if (dns_parse_server (server, &dns_addr, &dns_addrlen) < 0)
+    {
+      log_msg ("dns: invalid name server \"%s\", dns option ignored",
+	       server);
+      return;
+    }
+
+  if ((dns_table = calloc (DNS_CACHE_MAX, sizeof (dns_entry_t *))) == NULL)
+    {
+      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	       __FILE__, __LINE__);
+      return;
+    }
+
+  if ((fd = epoll_create1 (EPOLL_CLOEXEC)) < 0)
+    {
+      log_msg ("dns: epoll_create1 failed: %s", strerror (errno));
+      return;
+    }
+  tfd = timerfd_create (CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (tfd < 0)
+    {
+      log_msg ("dns: timerfd_create failed: %s", strerror (errno));
+      close (fd);
+      return;
+    }
+  if (dns_xprt_create (fd, &dns_sock_ops) < 0 ||
+      dns_xprt_create (tfd, &dns_timer_ops) < 0)
+    return;
+
+  dns_epfd = fd;
+  dns_timer_fd = tfd;
+  stats_register (dns_stats);
+
+  if (debug_flag)
+    log_msg ("dns: using name server %s%s%s", server,
+	     dns_domain[0] ? ", domain " : "", dns_domain);
+}
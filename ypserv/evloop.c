@@ -0,0 +1,1271 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <poll.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <arpa/inet.h>
+#include <rpc/rpc.h>
+#include <rpc/svc_auth.h>
+#include <rpc/svc_mt.h>
+
+#include "yp.h"
+#include "log_msg.h"
+#include "ypserv_conf.h"
+#include "workers.h"
+#include "stats.h"
+#include "evloop.h"
+
+/* With "epoll: yes" in ypserv.conf, the TCP transports are not
+   created by svc_vc_create, which needs a poll() over all
+   connections for every request. Instead we own the listening
+   sockets and the connections, and do the record marking ourself.
+   Every connection has an input and an output buffer, only one
+   request per connection is processed until its reply is written,
+   so a client which does not read cannot make us buffer more.
+   Connections are kept in a list sorted by last activity, the head
+   of this list is closed after tcp_timeout seconds of idle time.
+   The UDP transports of libtirpc are added to the same epoll set.
+
+   A YPPROC_ALL reply is streamed by the event loop, too: whenever
+   the socket is writable and the last part is written, the fill
+   function of the stream encodes the next records into a new
+   fragment of the reply. A reply, which is already encoded in a
+   file, is sent with sendfile instead. Only all_streams replies are
+   streamed at the same time, further YPPROC_ALL requests stay in the
+   input buffer of their connection until another stream has
+   finished. */
+
+#define EV_MAXEVENTS 64
+#define EV_BUFSIZE 4096
+/* Largest request record a client may send us */
+#define EV_MAXRECORD (64 * 1024)
+/* Largest reply we buffer, ypproc_all is streamed */
+#define EV_MAXREPLY (64 * 1024 * 1024)
+/* Size of one fragment of a streamed reply. It is doubled for a
+   record, which does not fit, up to EV_MAXREPLY. */
+#define EV_STREAM_CHUNK (64 * 1024)
+/* How much of an encoded reply is sent with one sendfile call */
+#define EV_SENDFILE_CHUNK (256 * 1024)
+
+#ifndef RQCRED_SIZE
+#define RQCRED_SIZE 400		/* this size is excessive */
+#endif
+
+typedef enum { EV_LISTENER, EV_CONN, EV_TIRPC } ev_type_t;
+
+typedef struct ev_listener
+{
+  ev_type_t type;
+  int family;
+  evloop_dispatch_t dispatch;
+  struct sockaddr_storage addr;
+  SVCXPRT xprt;
+} ev_listener_t;
+
+typedef struct ev_conn
+{
+  ev_type_t type;
+  ev_listener_t *listener;
+  SVCXPRT xprt;
+  SVCXPRT_EXT ext;
+  struct sockaddr_storage raddr;
+  XDR xdr_in;			/* decodes the current request */
+  u_int32_t xid;
+  char *in;			/* bytes read, not yet processed */
+  size_t in_len, in_size;
+  char *rec;			/* request with several fragments */
+  size_t rec_len, rec_size;
+  char *out;			/* reply not yet written */
+  size_t out_off, out_len, out_size;
+  evloop_free_t release;	/* set while a stream is not finished */
+  void *stream_data;
+  evloop_fill_t fill;		/* next part is encoded by fill */
+  int file_fd;			/* or sent from this file */
+  off_t file_off, file_size;
+  int rec_ready;		/* rec is a request waiting for a stream */
+  int deferred;			/* the reply is sent by evloop_reply */
+  evloop_free_t cancel;
+  void *defer_data;
+  int waiting;
+  struct ev_conn *wait_next;
+  uint32_t events;
+  int dead;
+  time_t last_used;
+  struct ev_conn *prev, *next;
+} ev_conn_t;
+
+typedef struct ev_tirpc
+{
+  ev_type_t type;
+  int fd;
+} ev_tirpc_t;
+
+static int epfd = -1;
+static pid_t evloop_pid;
+static ev_conn_t *idle_head = NULL;
+static ev_conn_t *idle_tail = NULL;
+static int nr_conns = 0;
+/* Closed during the current epoll_wait round, may still have events */
+static ev_conn_t *closed_conns = NULL;
+/* Connections with a YPPROC_ALL request, which waits for a stream */
+static ev_conn_t *wait_head = NULL;
+static ev_conn_t *wait_tail = NULL;
+static int nr_streams = 0;
+static unsigned long stat_streams = 0;
+static unsigned long stat_waited = 0;
+static unsigned long stat_sendfile = 0;
+
+static time_t
+ev_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec;
+}
+
+static int
+buf_reserve (char **buf, size_t *size, size_t need)
+{
+  size_t n = *size > 0 ? *size : EV_BUFSIZE;
+  char *p;
+
+  if (need <= *size)
+    return 0;
+
+  while (n < need)
+    n *= 2;
+
+  if ((p = realloc (*buf, n)) == NULL)
+    {
+      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	       __FILE__, __LINE__);
+      return -1;
+    }
+  *buf = p;
+  *size = n;
+  return 0;
+}
+
+/* Don't keep large buffers of a connection around, which is idle
+   afterwards. */
+static void
+buf_shrink (char **buf, size_t *size)
+{
+  if (*size > EV_BUFSIZE)
+    {
+      free (*buf);
+      *buf = NULL;
+      *size = 0;
+    }
+}
+
+static void
+idle_unlink (ev_conn_t *c)
+{
+  if (c->prev)
+    c->prev->next = c->next;
+  else
+    idle_head = c->next;
+  if (c->next)
+    c->next->prev = c->prev;
+  else
+    idle_tail = c->prev;
+  c->prev = c->next = NULL;
+}
+
+static void
+idle_append (ev_conn_t *c, time_t now)
+{
+  c->last_used = now;
+  c->next = NULL;
+  c->prev = idle_tail;
+  if (idle_tail)
+    idle_tail->next = c;
+  else
+    idle_head = c;
+  idle_tail = c;
+}
+
+static void
+stream_end (ev_conn_t *c)
+{
+  (*c->release) (c->stream_data);
+  c->release = NULL;
+  c->stream_data = NULL;
+  c->fill = NULL;
+  c->file_fd = -1;
+  --nr_streams;
+}
+
+static void
+wait_unlink (ev_conn_t *c)
+{
+  ev_conn_t **pp, *prev = NULL;
+
+  for (pp = &wait_head; *pp != NULL; prev = *pp, pp = &(*pp)->wait_next)
+    if (*pp == c)
+      {
+	*pp = c->wait_next;
+	if (wait_tail == c)
+	  wait_tail = prev;
+	break;
+      }
+  c->wait_next = NULL;
+  c->waiting = 0;
+}
+
+static void
+conn_close (ev_conn_t *c)
+{
+  if (debug_flag)
+    log_msg ("evloop: closing connection %d", c->xprt.xp_fd);
+
+  if (c->release != NULL)
+    stream_end (c);
+  if (c->deferred)
+    {
+      c->deferred = 0;
+      (*c->cancel) (c->defer_data);
+    }
+  if (c->waiting)
+    wait_unlink (c);
+  idle_unlink (c);
+  /* A forked ypproc_all child may still have the socket open */
+  epoll_ctl (epfd, EPOLL_CTL_DEL, c->xprt.xp_fd, NULL);
+  close (c->xprt.xp_fd);
+  c->xprt.xp_fd = -1;
+  c->next = closed_conns;
+  closed_conns = c;
+  --nr_conns;
+}
+
+static void
+conn_free_closed (void)
+{
+  while (closed_conns != NULL)
+    {
+      ev_conn_t *c = closed_conns;
+
+      closed_conns = c->next;
+      free (c->in);
+      free (c->rec);
+      free (c->out);
+      free (c);
+    }
+}
+
+/* Write the pending reply. If block is set, wait until everything
+   is written, this is only done by a forked child. */
+static int
+conn_flush (ev_conn_t *c, int block)
+{
+  while (c->out_off < c->out_len)
+    {
+      ssize_t n = write (c->xprt.xp_fd, c->out + c->out_off,
+			 c->out_len - c->out_off);
+
+      if (n >= 0)
+	{
+	  c->out_off += n;
+	  continue;
+	}
+      if (errno == EINTR)
+	continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+	{
+	  struct pollfd pfd;
+	  int r;
+
+	  if (!block)
+	    return 0;
+
+	  pfd.fd = c->xprt.xp_fd;
+	  pfd.events = POLLOUT;
+	  r = poll (&pfd, 1, tcp_timeout > 0 ? tcp_timeout * 1000 : -1);
+	  if (r == 0 || (r < 0 && errno != EINTR))
+	    return -1;
+	  continue;
+	}
+      if (debug_flag)
+	log_msg ("evloop: write failed: %s", strerror (errno));
+      return -1;
+    }
+
+  c->out_off = c->out_len = 0;
+  /* The next part of a stream needs the buffer again */
+  if (c->release == NULL)
+    buf_shrink (&c->out, &c->out_size);
+  return 0;
+}
+
+static int
+conn_write_blocking (void *handle, void *buf, int len)
+{
+  ev_conn_t *c = handle;
+
+  c->out_off = 0;
+  c->out_len = 0;
+  if (buf_reserve (&c->out, &c->out_size, len) < 0)
+    return -1;
+  memcpy (c->out, buf, len);
+  c->out_len = len;
+  if (conn_flush (c, 1) < 0)
+    return -1;
+  return len;
+}
+
+static bool_t
+conn_recv (SVCXPRT *xprt __attribute__ ((unused)),
+	   struct rpc_msg *msg __attribute__ ((unused)))
+{
+  /* Requests are read by the event loop */
+  return FALSE;
+}
+
+static enum xprt_stat
+conn_stat (SVCXPRT *xprt __attribute__ ((unused)))
+{
+  return XPRT_IDLE;
+}
+
+static bool_t
+conn_getargs (SVCXPRT *xprt, xdrproc_t xdr_args, void *args_ptr)
+{
+  ev_conn_t *c = xprt->xp_p1;
+
+  return (*xdr_args) (&c->xdr_in, args_ptr);
+}
+
+static bool_t
+conn_freeargs (SVCXPRT *xprt __attribute__ ((unused)), xdrproc_t xdr_args,
+	       void *args_ptr)
+{
+  XDR xdrs;
+
+  xdrs.x_op = XDR_FREE;
+  return (*xdr_args) (&xdrs, args_ptr);
+}
+
+static bool_t
+conn_reply (SVCXPRT *xprt, struct rpc_msg *msg)
+{
+  ev_conn_t *c = xprt->xp_p1;
+  size_t start = c->out_len;
+  u_int32_t hdr;
+  XDR xdrs;
+
+  msg->rm_xid = c->xid;
+
+  if (getpid () != evloop_pid)
+    {
+      /* We are the ypproc_all child, which streams the whole map.
+	 Don't collect it in memory. */
+      bool_t stat;
+
+      xdrrec_create (&xdrs, 0, 0, c, NULL, conn_write_blocking);
+      xdrs.x_op = XDR_ENCODE;
+      stat = xdr_replymsg (&xdrs, msg);
+      if (!xdrrec_endofrecord (&xdrs, TRUE))
+	stat = FALSE;
+      XDR_DESTROY (&xdrs);
+      return stat;
+    }
+
+  /* Encode the reply directly behind the record mark into the
+     output buffer, if it does not fit, retry with a larger one. */
+  for (;;)
+    {
+      if (buf_reserve (&c->out, &c->out_size, start + EV_BUFSIZE) < 0)
+	return FALSE;
+
+      xdrmem_create (&xdrs, c->out + start + 4, c->out_size - start - 4,
+		     XDR_ENCODE);
+      if (xdr_replymsg (&xdrs, msg))
+	break;
+      XDR_DESTROY (&xdrs);
+
+      if (c->out_size >= EV_MAXREPLY ||
+	  buf_reserve (&c->out, &c->out_size, c->out_size * 2) < 0)
+	{
+	  log_msg ("evloop: cannot encode reply");
+	  return FALSE;
+	}
+    }
+
+  hdr = htonl (0x80000000 | xdr_getpos (&xdrs));
+  XDR_DESTROY (&xdrs);
+  memcpy (c->out + start, &hdr, 4);
+  c->out_len = start + 4 + (ntohl (hdr) & 0x7fffffff);
+
+  if (conn_flush (c, 0) < 0)
+    {
+      c->dead = 1;
+      return FALSE;
+    }
+  return TRUE;
+}
+
+/* Encode the next fragment of a stream behind the pending output,
+   the first one starts with the reply header msg. The fragment is
+   the last one, if the fill function has finished the stream. The
+   fill function encodes nothing, if the next record does not fit,
+   and is called again with a larger fragment then. */
+static int
+stream_fill (ev_conn_t *c, struct rpc_msg *msg)
+{
+  size_t start = c->out_len, chunk = EV_STREAM_CHUNK;
+  u_int32_t hdr;
+  u_int pos, len;
+  XDR xdrs;
+  int ret;
+
+  for (;;)
+    {
+      if (buf_reserve (&c->out, &c->out_size, start + 4 + chunk) < 0)
+	return -1;
+
+      xdrmem_create (&xdrs, c->out + start + 4, chunk, XDR_ENCODE);
+      if (msg != NULL && !xdr_replymsg (&xdrs, msg))
+	{
+	  XDR_DESTROY (&xdrs);
+	  return -1;
+	}
+      pos = xdr_getpos (&xdrs);
+      ret = (*c->fill) (&xdrs, c->stream_data);
+      len = xdr_getpos (&xdrs);
+      XDR_DESTROY (&xdrs);
+
+      if (ret <= 0 || len > pos || chunk >= EV_MAXREPLY)
+	break;
+      chunk *= 2;
+    }
+
+  /* Not even one record fits into the largest fragment */
+  if (ret < 0 || (ret > 0 && len == pos))
+    {
+      log_msg ("evloop: cannot encode reply stream");
+      return -1;
+    }
+
+  hdr = htonl ((ret == 0 ? 0x80000000 : 0) | len);
+  memcpy (c->out + start, &hdr, 4);
+  c->out_len = start + 4 + len;
+
+  if (ret == 0)
+    stream_end (c);
+  return 0;
+}
+
+/* Send the next part of a stream, after the last one is written */
+static int
+stream_next (ev_conn_t *c)
+{
+  ssize_t n;
+
+  /* Only one part per round, the other connections should not wait
+     until a large map is sent */
+  if (c->fill != NULL)
+    {
+      if (stream_fill (c, NULL) < 0 || conn_flush (c, 0) < 0)
+	return -1;
+      return 0;
+    }
+
+  n = sendfile (c->xprt.xp_fd, c->file_fd, &c->file_off,
+		c->file_size - c->file_off < EV_SENDFILE_CHUNK ?
+		c->file_size - c->file_off : EV_SENDFILE_CHUNK);
+  if (n < 0)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+	return 0;
+      if (debug_flag)
+	log_msg ("evloop: sendfile failed: %s", strerror (errno));
+      return -1;
+    }
+  if (n == 0)
+    {
+      log_msg ("evloop: file of reply stream is too short");
+      return -1;
+    }
+  if (c->file_off >= c->file_size)
+    stream_end (c);
+  return 0;
+}
+
+static void
+conn_destroy (SVCXPRT *xprt)
+{
+  ev_conn_t *c = xprt->xp_p1;
+
+  c->dead = 1;
+}
+
+static bool_t
+conn_control (SVCXPRT *xprt __attribute__ ((unused)),
+	      const u_int rq __attribute__ ((unused)),
+	      void *in __attribute__ ((unused)))
+{
+  return FALSE;
+}
+
+static const struct xp_ops conn_ops = {
+  conn_recv, conn_stat, conn_getargs, conn_reply, conn_freeargs,
+  conn_destroy
+};
+
+static const struct xp_ops2 conn_ops2 = {
+  conn_control
+};
+
+/* Returns 1 if the reply to the current request of xprt can be sent
+   by evloop_stream or evloop_sendfile. */
+int
+evloop_can_stream (SVCXPRT *xprt)
+{
+  return xprt->xp_ops == &conn_ops && all_streams > 0 &&
+    getpid () == evloop_pid && ((ev_conn_t *) xprt->xp_p1)->release == NULL;
+}
+
+static void
+stream_reply_msg (ev_conn_t *c, struct rpc_msg *msg)
+{
+  memset (msg, 0, sizeof (*msg));
+  msg->rm_xid = c->xid;
+  msg->rm_direction = REPLY;
+  msg->rm_reply.rp_stat = MSG_ACCEPTED;
+  msg->acpted_rply.ar_verf = c->xprt.xp_verf;
+  msg->acpted_rply.ar_stat = SUCCESS;
+  msg->acpted_rply.ar_results.where = NULL;
+  msg->acpted_rply.ar_results.proc = (xdrproc_t) xdr_void;
+}
+
+/* Send the reply to the current request of xprt as stream: the
+   accepted reply header is followed by everything fill encodes.
+   fill is called again whenever the last part is written, until
+   it returns 0, release is called at the end of the stream or when
+   the connection is closed before. Returns -1 if xprt is not a
+   connection of the event loop, the caller has to reply himself. */
+int
+evloop_stream (SVCXPRT *xprt, evloop_fill_t fill, evloop_free_t release,
+	       void *data)
+{
+  struct rpc_msg msg;
+  ev_conn_t *c;
+
+  if (!evloop_can_stream (xprt))
+    return -1;
+
+  c = xprt->xp_p1;
+  c->release = release;
+  c->stream_data = data;
+  c->fill = fill;
+  ++nr_streams;
+  ++stat_streams;
+
+  stream_reply_msg (c, &msg);
+  if (stream_fill (c, &msg) < 0 || conn_flush (c, 0) < 0)
+    c->dead = 1;
+  return 0;
+}
+
+/* Like evloop_stream, but the accepted reply header is followed by
+   size bytes of the file fd, which must contain the rest of the
+   reply with record marking already. */
+int
+evloop_sendfile (SVCXPRT *xprt, int fd, off_t size, evloop_free_t release,
+		 void *data)
+{
+  struct rpc_msg msg;
+  u_int32_t hdr;
+  XDR xdrs;
+  ev_conn_t *c;
+
+  if (!evloop_can_stream (xprt))
+    return -1;
+
+  c = xprt->xp_p1;
+  c->release = release;
+  c->stream_data = data;
+  c->file_fd = fd;
+  c->file_off = 0;
+  c->file_size = size;
+  ++nr_streams;
+  ++stat_streams;
+  ++stat_sendfile;
+
+  /* The header is a fragment of its own */
+  stream_reply_msg (c, &msg);
+  if (buf_reserve (&c->out, &c->out_size, c->out_len + EV_BUFSIZE) < 0)
+    {
+      c->dead = 1;
+      return 0;
+    }
+  xdrmem_create (&xdrs, c->out + c->out_len + 4,
+		 c->out_size - c->out_len - 4, XDR_ENCODE);
+  if (!xdr_replymsg (&xdrs, &msg))
+    {
+      XDR_DESTROY (&xdrs);
+      log_msg ("evloop: cannot encode reply");
+      c->dead = 1;
+      return 0;
+    }
+  hdr = htonl (xdr_getpos (&xdrs));
+  memcpy (c->out + c->out_len, &hdr, 4);
+  c->out_len += 4 + xdr_getpos (&xdrs);
+  XDR_DESTROY (&xdrs);
+
+  if (conn_flush (c, 0) < 0)
+    c->dead = 1;
+  return 0;
+}
+
+/* Decode the RPC header of one complete request and call the
+   dispatch function, like svc_getreq_common() does. */
+static void
+conn_dispatch (ev_conn_t *c, char *buf, size_t len)
+{
+  char cred_area[2 * MAX_AUTH_BYTES + RQCRED_SIZE];
+  struct rpc_msg msg;
+  struct svc_req r;
+  enum auth_stat why;
+  rpcvers_t low;
+
+  memset (&msg, 0, sizeof (msg));
+  memset (&r, 0, sizeof (r));
+  msg.rm_call.cb_cred.oa_base = cred_area;
+  msg.rm_call.cb_verf.oa_base = &cred_area[MAX_AUTH_BYTES];
+  r.rq_clntcred = &cred_area[2 * MAX_AUTH_BYTES];
+
+  xdrmem_create (&c->xdr_in, buf, len, XDR_DECODE);
+  if (!xdr_callmsg (&c->xdr_in, &msg))
+    {
+      if (debug_flag)
+	log_msg ("evloop: cannot decode request on connection %d",
+		 c->xprt.xp_fd);
+      return;
+    }
+
+  c->xid = msg.rm_xid;
+  r.rq_xprt = &c->xprt;
+  r.rq_prog = msg.rm_call.cb_prog;
+  r.rq_vers = msg.rm_call.cb_vers;
+  r.rq_proc = msg.rm_call.cb_proc;
+  r.rq_cred = msg.rm_call.cb_cred;
+
+  if ((why = _authenticate (&r, &msg)) != AUTH_OK)
+    {
+      svcerr_auth (&c->xprt, why);
+      return;
+    }
+
+  /* Version 1 is only registered for IPv4 */
+  low = c->listener->family == AF_INET ? YPVERS_ORIG : YPVERS;
+  if (r.rq_prog != YPPROG)
+    svcerr_noprog (&c->xprt);
+  else if (r.rq_vers < low || r.rq_vers > YPVERS_MULTI)
+    svcerr_progvers (&c->xprt, low, YPVERS_MULTI);
+  else
+    (*c->listener->dispatch) (&r, &c->xprt);
+}
+
+/* A YPPROC_ALL request has to wait in the input buffer, if
+   all_streams replies are streamed already. Only the RPC header of
+   the request is looked at. */
+static int
+conn_must_wait (ev_conn_t *c, const char *buf, size_t len)
+{
+  u_int32_t prog, proc;
+
+  if (all_streams <= 0 || nr_streams < all_streams || len < 24)
+    return 0;
+
+  memcpy (&prog, buf + 12, 4);
+  memcpy (&proc, buf + 20, 4);
+  if (ntohl (prog) != YPPROG || ntohl (proc) != YPPROC_ALL)
+    return 0;
+
+  if (!c->waiting)
+    {
+      if (debug_flag)
+	log_msg ("evloop: connection %d waits for a stream",
+		 c->xprt.xp_fd);
+      c->waiting = 1;
+      c->wait_next = NULL;
+      if (wait_tail)
+	wait_tail->wait_next = c;
+      else
+	wait_head = c;
+      wait_tail = c;
+      ++stat_waited;
+    }
+  return 1;
+}
+
+static void
+conn_update_events (ev_conn_t *c)
+{
+  struct epoll_event ev;
+  uint32_t want;
+
+  if (c->out_len > 0 || c->release != NULL)
+    want = EPOLLOUT;
+  else if (c->waiting || c->deferred)
+    want = 0;
+  else
+    want = EPOLLIN;
+
+  if (c->dead || c->events == want)
+    return;
+
+  ev.events = want;
+  ev.data.ptr = c;
+  if (epoll_ctl (epfd, EPOLL_CTL_MOD, c->xprt.xp_fd, &ev) < 0)
+    {
+      log_msg ("evloop: epoll_ctl failed: %s", strerror (errno));
+      c->dead = 1;
+      return;
+    }
+  c->events = want;
+}
+
+/* Split the input into record marking fragments and process all
+   complete requests, as long as there is no reply pending. */
+static void
+conn_process (ev_conn_t *c)
+{
+  size_t off = 0;
+
+  if (c->rec_ready && !c->dead)
+    {
+      if (conn_must_wait (c, c->rec, c->rec_len))
+	return;
+      c->rec_ready = 0;
+      conn_dispatch (c, c->rec, c->rec_len);
+      c->rec_len = 0;
+      buf_shrink (&c->rec, &c->rec_size);
+    }
+
+  while (!c->dead && c->out_len == 0 && c->release == NULL &&
+	 !c->deferred && c->in_len - off >= 4)
+    {
+      u_int32_t hdr;
+      size_t len;
+      int last;
+
+      memcpy (&hdr, c->in + off, 4);
+      hdr = ntohl (hdr);
+      last = (hdr & 0x80000000) != 0;
+      len = hdr & 0x7fffffff;
+
+      if (c->rec_len + len > EV_MAXRECORD)
+	{
+	  log_msg ("evloop: request with %lu bytes too large, closing connection",
+		   (unsigned long) (c->rec_len + len));
+	  c->dead = 1;
+	  break;
+	}
+      if (c->in_len - off - 4 < len)
+	break;
+
+      if (last && c->rec_len == 0)
+	{
+	  if (conn_must_wait (c, c->in + off + 4, len))
+	    break;
+	  off += 4;
+	  conn_dispatch (c, c->in + off, len);
+	}
+      else
+	{
+	  if (buf_reserve (&c->rec, &c->rec_size, c->rec_len + len) < 0)
+	    {
+	      c->dead = 1;
+	      break;
+	    }
+	  off += 4;
+	  memcpy (c->rec + c->rec_len, c->in + off, len);
+	  c->rec_len += len;
+	  if (last)
+	    {
+	      if (conn_must_wait (c, c->rec, c->rec_len))
+		{
+		  c->rec_ready = 1;
+		  off += len;
+		  break;
+		}
+	      conn_dispatch (c, c->rec, c->rec_len);
+	      c->rec_len = 0;
+	      buf_shrink (&c->rec, &c->rec_size);
+	    }
+	}
+      off += len;
+    }
+
+  if (off > 0)
+    {
+      memmove (c->in, c->in + off, c->in_len - off);
+      c->in_len -= off;
+    }
+  if (c->in_len == 0)
+    buf_shrink (&c->in, &c->in_size);
+}
+
+static void
+conn_read (ev_conn_t *c)
+{
+  ssize_t n;
+
+  if (buf_reserve (&c->in, &c->in_size, c->in_len + EV_BUFSIZE) < 0)
+    {
+      c->dead = 1;
+      return;
+    }
+
+  do
+    n = read (c->xprt.xp_fd, c->in + c->in_len, c->in_size - c->in_len);
+  while (n < 0 && errno == EINTR);
+
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+    {
+      c->dead = 1;
+      return;
+    }
+  if (n > 0)
+    {
+      c->in_len += n;
+      conn_process (c);
+    }
+}
+
+static void
+conn_new (ev_listener_t *l, int fd, struct sockaddr_storage *ss,
+	  socklen_t len, time_t now)
+{
+  struct epoll_event ev;
+  ev_conn_t *c;
+
+  if ((c = calloc (1, sizeof (ev_conn_t))) == NULL)
+    {
+      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	       __FILE__, __LINE__);
+      close (fd);
+      return;
+    }
+
+  c->type = EV_CONN;
+  c->listener = l;
+  memcpy (&c->raddr, ss, len);
+
+  c->xprt.xp_fd = fd;
+  c->xprt.xp_port = l->xprt.xp_port;
+  c->xprt.xp_ops = &conn_ops;
+  c->xprt.xp_ops2 = &conn_ops2;
+  c->xprt.xp_netid = l->xprt.xp_netid;
+  c->xprt.xp_ltaddr = l->xprt.xp_ltaddr;
+  c->xprt.xp_rtaddr.buf = &c->raddr;
+  c->xprt.xp_rtaddr.len = len;
+  c->xprt.xp_rtaddr.maxlen = sizeof (c->raddr);
+  c->xprt.xp_addrlen = len;
+  if (len <= sizeof (c->xprt.xp_raddr))
+    memcpy (&c->xprt.xp_raddr, ss, len);
+  c->xprt.xp_p1 = c;
+  c->xprt.xp_p3 = &c->ext;
+  c->file_fd = -1;
+
+  ev.events = c->events = EPOLLIN;
+  ev.data.ptr = c;
+  if (epoll_ctl (epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+      log_msg ("evloop: epoll_ctl failed: %s", strerror (errno));
+      close (fd);
+      free (c);
+      return;
+    }
+
+  idle_append (c, now);
+  ++nr_conns;
+
+  if (debug_flag)
+    log_msg ("evloop: new connection %d (%d open)", fd, nr_conns);
+}
+
+static void
+listener_accept (ev_listener_t *l, time_t now)
+{
+  for (;;)
+    {
+      struct sockaddr_storage ss;
+      socklen_t len = sizeof (ss);
+      int fd;
+
+      fd = accept4 (l->xprt.xp_fd, (struct sockaddr *) &ss, &len,
+		    SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd >= 0)
+	{
+	  conn_new (l, fd, &ss, len, now);
+	  continue;
+	}
+
+      if (errno == EINTR || errno == ECONNABORTED)
+	continue;
+      if ((errno == EMFILE || errno == ENFILE) && idle_head != NULL)
+	{
+	  /* Make room by closing the longest idle connection */
+	  log_msg ("evloop: out of file descriptors, closing idle connection");
+	  conn_close (idle_head);
+	  continue;
+	}
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+	log_msg ("evloop: accept failed: %s", strerror (errno));
+      return;
+    }
+}
+
+static bool_t
+listener_recv (SVCXPRT *xprt __attribute__ ((unused)),
+	       struct rpc_msg *msg __attribute__ ((unused)))
+{
+  return FALSE;
+}
+
+static enum xprt_stat
+listener_stat (SVCXPRT *xprt __attribute__ ((unused)))
+{
+  return XPRT_IDLE;
+}
+
+static bool_t
+listener_args (SVCXPRT *xprt __attribute__ ((unused)),
+	       xdrproc_t xdr_args __attribute__ ((unused)),
+	       void *args_ptr __attribute__ ((unused)))
+{
+  return FALSE;
+}
+
+static bool_t
+listener_reply (SVCXPRT *xprt __attribute__ ((unused)),
+		struct rpc_msg *msg __attribute__ ((unused)))
+{
+  return FALSE;
+}
+
+static void
+listener_destroy (SVCXPRT *xprt __attribute__ ((unused)))
+{
+}
+
+static const struct xp_ops listener_ops = {
+  listener_recv, listener_stat, listener_args, listener_reply,
+  listener_args, listener_destroy
+};
+
+static const struct xp_ops2 listener_ops2 = {
+  conn_control
+};
+
+/* Create a transport for a listening TCP socket. It is only used
+   to register the service with rpcbind, requests are read by
+   evloop_run. */
+SVCXPRT *
+evloop_create_listener (int sock, evloop_dispatch_t dispatch)
+{
+  struct epoll_event ev;
+  ev_listener_t *l;
+  socklen_t len;
+  int flags;
+
+  if (epfd < 0 && (epfd = epoll_create1 (EPOLL_CLOEXEC)) < 0)
+    {
+      log_msg ("evloop: epoll_create1 failed: %s", strerror (errno));
+      return NULL;
+    }
+
+  if ((l = calloc (1, sizeof (ev_listener_t))) == NULL)
+    {
+      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	       __FILE__, __LINE__);
+      return NULL;
+    }
+
+  len = sizeof (l->addr);
+  if (getsockname (sock, (struct sockaddr *) &l->addr, &len) < 0)
+    {
+      log_msg ("evloop: getsockname failed: %s", strerror (errno));
+      free (l);
+      return NULL;
+    }
+
+  flags = fcntl (sock, F_GETFL);
+  if (flags == -1 || fcntl (sock, F_SETFL, flags | O_NONBLOCK) == -1)
+    {
+      log_msg ("Cannot set O_NONBLOCK: %s", strerror (errno));
+      free (l);
+      return NULL;
+    }
+
+  l->type = EV_LISTENER;
+  l->family = l->addr.ss_family;
+  l->dispatch = dispatch;
+  l->xprt.xp_fd = sock;
+  if (l->family == AF_INET)
+    l->xprt.xp_port = ntohs (((struct sockaddr_in *) &l->addr)->sin_port);
+  else if (l->family == AF_INET6)
+    l->xprt.xp_port = ntohs (((struct sockaddr_in6 *) &l->addr)->sin6_port);
+  l->xprt.xp_ops = &listener_ops;
+  l->xprt.xp_ops2 = &listener_ops2;
+  l->xprt.xp_ltaddr.buf = &l->addr;
+  l->xprt.xp_ltaddr.len = len;
+  l->xprt.xp_ltaddr.maxlen = sizeof (l->addr);
+  l->xprt.xp_p1 = l;
+
+  ev.events = EPOLLIN;
+  ev.data.ptr = l;
+  if (epoll_ctl (epfd, EPOLL_CTL_ADD, sock, &ev) < 0)
+    {
+      log_msg ("evloop: epoll_ctl failed: %s", strerror (errno));
+      free (l);
+      return NULL;
+    }
+
+  return &l->xprt;
+}
+
+static void
+evloop_add_tirpc (void)
+{
+  int i;
+
+  for (i = 0; i < svc_max_pollfd; i++)
+    {
+      struct epoll_event ev;
+      ev_tirpc_t *t;
+      int fd = svc_pollfd[i].fd;
+
+      if (fd < 0 || workers_own_fd (fd))
+	continue;
+
+      if ((t = calloc (1, sizeof (ev_tirpc_t))) == NULL)
+	{
+	  log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+		   __FILE__, __LINE__);
+	  continue;
+	}
+      t->type = EV_TIRPC;
+      t->fd = fd;
+      ev.events = EPOLLIN;
+      ev.data.ptr = t;
+      if (epoll_ctl (epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+	{
+	  log_msg ("evloop: epoll_ctl failed: %s", strerror (errno));
+	  free (t);
+	}
+    }
+}
+
+static void
+conn_done (ev_conn_t *c, time_t now)
+{
+  if (c->dead)
+    {
+      conn_close (c);
+      return;
+    }
+
+  idle_unlink (c);
+  idle_append (c, now);
+  conn_update_events (c);
+  if (c->dead)
+    conn_close (c);
+}
+
+static void
+conn_event (ev_conn_t *c, uint32_t events, time_t now)
+{
+  if (c->xprt.xp_fd < 0)
+    return;
+
+  if ((events & (EPOLLERR | EPOLLHUP)) && !(events & (EPOLLIN | EPOLLOUT)))
+    c->dead = 1;
+
+  if (!c->dead && (events & EPOLLOUT))
+    {
+      if (conn_flush (c, 0) < 0)
+	c->dead = 1;
+      else if (c->out_len == 0 && c->release != NULL &&
+	       stream_next (c) < 0)
+	c->dead = 1;
+      if (!c->dead && c->out_len == 0 && c->release == NULL)
+	/* Requests which arrived while the reply was pending */
+	conn_process (c);
+    }
+  if (!c->dead && (events & EPOLLIN) && c->out_len == 0 &&
+      c->release == NULL && !c->deferred)
+    conn_read (c);
+
+  conn_done (c, now);
+}
+
+/* Don't reply to the current request of xprt now, the reply is sent
+   later with evloop_reply. No further request of the connection is
+   processed until then. If the connection is closed before, cancel
+   is called with data and the returned handle is not valid anymore.
+   Returns NULL if xprt is not a connection of the event loop. */
+void *
+evloop_defer (SVCXPRT *xprt, evloop_free_t cancel, void *data)
+{
+  ev_conn_t *c;
+
+  if (xprt->xp_ops != &conn_ops || getpid () != evloop_pid)
+    return NULL;
+
+  c = xprt->xp_p1;
+  c->deferred = 1;
+  c->cancel = cancel;
+  c->defer_data = data;
+  return c;
+}
+
+/* Send the reply to a request deferred with evloop_defer and continue
+   with the requests, which arrived meanwhile. */
+void
+evloop_reply (void *handle, xdrproc_t xdr_result, void *result)
+{
+  ev_conn_t *c = handle;
+  struct rpc_msg msg;
+
+  c->deferred = 0;
+  c->cancel = NULL;
+  c->defer_data = NULL;
+
+  stream_reply_msg (c, &msg);
+  msg.acpted_rply.ar_results.where = result;
+  msg.acpted_rply.ar_results.proc = xdr_result;
+  if (!conn_reply (&c->xprt, &msg))
+    c->dead = 1;
+  else if (c->out_len == 0)
+    conn_process (c);
+  conn_done (c, ev_now ());
+}
+
+/* Continue the connections, which wait for a free stream */
+static void
+streams_resume (time_t now)
+{
+  while (wait_head != NULL && nr_streams < all_streams)
+    {
+      ev_conn_t *c = wait_head;
+
+      wait_unlink (c);
+      conn_process (c);
+      conn_done (c, now);
+    }
+}
+
+static void
+evloop_stats (void)
+{
+  log_msg ("  all_streams: %d active, %lu streamed (%lu with sendfile), "
+	   "%lu had to wait", nr_streams, stat_streams, stat_sendfile,
+	   stat_waited);
+}
+
+/* Replacement for svc_run() and workers_run(). */
+void
+evloop_run (void)
+{
+  struct epoll_event events[EV_MAXEVENTS];
+  sigset_t waitmask;
+
+  if (epfd < 0)
+    {
+      workers_run ();
+      return;
+    }
+
+  evloop_pid = getpid ();
+  evloop_add_tirpc ();
+  if (all_streams > 0)
+    stats_register (evloop_stats);
+  workers_start ();
+  stats_block_signal (&waitmask);
+
+  for (;;)
+    {
+      time_t now = ev_now ();
+      int i, n, timeout = -1;
+
+      if (tcp_timeout > 0)
+	{
+	  while (idle_head != NULL &&
+		 now - idle_head->last_used >= tcp_timeout)
+	    {
+	      if (debug_flag)
+		log_msg ("evloop: connection %d idle for %d seconds",
+			 idle_head->xprt.xp_fd, tcp_timeout);
+	      conn_close (idle_head);
+	    }
+	  conn_free_closed ();
+	  if (idle_head != NULL)
+	    timeout = (idle_head->last_used + tcp_timeout - now) * 1000;
+	}
+
+      n = epoll_pwait (epfd, events, EV_MAXEVENTS, timeout, &waitmask);
+      if (n < 0)
+	{
+	  if (errno == EINTR)
+	    {
+	      if (stats_requested)
+		stats_dump ();
+	      continue;
+	    }
+	  log_msg ("evloop_run: epoll_wait failed: %s", strerror (errno));
+	  return;
+	}
+
+      now = ev_now ();
+      for (i = 0; i < n; i++)
+	{
+	  ev_type_t *type = events[i].data.ptr;
+
+	  switch (*type)
+	    {
+	    case EV_LISTENER:
+	      listener_accept ((ev_listener_t *) type, now);
+	      break;
+	    case EV_CONN:
+	      conn_event ((ev_conn_t *) type, events[i].events, now);
+	      break;
+	    case EV_TIRPC:
+	      svc_getreq_common (((ev_tirpc_t *) type)->fd);
+	      break;
+	    }
+	}
+      streams_resume (now);
+      conn_free_closed ();
+    }
+}
@@ -0,0 +1,40 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifndef __EVLOOP_H__
+#define __EVLOOP_H__
+
+#include <sys/types.h>
+#include <rpc/rpc.h>
+
+typedef void (*evloop_dispatch_t) (struct svc_req *, SVCXPRT *);
+/* Encodes the next part of a stream, returns 1 if more follows,
+   0 at the end of the stream and -1 on error. If nothing fits, it
+   must encode nothing, it is called again with more space. */
+typedef int (*evloop_fill_t) (XDR *, void *);
+typedef void (*evloop_free_t) (void *);
+
+extern SVCXPRT *evloop_create_listener (int sock, evloop_dispatch_t dispatch);
+extern int evloop_can_stream (SVCXPRT *xprt);
+extern int evloop_stream (SVCXPRT *xprt, evloop_fill_t fill,
+			  evloop_free_t release, void *data);
+extern int evloop_sendfile (SVCXPRT *xprt, int fd, off_t size,
+			    evloop_free_t release, void *data);
+extern void *evloop_defer (SVCXPRT *xprt, evloop_free_t cancel, void *data);
+extern void evloop_reply (void *handle, xdrproc_t xdr_result, void *result);
+extern void evloop_run (void);
+
+#endif
@@ -0,0 +1,176 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <rpc/rpc.h>
+
+#include "yp.h"
+#include "log_msg.h"
+#include "fastpath.h"
+
+/* MATCH, ORDER and MASTER are by far the most often used procedures.
+   The generic XDR routines malloc the domain, the map and the key
+   for every request and free them again afterwards. Here they are
+   decoded into buffers on the stack, and the key is used in place
+   in the receive buffer if the XDR stream has it in one piece.
+   The reply is encoded by svc_sendreply directly into the send
+   buffer of the transport, like before. */
+
+typedef struct fast_req
+{
+  char domain[YPMAXDOMAIN + 1];
+  char map[YPMAXMAP + 1];
+  char key[YPMAXRECORD];
+  ypreq_key key_req;
+  ypreq_nokey nokey_req;
+} fast_req_t;
+
+/* Decode a string of at most maxlen bytes into buf */
+static bool_t
+xdr_fast_string (XDR *xdrs, char *buf, u_int maxlen)
+{
+  u_int len;
+
+  if (!xdr_u_int (xdrs, &len) || len > maxlen)
+    return FALSE;
+  if (!xdr_opaque (xdrs, buf, len))
+    return FALSE;
+  buf[len] = '\0';
+
+  return TRUE;
+}
+
+static bool_t
+xdr_fast_keydat (XDR *xdrs, fast_req_t *r)
+{
+  int32_t *p;
+  u_int len;
+
+  if (!xdr_u_int (xdrs, &len) || len > YPMAXRECORD)
+    return FALSE;
+
+  if (len > 0 && (p = XDR_INLINE (xdrs, RNDUP (len))) != NULL)
+    r->key_req.keydat.keydat_val = (char *) p;
+  else
+    {
+      if (!xdr_opaque (xdrs, r->key, len))
+	return FALSE;
+      r->key_req.keydat.keydat_val = r->key;
+    }
+  r->key_req.keydat.keydat_len = len;
+
+  return TRUE;
+}
+
+static bool_t
+xdr_fast_ypreq_nokey (XDR *xdrs, fast_req_t *r)
+{
+  /* Nothing was allocated */
+  if (xdrs->x_op == XDR_FREE)
+    return TRUE;
+  if (xdrs->x_op != XDR_DECODE)
+    return FALSE;
+
+  if (!xdr_fast_string (xdrs, r->domain, YPMAXDOMAIN) ||
+      !xdr_fast_string (xdrs, r->map, YPMAXMAP))
+    return FALSE;
+
+  r->nokey_req.domain = r->key_req.domain = r->domain;
+  r->nokey_req.map = r->key_req.map = r->map;
+
+  return TRUE;
+}
+
+static bool_t
+xdr_fast_ypreq_key (XDR *xdrs, fast_req_t *r)
+{
+  if (!xdr_fast_ypreq_nokey (xdrs, r))
+    return FALSE;
+  if (xdrs->x_op == XDR_FREE)
+    return TRUE;
+
+  return xdr_fast_keydat (xdrs, r);
+}
+
+/* Returns 1 if the request was answered, 0 if the generic code in
+   ypprog_2 has to do it. */
+int
+ypprog_2_fast (struct svc_req *rqstp, SVCXPRT *transp)
+{
+  union {
+    ypresp_val val;
+    ypresp_order order;
+    ypresp_master master;
+  } result;
+  fast_req_t r;
+  xdrproc_t _xdr_argument, _xdr_result;
+  bool_t retval;
+
+  if (rqstp->rq_vers != YPVERS && rqstp->rq_vers != YPVERS_MULTI)
+    return 0;
+
+  switch (rqstp->rq_proc)
+    {
+    case YPPROC_MATCH:
+      _xdr_argument = (xdrproc_t) xdr_fast_ypreq_key;
+      _xdr_result = (xdrproc_t) xdr_ypresp_val;
+      break;
+    case YPPROC_ORDER:
+      _xdr_argument = (xdrproc_t) xdr_fast_ypreq_nokey;
+      _xdr_result = (xdrproc_t) xdr_ypresp_order;
+      break;
+    case YPPROC_MASTER:
+      _xdr_argument = (xdrproc_t) xdr_fast_ypreq_nokey;
+      _xdr_result = (xdrproc_t) xdr_ypresp_master;
+      break;
+    default:
+      return 0;
+    }
+
+  if (!svc_getargs (transp, _xdr_argument, (caddr_t) &r))
+    {
+      if (debug_flag)
+	log_msg ("ERROR: Cannot decode arguments for %d",
+		 (int) rqstp->rq_proc);
+      svcerr_decode (transp);
+      return 1;
+    }
+
+  switch (rqstp->rq_proc)
+    {
+    case YPPROC_MATCH:
+      retval = ypproc_match_2_svc (&r.key_req, &result.val, rqstp);
+      break;
+    case YPPROC_ORDER:
+      retval = ypproc_order_2_svc (&r.nokey_req, &result.order, rqstp);
+      break;
+    default:
+      retval = ypproc_master_2_svc (&r.nokey_req, &result.master, rqstp);
+      break;
+    }
+
+  if (retval > 0 && !svc_sendreply (transp, _xdr_result, (char *) &result))
+    svcerr_systemerr (transp);
+
+  if (!ypprog_2_freeresult (transp, _xdr_result, (caddr_t) &result))
+    log_msg ("ERROR: Unable to free results");
+
+  return 1;
+}
@@ -0,0 +1,445 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "yp.h"
+#include "log_msg.h"
+#include "ypserv_conf.h"
+#include "stats.h"
+#include "match_cache.h"
+
+/* With "match_cache: SIZE" in ypserv.conf, the values of successful
+   MATCH requests are kept in memory, so that the most often asked
+   keys are answered without opening and searching the map. The
+   entries are kept in a LRU list, if the cache grows above SIZE
+   bytes, the least recently used ones are removed.
+
+   The cache is emptied after a YPPROC_CLEAR request, which is sent
+   by makedbm -c and ypxfr after a map was changed. The entries of a
+   map reloaded with "reload: yes" are removed. In addition, the
+   YP_LAST_MODIFIED record of a map is compared at most every
+   MC_RECHECK seconds, and all entries of the map are removed if it
+   has changed. */
+
+#define MC_RECHECK 1
+
+typedef struct mc_map
+{
+  struct mc_map *next;
+  char *domain;
+  char *map;
+  unsigned int ordernum;
+  unsigned int generation;	/* of ypdb_map_generation */
+  time_t checked;
+} mc_map_t;
+
+typedef struct mc_entry
+{
+  struct mc_entry *hnext;	/* hash chain */
+  struct mc_entry *prev;	/* LRU list, most recently used first */
+  struct mc_entry *next;
+  mc_map_t *map;
+  unsigned int hash;
+  u_int keylen;
+  u_int vallen;
+  char data[];			/* key, followed by the value */
+} mc_entry_t;
+
+static pthread_mutex_t mc_lock = PTHREAD_MUTEX_INITIALIZER;
+static mc_entry_t **mc_table = NULL;
+static unsigned int mc_mask = 0;
+static mc_entry_t *mc_head = NULL;
+static mc_entry_t *mc_tail = NULL;
+static mc_map_t *mc_maps = NULL;
+static unsigned long mc_bytes = 0;
+static unsigned long mc_entries = 0;
+static unsigned int mc_generation = 0;
+
+/* Generation of YPPROC_CLEAR seen by the last lookup of this thread,
+   and the one of the map. An entry is only inserted if there was no
+   YPPROC_CLEAR and the map was not reloaded since then, else the
+   value could come from an old map handle. */
+static __thread unsigned int lookup_generation = 0;
+static __thread unsigned int lookup_map_generation = 0;
+
+/* Counters, protected by mc_lock */
+static unsigned long stat_hits = 0;
+static unsigned long stat_misses = 0;
+static unsigned long stat_evictions = 0;
+static unsigned long stat_invalidations = 0;
+
+static void
+match_cache_stats (void)
+{
+  unsigned long hits, misses;
+
+  pthread_mutex_lock (&mc_lock);
+  hits = stat_hits;
+  misses = stat_misses;
+  log_msg ("  match_cache: %lu hits, %lu misses (%.1f%% hit ratio)",
+	   hits, misses,
+	   hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
+  log_msg ("  match_cache: %lu entries, %lu of %lu bytes, "
+	   "%lu evictions, %lu invalidations", mc_entries, mc_bytes,
+	   match_cache_size, stat_evictions, stat_invalidations);
+  pthread_mutex_unlock (&mc_lock);
+}
+
+/* FNV-1a of the key, mixed with the map */
+static unsigned int
+mc_hash (const mc_map_t *m, const char *key, u_int keylen)
+{
+  unsigned int h = 2166136261U;
+  u_int i;
+
+  for (i = 0; i < keylen; i++)
+    {
+      h ^= (unsigned char) key[i];
+      h *= 16777619U;
+    }
+
+  return h ^ (unsigned int) ((unsigned long) m >> 4);
+}
+
+static mc_entry_t *
+mc_find_entry (const mc_map_t *m, unsigned int hash,
+	       const char *key, u_int keylen)
+{
+  mc_entry_t *e;
+
+  for (e = mc_table[hash & mc_mask]; e != NULL; e = e->hnext)
+    if (e->hash == hash && e->map == m && e->keylen == keylen &&
+	memcmp (e->data, key, keylen) == 0)
+      return e;
+
+  return NULL;
+}
+
+static void
+mc_remove (mc_entry_t *e)
+{
+  mc_entry_t **pp = &mc_table[e->hash & mc_mask];
+
+  while (*pp != e)
+    pp = &(*pp)->hnext;
+  *pp = e->hnext;
+
+  if (e->prev)
+    e->prev->next = e->next;
+  else
+    mc_head = e->next;
+  if (e->next)
+    e->next->prev = e->prev;
+  else
+    mc_tail = e->prev;
+
+  mc_bytes -= sizeof (mc_entry_t) + e->keylen + e->vallen;
+  --mc_entries;
+  free (e);
+}
+
+/* Remove all entries of map m, or all entries if m is NULL */
+static void
+mc_flush (const mc_map_t *m)
+{
+  mc_entry_t *e = mc_head;
+
+  while (e != NULL)
+    {
+      mc_entry_t *next = e->next;
+
+      if (m == NULL || e->map == m)
+	mc_remove (e);
+      e = next;
+    }
+}
+
+/* Empty the cache, if there was a YPPROC_CLEAR request meanwhile */
+static void
+mc_check_generation (void)
+{
+  unsigned int gen = ypdb_clear_generation ();
+  mc_map_t *m;
+
+  if (gen == mc_generation)
+    return;
+
+  if (debug_flag)
+    log_msg ("match_cache: maps cleared, removing all entries");
+
+  mc_flush (NULL);
+  for (m = mc_maps; m != NULL; m = m->next)
+    m->checked = 0;
+  mc_generation = gen;
+  ++stat_invalidations;
+}
+
+/* Remove the entries of m, if the map was reloaded meanwhile */
+static void
+mc_check_map (mc_map_t *m, unsigned int gen)
+{
+  if (gen == m->generation)
+    return;
+
+  if (debug_flag)
+    log_msg ("match_cache: %s/%s reloaded, removing entries",
+	     m->domain, m->map);
+
+  mc_flush (m);
+  m->generation = gen;
+  m->checked = 0;
+  ++stat_invalidations;
+}
+
+/* Entries of the map list are never freed, so the pointers stay
+   valid after mc_lock was released. */
+static mc_map_t *
+mc_find_map (const char *domain, const char *map)
+{
+  mc_map_t *m;
+
+  for (m = mc_maps; m != NULL; m = m->next)
+    if (strcmp (m->map, map) == 0 && strcmp (m->domain, domain) == 0)
+      return m;
+
+  return NULL;
+}
+
+void
+match_cache_init (void)
+{
+  unsigned long buckets = 256;
+
+  if (match_cache_size == 0)
+    return;
+
+  /* About one bucket for every 256 bytes of cache */
+  while (buckets < match_cache_size / 256 && buckets < (1UL << 20))
+    buckets <<= 1;
+
+  if ((mc_table = calloc (buckets, sizeof (mc_entry_t *))) == NULL)
+    {
+      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	       __FILE__, __LINE__);
+      return;
+    }
+  mc_mask = buckets - 1;
+  mc_generation = ypdb_clear_generation ();
+
+  stats_register (match_cache_stats);
+}
+
+/* Look for domain/map/key in the cache. If it is found, copy the
+   value, which is never larger than YPMAXRECORD, into val. */
+int
+match_cache_lookup (const char *domain, const char *map,
+		    const char *key, u_int keylen, char *val, u_int *vallen)
+{
+  mc_map_t *m;
+  mc_entry_t *e;
+  unsigned int hash;
+  time_t now;
+
+  if (mc_table == NULL)
+    return 0;
+
+  pthread_mutex_lock (&mc_lock);
+
+  mc_check_generation ();
+  lookup_generation = mc_generation;
+  lookup_map_generation = ypdb_map_generation (domain, map);
+
+  if ((m = mc_find_map (domain, map)) == NULL)
+    goto miss;
+  mc_check_map (m, lookup_map_generation);
+
+  now = time (NULL);
+  if (now - m->checked >= MC_RECHECK)
+    {
+      DB_FILE dbp;
+      unsigned int ordernum = 0;
+      int found;
+
+      /* ypdb_open may wait for another thread, don't block the
+	 cache meanwhile. */
+      m->checked = now;
+      pthread_mutex_unlock (&mc_lock);
+      if ((found = ((dbp = ypdb_open (domain, map)) != NULL)))
+	{
+	  ordernum = ypdb_last_modified (dbp);
+	  ypdb_close (dbp);
+	}
+      pthread_mutex_lock (&mc_lock);
+
+      mc_check_generation ();
+      lookup_generation = mc_generation;
+      lookup_map_generation = ypdb_map_generation (domain, map);
+      mc_check_map (m, lookup_map_generation);
+      if (!found || ordernum != m->ordernum)
+	{
+	  if (debug_flag)
+	    log_msg ("match_cache: %s/%s changed, removing entries",
+		     domain, map);
+	  mc_flush (m);
+	  m->ordernum = ordernum;
+	  ++stat_invalidations;
+	  goto miss;
+	}
+    }
+
+  hash = mc_hash (m, key, keylen);
+  if ((e = mc_find_entry (m, hash, key, keylen)) == NULL)
+    goto miss;
+
+  /* Move to the front of the LRU list */
+  if (e != mc_head)
+    {
+      e->prev->next = e->next;
+      if (e->next)
+	e->next->prev = e->prev;
+      else
+	mc_tail = e->prev;
+      e->prev = NULL;
+      e->next = mc_head;
+      mc_head->prev = e;
+      mc_head = e;
+    }
+
+  memcpy (val, e->data + e->keylen, e->vallen);
+  *vallen = e->vallen;
+  ++stat_hits;
+  pthread_mutex_unlock (&mc_lock);
+
+  if (debug_flag)
+    log_msg ("\t-> Found in match_cache");
+
+  return 1;
+
+ miss:
+  ++stat_misses;
+  pthread_mutex_unlock (&mc_lock);
+  return 0;
+}
+
+/* Add the result of a successful MATCH request, dbp is the handle
+   the value was read from. */
+void
+match_cache_insert (DB_FILE dbp, const char *domain, const char *map,
+		    const char *key, u_int keylen,
+		    const char *val, u_int vallen)
+{
+  size_t size = sizeof (mc_entry_t) + keylen + vallen;
+  unsigned int ordernum, hash;
+  mc_map_t *m;
+  mc_entry_t *e;
+
+  if (mc_table == NULL || vallen > YPMAXRECORD || size > match_cache_size)
+    return;
+
+  pthread_mutex_lock (&mc_lock);
+  if ((m = mc_find_map (domain, map)) == NULL)
+    {
+      pthread_mutex_unlock (&mc_lock);
+
+      /* A map we did not see before, YP_LAST_MODIFIED is read from
+	 the same handle as the value. */
+      ordernum = ypdb_last_modified (dbp);
+      if ((m = calloc (1, sizeof (mc_map_t))) == NULL ||
+	  (m->domain = strdup (domain)) == NULL ||
+	  (m->map = strdup (map)) == NULL)
+	{
+	  if (m)
+	    free (m->domain);
+	  free (m);
+	  log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+		   __FILE__, __LINE__);
+	  return;
+	}
+      m->ordernum = ordernum;
+      m->generation = lookup_map_generation;
+      m->checked = time (NULL);
+
+      pthread_mutex_lock (&mc_lock);
+      if (mc_find_map (domain, map) != NULL)
+	{
+	  /* Another thread was faster */
+	  free (m->domain);
+	  free (m->map);
+	  free (m);
+	  pthread_mutex_unlock (&mc_lock);
+	  return;
+	}
+      m->next = mc_maps;
+      mc_maps = m;
+    }
+
+  mc_check_generation ();
+  mc_check_map (m, ypdb_map_generation (domain, map));
+  if (lookup_generation != mc_generation ||
+      lookup_map_generation != m->generation)
+    {
+      pthread_mutex_unlock (&mc_lock);
+      return;
+    }
+
+  hash = mc_hash (m, key, keylen);
+  if (mc_find_entry (m, hash, key, keylen) != NULL)
+    {
+      /* Inserted by another thread meanwhile */
+      pthread_mutex_unlock (&mc_lock);
+      return;
+    }
+
+  if ((e = malloc (size)) == NULL)
+    {
+      pthread_mutex_unlock (&mc_lock);
+      return;
+    }
+  e->map = m;
+  e->hash = hash;
+  e->keylen = keylen;
+  e->vallen = vallen;
+  memcpy (e->data, key, keylen);
+  memcpy (e->data + keylen, val, vallen);
+
+  e->hnext = mc_table[hash & mc_mask];
+  mc_table[hash & mc_mask] = e;
+  e->prev = NULL;
+  e->next = mc_head;
+  if (mc_head)
+    mc_head->prev = e;
+  else
+    mc_tail = e;
+  mc_head = e;
+  mc_bytes += size;
+  ++mc_entries;
+
+  while (mc_bytes > match_cache_size && mc_tail != NULL)
+    {
+      mc_remove (mc_tail);
+      ++stat_evictions;
+    }
+
+  pthread_mutex_unlock (&mc_lock);
+}
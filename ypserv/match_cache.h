@@ -0,0 +1,32 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifndef __MATCH_CACHE_H__
+#define __MATCH_CACHE_H__
+
+#include <rpc/rpc.h>
+
+#include "yp_db.h"
+
+extern void match_cache_init (void);
+extern int match_cache_lookup (const char *domain, const char *map,
+			       const char *key, u_int keylen,
+			       char *val, u_int *vallen);
+extern void match_cache_insert (DB_FILE dbp, const char *domain,
+				const char *map, const char *key,
+				u_int keylen, const char *val, u_int vallen);
+
+#endif
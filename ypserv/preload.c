@@ -0,0 +1,509 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <time.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "yp_db.h"
+#include "ypc.h"
+#include "ypj.h"
+#include "log_msg.h"
+#include "ypserv_conf.h"
+#include "preload.h"
+
+/* With "preload: MAP..." in ypserv.conf, the maps matching one of the
+   patterns are opened before ypserv registers with rpcbind and tells
+   systemd that it is ready, so the first requests after a restart
+   don't wait for the database and the disk. The files of a map are
+   read into the page cache, with "preload_lock: yes" they are locked
+   into memory. Opening the map loads it, if it is one of the
+   memory_maps, and with cached handles the handle stays open.
+   Several threads preload the maps, the time needed for every map
+   is logged.
+
+   A file is only locked as long as it is mapped, so the mappings of
+   the locked files are kept with the map they belong to. If a map is
+   replaced by a new version, or after YPPROC_CLEAR, a thread unlocks
+   and unmaps the old files and locks the new ones. */
+
+#define PRELOAD_MAX_THREADS 8
+
+typedef struct preload_job
+{
+  char *domain;
+  char *map;
+} preload_job_t;
+
+static preload_job_t *jobs = NULL;
+static size_t nr_jobs = 0;
+static size_t next_job = 0;
+static unsigned long total_bytes = 0;
+
+/* The files a map can consist of, and its journal */
+static const char *const suffixes[] = {
+  "", YPC_SUFFIX, YPJ_SUFFIX,
+#if defined(HAVE_NDBM)
+  ".db", ".pag", ".dir",
+#endif
+};
+#define NR_SUFFIXES (sizeof (suffixes) / sizeof (suffixes[0]))
+
+typedef struct locked_file
+{
+  void *addr;			/* NULL if not locked */
+  size_t size;
+  dev_t dev;
+  ino_t ino;
+} locked_file_t;
+
+/* The locked files of a map */
+typedef struct locked_map
+{
+  struct locked_map *next;
+  char *domain;
+  char *map;
+  int changed;
+  locked_file_t files[NR_SUFFIXES];
+} locked_map_t;
+
+/* The list is only changed while the maps are preloaded, and by the
+   relock thread. locked_lock protects the changed flags. */
+static pthread_mutex_t locked_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t locked_cond = PTHREAD_COND_INITIALIZER;
+static locked_map_t *locked_maps = NULL;
+static int relock_pending = 0;
+
+static int
+add_job (const char *domain, const char *map)
+{
+  preload_job_t *tmp;
+  size_t i;
+
+  for (i = 0; i < nr_jobs; i++)
+    if (strcmp (jobs[i].map, map) == 0 && strcmp (jobs[i].domain, domain) == 0)
+      return 0;
+
+  if ((tmp = realloc (jobs, (nr_jobs + 1) * sizeof (preload_job_t))) == NULL)
+    return -1;
+  jobs = tmp;
+  if ((jobs[nr_jobs].domain = strdup (domain)) == NULL)
+    return -1;
+  if ((jobs[nr_jobs].map = strdup (map)) == NULL)
+    {
+      free (jobs[nr_jobs].domain);
+      return -1;
+    }
+  nr_jobs++;
+  return 0;
+}
+
+/* Collect the maps of all domains matching preload_maps */
+static int
+find_maps (void)
+{
+  DIR *dp, *mp;
+  struct dirent *d, *m;
+  struct stat st;
+
+  if ((dp = opendir (".")) == NULL)
+    {
+      log_msg ("preload: cannot read map directory: %s", strerror (errno));
+      return -1;
+    }
+
+  while ((d = readdir (dp)) != NULL)
+    {
+      if (d->d_name[0] == '.' || strcmp (d->d_name, "binding") == 0 ||
+	  stat (d->d_name, &st) < 0 || !S_ISDIR (st.st_mode) ||
+	  (mp = opendir (d->d_name)) == NULL)
+	continue;
+
+      while ((m = readdir (mp)) != NULL)
+	{
+	  char map[256];
+	  size_t i, len = strlen (m->d_name);
+
+	  if (m->d_name[0] == '.' || len >= sizeof (map) ||
+	      m->d_name[len - 1] == '~')
+	    continue;
+
+	  strcpy (map, m->d_name);
+	  for (i = 1; i < NR_SUFFIXES; i++)
+	    {
+	      size_t slen = strlen (suffixes[i]);
+
+	      if (len > slen && strcmp (map + len - slen, suffixes[i]) == 0)
+		{
+		  map[len - slen] = '\0';
+		  break;
+		}
+	    }
+
+	  if (ypdb_map_in_list (preload_maps, map) &&
+	      add_job (d->d_name, map) < 0)
+	    {
+	      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+		       __FILE__, __LINE__);
+	      closedir (mp);
+	      closedir (dp);
+	      return -1;
+	    }
+	}
+      closedir (mp);
+    }
+  closedir (dp);
+
+  return 0;
+}
+
+/* Read a file into the page cache, or lock it into memory and keep
+   the mapping in lf. Returns the size of the file. */
+static unsigned long
+preload_file (const char *path, locked_file_t *lf)
+{
+  long pagesize = sysconf (_SC_PAGESIZE);
+  volatile unsigned char sum = 0;
+  struct stat st;
+  unsigned char *p;
+  off_t off;
+  int fd;
+
+  if ((fd = open (path, O_RDONLY | O_CLOEXEC)) < 0)
+    return 0;
+  if (fstat (fd, &st) < 0 || !S_ISREG (st.st_mode) || st.st_size == 0)
+    {
+      close (fd);
+      return 0;
+    }
+  p = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (p == MAP_FAILED)
+    {
+      log_msg ("preload: cannot map %s: %s", path, strerror (errno));
+      return 0;
+    }
+
+  madvise (p, st.st_size, MADV_WILLNEED);
+
+  /* The mapping is kept, else the pages would be unlocked again */
+  if (lf != NULL)
+    {
+      if (mlock (p, st.st_size) == 0)
+	{
+	  lf->addr = p;
+	  lf->size = st.st_size;
+	  lf->dev = st.st_dev;
+	  lf->ino = st.st_ino;
+	  return st.st_size;
+	}
+      log_msg ("preload: cannot lock %s: %s", path, strerror (errno));
+    }
+
+  for (off = 0; off < st.st_size; off += pagesize)
+    sum += p[off];
+  munmap (p, st.st_size);
+
+  return st.st_size;
+}
+
+static void
+unlock_file (locked_file_t *lf)
+{
+  if (lf->addr == NULL)
+    return;
+  munlock (lf->addr, lf->size);
+  munmap (lf->addr, lf->size);
+  lf->addr = NULL;
+}
+
+static locked_map_t *
+new_locked_map (const char *domain, const char *map)
+{
+  locked_map_t *lm;
+
+  if ((lm = calloc (1, sizeof (locked_map_t))) == NULL ||
+      (lm->domain = strdup (domain)) == NULL ||
+      (lm->map = strdup (map)) == NULL)
+    {
+      if (lm)
+	free (lm->domain);
+      free (lm);
+      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	       __FILE__, __LINE__);
+      return NULL;
+    }
+
+  return lm;
+}
+
+static void
+preload_map (const preload_job_t *job)
+{
+  struct timespec start, end;
+  unsigned long bytes = 0;
+  unsigned int order;
+  locked_map_t *lm = NULL;
+  DB_FILE dbp;
+  size_t i;
+  long ms;
+
+  clock_gettime (CLOCK_MONOTONIC, &start);
+
+  if (preload_lock)
+    lm = new_locked_map (job->domain, job->map);
+
+  for (i = 0; i < NR_SUFFIXES; i++)
+    {
+      char *path;
+
+      if (asprintf (&path, "%s/%s%s", job->domain, job->map,
+		    suffixes[i]) < 0)
+	continue;
+      bytes += preload_file (path, lm ? &lm->files[i] : NULL);
+      free (path);
+    }
+
+  if (lm != NULL)
+    {
+      pthread_mutex_lock (&locked_lock);
+      lm->next = locked_maps;
+      locked_maps = lm;
+      pthread_mutex_unlock (&locked_lock);
+    }
+
+  /* Read the YP_ keys, they are needed by most requests */
+  if ((dbp = ypdb_open (job->domain, job->map)) != NULL)
+    {
+      ypdb_order (dbp, &order);
+      ypdb_master_name (dbp);
+      ypdb_secure (dbp);
+      ypdb_close (dbp);
+    }
+
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  ms = (end.tv_sec - start.tv_sec) * 1000 +
+    (end.tv_nsec - start.tv_nsec) / 1000000;
+
+  if (dbp == NULL)
+    log_msg ("preload: cannot open %s/%s", job->domain, job->map);
+  else
+    log_msg ("preload: %s/%s: %lu bytes in %ld ms", job->domain, job->map,
+	     bytes, ms);
+  __atomic_add_fetch (&total_bytes, bytes, __ATOMIC_RELAXED);
+}
+
+/* Lock the files of lm again, which were replaced */
+static void
+relock_map (locked_map_t *lm)
+{
+  unsigned long bytes = 0;
+  int relocked = 0;
+  size_t i;
+
+  for (i = 0; i < NR_SUFFIXES; i++)
+    {
+      locked_file_t *lf = &lm->files[i];
+      struct stat st;
+      char *path;
+
+      if (asprintf (&path, "%s/%s%s", lm->domain, lm->map,
+		    suffixes[i]) < 0)
+	continue;
+      if (stat (path, &st) < 0 || !S_ISREG (st.st_mode))
+	{
+	  if (lf->addr != NULL)
+	    relocked = 1;
+	  unlock_file (lf);
+	}
+      else if (lf->addr == NULL || lf->dev != st.st_dev ||
+	       lf->ino != st.st_ino)
+	{
+	  unlock_file (lf);
+	  bytes += preload_file (path, lf);
+	  relocked = 1;
+	}
+      free (path);
+    }
+
+  if (relocked)
+    log_msg ("preload: %s/%s changed, %lu bytes locked", lm->domain,
+	     lm->map, bytes);
+}
+
+static void *
+relock_run (void *arg __attribute__ ((unused)))
+{
+  locked_map_t *lm;
+
+  pthread_mutex_lock (&locked_lock);
+  for (;;)
+    {
+      while (!relock_pending)
+	pthread_cond_wait (&locked_cond, &locked_lock);
+      relock_pending = 0;
+
+      for (lm = locked_maps; lm != NULL; lm = lm->next)
+	if (lm->changed)
+	  {
+	    lm->changed = 0;
+	    pthread_mutex_unlock (&locked_lock);
+	    relock_map (lm);
+	    pthread_mutex_lock (&locked_lock);
+	  }
+    }
+
+  return NULL;
+}
+
+/* ypdb_changed_hook, wakes up the relock thread */
+static void
+preload_changed (const char *domain, const char *map)
+{
+  locked_map_t *lm;
+
+  pthread_mutex_lock (&locked_lock);
+  for (lm = locked_maps; lm != NULL; lm = lm->next)
+    if (domain == NULL ||
+	(strcmp (lm->map, map) == 0 && strcmp (lm->domain, domain) == 0))
+      {
+	lm->changed = 1;
+	relock_pending = 1;
+      }
+  if (relock_pending)
+    pthread_cond_signal (&locked_cond);
+  pthread_mutex_unlock (&locked_lock);
+}
+
+static void
+locked_prepare (void)
+{
+  pthread_mutex_lock (&locked_lock);
+}
+
+static void
+locked_release (void)
+{
+  pthread_mutex_unlock (&locked_lock);
+}
+
+/* Start the thread, which locks new versions of the preloaded maps */
+static void
+relock_init (void)
+{
+  sigset_t set, oldset;
+  pthread_t tid;
+
+  if (locked_maps == NULL)
+    return;
+
+  sigfillset (&set);
+  pthread_sigmask (SIG_BLOCK, &set, &oldset);
+  if (pthread_create (&tid, NULL, relock_run, NULL) != 0)
+    log_msg ("preload: cannot create relock thread: %s", strerror (errno));
+  else
+    {
+      pthread_detach (tid);
+      /* ypproc_all and ypproc_xfr fork, the child opens maps, too */
+      pthread_atfork (locked_prepare, locked_release, locked_release);
+      ypdb_changed_hook = preload_changed;
+    }
+  pthread_sigmask (SIG_SETMASK, &oldset, NULL);
+}
+
+static void *
+preload_run (void *arg __attribute__ ((unused)))
+{
+  size_t i;
+
+  while ((i = __atomic_fetch_add (&next_job, 1, __ATOMIC_RELAXED)) < nr_jobs)
+    preload_map (&jobs[i]);
+
+  return NULL;
+}
+
+/* Preload the maps, returns after all of them are done */
+void
+preload_maps_run (void)
+{
+  pthread_t tids[PRELOAD_MAX_THREADS];
+  struct timespec start, end;
+  sigset_t set, oldset;
+  int i, nthreads = 0;
+  long ncpu, ms;
+  size_t j;
+
+  if (preload_maps == NULL)
+    return;
+
+  clock_gettime (CLOCK_MONOTONIC, &start);
+
+  if (find_maps () < 0)
+    return;
+  if (nr_jobs == 0)
+    {
+      log_msg ("preload: no map matches \"%s\"", preload_maps);
+      return;
+    }
+  if (cached_filehandles > 0 && nr_jobs > (size_t) cached_filehandles)
+    log_msg ("preload: %zu maps, but only %d cached handles (files:)",
+	     nr_jobs, cached_filehandles);
+
+  /* The main thread works, too */
+  ncpu = sysconf (_SC_NPROCESSORS_ONLN);
+  if (ncpu > PRELOAD_MAX_THREADS + 1)
+    ncpu = PRELOAD_MAX_THREADS + 1;
+
+  sigfillset (&set);
+  pthread_sigmask (SIG_BLOCK, &set, &oldset);
+  for (i = 0; i < ncpu - 1 && (size_t) i + 1 < nr_jobs; i++)
+    if (pthread_create (&tids[nthreads], NULL, preload_run, NULL) == 0)
+      nthreads++;
+  pthread_sigmask (SIG_SETMASK, &oldset, NULL);
+
+  preload_run (NULL);
+  for (i = 0; i < nthreads; i++)
+    pthread_join (tids[i], NULL);
+
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  ms = (end.tv_sec - start.tv_sec) * 1000 +
+    (end.tv_nsec - start.tv_nsec) / 1000000;
+  log_msg ("preload: %zu maps, %lu bytes in %ld ms with %d threads",
+	   nr_jobs, total_bytes, ms, nthreads + 1);
+
+  relock_init ();
+
+  for (j = 0; j < nr_jobs; j++)
+    {
+      free (jobs[j].domain);
+      free (jobs[j].map);
+    }
+  free (jobs);
+  jobs = NULL;
+  nr_jobs = next_job = 0;
+}
@@ -30,15 +30,24 @@
 #include <stdlib.h>
 #include <dirent.h>
 #include <errno.h>
+#include <signal.h>
 #include <fcntl.h>
 #include <time.h>
 #include <netdb.h>
 #include <rpcsvc/yp_prot.h>
 #include "yp.h"
 #include "yp_db.h"
+#include "ypc.h"
+#include "ypj.h"
 #include "access.h"
 #include "ypserv_conf.h"
 #include "log_msg.h"
+#include "match_cache.h"
+#include "bloom.h"
+#include "evloop.h"
+#include "all_cache.h"
+#include "dir_cache.h"
+#include "dns.h"
 
 bool_t
 ypproc_null_2_svc (void *argp UNUSED, void *result UNUSED,
@@ -49,7 +58,7 @@ ypproc_null_2_svc (void *argp UNUSED, void *result UNUSED,
       struct netconfig *nconf;
       struct netbuf *rqhost = svc_getrpccaller(rqstp->rq_xprt);
 
-      if ((nconf = getnetconfigent (rqstp->rq_xprt->xp_netid)) == NULL)
+      if ((nconf = get_netconfig (rqstp->rq_xprt->xp_netid)) == NULL)
         svcerr_systemerr (rqstp->rq_xprt);
       else
         {
@@ -58,7 +67,6 @@ ypproc_null_2_svc (void *argp UNUSED, void *result UNUSED,
                    taddr2ipstr (nconf, rqhost,
                                 namebuf6, sizeof (namebuf6)),
                    taddr2port (nconf, rqhost));
-          freenetconfigent (nconf);
         }
     }
 
@@ -78,7 +86,7 @@ ypproc_domain_2_svc (domainname *argp, bool_t *result,
       struct netconfig *nconf;
       struct netbuf *rqhost = svc_getrpccaller(rqstp->rq_xprt);
 
-      if ((nconf = getnetconfigent (rqstp->rq_xprt->xp_netid)) == NULL)
+      if ((nconf = get_netconfig (rqstp->rq_xprt->xp_netid)) == NULL)
         svcerr_systemerr (rqstp->rq_xprt);
       else
         {
@@ -87,7 +95,6 @@ ypproc_domain_2_svc (domainname *argp, bool_t *result,
                    taddr2ipstr (nconf, rqhost,
                                 namebuf6, sizeof (namebuf6)),
                    taddr2port (nconf, rqhost));
-          freenetconfigent (nconf);
         }
     }
 
@@ -129,7 +136,7 @@ ypproc_domain_nonack_2_svc (domainname *argp, bool_t *result,
       struct netconfig *nconf;
       struct netbuf *rqhost = svc_getrpccaller(rqstp->rq_xprt);
 
-      if ((nconf = getnetconfigent (rqstp->rq_xprt->xp_netid)) == NULL)
+      if ((nconf = get_netconfig (rqstp->rq_xprt->xp_netid)) == NULL)
         svcerr_systemerr (rqstp->rq_xprt);
       else
         {
@@ -138,7 +145,6 @@ ypproc_domain_nonack_2_svc (domainname *argp, bool_t *result,
                    taddr2ipstr (nconf, rqhost,
                                 namebuf6, sizeof (namebuf6)),
                    taddr2port (nconf, rqhost));
-          freenetconfigent (nconf);
         }
     }
 
@@ -173,6 +179,10 @@ ypproc_domain_nonack_2_svc (domainname *argp, bool_t *result,
 }
 
 
+/* Values from the match_cache and from maps in memory are copied in
+   a buffer of the thread. ypprog_2_freeresult does not free it. */
+static __thread char match_buf[YPMAXRECORD];
+
 bool_t
 ypproc_match_2_svc (ypreq_key *argp, ypresp_val *result,
 		    struct svc_req *rqstp)
@@ -184,7 +194,7 @@ ypproc_match_2_svc (ypreq_key *argp, ypresp_val *result,
       struct netconfig *nconf;
       struct netbuf *rqhost = svc_getrpccaller(rqstp->rq_xprt);
 
-      if ((nconf = getnetconfigent (rqstp->rq_xprt->xp_netid)) == NULL)
+      if ((nconf = get_netconfig (rqstp->rq_xprt->xp_netid)) == NULL)
         svcerr_systemerr (rqstp->rq_xprt);
       else
         {
@@ -193,7 +203,6 @@ ypproc_match_2_svc (ypreq_key *argp, ypresp_val *result,
                    taddr2ipstr (nconf, rqhost,
                                 namebuf6, sizeof (namebuf6)),
                    taddr2port (nconf, rqhost));
-          freenetconfigent (nconf);
 	  log_msg ("\t\tdomainname = \"%s\"", argp->domain);
 	  log_msg ("\t\tmapname = \"%s\"", argp->map);
 	  log_msg ("\t\tkeydat = \"%.*s\"", (int) argp->keydat.keydat_len,
@@ -239,6 +248,17 @@ ypproc_match_2_svc (ypreq_key *argp, ypresp_val *result,
 
   if (argp->keydat.keydat_len == 0 || argp->keydat.keydat_val[0] == '\0')
     result->status = YP_BADARGS;
+  else if (!bloom_lookup (argp->domain, argp->map, argp->keydat.keydat_val,
+			  argp->keydat.keydat_len))
+    result->status = YP_NOKEY;
+  else if (match_cache_lookup (argp->domain, argp->map,
+			       argp->keydat.keydat_val,
+			       argp->keydat.keydat_len,
+			       match_buf, &result->valdat.valdat_len))
+    {
+      result->status = YP_TRUE;
+      result->valdat.valdat_val = match_buf;
+    }
   else
     {
       datum rdat, qdat;
@@ -251,21 +271,37 @@ ypproc_match_2_svc (ypreq_key *argp, ypresp_val *result,
           qdat.dsize = argp->keydat.keydat_len;
           qdat.dptr = argp->keydat.keydat_val;
 
-          rdat = ypdb_fetch (dbp, qdat);
+          rdat = ypdb_fetch_into (dbp, qdat, match_buf, sizeof (match_buf));
 
           if (rdat.dptr != NULL)
             {
               result->status = YP_TRUE;
               result->valdat.valdat_len = rdat.dsize;
               result->valdat.valdat_val = rdat.dptr;
+	      match_cache_insert (dbp, argp->domain, argp->map,
+				  qdat.dptr, qdat.dsize,
+				  rdat.dptr, rdat.dsize);
             }
           else
-            result->status = YP_NOKEY;
+	    {
+	      result->status = YP_NOKEY;
+	      bloom_false_positive ();
+	    }
 
           ypdb_close (dbp);
         }
     }
 
+  if (result->status == YP_NOKEY && dns_flag &&
+      !dns_match (rqstp, argp->map, argp->keydat.keydat_val,
+		  argp->keydat.keydat_len, result, match_buf,
+		  sizeof (match_buf)))
+    {
+      if (debug_flag)
+	log_msg ("\t-> Waiting for DNS");
+      return FALSE;
+    }
+
   if (debug_flag)
     {
       if (result->status == YP_TRUE)
@@ -291,7 +327,7 @@ ypproc_first_2_svc (ypreq_nokey *argp, ypresp_key_val *result,
       struct netconfig *nconf;
       struct netbuf *rqhost = svc_getrpccaller(rqstp->rq_xprt);
 
-      if ((nconf = getnetconfigent (rqstp->rq_xprt->xp_netid)) == NULL)
+      if ((nconf = get_netconfig (rqstp->rq_xprt->xp_netid)) == NULL)
         svcerr_systemerr (rqstp->rq_xprt);
       else
         {
@@ -300,7 +336,6 @@ ypproc_first_2_svc (ypreq_nokey *argp, ypresp_key_val *result,
                    taddr2ipstr (nconf, rqhost,
                                 namebuf6, sizeof (namebuf6)),
                    taddr2port (nconf, rqhost));
-          freenetconfigent (nconf);
 	  log_msg ("\tdomainname = \"%s\"", argp->domain);
 	  log_msg ("\tmapname = \"%s\"", argp->map);
 	}
@@ -347,21 +382,7 @@ ypproc_first_2_svc (ypreq_nokey *argp, ypresp_key_val *result,
     result->status = YP_NOMAP;
   else
     {
-      datum dkey = ypdb_firstkey (dbp);
-
-      while (dkey.dptr != NULL && dkey.dptr[0] == 'Y' &&
-	     dkey.dptr[1] == 'P' && dkey.dptr[2] == '_')
-	{
-#if defined(HAVE_NDBM)
-	  /* This is much more faster then ypdb_nextkey, but
-	     it is terrible to port to other databases */
-	  dkey = dbm_nextkey (dbp);
-#else
-	  datum tkey = dkey;
-	  dkey = ypdb_nextkey (dbp, tkey);
-	  ypdb_free (tkey.dptr);
-#endif
-	}
+      datum dkey = ypdb_first_datakey (dbp);
 
       if (dkey.dptr != NULL)
 	{
@@ -406,7 +427,7 @@ ypproc_next_2_svc (ypreq_key *argp, ypresp_key_val *result,
       struct netconfig *nconf;
       struct netbuf *rqhost = svc_getrpccaller(rqstp->rq_xprt);
 
-      if ((nconf = getnetconfigent (rqstp->rq_xprt->xp_netid)) == NULL)
+      if ((nconf = get_netconfig (rqstp->rq_xprt->xp_netid)) == NULL)
         svcerr_systemerr (rqstp->rq_xprt);
       else
         {
@@ -415,7 +436,6 @@ ypproc_next_2_svc (ypreq_key *argp, ypresp_key_val *result,
                    taddr2ipstr (nconf, rqhost,
                                 namebuf6, sizeof (namebuf6)),
                    taddr2port (nconf, rqhost));
-          freenetconfigent (nconf);
 	  log_msg ("\tdomainname = \"%s\"", argp->domain);
 	  log_msg ("\tmapname = \"%s\"", argp->map);
 	  log_msg ("\tkeydat = \"%.*s\"",
@@ -531,7 +551,7 @@ ypproc_xfr_all_svc (ypreq_xfr *argp, ypresp_xfr *result,
       struct netconfig *nconf = NULL;
       struct netbuf *rqhost = svc_getrpccaller(rqstp->rq_xprt);
 
-      if ((nconf = getnetconfigent (rqstp->rq_xprt->xp_netid)) == NULL)
+      if ((nconf = get_netconfig (rqstp->rq_xprt->xp_netid)) == NULL)
         svcerr_systemerr (rqstp->rq_xprt);
 
       switch (valid)
@@ -577,8 +597,6 @@ ypproc_xfr_all_svc (ypreq_xfr *argp, ypresp_xfr *result,
 	  result->xfrstat = YPXFR_NODOM;
 	  break;
 	}
-      if (nconf)
-	freenetconfigent (nconf);
       return TRUE;
     }
 
@@ -588,7 +606,7 @@ ypproc_xfr_all_svc (ypreq_xfr *argp, ypresp_xfr *result,
       struct netconfig *nconf = NULL;
       struct netbuf *rqhost = svc_getrpccaller(rqstp->rq_xprt);
 
-      if ((nconf = getnetconfigent (rqstp->rq_xprt->xp_netid)) == NULL)
+      if ((nconf = get_netconfig (rqstp->rq_xprt->xp_netid)) == NULL)
         svcerr_systemerr (rqstp->rq_xprt);
 
       if(taddr2port (nconf, rqhost) >= IPPORT_RESERVED)
@@ -601,13 +619,9 @@ ypproc_xfr_all_svc (ypreq_xfr *argp, ypresp_xfr *result,
 		     taddr2ipstr (nconf, rqhost,
 				  namebuf6, sizeof (namebuf6)),
 		     taddr2port (nconf, rqhost));
-	  if (nconf)
-	    freenetconfigent (nconf);
           result->xfrstat = YPXFR_REFUSED;
 	  return TRUE;
 	}
-      if (nconf)
-	freenetconfigent (nconf);
     }
 
   /* If we have the map, check, if the master name is the same as in
@@ -641,7 +655,7 @@ ypproc_xfr_all_svc (ypreq_xfr *argp, ypresp_xfr *result,
 		  struct netconfig *nconf;
 		  struct netbuf *rqhost = svc_getrpccaller(rqstp->rq_xprt);
 
-		  if ((nconf = getnetconfigent (rqstp->rq_xprt->xp_netid))
+		  if ((nconf = get_netconfig (rqstp->rq_xprt->xp_netid))
 		      == NULL)
 		    svcerr_systemerr (rqstp->rq_xprt);
 		  else
@@ -651,7 +665,6 @@ ypproc_xfr_all_svc (ypreq_xfr *argp, ypresp_xfr *result,
 			       taddr2ipstr (nconf, rqhost,
 					namebuf6, sizeof (namebuf6)),
 			   taddr2port (nconf, rqhost), buf);
-		      freenetconfigent (nconf);
 		    }
 		}
 	      ypdb_close (dbp);
@@ -687,7 +700,7 @@ ypproc_xfr_all_svc (ypreq_xfr *argp, ypresp_xfr *result,
 	      struct netconfig *nconf;
 	      struct netbuf *rqhost = svc_getrpccaller(rqstp->rq_xprt);
 
-	      if ((nconf = getnetconfigent (rqstp->rq_xprt->xp_netid)) == NULL)
+	      if ((nconf = get_netconfig (rqstp->rq_xprt->xp_netid)) == NULL)
 		svcerr_systemerr (rqstp->rq_xprt);
 	      else
 		{
@@ -697,7 +710,6 @@ ypproc_xfr_all_svc (ypreq_xfr *argp, ypresp_xfr *result,
 			   taddr2ipstr (nconf, rqhost,
 					namebuf6, sizeof (namebuf6)),
                            taddr2port (nconf, rqhost));
-		  freenetconfigent (nconf);
 		}
 	    }
 	  result->xfrstat = YPXFR_NODOM;
@@ -714,7 +726,7 @@ ypproc_xfr_all_svc (ypreq_xfr *argp, ypresp_xfr *result,
 	      struct netconfig *nconf;
 	      struct netbuf *rqhost = svc_getrpccaller(rqstp->rq_xprt);
 
-	      if ((nconf = getnetconfigent (rqstp->rq_xprt->xp_netid)) == NULL)
+	      if ((nconf = get_netconfig (rqstp->rq_xprt->xp_netid)) == NULL)
 		svcerr_systemerr (rqstp->rq_xprt);
 	      else
 		{
@@ -723,7 +735,6 @@ ypproc_xfr_all_svc (ypreq_xfr *argp, ypresp_xfr *result,
 			   taddr2ipstr (nconf, rqhost,
 					namebuf6, sizeof (namebuf6)),
                            taddr2port (nconf, rqhost));
-		  freenetconfigent (nconf);
 		}
 	    }
 	}
@@ -738,7 +749,7 @@ ypproc_xfr_all_svc (ypreq_xfr *argp, ypresp_xfr *result,
       struct netconfig *nconf;
       struct netbuf *rqhost = svc_getrpccaller(rqstp->rq_xprt);
 
-      if ((nconf = getnetconfigent (rqstp->rq_xprt->xp_netid)) == NULL)
+      if ((nconf = get_netconfig (rqstp->rq_xprt->xp_netid)) == NULL)
 	svcerr_systemerr (rqstp->rq_xprt);
       else
 	{
@@ -752,7 +763,6 @@ ypproc_xfr_all_svc (ypreq_xfr *argp, ypresp_xfr *result,
 		     argp->map_parms.map,
 		     taddr2ipstr (nconf, rqhost,
 				  namebuf6, sizeof (namebuf6)));
-	  freenetconfigent (nconf);
 	}
       result->xfrstat = YPXFR_REFUSED;
       return TRUE;
@@ -767,10 +777,15 @@ ypproc_xfr_all_svc (ypreq_xfr *argp, ypresp_xfr *result,
 	const char *host;
         char *ypxfr_command = alloca (sizeof (YPBINDIR) + 8);
         char proto[30], transid[30];
+        sigset_t set;
         int i;
 	struct netconfig *nconf;
 	struct netbuf *rqhost = svc_getrpccaller(rqstp->rq_xprt);
 
+        /* The threads of ypserv block signals, ypxfr should get them */
+        sigemptyset (&set);
+        sigprocmask (SIG_SETMASK, &set, NULL);
+
         umask (0);
         i = open ("/dev/null", O_RDWR);
         if (dup (i) == -1)
@@ -786,7 +801,7 @@ ypproc_xfr_all_svc (ypreq_xfr *argp, ypresp_xfr *result,
 	    exit (err);
 	  }
 
-	if ((nconf = getnetconfigent (rqstp->rq_xprt->xp_netid)) == NULL)
+	if ((nconf = get_netconfig (rqstp->rq_xprt->xp_netid)) == NULL)
 	  {
 	    int err = ENOENT;
 	    exit (err);
@@ -831,7 +846,7 @@ bool_t ypproc_newxfr_2_svc (ypreq_newxfr *argp, ypresp_xfr *result,
       struct netconfig *nconf;
       struct netbuf *rqhost = svc_getrpccaller(rqstp->rq_xprt);
 
-      if ((nconf = getnetconfigent (rqstp->rq_xprt->xp_netid)) == NULL)
+      if ((nconf = get_netconfig (rqstp->rq_xprt->xp_netid)) == NULL)
         svcerr_systemerr (rqstp->rq_xprt);
       else
         {
@@ -840,7 +855,6 @@ bool_t ypproc_newxfr_2_svc (ypreq_newxfr *argp, ypresp_xfr *result,
                    taddr2ipstr (nconf, rqhost,
                                 namebuf6, sizeof (namebuf6)),
                    taddr2port (nconf, rqhost));
-          freenetconfigent (nconf);
 	  log_msg ("\t\tdomain   = \"%s\"", argp->map_parms.domain);
 	  log_msg ("\t\tmap      = \"%s\"", argp->map_parms.map);
 	  log_msg ("\t\tordernum = %u", argp->map_parms.ordernum);
@@ -864,7 +878,7 @@ ypproc_xfr_2_svc (ypreq_xfr *argp, ypresp_xfr *result,
       struct netconfig *nconf;
       struct netbuf *rqhost = svc_getrpccaller(rqstp->rq_xprt);
 
-      if ((nconf = getnetconfigent (rqstp->rq_xprt->xp_netid)) == NULL)
+      if ((nconf = get_netconfig (rqstp->rq_xprt->xp_netid)) == NULL)
         svcerr_systemerr (rqstp->rq_xprt);
       else
         {
@@ -873,7 +887,6 @@ ypproc_xfr_2_svc (ypreq_xfr *argp, ypresp_xfr *result,
                    taddr2ipstr (nconf, rqhost,
                                 namebuf6, sizeof (namebuf6)),
                    taddr2port (nconf, rqhost));
-          freenetconfigent (nconf);
 	  log_msg ("\t\tdomain   = \"%s\"", argp->map_parms.domain);
 	  log_msg ("\t\tmap      = \"%s\"", argp->map_parms.map);
 	  log_msg ("\t\tordernum = %u", argp->map_parms.ordernum);
@@ -895,7 +908,7 @@ bool_t ypproc_clear_2_svc (void *argp UNUSED, void *result UNUSED,
       struct netconfig *nconf;
       struct netbuf *rqhost = svc_getrpccaller(rqstp->rq_xprt);
 
-      if ((nconf = getnetconfigent (rqstp->rq_xprt->xp_netid)) == NULL)
+      if ((nconf = get_netconfig (rqstp->rq_xprt->xp_netid)) == NULL)
         svcerr_systemerr (rqstp->rq_xprt);
       else
         {
@@ -904,7 +917,6 @@ bool_t ypproc_clear_2_svc (void *argp UNUSED, void *result UNUSED,
                    taddr2ipstr (nconf, rqhost,
                                 namebuf6, sizeof (namebuf6)),
                    taddr2port (nconf, rqhost));
-          freenetconfigent (nconf);
         }
     }
 
@@ -914,7 +926,7 @@ bool_t ypproc_clear_2_svc (void *argp UNUSED, void *result UNUSED,
         log_msg ("\t-> Ignored (not a valid source host)");
     }
   else
-    ypdb_close_all ();
+    ypdb_clear_all ();
 
   return TRUE;
 }
@@ -995,7 +1007,163 @@ ypall_encode (ypresp_key_val *val, void *data)
   return val->status;
 }
 
-extern xdr_ypall_cb_t xdr_ypall_cb;
+#if !defined(HAVE_NDBM)
+/* With the event loop, the reply to YPPROC_ALL is streamed without a
+   child process. For every part of the reply the handle is borrowed
+   from the cache again, and the iteration continues behind the last
+   key sent. The handle is pinned, so the stream reads the same
+   version of the map to the end, even if it is replaced meanwhile.
+   Without cached handles, the map could be replaced by YPPROC_CLEAR
+   too, so the client gets YP_YPERR instead of a mix of both maps.
+   The first stream of a map encodes every record a second time for
+   the snapshot in the all_cache, if there is one. */
+typedef struct ypall_stream {
+  char *domain;
+  char *map;
+  datum lastkey;
+  unsigned int generation;
+  int started;
+  all_snap_t *snap;
+  struct _fopen *pin;
+} ypall_stream_t;
+
+static void
+ypall_stream_free (void *data)
+{
+  ypall_stream_t *s = data;
+
+  if (s->snap != NULL)
+    all_cache_release (s->snap);
+  if (s->pin != NULL)
+    ypdb_unpin (s->pin);
+  free (s->domain);
+  free (s->map);
+  ypdb_free (s->lastkey.dptr);
+  free (s);
+}
+
+static void
+ypall_snap_free (void *data)
+{
+  all_cache_release (data);
+}
+
+/* Encode one record, if it does not fit, nothing is encoded */
+static int
+ypall_put (XDR *xdrs, ypresp_key_val *val)
+{
+  u_int pos = xdr_getpos (xdrs);
+  bool_t more = TRUE;
+
+  if (xdr_bool (xdrs, &more) && xdr_ypresp_key_val (xdrs, val))
+    return 1;
+  xdr_setpos (xdrs, pos);
+  return 0;
+}
+
+/* End the stream, with a last record containing status, if it is
+   not YP_TRUE. Returns 1, if this has to be done with the next
+   part. */
+static int
+ypall_finish (XDR *xdrs, ypstat status)
+{
+  u_int pos = xdr_getpos (xdrs);
+  ypresp_key_val val;
+  bool_t more = FALSE;
+
+  memset (&val, 0, sizeof (val));
+  val.status = status;
+  if ((status == YP_TRUE || ypall_put (xdrs, &val)) &&
+      xdr_bool (xdrs, &more))
+    return 0;
+  xdr_setpos (xdrs, pos);
+  return 1;
+}
+
+static int
+ypall_fill (XDR *xdrs, void *data)
+{
+  ypall_stream_t *s = data;
+  DB_FILE dbp;
+  datum dkey;
+  int ret = 1;
+
+  if (s->pin != NULL)
+    dbp = ypdb_open_pinned (s->pin);
+  else if (s->lastkey.dptr != NULL &&
+	   s->generation != ypdb_map_generation (s->domain, s->map))
+    {
+      if (debug_flag)
+	log_msg ("ypproc_all: %s/%s was cleared, aborting", s->domain,
+		 s->map);
+      return ypall_finish (xdrs, YP_YPERR);
+    }
+  else
+    {
+      if (s->lastkey.dptr == NULL)
+	s->generation = ypdb_map_generation (s->domain, s->map);
+      if ((dbp = ypdb_open (s->domain, s->map)) == NULL)
+	return ypall_finish (xdrs, s->started ? YP_YPERR : YP_NOMAP);
+      s->pin = ypdb_pin (dbp);
+    }
+
+  if (s->lastkey.dptr == NULL)
+    {
+      /* Called again, if the first record did not fit */
+      if (s->snap == NULL)
+	s->snap = all_cache_build (dbp, s->domain, s->map, s->generation);
+      dkey = ypdb_first_datakey (dbp);
+    }
+  else
+    dkey = ypdb_nextkey (dbp, s->lastkey);
+
+  for (;;)
+    {
+      if (dkey.dptr == NULL)
+	{
+	  ypstat status = s->started ? YP_TRUE : YP_NOMORE;
+
+	  ret = ypall_finish (xdrs, status);
+	  if (ret == 0 && s->snap != NULL)
+	    all_cache_finish (s->snap, status);
+	  break;
+	}
+
+      if (dkey.dsize < 3 || strncmp (dkey.dptr, "YP_", 3) != 0)
+	{
+	  ypresp_key_val val;
+	  datum dval = ypdb_fetch (dbp, dkey);
+
+	  val.status = YP_TRUE;
+	  val.keydat.keydat_val = dkey.dptr;
+	  val.keydat.keydat_len = dkey.dsize;
+	  val.valdat.valdat_val = dval.dptr;
+	  val.valdat.valdat_len = dval.dsize;
+
+	  if (!ypall_put (xdrs, &val))
+	    {
+	      /* Sent with the next part */
+	      ypdb_free (dval.dptr);
+	      ypdb_free (dkey.dptr);
+	      break;
+	    }
+	  if (s->snap != NULL)
+	    all_cache_add (s->snap, &val);
+	  ypdb_free (dval.dptr);
+	  s->started = 1;
+	}
+
+      ypdb_free (s->lastkey.dptr);
+      s->lastkey = dkey;
+      dkey = ypdb_nextkey (dbp, s->lastkey);
+    }
+
+  ypdb_close (dbp);
+  return ret;
+}
+#endif
+
+extern __thread xdr_ypall_cb_t xdr_ypall_cb;
 
 bool_t
 ypproc_all_2_svc (ypreq_nokey *argp, ypresp_all *result, struct svc_req *rqstp)
@@ -1008,7 +1176,7 @@ ypproc_all_2_svc (ypreq_nokey *argp, ypresp_all *result, struct svc_req *rqstp)
       struct netconfig *nconf;
       struct netbuf *rqhost = svc_getrpccaller(rqstp->rq_xprt);
 
-      if ((nconf = getnetconfigent (rqstp->rq_xprt->xp_netid)) == NULL)
+      if ((nconf = get_netconfig (rqstp->rq_xprt->xp_netid)) == NULL)
         svcerr_systemerr (rqstp->rq_xprt);
       else
         {
@@ -1017,7 +1185,6 @@ ypproc_all_2_svc (ypreq_nokey *argp, ypresp_all *result, struct svc_req *rqstp)
                    taddr2ipstr (nconf, rqhost,
                                 namebuf6, sizeof (namebuf6)),
                    taddr2port (nconf, rqhost));
-          freenetconfigent (nconf);
 	  log_msg ("\t\tdomain = \"%s\"", argp->domain);
 	  log_msg ("\t\tmap = \"%s\"", argp->map);
 	}
@@ -1066,6 +1233,45 @@ ypproc_all_2_svc (ypreq_nokey *argp, ypresp_all *result, struct svc_req *rqstp)
       return TRUE;
     }
 
+#if !defined(HAVE_NDBM)
+  if (evloop_can_stream (rqstp->rq_xprt))
+    {
+      ypall_stream_t *s;
+      all_snap_t *snap;
+      off_t size;
+      int fd;
+
+      if ((snap = all_cache_lookup (argp->domain, argp->map,
+				    &fd, &size)) != NULL)
+	{
+	  if (evloop_sendfile (rqstp->rq_xprt, fd, size, ypall_snap_free,
+			       snap) == 0)
+	    {
+	      if (debug_flag)
+		log_msg ("\t -> Sent from the all_cache.");
+	      return FALSE;
+	    }
+	  all_cache_release (snap);
+	}
+
+      s = calloc (1, sizeof (ypall_stream_t));
+
+      if (s != NULL && (s->domain = strdup (argp->domain)) != NULL &&
+	  (s->map = strdup (argp->map)) != NULL)
+	{
+	  if (evloop_stream (rqstp->rq_xprt, ypall_fill, ypall_stream_free,
+			     s) == 0)
+	    {
+	      if (debug_flag)
+		log_msg ("\t -> Streamed by the event loop.");
+	      return FALSE;
+	    }
+	}
+      if (s != NULL)
+	ypall_stream_free (s);
+    }
+#endif
+
   switch (fork ())
     {
     case 0: /* child */
@@ -1101,15 +1307,7 @@ ypproc_all_2_svc (ypreq_nokey *argp, ypresp_all *result, struct svc_req *rqstp)
     result->ypresp_all_u.val.status = YP_NOMAP;
   else
     {
-      data->dkey = ypdb_firstkey (data->dbm);
-
-      while (data->dkey.dptr != NULL && data->dkey.dptr[0] == 'Y'
-	     && data->dkey.dptr[1] == 'P' && data->dkey.dptr[2] == '_')
-	{
-	  datum tkey = data->dkey;
-	  data->dkey = ypdb_nextkey (data->dbm, tkey);
-	  ypdb_free (tkey.dptr);
-	}
+      data->dkey = ypdb_first_datakey (data->dbm);
 
       if (data->dkey.dptr != NULL)
 	{
@@ -1154,6 +1352,10 @@ ypproc_all_2_svc (ypreq_nokey *argp, ypresp_all *result, struct svc_req *rqstp)
   _exit(0);
 }
 
+/* The master name is returned in a buffer of the thread, so no malloc
+   is necessary. ypprog_2_freeresult does not free it. */
+static __thread char master_buf[YPMAXPEER + 1];
+
 bool_t
 ypproc_master_2_svc (ypreq_nokey *argp, ypresp_master *result,
 		     struct svc_req *rqstp)
@@ -1166,7 +1368,7 @@ ypproc_master_2_svc (ypreq_nokey *argp, ypresp_master *result,
       struct netconfig *nconf;
       struct netbuf *rqhost = svc_getrpccaller(rqstp->rq_xprt);
 
-      if ((nconf = getnetconfigent (rqstp->rq_xprt->xp_netid)) == NULL)
+      if ((nconf = get_netconfig (rqstp->rq_xprt->xp_netid)) == NULL)
         svcerr_systemerr (rqstp->rq_xprt);
       else
         {
@@ -1175,7 +1377,6 @@ ypproc_master_2_svc (ypreq_nokey *argp, ypresp_master *result,
                    taddr2ipstr (nconf, rqhost,
                                 namebuf6, sizeof (namebuf6)),
                    taddr2port (nconf, rqhost));
-          freenetconfigent (nconf);
 	  log_msg ("\t\tdomain = \"%s\"", argp->domain);
 	  log_msg ("\t\tmap = \"%s\"", argp->map);
 	}
@@ -1214,7 +1415,8 @@ ypproc_master_2_svc (ypreq_nokey *argp, ypresp_master *result,
 	  result->status = YP_NOMAP;
 	  break;
         }
-      result->master = strdup ("");
+      master_buf[0] = '\0';
+      result->master = master_buf;
       return TRUE;
     }
 
@@ -1223,39 +1425,30 @@ ypproc_master_2_svc (ypreq_nokey *argp, ypresp_master *result,
     result->status = YP_NOMAP;
   else
     {
-      datum key, val;
-
-      key.dsize = sizeof ("YP_MASTER_NAME") - 1;
-      key.dptr = "YP_MASTER_NAME";
+      const char *master = ypdb_master_name (dbp);
 
-      val = ypdb_fetch (dbp, key);
-      if (val.dptr == NULL)
+      if (master == NULL)
 	{
 	  /* No YP_MASTER_NAME record in map? There is someting wrong */
 	  result->status = YP_BADDB;
 	}
       else
 	{
-	  int i;
-	  char *hostbuf = alloca (val.dsize + 1);
+	  strncpy (master_buf, master, YPMAXPEER);
+	  master_buf[YPMAXPEER] = '\0';
 
-	  /* put the eof string mark at the end of the string */
-	  for (i = 0; i < val.dsize; ++i)
-	    hostbuf[i] = val.dptr[i];
-	  hostbuf[val.dsize] = '\0';
-	  ypdb_free (val.dptr);
-
-	  if ((result->master = strdup (hostbuf)) == NULL)
-	    result->status = YP_YPERR;
-	  else
-	    result->status = YP_TRUE;
+	  result->master = master_buf;
+	  result->status = YP_TRUE;
 	}
 
       ypdb_close (dbp);
     }
 
   if (result->master == NULL)
-    result->master = strdup ("");
+    {
+      master_buf[0] = '\0';
+      result->master = master_buf;
+    }
 
   if (debug_flag)
     log_msg ("\t-> Master = \"%s\"", result->master);
@@ -1264,29 +1457,10 @@ ypproc_master_2_svc (ypreq_nokey *argp, ypresp_master *result,
 }
 
 
-/* Get the DateTimeModified value for a certain map database */
-static inline unsigned long
-get_dtm (const char *domain, const char *map)
-{
-  struct stat sbuf;
-  char *buf = alloca (strlen (domain) + strlen (map) + 3);
-  char *cp;
-
-  cp = stpcpy (buf, domain);
-  *cp++ = '/';
-  strcpy (cp, map);
-
-  if (stat (buf, &sbuf) < 0)
-    return time (NULL); /* We set it to the current time. */
-  else
-    return (unsigned long) sbuf.st_mtime;
-}
-
 bool_t
 ypproc_order_2_svc (ypreq_nokey *argp, ypresp_order *result,
 		    struct svc_req *rqstp)
 {
-  DB_FILE dbp;
   int valid;
 
   if (debug_flag)
@@ -1294,7 +1468,7 @@ ypproc_order_2_svc (ypreq_nokey *argp, ypresp_order *result,
       struct netconfig *nconf;
       struct netbuf *rqhost = svc_getrpccaller(rqstp->rq_xprt);
 
-      if ((nconf = getnetconfigent (rqstp->rq_xprt->xp_netid)) == NULL)
+      if ((nconf = get_netconfig (rqstp->rq_xprt->xp_netid)) == NULL)
         svcerr_systemerr (rqstp->rq_xprt);
       else
         {
@@ -1303,7 +1477,6 @@ ypproc_order_2_svc (ypreq_nokey *argp, ypresp_order *result,
                    taddr2ipstr (nconf, rqhost,
                                 namebuf6, sizeof (namebuf6)),
                    taddr2port (nconf, rqhost));
-          freenetconfigent (nconf);
 	  log_msg ("\t\tdomain = \"%s\"", argp->domain);
 	  log_msg ("\t\tmap = \"%s\"", argp->map);
 	}
@@ -1345,89 +1518,407 @@ ypproc_order_2_svc (ypreq_nokey *argp, ypresp_order *result,
       return TRUE;
     }
 
-  dbp = ypdb_open (argp->domain, argp->map);
+  result->status = dir_cache_order (argp->domain, argp->map,
+				    &result->ordernum);
 
-  if (dbp == NULL)
-    result->status = YP_NOMAP;
-  else
+  if (debug_flag)
+    log_msg ("-> Order # %u", result->ordernum);
+
+  return TRUE;
+}
+
+
+bool_t
+ypproc_maplist_2_svc (domainname *argp, ypresp_maplist *result,
+		      struct svc_req *rqstp)
+{
+  dir_maplist_t *reply;
+  int valid;
+
+  if (debug_flag)
+    {
+      struct netconfig *nconf;
+      struct netbuf *rqhost = svc_getrpccaller(rqstp->rq_xprt);
+
+      if ((nconf = get_netconfig (rqstp->rq_xprt->xp_netid)) == NULL)
+        svcerr_systemerr (rqstp->rq_xprt);
+      else
+        {
+          char namebuf6[INET6_ADDRSTRLEN];
+          log_msg ("ypproc_maplist_2(%s) from %s port %d", *argp,
+                   taddr2ipstr (nconf, rqhost,
+                                namebuf6, sizeof (namebuf6)),
+                   taddr2port (nconf, rqhost));
+        }
+    }
+
+  memset (result, 0, sizeof (ypresp_maplist));
+
+  valid = is_valid (rqstp, NULL, *argp);
+  if (valid < 1)
+    {
+      switch (valid)
+	{
+	case 0:
+	  if (debug_flag)
+	    log_msg ("\t-> Ignored (forbidden by securenets)");
+	  result->status = YP_NOMAP;
+	  break;
+	case -1:
+          if (debug_flag)
+            log_msg ("\t-> Ignored (not a valid source host)");
+          result->status = YP_NOMAP;
+	  break;
+	case -4: /* should never happen */
+	case -2: /* should never happen */
+	  result->status = YP_NOMAP;
+	  break;
+	case -3:
+          if (debug_flag)
+            log_msg ("\t-> Ignored (not a valid domain)");
+          result->status = YP_NODOM;
+	  break;
+        }
+      return TRUE;
+    }
+
+  /* The reply is sent here, it is encoded already */
+  if ((reply = dir_cache_maplist (*argp)) == NULL)
+    {
+      result->status = YP_YPERR;
+      return TRUE;
+    }
+  if (!svc_sendreply (rqstp->rq_xprt, (xdrproc_t) xdr_dir_maplist,
+		      (caddr_t) reply))
+    svcerr_systemerr (rqstp->rq_xprt);
+  dir_cache_release (reply);
+
+  return FALSE;
+}
+
+/* Size of an entry or token in the XDR encoded reply */
+#define PAGE_BYTES(len) (4 + (((len) + 3) & ~3))
+
+/* Every key is looked up like with YPPROC_MATCH, including the access
+   checks. ypproc_match_2_svc returns the value in match_buf, which is
+   copied, or in allocated memory, which the reply takes over. The
+   reply has to fit into one datagram, so the values of the keys behind
+   YPMAXPAGEBYTES are left out with the status YP_NOMORE. */
+bool_t
+ypproc_match_multi_3_svc (ypreq_match_multi *argp,
+			  ypresp_match_multi *result, struct svc_req *rqstp)
+{
+  u_int i, n = argp->keys.keys_len;
+  u_int used;
+
+  if (debug_flag)
+    log_msg ("ypproc_match_multi_3: %u keys of domain \"%s\"", n,
+	     argp->domain);
+
+  memset (result, 0, sizeof (ypresp_match_multi));
+
+  if (n == 0)
+    {
+      result->status = YP_TRUE;
+      return TRUE;
+    }
+
+  if ((result->vals.vals_val = calloc (n, sizeof (ypresp_val))) == NULL)
+    {
+      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	       __FILE__, __LINE__);
+      result->status = YP_YPERR;
+      return TRUE;
+    }
+  result->vals.vals_len = n;
+
+  /* status, count and the status and empty value of every key */
+  used = 8 + n * 8;
+
+  for (i = 0; i < n; i++)
     {
-      datum key, val;
+      ypmatch_multi_key *k = &argp->keys.keys_val[i];
+      ypresp_val *v = &result->vals.vals_val[i];
+      ypreq_key req;
+      ypresp_val val;
 
-      key.dsize = sizeof ("YP_LAST_MODIFIED") - 1;
-      key.dptr = "YP_LAST_MODIFIED";
+      if (used >= YPMAXPAGEBYTES)
+	{
+	  v->status = YP_NOMORE;
+	  continue;
+	}
+
+      req.domain = argp->domain;
+      req.map = k->map;
+      req.keydat = k->keydat;
 
-      val = ypdb_fetch (dbp, key);
-      if (val.dptr == NULL)
+      memset (&val, 0, sizeof (val));
+      /* A key of hosts.* not in the DNS cache yet is never deferred,
+	 dns_match returns YP_YPERR for it */
+      if (!ypproc_match_2_svc (&req, &val, rqstp))
 	{
-	  /* No YP_LAST_MODIFIED record in map? Use DTM timestamp.. */
-	  result->ordernum = get_dtm (argp->domain, argp->map);
+	  v->status = YP_YPERR;
+	  continue;
 	}
-      else
+
+      v->status = val.status;
+      if (val.status != YP_TRUE)
+	continue;
+
+      if (used + PAGE_BYTES (val.valdat.valdat_len) - 4 > YPMAXPAGEBYTES)
 	{
-	  char *buf = alloca (val.dsize + 1);
+	  if (val.valdat.valdat_val != match_buf)
+	    free (val.valdat.valdat_val);
+	  v->status = YP_NOMORE;
+	  used = YPMAXPAGEBYTES;
+	  continue;
+	}
+      used += PAGE_BYTES (val.valdat.valdat_len) - 4;
 
-	  memcpy (buf, val.dptr, val.dsize);
-	  buf[val.dsize] = '\0';
-	  result->ordernum = atoi (buf);
-	  ypdb_free (val.dptr);
+      if (val.valdat.valdat_val != match_buf)
+	{
+	  v->valdat = val.valdat;
+	  continue;
+	}
+      if ((v->valdat.valdat_val = malloc (val.valdat.valdat_len + 1)) == NULL)
+	{
+	  v->status = YP_YPERR;
+	  continue;
 	}
+      memcpy (v->valdat.valdat_val, val.valdat.valdat_val,
+	      val.valdat.valdat_len);
+      v->valdat.valdat_len = val.valdat.valdat_len;
+    }
 
-      result->status = YP_TRUE;
+  result->status = YP_TRUE;
+  return TRUE;
+}
+
+/* Continues the enumeration like YPPROC_NEXT behind the token, which
+   is the last key sent, but returns as many entries as fit into
+   count and maxbytes. At least one entry is returned, so a client
+   asking for too few bytes still gets through the map. Without a
+   valid token, the enumeration ends like with YPPROC_NEXT. */
+bool_t
+ypproc_next_page_3_svc (ypreq_page *argp, ypresp_page *result,
+			struct svc_req *rqstp)
+{
+  DB_FILE dbp;
+  datum dkey;
+  u_int count, maxbytes, used = 0, n = 0;
+  int valid;
+
+  if (debug_flag)
+    {
+      struct netconfig *nconf;
+      struct netbuf *rqhost = svc_getrpccaller(rqstp->rq_xprt);
+
+      if ((nconf = get_netconfig (rqstp->rq_xprt->xp_netid)) == NULL)
+        svcerr_systemerr (rqstp->rq_xprt);
+      else
+        {
+          char namebuf6[INET6_ADDRSTRLEN];
+          log_msg ("ypproc_next_page_3 from %s port %d",
+                   taddr2ipstr (nconf, rqhost,
+                                namebuf6, sizeof (namebuf6)),
+                   taddr2port (nconf, rqhost));
+	  log_msg ("\tdomainname = \"%s\"", argp->domain);
+	  log_msg ("\tmapname = \"%s\"", argp->map);
+	  log_msg ("\ttoken = \"%.*s\"", (int) argp->token.keydat_len,
+		   argp->token.keydat_val);
+	  log_msg ("\tcount = %u, maxbytes = %u", argp->count,
+		   argp->maxbytes);
+	}
+    }
+
+  memset (result, 0, sizeof (ypresp_page));
+
+  valid = is_valid (rqstp, argp->map, argp->domain);
+  if (valid < 1)
+    {
+      switch (valid)
+	{
+	case -1:
+          if (debug_flag)
+            log_msg ("\t-> Ignored (not a valid source host)");
+          result->status = YP_NOMAP;
+	  break;
+	case -2:
+          if (debug_flag)
+            log_msg ("\t-> Ignored (not a valid map name)");
+	  result->status = YP_BADARGS;
+	  break;
+	case -3:
+          if (debug_flag)
+            log_msg ("\t-> Ignored (not a valid domain)");
+          result->status = YP_NODOM;
+	  break;
+	case -4:
+	  if (debug_flag)
+	    log_msg ("\t-> Ignored (map does not exist)");
+	  result->status = YP_NOMAP;
+	  break;
+	case 0:
+	  if (debug_flag)
+	    log_msg ("\t-> Ignored (forbidden by securenets)");
+	  result->status = YP_NOMAP;
+	  break;
+        }
+      return TRUE;
+    }
+
+  count = argp->count;
+  if (count == 0 || count > YPMAXPAGE)
+    count = YPMAXPAGE;
+  maxbytes = argp->maxbytes;
+  if (maxbytes == 0 || maxbytes > YPMAXPAGEBYTES)
+    maxbytes = YPMAXPAGEBYTES;
+
+  dbp = ypdb_open (argp->domain, argp->map);
+  if (dbp == NULL)
+    {
+      result->status = YP_NOMAP;
+      return TRUE;
+    }
+
+  if ((result->entries.entries_val =
+       calloc (count, sizeof (ypmap_entry))) == NULL)
+    {
+      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	       __FILE__, __LINE__);
       ypdb_close (dbp);
+      result->status = YP_YPERR;
+      return TRUE;
+    }
+
+  if (argp->token.keydat_len == 0)
+    dkey = ypdb_first_datakey (dbp);
+  else
+    {
+      datum oldkey;
+
+      oldkey.dptr = argp->token.keydat_val;
+      oldkey.dsize = argp->token.keydat_len;
+      dkey = ypdb_nextkey (dbp, oldkey);
+    }
+
+  while (dkey.dptr != NULL && n < count)
+    {
+      datum dval, next;
+
+      if (dkey.dsize >= 3 && strncmp (dkey.dptr, "YP_", 3) == 0)
+	{
+	  next = ypdb_nextkey (dbp, dkey);
+	  ypdb_free (dkey.dptr);
+	  dkey = next;
+	  continue;
+	}
+
+      dval = ypdb_fetch (dbp, dkey);
+      /* The key is sent a second time as token */
+      if (n > 0 && used + 2 * PAGE_BYTES (dkey.dsize) +
+	  PAGE_BYTES (dval.dsize) > maxbytes)
+	{
+	  ypdb_free (dval.dptr);
+	  break;
+	}
+      used += PAGE_BYTES (dkey.dsize) + PAGE_BYTES (dval.dsize);
+
+      result->entries.entries_val[n].keydat.keydat_val = dkey.dptr;
+      result->entries.entries_val[n].keydat.keydat_len = dkey.dsize;
+      result->entries.entries_val[n].valdat.valdat_val = dval.dptr;
+      result->entries.entries_val[n].valdat.valdat_len = dval.dsize;
+      n++;
+
+      dkey = ypdb_nextkey (dbp, dkey);
+    }
+  result->entries.entries_len = n;
+
+  /* More entries follow, continue behind the last one */
+  if (dkey.dptr != NULL && n > 0)
+    {
+      keydat_t *last = &result->entries.entries_val[n - 1].keydat;
+
+      if ((result->token.keydat_val = malloc (last->keydat_len)) == NULL)
+	{
+	  log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+		   __FILE__, __LINE__);
+	  result->status = YP_YPERR;
+	}
+      else
+	{
+	  memcpy (result->token.keydat_val, last->keydat_val,
+		  last->keydat_len);
+	  result->token.keydat_len = last->keydat_len;
+	}
     }
+  ypdb_free (dkey.dptr);
+  ypdb_close (dbp);
+
+  if (result->status != YP_YPERR)
+    result->status = n > 0 ? YP_TRUE : YP_NOMORE;
 
   if (debug_flag)
-    log_msg ("-> Order # %u", result->ordernum);
+    {
+      if (result->status == YP_TRUE)
+	log_msg ("\t-> %u entries, %s", n,
+		 result->token.keydat_len ? "more follow" : "no more entries");
+      else if (result->status == YP_NOMORE)
+        log_msg ("\t-> No more entry's");
+      else
+        log_msg ("\t-> Error #%d", result->status);
+    }
 
   return TRUE;
 }
 
-
+/* Takes the changes for YPPROC_CHANGES from the journal */
 static int
-add_maplist (ypmaplist **mlhp, char *map)
+changes_next (ypchange *change, void *data)
 {
-  ypmaplist *mlp;
-#if defined(HAVE_NDBM)
-#if defined(sun) || defined(__sun__)
-  int len = strlen (map);
-
-  /* We have all maps twice: with .dir and with .pag. Ignore .pag */
-  if (len > 3 && map[len - 4] == '.' && map[len - 3] == 'p' &&
-      map[len - 2] == 'a' && map[len - 1] == 'g')
-    return 0;
-
-  if (len > 3 && map[len - 4] == '.' && map[len - 3] == 'd' &&
-      map[len - 2] == 'i' && map[len - 1] == 'r')
-    map[len - 4] = '\0';
-#else
-  int len = strlen (map);
-
-  if (len > 2 && map[len - 3] == '.' && map[len - 2] == 'd' &&
-      map[len - 1] == 'b')
-    map[len - 3] = '\0';
-#endif
-#endif
+  char *key, *val;
+  size_t klen, vlen;
+  uint32_t op;
+  int ret;
 
-  if ((mlp = malloc (sizeof (*mlp))) == NULL)
-    return -1;
+  if (change == NULL)
+    {
+      ypj_rewind (data);
+      return 0;
+    }
 
-  if ((mlp->map = strdup (map)) == NULL)
+  if ((ret = ypj_next (data, &op, &key, &klen, &val, &vlen)) <= 0)
     {
-      free (mlp);
-      return -1;
+      if (ret < 0)
+	log_msg ("ypproc_changes: journal is corrupt");
+      return ret;
     }
 
-  mlp->next = *mlhp;
-  *mlhp = mlp;
+  change->op = op == YPJ_DELETE ? YPCHANGE_DELETE : YPCHANGE_STORE;
+  change->keydat.keydat_val = key;
+  change->keydat.keydat_len = klen;
+  change->valdat.valdat_val = val;
+  change->valdat.valdat_len = vlen;
+  return 1;
+}
 
-  return 0;
+static void
+changes_release (void *data)
+{
+  ypj_close (data);
 }
 
+/* The changes are encoded directly from the mapped journal. Only the
+   journal of the current version of the map is used, it ends with
+   the order number of the map. */
 bool_t
-ypproc_maplist_2_svc (domainname *argp, ypresp_maplist *result,
+ypproc_changes_3_svc (ypreq_changes *argp, ypresp_changes *result,
 		      struct svc_req *rqstp)
 {
-  DIR *dp;
+  DB_FILE dbp;
+  ypj_file_t *j;
+  char *path;
+  unsigned int ordernum = 0;
   int valid;
 
   if (debug_flag)
@@ -1435,100 +1926,93 @@ ypproc_maplist_2_svc (domainname *argp, ypresp_maplist *result,
       struct netconfig *nconf;
       struct netbuf *rqhost = svc_getrpccaller(rqstp->rq_xprt);
 
-      if ((nconf = getnetconfigent (rqstp->rq_xprt->xp_netid)) == NULL)
+      if ((nconf = get_netconfig (rqstp->rq_xprt->xp_netid)) == NULL)
         svcerr_systemerr (rqstp->rq_xprt);
       else
         {
           char namebuf6[INET6_ADDRSTRLEN];
-          log_msg ("ypproc_maplist_2(%s) from %s port %d", *argp,
+          log_msg ("ypproc_changes_3 from %s port %d",
                    taddr2ipstr (nconf, rqhost,
                                 namebuf6, sizeof (namebuf6)),
                    taddr2port (nconf, rqhost));
-          freenetconfigent (nconf);
-        }
+	  log_msg ("\tdomainname = \"%s\"", argp->domain);
+	  log_msg ("\tmapname = \"%s\"", argp->map);
+	  log_msg ("\tordernum = %u", argp->ordernum);
+	}
     }
 
-  memset (result, 0, sizeof (ypresp_maplist));
+  memset (result, 0, sizeof (ypresp_changes));
 
-  valid = is_valid (rqstp, NULL, *argp);
+  valid = is_valid (rqstp, argp->map, argp->domain);
   if (valid < 1)
     {
       switch (valid)
 	{
-	case 0:
-	  if (debug_flag)
-	    log_msg ("\t-> Ignored (forbidden by securenets)");
-	  result->status = YP_NOMAP;
-	  break;
 	case -1:
           if (debug_flag)
             log_msg ("\t-> Ignored (not a valid source host)");
           result->status = YP_NOMAP;
 	  break;
-	case -4: /* should never happen */
-	case -2: /* should never happen */
-	  result->status = YP_NOMAP;
+	case -2:
+          if (debug_flag)
+            log_msg ("\t-> Ignored (not a valid map name)");
+	  result->status = YP_BADARGS;
 	  break;
 	case -3:
           if (debug_flag)
             log_msg ("\t-> Ignored (not a valid domain)");
           result->status = YP_NODOM;
 	  break;
+	case -4:
+	  if (debug_flag)
+	    log_msg ("\t-> Ignored (map does not exist)");
+	  result->status = YP_NOMAP;
+	  break;
+	case 0:
+	  if (debug_flag)
+	    log_msg ("\t-> Ignored (forbidden by securenets)");
+	  result->status = YP_NOMAP;
+	  break;
         }
       return TRUE;
     }
 
-  /* open domain directory */
-  dp = opendir (*argp);
-  if (dp == NULL)
+  dbp = ypdb_open (argp->domain, argp->map);
+  if (dbp == NULL)
     {
-      if (debug_flag)
-	log_msg ("opendir: %s", strerror (errno));
-
-      result->status = YP_BADDB;
+      result->status = YP_NOMAP;
+      return TRUE;
     }
-  else
+  if (!ypdb_order (dbp, &ordernum))
+    ordernum = 0;
+  ypdb_close (dbp);
+
+  result->ordernum = ordernum;
+  result->status = YP_NOMORE;
+  if (ordernum != 0 &&
+      asprintf (&path, "%s/%s%s", argp->domain, argp->map, YPJ_SUFFIX) >= 0)
     {
-      struct dirent *dep;
-
-      while ((dep = readdir (dp)) != NULL)
+      if ((j = ypj_open (path)) != NULL)
 	{
-	  /* ignore files starting with . */
-	  if (dep->d_name[0] == '.')
-	    continue;
-	  /* ignore temporary files ending with ~, created
-	     by makedbm and ypxfr if updating maps */
-	  if (dep->d_name[strlen(dep->d_name) - 1] == '~')
-	    continue;
-	  if (add_maplist (&result->list, dep->d_name) < 0)
+	  if (ypj_since (j, argp->ordernum, ordernum) == 0)
 	    {
-	      result->status = YP_YPERR;
-	      break;
+	      result->status = YP_TRUE;
+	      result->change = changes_next;
+	      result->release = changes_release;
+	      result->data = j;
 	    }
+	  else
+	    ypj_close (j);
 	}
-      closedir (dp);
-      result->status = YP_TRUE;
+      free (path);
     }
 
   if (debug_flag)
     {
       if (result->status == YP_TRUE)
-        {
-          ypmaplist *p;
-
-          p = result->list;
-          log_msg ("-> ");
-          while (p)
-            {
-              if (p->next)
-		log_msg ("   %s,", p->map);
-	      else
-		log_msg ("   %s", p->map);
-              p = p->next;
-            }
-        }
+	log_msg ("\t-> Changes from %u to %u", argp->ordernum, ordernum);
       else
-        log_msg ("\t-> Error #%d", result->status);
+	log_msg ("\t-> No changes since %u in the journal", argp->ordernum);
     }
 
   return TRUE;
@@ -1538,6 +2022,14 @@ int
 ypprog_2_freeresult (SVCXPRT *transp UNUSED,
 		     xdrproc_t xdr_result, caddr_t result)
 {
+  /* master is master_buf of ypproc_master_2_svc */
+  if (xdr_result == (xdrproc_t) xdr_ypresp_master)
+    return 1;
+  /* value is match_buf of ypproc_match_2_svc */
+  if (xdr_result == (xdrproc_t) xdr_ypresp_val &&
+      ((ypresp_val *) result)->valdat.valdat_val == match_buf)
+    return 1;
+
   xdr_free (xdr_result, result);
 
   return 1;
@@ -0,0 +1,78 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "log_msg.h"
+#include "stats.h"
+
+/* Several parts of ypserv count, how efficient they are. The signal
+   handler of SIGUSR2 only sets stats_requested. The main loop blocks
+   the signal, except while it waits for events with ppoll or
+   epoll_pwait, so the wait is interrupted and the counters are
+   written with log_msg afterwards, even if no request arrives. */
+
+#define STATS_MAX_FUNCS 16
+
+volatile sig_atomic_t stats_requested = 0;
+
+static stats_func_t stats_funcs[STATS_MAX_FUNCS];
+static int nr_stats_funcs = 0;
+
+/* Must be called before the first request is served */
+void
+stats_register (stats_func_t func)
+{
+  int i;
+
+  for (i = 0; i < nr_stats_funcs; i++)
+    if (stats_funcs[i] == func)
+      return;
+
+  if (nr_stats_funcs < STATS_MAX_FUNCS)
+    stats_funcs[nr_stats_funcs++] = func;
+}
+
+/* Block SIGUSR2, waitmask gets the signal mask to wait with */
+void
+stats_block_signal (sigset_t *waitmask)
+{
+  sigset_t set;
+
+  sigemptyset (&set);
+  sigaddset (&set, SIGUSR2);
+  pthread_sigmask (SIG_BLOCK, &set, waitmask);
+  sigdelset (waitmask, SIGUSR2);
+}
+
+void
+stats_dump (void)
+{
+  int i;
+
+  /* Only one thread should write the statistics */
+  if (!__atomic_exchange_n (&stats_requested, 0, __ATOMIC_SEQ_CST))
+    return;
+
+  log_msg ("ypserv statistics:");
+  for (i = 0; i < nr_stats_funcs; i++)
+    (*stats_funcs[i]) ();
+}
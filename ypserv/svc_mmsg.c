@@ -0,0 +1,432 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <rpc/rpc.h>
+#include <rpc/svc_auth.h>
+#include <rpc/svc_mt.h>
+
+#include "log_msg.h"
+#include "ypserv_conf.h"
+#include "stats.h"
+#include "svc_mmsg.h"
+
+/* A replacement for svc_dg_create(). During a login storm, clients
+   send thousands of YPPROC_MATCH datagrams per second, and svc_dg
+   needs one recvmsg and one sendmsg for every one of them.
+   This transport reads up to "udp_batch" datagrams with a single
+   recvmmsg call. svc_getreq_common() calls our xp_recv as long as
+   xp_stat reports XPRT_MOREREQS, the replies are collected and sent
+   with one sendmmsg call after the last request of the batch was
+   processed. Every transport is only used by one thread. */
+
+/* Room for IP_PKTINFO or IPV6_PKTINFO */
+#define MMSG_CMSGSIZE 64
+
+typedef struct mmsg_slot
+{
+  struct sockaddr_storage addr;
+  struct iovec in_iov;
+  struct iovec out_iov;
+  size_t out_len;
+  union
+  {
+    struct cmsghdr align;
+    char buf[MMSG_CMSGSIZE];
+  } cmsg;
+} mmsg_slot_t;
+
+typedef struct mmsg_data
+{
+  SVCXPRT_EXT ext;
+  struct sockaddr_storage laddr;
+  XDR xdr_in;			/* decodes the current request */
+  u_int32_t xid;
+  pid_t pid;
+  u_int batch;			/* size of the arrays */
+  u_int count;			/* datagrams read by recvmmsg */
+  u_int next;			/* next datagram to process */
+  int cur;			/* datagram currently processed */
+  char *in_buf;
+  char *out_buf;
+  mmsg_slot_t *slots;
+  struct mmsghdr *in_msgs;
+  struct mmsghdr *out_msgs;
+} mmsg_data_t;
+
+/* Counters, shared by all transports */
+static unsigned long stat_batches = 0;
+static unsigned long stat_requests = 0;
+static unsigned long stat_full = 0;
+static unsigned long stat_sends = 0;
+static unsigned long stat_replies = 0;
+
+static void
+mmsg_stats (void)
+{
+  unsigned long batches = __atomic_load_n (&stat_batches, __ATOMIC_RELAXED);
+  unsigned long requests = __atomic_load_n (&stat_requests, __ATOMIC_RELAXED);
+  unsigned long sends = __atomic_load_n (&stat_sends, __ATOMIC_RELAXED);
+  unsigned long replies = __atomic_load_n (&stat_replies, __ATOMIC_RELAXED);
+
+  log_msg ("  udp_batch: %lu requests in %lu recvmmsg calls (%.2f per call, "
+	   "%lu full batches)", requests, batches,
+	   batches ? (double) requests / batches : 0.0,
+	   __atomic_load_n (&stat_full, __ATOMIC_RELAXED));
+  log_msg ("  udp_batch: %lu replies in %lu sendmmsg calls (%.2f per call)",
+	   replies, sends, sends ? (double) replies / sends : 0.0);
+}
+
+/* Reply from the address the request was sent to, like svc_dg does.
+   For IPv4 the kernel should choose the interface. */
+static void
+mmsg_fix_pktinfo (struct msghdr *mh)
+{
+  struct cmsghdr *cmsg;
+
+  for (cmsg = CMSG_FIRSTHDR (mh); cmsg != NULL; cmsg = CMSG_NXTHDR (mh, cmsg))
+    if (cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_PKTINFO)
+      {
+	struct in_pktinfo *pkti = (struct in_pktinfo *) CMSG_DATA (cmsg);
+
+	pkti->ipi_ifindex = 0;
+	pkti->ipi_spec_dst = pkti->ipi_addr;
+	return;
+      }
+    else if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO)
+      return;
+
+  mh->msg_control = NULL;
+  mh->msg_controllen = 0;
+}
+
+static void
+mmsg_flush (mmsg_data_t *md, int fd)
+{
+  u_int i, n = 0;
+
+  for (i = 0; i < md->count; i++)
+    {
+      mmsg_slot_t *slot = &md->slots[i];
+      struct msghdr *mh;
+
+      if (slot->out_len == 0)
+	continue;
+
+      mh = &md->out_msgs[n].msg_hdr;
+      memset (mh, 0, sizeof (*mh));
+      slot->out_iov.iov_len = slot->out_len;
+      mh->msg_name = &slot->addr;
+      mh->msg_namelen = md->in_msgs[i].msg_hdr.msg_namelen;
+      mh->msg_iov = &slot->out_iov;
+      mh->msg_iovlen = 1;
+      mh->msg_control = slot->cmsg.buf;
+      mh->msg_controllen = md->in_msgs[i].msg_hdr.msg_controllen;
+      mmsg_fix_pktinfo (mh);
+      slot->out_len = 0;
+      n++;
+    }
+
+  i = 0;
+  while (i < n)
+    {
+      int r = sendmmsg (fd, &md->out_msgs[i], n - i, 0);
+
+      if (r < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  /* Clients will retry */
+	  if (debug_flag)
+	    log_msg ("sendmmsg failed: %s", strerror (errno));
+	  break;
+	}
+      __atomic_add_fetch (&stat_sends, 1, __ATOMIC_RELAXED);
+      __atomic_add_fetch (&stat_replies, r, __ATOMIC_RELAXED);
+      i += r;
+    }
+}
+
+static int
+mmsg_fill (mmsg_data_t *md, int fd)
+{
+  u_int i;
+  int n;
+
+  for (i = 0; i < md->batch; i++)
+    {
+      struct msghdr *mh = &md->in_msgs[i].msg_hdr;
+
+      mh->msg_name = &md->slots[i].addr;
+      mh->msg_namelen = sizeof (md->slots[i].addr);
+      mh->msg_iov = &md->slots[i].in_iov;
+      mh->msg_iovlen = 1;
+      mh->msg_control = md->slots[i].cmsg.buf;
+      mh->msg_controllen = sizeof (md->slots[i].cmsg.buf);
+      mh->msg_flags = 0;
+      md->slots[i].out_len = 0;
+    }
+
+  do
+    n = recvmmsg (fd, md->in_msgs, md->batch, MSG_DONTWAIT, NULL);
+  while (n < 0 && errno == EINTR);
+
+  if (n <= 0)
+    return 0;
+
+  __atomic_add_fetch (&stat_batches, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch (&stat_requests, n, __ATOMIC_RELAXED);
+  if ((u_int) n == md->batch)
+    __atomic_add_fetch (&stat_full, 1, __ATOMIC_RELAXED);
+
+  md->count = n;
+  md->next = 0;
+  return n;
+}
+
+static bool_t
+mmsg_recv (SVCXPRT *xprt, struct rpc_msg *msg)
+{
+  mmsg_data_t *md = xprt->xp_p1;
+  mmsg_slot_t *slot;
+  u_int len;
+
+  if (md->next >= md->count && mmsg_fill (md, xprt->xp_fd) == 0)
+    return FALSE;
+
+  md->cur = md->next++;
+  slot = &md->slots[md->cur];
+  len = md->in_msgs[md->cur].msg_len;
+
+  if (len < 4 * sizeof (u_int32_t))
+    return FALSE;
+
+  xdrmem_create (&md->xdr_in, slot->in_iov.iov_base, len, XDR_DECODE);
+  if (!xdr_callmsg (&md->xdr_in, msg))
+    return FALSE;
+  md->xid = msg->rm_xid;
+
+  xprt->xp_rtaddr.buf = &slot->addr;
+  xprt->xp_rtaddr.len = md->in_msgs[md->cur].msg_hdr.msg_namelen;
+  xprt->xp_addrlen = xprt->xp_rtaddr.len;
+  if (xprt->xp_rtaddr.len <= sizeof (xprt->xp_raddr))
+    memcpy (&xprt->xp_raddr, &slot->addr, xprt->xp_rtaddr.len);
+
+  return TRUE;
+}
+
+static enum xprt_stat
+mmsg_stat (SVCXPRT *xprt)
+{
+  mmsg_data_t *md = xprt->xp_p1;
+
+  if (md->next < md->count)
+    return XPRT_MOREREQS;
+
+  if (md->count > 0)
+    {
+      mmsg_flush (md, xprt->xp_fd);
+      md->count = md->next = 0;
+    }
+  return XPRT_IDLE;
+}
+
+static bool_t
+mmsg_getargs (SVCXPRT *xprt, xdrproc_t xdr_args, void *args_ptr)
+{
+  mmsg_data_t *md = xprt->xp_p1;
+
+  return (*xdr_args) (&md->xdr_in, args_ptr);
+}
+
+static bool_t
+mmsg_freeargs (SVCXPRT *xprt __attribute__ ((unused)), xdrproc_t xdr_args,
+	       void *args_ptr)
+{
+  XDR xdrs;
+
+  xdrs.x_op = XDR_FREE;
+  return (*xdr_args) (&xdrs, args_ptr);
+}
+
+static bool_t
+mmsg_reply (SVCXPRT *xprt, struct rpc_msg *msg)
+{
+  mmsg_data_t *md = xprt->xp_p1;
+  mmsg_slot_t *slot = &md->slots[md->cur];
+  XDR xdrs;
+
+  msg->rm_xid = md->xid;
+  xdrmem_create (&xdrs, slot->out_iov.iov_base, UDPMSGSIZE, XDR_ENCODE);
+  if (!xdr_replymsg (&xdrs, msg))
+    {
+      XDR_DESTROY (&xdrs);
+      return FALSE;
+    }
+  slot->out_len = xdr_getpos (&xdrs);
+  XDR_DESTROY (&xdrs);
+
+  /* A forked child (ypproc_all) exits before the batch is sent */
+  if (getpid () != md->pid)
+    {
+      if (sendto (xprt->xp_fd, slot->out_iov.iov_base, slot->out_len, 0,
+		  (struct sockaddr *) &slot->addr,
+		  md->in_msgs[md->cur].msg_hdr.msg_namelen) < 0)
+	return FALSE;
+      slot->out_len = 0;
+    }
+
+  return TRUE;
+}
+
+static void
+mmsg_destroy (SVCXPRT *xprt)
+{
+  mmsg_data_t *md = xprt->xp_p1;
+
+  xprt_unregister (xprt);
+  close (xprt->xp_fd);
+  free (md->in_buf);
+  free (md->out_buf);
+  free (md->slots);
+  free (md->in_msgs);
+  free (md->out_msgs);
+  free (md);
+  if (xprt->xp_netid)
+    free (xprt->xp_netid);
+  free (xprt);
+}
+
+static bool_t
+mmsg_control (SVCXPRT *xprt __attribute__ ((unused)),
+	      const u_int rq __attribute__ ((unused)),
+	      void *in __attribute__ ((unused)))
+{
+  return FALSE;
+}
+
+static const struct xp_ops mmsg_ops = {
+  mmsg_recv, mmsg_stat, mmsg_getargs, mmsg_reply, mmsg_freeargs,
+  mmsg_destroy
+};
+
+static const struct xp_ops2 mmsg_ops2 = {
+  mmsg_control
+};
+
+SVCXPRT *
+svc_mmsg_create (int sock, u_int batch)
+{
+  SVCXPRT *xprt;
+  mmsg_data_t *md;
+  socklen_t len;
+  u_int i;
+  int on = 1;
+
+  if ((xprt = calloc (1, sizeof (SVCXPRT))) == NULL ||
+      (md = calloc (1, sizeof (mmsg_data_t))) == NULL)
+    {
+      free (xprt);
+      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	       __FILE__, __LINE__);
+      return NULL;
+    }
+
+  md->batch = batch;
+  md->pid = getpid ();
+  md->in_buf = malloc (batch * UDPMSGSIZE);
+  md->out_buf = malloc (batch * UDPMSGSIZE);
+  md->slots = calloc (batch, sizeof (mmsg_slot_t));
+  md->in_msgs = calloc (batch, sizeof (struct mmsghdr));
+  md->out_msgs = calloc (batch, sizeof (struct mmsghdr));
+  if (md->in_buf == NULL || md->out_buf == NULL || md->slots == NULL ||
+      md->in_msgs == NULL || md->out_msgs == NULL)
+    {
+      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	       __FILE__, __LINE__);
+      goto fail;
+    }
+  for (i = 0; i < batch; i++)
+    {
+      md->slots[i].in_iov.iov_base = md->in_buf + i * UDPMSGSIZE;
+      md->slots[i].in_iov.iov_len = UDPMSGSIZE;
+      md->slots[i].out_iov.iov_base = md->out_buf + i * UDPMSGSIZE;
+    }
+
+  len = sizeof (md->laddr);
+  if (getsockname (sock, (struct sockaddr *) &md->laddr, &len) < 0)
+    {
+      log_msg ("svc_mmsg_create: getsockname failed: %s", strerror (errno));
+      goto fail;
+    }
+
+  /* We need the destination address of the request for the reply */
+  if (md->laddr.ss_family == AF_INET)
+    setsockopt (sock, SOL_IP, IP_PKTINFO, &on, sizeof (on));
+  else if (md->laddr.ss_family == AF_INET6)
+    setsockopt (sock, SOL_IPV6, IPV6_RECVPKTINFO, &on, sizeof (on));
+
+  xprt->xp_fd = sock;
+  if (md->laddr.ss_family == AF_INET)
+    xprt->xp_port = ntohs (((struct sockaddr_in *) &md->laddr)->sin_port);
+  else if (md->laddr.ss_family == AF_INET6)
+    xprt->xp_port = ntohs (((struct sockaddr_in6 *) &md->laddr)->sin6_port);
+  xprt->xp_ops = &mmsg_ops;
+  xprt->xp_ops2 = &mmsg_ops2;
+  xprt->xp_ltaddr.buf = &md->laddr;
+  xprt->xp_ltaddr.len = len;
+  xprt->xp_ltaddr.maxlen = sizeof (md->laddr);
+  xprt->xp_rtaddr.maxlen = sizeof (struct sockaddr_storage);
+  xprt->xp_p1 = md;
+  xprt->xp_p3 = &md->ext;
+
+  stats_register (mmsg_stats);
+  xprt_register (xprt);
+
+  return xprt;
+
+ fail:
+  free (md->in_buf);
+  free (md->out_buf);
+  free (md->slots);
+  free (md->in_msgs);
+  free (md->out_msgs);
+  free (md);
+  free (xprt);
+  return NULL;
+}
+
+/* Store the transaction id of the request currently processed in
+   xid. Returns 0 if xprt was not created by svc_mmsg_create. */
+int
+svc_mmsg_xid (SVCXPRT *xprt, u_int32_t *xid)
+{
+  if (xprt->xp_ops != &mmsg_ops)
+    return 0;
+
+  *xid = ((mmsg_data_t *) xprt->xp_p1)->xid;
+  return 1;
+}
@@ -0,0 +1,25 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifndef __SVC_MMSG_H__
+#define __SVC_MMSG_H__
+
+#include <rpc/rpc.h>
+
+extern SVCXPRT *svc_mmsg_create (int sock, u_int batch);
+extern int svc_mmsg_xid (SVCXPRT *xprt, u_int32_t *xid);
+
+#endif
@@ -0,0 +1,256 @@
+/* Copyright (c) 2026 The ypserv contributors
+
+   The YP Server is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   version 2 as published by the Free Software Foundation.
+
+   The YP Server is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with the YP Server; see the file COPYING. If
+   not, write to the Free Software Foundation, Inc., 51 Franklin Street,
+   Suite 500, Boston, MA 02110-1335, USA. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <poll.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/select.h>
+#include <rpc/rpc.h>
+
+#include "log_msg.h"
+#include "ypserv_conf.h"
+#include "svc_mmsg.h"
+#include "stats.h"
+#include "workers.h"
+
+/* With "threads: N" in ypserv.conf, N worker threads answer UDP
+   requests in parallel to the main thread. Every worker owns a
+   dup() of each UDP socket with its own svc_dg transport, so the
+   receive buffer and the reply state are never shared. The kernel
+   delivers every datagram to exactly one reader. TCP connections
+   are still served by the main thread. */
+
+#define WORKER_MAX_FDS 8
+
+typedef struct worker
+{
+  pthread_t tid;
+  int nfds;
+  struct pollfd fds[WORKER_MAX_FDS];
+} worker_t;
+
+static worker_t *workers = NULL;
+static int nr_workers = 0;
+static fd_set worker_fdset;
+
+int
+workers_add_xprt (int sock, const char *netid)
+{
+  int i, flags;
+
+  if (worker_threads <= 0)
+    return 0;
+
+#if defined(HAVE_NDBM)
+  /* dbm_fetch returns a pointer into the handle, which is reused
+     by the next thread. */
+  if (nr_workers == 0)
+    log_msg ("threads: not supported with NDBM, ignoring option");
+  worker_threads = 0;
+  return 0;
+#endif
+
+  if (workers == NULL)
+    {
+      if ((workers = calloc (worker_threads, sizeof (worker_t))) == NULL)
+	{
+	  log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+		   __FILE__, __LINE__);
+	  return -1;
+	}
+      nr_workers = worker_threads;
+      FD_ZERO (&worker_fdset);
+    }
+
+  /* Several threads poll the same socket, the ones losing the race
+     must not block in recvmsg. */
+  flags = fcntl (sock, F_GETFL);
+  if (flags == -1 || fcntl (sock, F_SETFL, flags | O_NONBLOCK) == -1)
+    {
+      log_msg ("Cannot set O_NONBLOCK: %s", strerror (errno));
+      return -1;
+    }
+
+  for (i = 0; i < nr_workers; i++)
+    {
+      worker_t *w = &workers[i];
+      SVCXPRT *xprt;
+      int fd;
+
+      if (w->nfds >= WORKER_MAX_FDS)
+	continue;
+
+      if ((fd = dup (sock)) < 0)
+	{
+	  log_msg ("Cannot dup socket: %s", strerror (errno));
+	  return -1;
+	}
+      if (fd >= FD_SETSIZE)
+	{
+	  log_msg ("Socket %d for worker thread too large", fd);
+	  close (fd);
+	  return -1;
+	}
+
+      /* The program is registered already, svc_getreq_common finds
+	 the dispatch function by program and version number. */
+      if (udp_batch > 0)
+	xprt = svc_mmsg_create (fd, udp_batch);
+      else
+	xprt = svc_dg_create (fd, 0, 0);
+      if (xprt == NULL)
+	{
+	  log_msg ("cannot create UDP handle for worker thread");
+	  close (fd);
+	  return -1;
+	}
+      /* Normally set by svc_reg, is_valid needs it */
+      xprt->xp_netid = strdup (netid);
+
+      FD_SET (fd, &worker_fdset);
+      w->fds[w->nfds].fd = fd;
+      w->fds[w->nfds].events = POLLIN;
+      w->nfds++;
+    }
+
+  return 0;
+}
+
+static void *
+worker_run (void *arg)
+{
+  worker_t *w = arg;
+
+  for (;;)
+    {
+      int i, n;
+
+      n = poll (w->fds, w->nfds, -1);
+      if (n < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  log_msg ("worker thread: poll failed: %s", strerror (errno));
+	  break;
+	}
+
+      for (i = 0; i < w->nfds && n > 0; i++)
+	if (w->fds[i].revents)
+	  {
+	    --n;
+	    svc_getreq_common (w->fds[i].fd);
+	  }
+    }
+
+  return NULL;
+}
+
+int
+workers_own_fd (int fd)
+{
+  return nr_workers > 0 && fd >= 0 && fd < FD_SETSIZE &&
+    FD_ISSET (fd, &worker_fdset);
+}
+
+/* Start the worker threads. Signals are handled by the main thread
+   only. */
+void
+workers_start (void)
+{
+  sigset_t set, oldset;
+  int i, started = 0;
+
+  if (nr_workers == 0)
+    return;
+
+  sigfillset (&set);
+  pthread_sigmask (SIG_BLOCK, &set, &oldset);
+  for (i = 0; i < nr_workers; i++)
+    {
+      if (workers[i].nfds == 0)
+	continue;
+      if (pthread_create (&workers[i].tid, NULL, worker_run, &workers[i]) != 0)
+	log_msg ("Cannot create worker thread: %s", strerror (errno));
+      else
+	++started;
+    }
+  pthread_sigmask (SIG_SETMASK, &oldset, NULL);
+
+  if (debug_flag)
+    log_msg ("Started %d worker threads", started);
+}
+
+/* Replacement for svc_run(). Start the worker threads, if there are
+   any, and let the main thread poll all transports which are not
+   owned by a worker. Unlike svc_run(), SIGUSR2 interrupts the wait,
+   see stats_block_signal. */
+void
+workers_run (void)
+{
+  sigset_t waitmask;
+  int i;
+
+  workers_start ();
+  stats_block_signal (&waitmask);
+
+  for (;;)
+    {
+      struct pollfd *fds;
+      int n, max_pollfd = svc_max_pollfd;
+
+      if ((fds = malloc (sizeof (struct pollfd) * (max_pollfd + 1))) == NULL)
+	{
+	  log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+		   __FILE__, __LINE__);
+	  return;
+	}
+
+      for (i = 0; i < max_pollfd; i++)
+	{
+	  fds[i].fd = svc_pollfd[i].fd;
+	  fds[i].events = svc_pollfd[i].events;
+	  fds[i].revents = 0;
+	  if (workers_own_fd (fds[i].fd))
+	    fds[i].fd = -1;
+	}
+
+      n = ppoll (fds, max_pollfd, NULL, &waitmask);
+      if (n < 0)
+	{
+	  free (fds);
+	  if (errno == EINTR)
+	    {
+	      if (stats_requested)
+		stats_dump ();
+	      continue;
+	    }
+	  log_msg ("workers_run: poll failed: %s", strerror (errno));
+	  return;
+	}
+      if (n > 0)
+	svc_getreq_poll (fds, n);
+      free (fds);
+    }
+}
@@ -32,6 +32,7 @@
 #include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/prctl.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <rpc/rpc.h>
@@ -39,10 +40,22 @@
 #include <rpc/nettype.h>
 
 #include "yp.h"
+#include "yp_db.h"
 #include "access.h"
 #include "log_msg.h"
 #include "ypserv_conf.h"
 #include "pidfile.h"
+#include "workers.h"
+#include "evloop.h"
+#include "svc_mmsg.h"
+#include "stats.h"
+#include "fastpath.h"
+#include "match_cache.h"
+#include "all_cache.h"
+#include "preload.h"
+#include "dns.h"
+#include "dir_cache.h"
+#include "bloom.h"
 
 #define _YPSERV_PIDFILE _PATH_VARRUN"ypserv.pid"
 
@@ -52,6 +65,26 @@
 
 static char *path_ypdb = YPMAPDIR;
 static int foreground_flag = 0;
+static pid_t main_pid;
+
+/* The sockets created for every netconfig entry. With "processes: N"
+   in ypserv.conf, every worker process creates its own sockets bound
+   to the same ports with SO_REUSEPORT, and the kernel distributes
+   the requests between them. */
+typedef struct transport
+{
+  char *netid;
+  sa_family_t family;
+  int type;
+  int proto;
+  int sock;
+} transport_t;
+
+static transport_t *transports = NULL;
+static int nr_transports = 0;
+
+static pid_t *worker_pids = NULL;
+static int nr_worker_pids = 0;
 
 static void
 ypprog_2 (struct svc_req *rqstp, register SVCXPRT * transp)
@@ -67,6 +100,9 @@ ypprog_2 (struct svc_req *rqstp, register SVCXPRT * transp)
     ypreq_nokey ypproc_master_2_arg;
     ypreq_nokey ypproc_order_2_arg;
     domainname ypproc_maplist_2_arg;
+    ypreq_match_multi ypproc_match_multi_3_arg;
+    ypreq_page ypproc_next_page_3_arg;
+    ypreq_changes ypproc_changes_3_arg;
   } argument;
   union {
     bool_t ypproc_domain_2_res;
@@ -79,11 +115,18 @@ ypprog_2 (struct svc_req *rqstp, register SVCXPRT * transp)
     ypresp_master ypproc_master_2_res;
     ypresp_order ypproc_order_2_res;
     ypresp_maplist ypproc_maplist_2_res;
+    ypresp_match_multi ypproc_match_multi_3_res;
+    ypresp_page ypproc_next_page_3_res;
+    ypresp_changes ypproc_changes_3_res;
   } result;
   bool_t retval;
   xdrproc_t _xdr_argument, _xdr_result;
   bool_t (*local) (char *, void *, struct svc_req *);
 
+  /* MATCH, ORDER and MASTER without malloc */
+  if (ypprog_2_fast (rqstp, transp))
+    return;
+
   switch (rqstp->rq_proc)
     {
     case YPPROC_NULL:
@@ -175,6 +218,44 @@ ypprog_2 (struct svc_req *rqstp, register SVCXPRT * transp)
 	(bool_t (*)(char *, void *, struct svc_req *)) ypproc_maplist_2_svc;
       break;
 
+    case YPPROC_MATCH_MULTI:
+      if (rqstp->rq_vers != YPVERS_MULTI)
+	{
+	  svcerr_noproc (transp);
+	  return;
+	}
+      _xdr_argument = (xdrproc_t) xdr_ypreq_match_multi;
+      _xdr_result = (xdrproc_t) xdr_ypresp_match_multi;
+      local =
+	(bool_t (*)(char *, void *, struct svc_req *))
+	ypproc_match_multi_3_svc;
+      break;
+
+    case YPPROC_NEXT_PAGE:
+      if (rqstp->rq_vers != YPVERS_MULTI)
+	{
+	  svcerr_noproc (transp);
+	  return;
+	}
+      _xdr_argument = (xdrproc_t) xdr_ypreq_page;
+      _xdr_result = (xdrproc_t) xdr_ypresp_page;
+      local =
+	(bool_t (*)(char *, void *, struct svc_req *))
+	ypproc_next_page_3_svc;
+      break;
+
+    case YPPROC_CHANGES:
+      if (rqstp->rq_vers != YPVERS_MULTI)
+	{
+	  svcerr_noproc (transp);
+	  return;
+	}
+      _xdr_argument = (xdrproc_t) xdr_ypreq_changes;
+      _xdr_result = (xdrproc_t) xdr_ypresp_changes;
+      local =
+	(bool_t (*)(char *, void *, struct svc_req *)) ypproc_changes_3_svc;
+      break;
+
     default:
       svcerr_noproc (transp);
       return;
@@ -251,13 +332,33 @@ sig_usr1 (int sig UNUSED)
   errno = save_errno;
 }
 
+/* SIGUSR2: the main loop writes the statistics. The main process
+   forwards the signal to the worker processes. */
+static void
+sig_usr2 (int sig UNUSED)
+{
+  int save_errno = errno;
+  int i;
+
+  stats_requested = 1;
+  if (getpid () == main_pid)
+    for (i = 0; i < nr_worker_pids; i++)
+      kill (worker_pids[i], SIGUSR2);
+  errno = save_errno;
+}
+
 /* Clean up if we quit the program. */
 static void
 sig_quit (int sig UNUSED)
 {
-  rpcb_unset (YPPROG, YPVERS, NULL);
-  rpcb_unset (YPPROG, YPOLDVERS, NULL);
-  unlink (_YPSERV_PIDFILE);
+  /* Worker processes and forked children don't own the registration */
+  if (getpid () == main_pid)
+    {
+      rpcb_unset (YPPROG, YPVERS_MULTI, NULL);
+      rpcb_unset (YPPROG, YPVERS, NULL);
+      rpcb_unset (YPPROG, YPOLDVERS, NULL);
+      unlink (_YPSERV_PIDFILE);
+    }
 
   exit (0);
 }
@@ -273,6 +374,251 @@ sig_child (int sig UNUSED)
   errno = save_errno;
 }
 
+/* Create and bind a socket for nconf. Returns -1 if this transport
+   should be skipped, -2 on fatal errors. */
+static int
+create_socket (struct netconfig *nconf, sa_family_t family, int type,
+	       int proto, int port)
+{
+  struct sockaddr *sa;
+  struct sockaddr_in sin;
+  struct sockaddr_in6 sin6;
+  int sock;
+
+  if ((sock = socket (family, type, proto)) < 0)
+    {
+      log_msg ("Cannot create socket for %s,%s: %s",
+	       nconf->nc_protofmly, nconf->nc_proto,
+	       strerror (errno));
+      return -1;
+    }
+
+  if (family == AF_INET6)
+    {
+      /* Disallow v4-in-v6 to allow host-based access checks */
+      int i = 1;
+
+      if (setsockopt (sock, IPPROTO_IPV6, IPV6_V6ONLY,
+		      &i, sizeof(i)) == -1)
+	{
+	  log_msg ("ERROR: cannot disable v4-in-v6 on %s6 socket",
+		   nconf->nc_proto);
+	  close (sock);
+	  return -2;
+	}
+    }
+
+  if (worker_processes > 1)
+    {
+      int i = 1;
+
+      if (setsockopt (sock, SOL_SOCKET, SO_REUSEPORT, &i, sizeof (i)) == -1)
+	{
+	  log_msg ("ERROR: cannot set SO_REUSEPORT on %s,%s socket: %s",
+		   nconf->nc_protofmly, nconf->nc_proto, strerror (errno));
+	  close (sock);
+	  return -2;
+	}
+    }
+
+  switch (family)
+    {
+    case AF_INET:
+      memset (&sin, 0, sizeof(sin));
+      sin.sin_family = AF_INET;
+      if (port > 0)
+	sin.sin_port = htons (port);
+      sa = (struct sockaddr *)(void *)&sin;
+      break;
+    case AF_INET6:
+      memset (&sin6, 0, sizeof (sin6));
+      sin6.sin6_family = AF_INET6;
+      if (port > 0)
+	sin6.sin6_port = htons (port);
+      sa = (struct sockaddr *)(void *)&sin6;
+      break;
+    default:
+      log_msg ("Unsupported address family %d", family);
+      close (sock);
+      return -2;
+    }
+
+  if (bindresvport_sa (sock, sa) == -1)
+    {
+      if (port > 0)
+	log_msg ("Cannot bind to reserved port %d (%s)",
+		 port, strerror (errno));
+      else
+	log_msg ("bindresvport failed: %s",
+		 strerror (errno));
+      close (sock);
+      return -2;
+    }
+
+  return sock;
+}
+
+static int
+add_transport (struct netconfig *nconf, sa_family_t family, int type,
+	       int proto, int sock)
+{
+  transport_t *tmp;
+
+  tmp = realloc (transports, (nr_transports + 1) * sizeof (transport_t));
+  if (tmp == NULL)
+    {
+      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	       __FILE__, __LINE__);
+      return -1;
+    }
+  transports = tmp;
+  transports[nr_transports].netid = strdup (nconf->nc_netid);
+  transports[nr_transports].family = family;
+  transports[nr_transports].type = type;
+  transports[nr_transports].proto = proto;
+  transports[nr_transports].sock = sock;
+  nr_transports++;
+
+  return 0;
+}
+
+/* Create the RPC transport for t and register the program. If nconf
+   is NULL, the program is only registered with the RPC library and
+   not with rpcbind. Returns 1 if the program could be registered. */
+static int
+create_transport (transport_t *t, struct netconfig *nconf)
+{
+  SVCXPRT *xprt;
+  int registered = 0;
+
+  if (t->type == SOCK_STREAM)
+    {
+      listen (t->sock, SOMAXCONN);
+      if (epoll_flag)
+	xprt = evloop_create_listener (t->sock, ypprog_2);
+      else
+	xprt = svc_vc_create (t->sock, 0, 0);
+    }
+  else if (udp_batch > 0)
+    xprt = svc_mmsg_create (t->sock, udp_batch);
+  else
+    xprt = svc_dg_create (t->sock, 0, 0);
+
+  if (xprt == NULL)
+    {
+      log_msg ("terminating: cannot create rpcbind handle");
+      exit (1);
+    }
+  if (xprt->xp_netid == NULL)
+    xprt->xp_netid = strdup (t->netid);
+
+  if (nconf)
+    rpcb_unset (YPPROG, YPVERS, nconf);
+  if (!svc_reg (xprt, YPPROG, YPVERS, ypprog_2, nconf))
+    {
+      log_msg ("unable to register (YPPROG, 2) for %s.", t->netid);
+      return 0;
+    }
+  else
+    registered = 1;
+
+  if (nconf)
+    rpcb_unset (YPPROG, YPVERS_MULTI, nconf);
+  if (!svc_reg (xprt, YPPROG, YPVERS_MULTI, ypprog_2, nconf))
+    log_msg ("unable to register (YPPROG, 3) for %s.", t->netid);
+
+  if (t->type == SOCK_DGRAM && workers_add_xprt (t->sock, t->netid) < 0)
+    log_msg ("unable to create worker transports for %s.", t->netid);
+
+  if (t->family == AF_INET)
+    {
+      if (nconf)
+	rpcb_unset (YPPROG, YPVERS_ORIG, nconf);
+      if (!svc_reg (xprt, YPPROG, YPVERS_ORIG,
+		    ypprog_2, nconf))
+	log_msg ("unable to register (YPPROG, 1) [%s]", t->netid);
+    }
+
+  return registered;
+}
+
+/* Fork worker_processes - 1 additional processes. Every one replaces
+   the inherited sockets with own ones bound to the same port. Only
+   the pages of the map files are shared, the caches are created by
+   every process after the fork and need their memory in each one. */
+static void
+start_processes (void)
+{
+  int i, t;
+
+  if ((worker_pids = calloc (worker_processes, sizeof (pid_t))) == NULL)
+    {
+      log_msg ("ERROR: could not allocate enough memory! [%s|%d]",
+	       __FILE__, __LINE__);
+      return;
+    }
+
+  for (i = 1; i < worker_processes; i++)
+    {
+      pid_t pid = fork ();
+
+      if (pid < 0)
+	{
+	  log_msg ("Cannot fork worker process: %s", strerror (errno));
+	  return;
+	}
+      if (pid > 0)
+	{
+	  worker_pids[nr_worker_pids++] = pid;
+	  continue;
+	}
+
+      /* Child: don't survive the main process */
+      nr_worker_pids = 0;
+      prctl (PR_SET_PDEATHSIG, SIGTERM);
+      if (getppid () != main_pid)
+	_exit (0);
+
+      for (t = 0; t < nr_transports; t++)
+	{
+	  struct netconfig *nconf;
+	  struct sockaddr_storage ss;
+	  socklen_t len = sizeof (ss);
+	  int port, sock;
+
+	  if (getsockname (transports[t].sock, (struct sockaddr *) &ss,
+			   &len) < 0)
+	    {
+	      log_msg ("getsockname failed: %s", strerror (errno));
+	      _exit (1);
+	    }
+	  if (ss.ss_family == AF_INET6)
+	    port = ntohs (((struct sockaddr_in6 *) &ss)->sin6_port);
+	  else
+	    port = ntohs (((struct sockaddr_in *) &ss)->sin_port);
+
+	  if ((nconf = getnetconfigent (transports[t].netid)) == NULL)
+	    {
+	      log_msg ("getnetconfigent (%s) failed", transports[t].netid);
+	      _exit (1);
+	    }
+	  sock = create_socket (nconf, transports[t].family,
+				transports[t].type, transports[t].proto,
+				port);
+	  freenetconfigent (nconf);
+	  if (sock < 0)
+	    _exit (1);
+
+	  close (transports[t].sock);
+	  transports[t].sock = sock;
+	}
+
+      if (debug_flag)
+	log_msg ("Started worker process %d", getpid ());
+      return;
+    }
+}
+
 static void
 Usage (int exitcode)
 {
@@ -289,6 +635,7 @@ main (int argc, char **argv)
   void *nc_handle;
   int my_port = -1;
   int could_register = 0;
+  int t;
 
   openlog ("ypserv", LOG_PID, LOG_DAEMON);
 
@@ -413,6 +760,7 @@ main (int argc, char **argv)
     }
 
   create_pidfile (_YPSERV_PIDFILE, "ypserv");
+  main_pid = getpid ();
 
   load_securenets ();
   load_config ();
@@ -435,12 +783,17 @@ main (int argc, char **argv)
    * If we get a SIGUSR1, enable/disable debuging.
    */
   signal (SIGUSR1, sig_usr1);
+  /*
+   * If we get a SIGUSR2, log statistics.
+   */
+  signal (SIGUSR2, sig_usr2);
   /*
    * On SIGCHLD wait for the child process, so it can give free all
    * resources.
    */
   signal (SIGCHLD, sig_child);
 
+  rpcb_unset (YPPROG, YPVERS_MULTI, NULL);
   rpcb_unset (YPPROG, YPVERS, NULL);
   rpcb_unset (YPPROG, YPOLDVERS, NULL);
 
@@ -453,14 +806,10 @@ main (int argc, char **argv)
 
   while ((nconf = __rpc_getconf (nc_handle)))
     {
-      SVCXPRT *xprt;
-      struct sockaddr *sa;
-      struct sockaddr_in sin;
-      struct sockaddr_in6 sin6;
-      int sock;
       sa_family_t family; /* AF_INET, AF_INET6 */
       int type; /* SOCK_DGRAM (udp), SOCK_STREAM (tcp) */
       int proto; /* IPPROTO_UDP, IPPROTO_TCP */
+      int sock;
 
       if (debug_flag)
 	log_msg ("Register ypserv for %s,%s",
@@ -486,99 +835,52 @@ main (int argc, char **argv)
       else
 	continue; /* We don't support nconf->nc_proto */
 
-      if ((sock = socket (family, type, proto)) < 0)
-	{
-	  log_msg ("Cannot create socket for %s,%s: %s",
-		   nconf->nc_protofmly, nconf->nc_proto,
-		   strerror (errno));
-	  continue;
-	}
+      sock = create_socket (nconf, family, type, proto, my_port);
+      if (sock == -1)
+	continue;
+      if (sock < 0)
+	return 1;
 
-      if (family == AF_INET6)
-	{
-	  /* Disallow v4-in-v6 to allow host-based access checks */
-	  int i = 1;
-
-	  if (setsockopt (sock, IPPROTO_IPV6, IPV6_V6ONLY,
-			  &i, sizeof(i)) == -1)
-	    {
-	      log_msg ("ERROR: cannot disable v4-in-v6 on %s6 socket",
-		       nconf->nc_proto);
-	      return 1;
-	    }
-	}
-
-      switch (family)
-	{
-	case AF_INET:
-	  memset (&sin, 0, sizeof(sin));
-	  sin.sin_family = AF_INET;
-	  if (my_port > 0)
-	    sin.sin_port = htons (my_port);
-	  sa = (struct sockaddr *)(void *)&sin;
-	  break;
-	case AF_INET6:
-	  memset (&sin6, 0, sizeof (sin6));
-	  sin6.sin6_family = AF_INET6;
-	  if (my_port > 0)
-	    sin6.sin6_port = htons (my_port);
-	  sa = (struct sockaddr *)(void *)&sin6;
-	  break;
-	default:
-	  log_msg ("Unsupported address family %d", family);
-	  return -1;
-	}
-
-      if (bindresvport_sa (sock, sa) == -1)
-	{
-	  if (my_port > 0)
-	    log_msg ("Cannot bind to reserved port %d (%s)",
-		     my_port, strerror (errno));
-	  else
-	    log_msg ("bindresvport failed: %s",
-		     strerror (errno));
-	  return 1;
-	}
-
-      if (type == SOCK_STREAM)
-	{
-	  listen (sock, SOMAXCONN);
-	  xprt = svc_vc_create (sock, 0, 0);
-	}
-      else
-	xprt = svc_dg_create (sock, 0, 0);
-
-      if (xprt == NULL)
-	{
-	  log_msg ("terminating: cannot create rpcbind handle");
-	  return 1;
-	}
+      if (add_transport (nconf, family, type, proto, sock) < 0)
+	return 1;
+    }
+  __rpc_endconf (nc_handle);
 
-      rpcb_unset (YPPROG, YPVERS, nconf);
-      if (!svc_reg (xprt, YPPROG, YPVERS, ypprog_2, nconf))
-	{
-	  log_msg ("unable to register (YPPROG, 2) for %s, %s.",
-		   nconf->nc_protofmly, nconf->nc_proto);
-	  continue;
-	}
-      else
-	could_register = 1;
+  /* Fork the worker processes before any transport is created, so
+     they don't inherit any state of them. */
+  if (worker_processes > 1)
+    {
+      ypdb_share_clear ();
+      start_processes ();
+    }
 
-      if (family == AF_INET)
+  match_cache_init ();
+  dir_cache_init ();
+  bloom_init ();
+  all_cache_init ();
+  dns_init ();
+  if (cached_filehandles > 0)
+    stats_register (ypdb_cache_stats);
+  ypdb_reload_init ();
+  /* Before we are registered and announced as ready */
+  preload_maps_run ();
+
+  for (t = 0; t < nr_transports; t++)
+    {
+      if (getpid () == main_pid)
 	{
-	  rpcb_unset (YPPROG, YPVERS_ORIG, nconf);
-	  if (!svc_reg (xprt, YPPROG, YPVERS_ORIG,
-			ypprog_2, nconf))
+	  if ((nconf = getnetconfigent (transports[t].netid)) == NULL)
 	    {
-	      log_msg ("unable to register (YPPROG, 1) [%s]",
-		       nconf->nc_netid);
+	      log_msg ("getnetconfigent (%s) failed", transports[t].netid);
 	      continue;
 	    }
-	  else
-	    could_register = 1;
+	  could_register |= create_transport (&transports[t], nconf);
+	  freenetconfigent (nconf);
 	}
+      else
+	/* Only the main process is registered with rpcbind */
+	could_register |= create_transport (&transports[t], NULL);
     }
-  __rpc_endconf (nc_handle);
 
   if (!could_register)
     {
@@ -591,9 +893,13 @@ main (int argc, char **argv)
      At this time, sockets for receiving connections are already
      created, so we can say we're ready now. It is a nop if we
      don't use systemd. */
-  announce_ready();
+  if (getpid () == main_pid)
+    announce_ready();
 
-  svc_run ();
+  if (epoll_flag)
+    evloop_run ();
+  else
+    workers_run ();
   log_msg ("svc_run returned");
   unlink (_YPSERV_PIDFILE);
   exit (1);
@@ -22,7 +22,8 @@
 #include <rpc/rpc.h>
 #include "yp.h"
 
-xdr_ypall_cb_t xdr_ypall_cb;
+/* Every thread has its own ypproc_all callback */
+__thread xdr_ypall_cb_t xdr_ypall_cb;
 
 bool_t
 xdr_ypresp_maplist (XDR *xdrs, ypresp_maplist *objp)
@@ -36,6 +37,70 @@ xdr_ypresp_maplist (XDR *xdrs, ypresp_maplist *objp)
   return xdr_pointer (xdrs, tp, sizeof (ypmaplist), (xdrproc_t) xdr_ypmaplist);
 }
 
+bool_t
+xdr_ypmatch_multi_key (XDR *xdrs, ypmatch_multi_key *objp)
+{
+  if (!xdr_string (xdrs, &objp->map, YPMAXMAP))
+    return FALSE;
+  return xdr_bytes (xdrs, (char **) &objp->keydat.keydat_val,
+		    &objp->keydat.keydat_len, YPMAXRECORD);
+}
+
+bool_t
+xdr_ypreq_match_multi (XDR *xdrs, ypreq_match_multi *objp)
+{
+  if (!xdr_string (xdrs, &objp->domain, YPMAXDOMAIN))
+    return FALSE;
+  return xdr_array (xdrs, (char **) &objp->keys.keys_val,
+		    &objp->keys.keys_len, YPMAXMULTI,
+		    sizeof (ypmatch_multi_key),
+		    (xdrproc_t) xdr_ypmatch_multi_key);
+}
+
+bool_t
+xdr_ypresp_match_multi (XDR *xdrs, ypresp_match_multi *objp)
+{
+  if (!xdr_ypstat (xdrs, &objp->status))
+    return FALSE;
+  return xdr_array (xdrs, (char **) &objp->vals.vals_val,
+		    &objp->vals.vals_len, YPMAXMULTI,
+		    sizeof (ypresp_val), (xdrproc_t) xdr_ypresp_val);
+}
+
+bool_t
+xdr_ypmap_entry (XDR *xdrs, ypmap_entry *objp)
+{
+  if (!xdr_bytes (xdrs, (char **) &objp->keydat.keydat_val,
+		  &objp->keydat.keydat_len, YPMAXRECORD))
+    return FALSE;
+  return xdr_bytes (xdrs, (char **) &objp->valdat.valdat_val,
+		    &objp->valdat.valdat_len, YPMAXRECORD);
+}
+
+bool_t
+xdr_ypreq_page (XDR *xdrs, ypreq_page *objp)
+{
+  if (!xdr_string (xdrs, &objp->domain, YPMAXDOMAIN) ||
+      !xdr_string (xdrs, &objp->map, YPMAXMAP) ||
+      !xdr_bytes (xdrs, (char **) &objp->token.keydat_val,
+		  &objp->token.keydat_len, YPMAXRECORD) ||
+      !xdr_u_int (xdrs, &objp->count))
+    return FALSE;
+  return xdr_u_int (xdrs, &objp->maxbytes);
+}
+
+bool_t
+xdr_ypresp_page (XDR *xdrs, ypresp_page *objp)
+{
+  if (!xdr_ypstat (xdrs, &objp->status) ||
+      !xdr_array (xdrs, (char **) &objp->entries.entries_val,
+		  &objp->entries.entries_len, YPMAXPAGE,
+		  sizeof (ypmap_entry), (xdrproc_t) xdr_ypmap_entry))
+    return FALSE;
+  return xdr_bytes (xdrs, (char **) &objp->token.keydat_val,
+		    &objp->token.keydat_len, YPMAXRECORD);
+}
+
 bool_t
 xdr_ypresp_all(XDR *xdrs, ypresp_all *objp)
 {
@@ -39,6 +39,8 @@
 #include "yp.h"
 #include "ypxfr.h"
 #include "ypxfrd.h"
+#include "ypc.h"
+#include "ypj.h"
 #include <rpcsvc/ypclnt.h>
 
 #if defined(HAVE_COMPAT_LIBGDBM)
@@ -52,6 +54,7 @@
 #define YPDB_REPLACE GDBM_REPLACE
 #define ypdb_close gdbm_close
 #define ypdb_fetch gdbm_fetch
+#define ypdb_delete gdbm_delete
 static GDBM_FILE dbm;
 #elif defined (HAVE_NDBM)
 #include <ndbm.h>
@@ -84,6 +87,12 @@ ypdb_store (TCBDB *dbm, datum key, datum data, int mode)
   return !tcbdbput(dbm, key.dptr, key.dsize, data.dptr, data.dsize);
 }
 
+static int
+ypdb_delete (TCBDB *dbm, datum key)
+{
+  return !tcbdbout(dbm, key.dptr, key.dsize);
+}
+
 static datum
 ypdb_fetch (TCBDB *bdb, datum key)
 {
@@ -445,6 +454,157 @@ ypxfr_foreach (int status, char *key, int keylen,
 
 extern struct ypall_callback *xdr_ypall_callback;
 
+#if !defined(HAVE_NDBM)
+static int
+ypxfr_change (ypchange *change, void *data UNUSED)
+{
+  datum outKey, outData;
+
+  if (debug_flag > 1)
+    log_msg ("ypxfr_change: %s key=%.*s",
+	     change->op == YPCHANGE_DELETE ? "delete" : "store",
+	     (int) change->keydat.keydat_len, change->keydat.keydat_val);
+
+  outKey.dptr = change->keydat.keydat_len ? change->keydat.keydat_val : "";
+  outKey.dsize = change->keydat.keydat_len;
+  if (change->op == YPCHANGE_DELETE)
+    {
+      /* Deleting a key we don't have is no error */
+      ypdb_delete (dbm, outKey);
+      return 0;
+    }
+
+  outData.dptr = change->valdat.valdat_len ? change->valdat.valdat_val : "";
+  outData.dsize = change->valdat.valdat_len;
+  if (ypdb_store (dbm, outKey, outData, YPDB_REPLACE) != 0)
+    return -1;
+  return 0;
+}
+
+static int
+copy_file (const char *from, const char *to)
+{
+  char buf[65536];
+  ssize_t n;
+  int in, out;
+
+  if ((in = open (from, O_RDONLY)) < 0)
+    return -1;
+  if ((out = open (to, O_WRONLY | O_CREAT | O_TRUNC, 0600)) < 0)
+    {
+      close (in);
+      return -1;
+    }
+
+  while ((n = read (in, buf, sizeof (buf))) > 0)
+    if (write (out, buf, n) != n)
+      {
+	n = -1;
+	break;
+      }
+
+  close (in);
+  if (close (out) != 0 || n < 0)
+    {
+      unlink (to);
+      return -1;
+    }
+  return 0;
+}
+
+/* Apply the changes since localOrderNum from the journal of the
+   master to a copy of our map. Returns 0 on success, else the
+   whole map has to be transferred. */
+static int
+ypxfr_changes (char *server, char *map, char *source_domain,
+	       char *master_host, char *dbName_orig, char *dbName_temp,
+	       time_t localOrderNum)
+{
+  struct ypreq_changes req_changes;
+  struct ypresp_changes resp_changes;
+  datum outKey, outData;
+  char orderNum[255];
+  CLIENT *clnt_tcp;
+  int result = -1;
+
+  /* Older servers don't have version 3 */
+  clnt_tcp = clnt_create (server, YPPROG, YPVERS_MULTI, "tcp");
+  if (clnt_tcp == NULL)
+    {
+      if (debug_flag)
+	log_msg (clnt_spcreateerror ("YPXFR changes"));
+      return -1;
+    }
+
+  if (copy_file (dbName_orig, dbName_temp) != 0)
+    {
+      log_msg ("Cannot copy %s: %s", dbName_orig, strerror (errno));
+      clnt_destroy (clnt_tcp);
+      return -1;
+    }
+#if defined(HAVE_COMPAT_LIBGDBM)
+  dbm = gdbm_open (dbName_temp, 0, GDBM_WRITER, 0600, NULL);
+#elif defined(HAVE_LIBTC)
+  dbm = tcbdbnew ();
+  if (!tcbdbopen (dbm, dbName_temp, BDBOWRITER))
+    {
+      tcbdbdel (dbm);
+      dbm = NULL;
+    }
+#endif
+  if (dbm == NULL)
+    {
+      log_msg ("Cannot open %s", dbName_temp);
+      clnt_destroy (clnt_tcp);
+      unlink (dbName_temp);
+      return -1;
+    }
+
+  req_changes.domain = source_domain;
+  req_changes.map = map;
+  req_changes.ordernum = localOrderNum;
+  memset (&resp_changes, 0, sizeof (resp_changes));
+  resp_changes.change = ypxfr_change;
+  if (ypproc_changes_3 (&req_changes, &resp_changes,
+			clnt_tcp) != RPC_SUCCESS)
+    log_msg (clnt_sperror (clnt_tcp, "ypproc_changes"));
+  else if (resp_changes.status != YP_TRUE)
+    {
+      if (debug_flag)
+	log_msg ("Master has no changes since %ld, transfer whole map",
+		 (long) localOrderNum);
+    }
+  else
+    {
+      outKey.dptr = "YP_MASTER_NAME";
+      outKey.dsize = strlen (outKey.dptr);
+      outData.dptr = master_host;
+      outData.dsize = strlen (outData.dptr);
+      if (ypdb_store (dbm, outKey, outData, YPDB_REPLACE) == 0)
+	{
+	  snprintf (orderNum, sizeof (orderNum), "%u",
+		    resp_changes.ordernum);
+	  outKey.dptr = "YP_LAST_MODIFIED";
+	  outKey.dsize = strlen (outKey.dptr);
+	  outData.dptr = orderNum;
+	  outData.dsize = strlen (outData.dptr);
+	  if (ypdb_store (dbm, outKey, outData, YPDB_REPLACE) == 0)
+	    result = 0;
+	}
+      if (debug_flag && result == 0)
+	log_msg ("Applied changes from %ld to %u", (long) localOrderNum,
+		 resp_changes.ordernum);
+    }
+
+  clnt_destroy (clnt_tcp);
+  ypdb_close (dbm);
+  if (result != 0)
+    unlink (dbName_temp);
+
+  return result;
+}
+#endif
+
 /* Don't replace the source_host with the FQDN in this function. Or ypserv
    cannot compare the name of the host, who initiated a yppush, with the
    master name of the map. */
@@ -466,6 +626,7 @@ ypxfr (char *map, char *source_host, char *source_domain, char *target_domain,
   struct ypresp_master resp_master;
   struct ypreq_nokey req_nokey;
   time_t masterOrderNum;
+  time_t localOrderNum = 0;
   int result;
 
   /* Name of the map file */
@@ -589,7 +750,6 @@ ypxfr (char *map, char *source_host, char *source_domain, char *target_domain,
   /* If we doesn't force the map, look, if the new map is really newer */
   if (!force)
     {
-      time_t localOrderNum = 0;
       datum inKey, inVal;
 
 #if defined(HAVE_COMPAT_LIBGDBM)
@@ -652,9 +812,19 @@ ypxfr (char *map, char *source_host, char *source_domain, char *target_domain,
 	}
     }
 
+  result = -1;
+#if !defined(HAVE_NDBM)
+  /* If the master has a journal of the map, only the changes since
+     our version are transferred. */
+  if (localOrderNum > 0)
+    result = ypxfr_changes (server, map, source_domain, master_host,
+			    dbName_orig, dbName_temp, localOrderNum);
+#endif
+
   /* Try to use ypxfrd for getting the new map. If it fails, use the old
      method. */
-  if ((result = ypxfrd_transfer (master_host, map,
+  if (result != 0 &&
+      (result = ypxfrd_transfer (master_host, map,
 				 target_domain, dbName_temp)) != 0)
     {
       /* No success with ypxfrd, get the map entry by entry */
@@ -820,6 +990,15 @@ ypxfr (char *map, char *source_host, char *source_domain, char *target_domain,
 
   if (result == 0)
     {
+      char ypcname[MAXPATHLEN + sizeof (YPC_SUFFIX)];
+
+      /* ypserv would use a ypc file of makedbm --mmap instead of
+	 the new map */
+      snprintf (ypcname, sizeof (ypcname), "%s%s", dbName_orig, YPC_SUFFIX);
+      unlink (ypcname);
+      /* Our journal does not fit the new map */
+      snprintf (ypcname, sizeof (ypcname), "%s%s", dbName_orig, YPJ_SUFFIX);
+      unlink (ypcname);
 #if defined(HAVE_LIBTC)
       chmod(dbName_temp, S_IRUSR|S_IWUSR);
 #endif